@@ -12,6 +12,9 @@
  * In order to verify if the cameras images are sync, one can put a hundredth-precision stopwatch in the front of the cameras and then 
  * press the spacebar to check out if the two images capture the same time within the range of 1 or 2 hundredth of a second.
  * 
+ * The frames are requested from both cameras in parallel. The snapshot also prints the difference between the times each server received its frame. It is meaningful only if 
+ * the clocks of the servers are synchronized, e.g., by NTP or PTP.
+ * 
  **/
 
 using namespace rpiasgige::client;
@@ -99,25 +102,29 @@ int main(int argc, char **argv)
 
     Performance_Counter performance_counter(120);
 
-    cv::Mat mat1, mat2;
+    // both cameras are grabbed at the same time, each one from its own thread
+    Device_Group cameras;
+    cameras.add(camera1);
+    cameras.add(camera2);
+
+    Group_Frames snapshot;
 
     int key = 0;
     bool freeze = false;
 
     while (key != 27) {
 
-        bool s1 = camera1.retrieve(mat1, keep_alive);
-        bool s2 = s1 && camera2.retrieve(mat2, keep_alive);
-
-        if (!s1) {
-            std::cerr << "Failed to grab frame from camera 1!\n";
+        if (!cameras.grab(snapshot, keep_alive)) {
+            for (int i = 0; i < cameras.size(); ++i) {
+                if (!snapshot.success[i]) {
+                    std::cerr << "Failed to grab frame from camera " << (i + 1) << "!\n";
+                }
+            }
             break;
         }
 
-        if (!s2) {
-            std::cerr << "Failed to grab frame from camera 2!\n";
-            break;
-        }
+        const cv::Mat &mat1 = snapshot.frames[0];
+        const cv::Mat &mat2 = snapshot.frames[1];
 
         int image_size_1 = mat1.total() * mat1.elemSize();
         int image_size_2 = mat2.total() * mat2.elemSize();
@@ -133,6 +140,10 @@ int main(int argc, char **argv)
 
         if (key == 32) {
             freeze = !freeze;
+            if (freeze) {
+                std::cout << "frames " << snapshot.infos[0].sequence << " and " << snapshot.infos[1].sequence << " were received " 
+                    << snapshot.skew << " microseconds apart\n";
+            }
         }
     }
 
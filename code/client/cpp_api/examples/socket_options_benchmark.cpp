@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "rpiasgige/client_api.hpp"
+
+using namespace rpiasgige::client;
+
+struct Benchmark_Result
+{
+    double ping_median = 0;
+    double ping_p99 = 0;
+    double get_median = 0;
+    double frames_per_second = 0;
+    double megabytes_per_second = 0;
+};
+
+static double elapsed_microseconds(const std::chrono::steady_clock::time_point &begin)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count());
+}
+
+static double percentile(std::vector<double> &samples, double rank)
+{
+    double result = 0;
+    if (!samples.empty())
+    {
+        std::sort(samples.begin(), samples.end());
+        const size_t index = std::min(samples.size() - 1, static_cast<size_t>(rank * samples.size()));
+        result = samples[index];
+    }
+    return result;
+}
+
+/**
+ * measures the round trip of small requests and the throughput of GRAB using options
+ **/
+static Benchmark_Result run_benchmark(const std::string &address, int port, const Socket_Options &options, int requests, int frames)
+{
+    Benchmark_Result result;
+
+    Device camera(address, port);
+    camera.set_socket_options(options);
+
+    if (!camera.ping(true))
+    {
+        std::cerr << "Camera didn't reply.\n";
+        return result;
+    }
+
+    std::vector<double> ping_samples;
+    std::vector<double> get_samples;
+    for (int i = 0; i < requests; ++i)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        camera.ping(true);
+        ping_samples.push_back(elapsed_microseconds(begin));
+
+        begin = std::chrono::steady_clock::now();
+        camera.get(cv::CAP_PROP_FPS, true);
+        get_samples.push_back(elapsed_microseconds(begin));
+    }
+    result.ping_median = percentile(ping_samples, 0.5);
+    result.ping_p99 = percentile(ping_samples, 0.99);
+    result.get_median = percentile(get_samples, 0.5);
+
+    if (frames > 0 && (camera.isOpened(true) || camera.open(true)))
+    {
+        cv::Mat frame;
+        double bytes = 0;
+        int received = 0;
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i)
+        {
+            if (camera.retrieve(frame, true))
+            {
+                bytes += frame.total() * frame.elemSize();
+                received++;
+            }
+        }
+        const double seconds = elapsed_microseconds(begin) / 1e6;
+        if (seconds > 0)
+        {
+            result.frames_per_second = received / seconds;
+            result.megabytes_per_second = bytes / seconds / (1024 * 1024);
+        }
+    }
+
+    return result;
+}
+
+static void print_result(const std::string &label, const Benchmark_Result &result)
+{
+    std::cout << label << ":\n"
+              << "  PING round trip: median " << result.ping_median << " us, p99 " << result.ping_p99 << " us\n"
+              << "  GET0 round trip: median " << result.get_median << " us\n"
+              << "  GRAB: " << result.frames_per_second << " frames/s, " << result.megabytes_per_second << " MB/s\n";
+}
+
+/**
+ * Compares the system default socket options with the tuned ones given in the command line.
+ * The server side is tuned by its own command line keys, e.g. -tcp-nodelay=true -so-sndbuf=4194304
+ **/
+int main(int argc, char **argv)
+{
+
+    const std::string keys =
+
+        "{address           | 192.168.2.2    | remote server ip such as 192.168.2.2         }"
+        "{port           | 4001    | remote server port         }"
+        "{requests           | 1000    | number of PING and GET0 requests         }"
+        "{frames           | 200    | number of frames grabbed. 0 skips the GRAB benchmark         }"
+        "{tcp-nodelay           | true    | disable Nagle's algorithm         }"
+        "{so-sndbuf           | 0    | socket send buffer size in bytes. 0 keeps the system default         }"
+        "{so-rcvbuf           | 8388608    | socket receive buffer size in bytes. 0 keeps the system default         }"
+        "{busy-poll           | 0    | microseconds to busy poll the network device on reads (Linux only)         }"
+        "{quick-ack           | true    | acknowledge received data immediately (Linux only)         }"
+
+        ;
+
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    const std::string address = parser.get<cv::String>("address");
+    const int port = parser.get<int>("port");
+    const int requests = std::max(1, parser.get<int>("requests"));
+    const int frames = std::max(0, parser.get<int>("frames"));
+
+    Socket_Options defaults;
+    defaults.no_delay = false;
+
+    Socket_Options tuned;
+    tuned.no_delay = parser.get<bool>("tcp-nodelay");
+    tuned.send_buffer_size = std::max(0, parser.get<int>("so-sndbuf"));
+    tuned.receive_buffer_size = std::max(0, parser.get<int>("so-rcvbuf"));
+    tuned.busy_poll = std::max(0, parser.get<int>("busy-poll"));
+    tuned.quick_ack = parser.get<bool>("quick-ack");
+
+    try
+    {
+        print_result("System defaults", run_benchmark(address, port, defaults, requests, frames));
+        print_result("Tuned", run_benchmark(address, port, tuned, requests, frames));
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Benchmark failed: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
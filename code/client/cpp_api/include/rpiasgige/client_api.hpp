@@ -4,6 +4,9 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/strand.hpp>
 
 namespace beast = boost::beast;        
 namespace http = beast::http;
@@ -11,10 +14,42 @@ namespace websocket = beast::websocket;
 namespace net = boost::asio;          
 using tcp = boost::asio::ip::tcp; 
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <climits>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include <opencv2/opencv.hpp>
 
+#ifdef RPIASGIGE_WITH_LZ4
+#include <lz4.h>
+#endif
+
 namespace rpiasgige
 {
 
@@ -40,9 +75,103 @@ namespace rpiasgige
         static const int KEEP_ALIVE_ADDRESS = 4;
         static const int HEADER_SIZE = STATUS_SIZE + KEEP_ALIVE_SIZE + DATA_SIZE;
         static const int IMAGE_META_DATA_SIZE = 3 * sizeof(int);
+        static const int COMPRESSED_META_DATA_SIZE = 4 * sizeof(int);
+        static const int FRAME_INFO_SIZE = 4 * sizeof(int64_t);
+        static const int REQUEST_ID_SIZE = sizeof(int);
+        static const int GRAB_FRAME_INFO = 1;
+        static const int GRAB_REQUEST_ID = 2;
+        static const int GRAB_ROI = 4;
+        static const int GRAB_DECIMATION = 8;
+        static const int GRAB_CHANNEL = 16;
+        static const int GRAB_DELTA = 32;
+        static const int GRAB_BUFFERED = 64;
+        static const int DECIMATION_SKIP = 0;
+        static const int DECIMATION_BINNING = 1;
+        // flags, request id, ROI, decimation factor and mode, channel, acknowledged frame id, query mode and value
+        static const int MAX_GRAB_OPTIONS_SIZE = 11 * sizeof(int) + sizeof(int64_t);
+        // frame id, id of the frame the delta is relative to, tile size and number of changed tiles
+        static const int DELTA_META_DATA_SIZE = 4 * sizeof(int);
+
+        // pixel formats negotiated by set_pixel_format
+        static const int PIXEL_FORMAT_NATIVE = 0;
+        static const int PIXEL_FORMAT_BGR = 1;
+        static const int PIXEL_FORMAT_GRAY8 = 2;
+        static const int PIXEL_FORMAT_YUYV = 3;
+        static const int PIXEL_FORMAT_NV12 = 4;
+
+        // codecs negotiated by set_codec
+        static const int CODEC_NONE = 0;
+        static const int CODEC_JPEG = 1;
+        static const int CODEC_PNG = 2;
+        static const int CODEC_LZ4 = 3;
+        static const int MAX_CODEC_STRIPES = 16;
+        // codec, number of stripes, rows per stripe and the stripe sizes, appended to the metadata of compressed frames
+        static const int CODEC_META_DATA_SIZE = (3 + MAX_CODEC_STRIPES) * sizeof(int);
 
         class Device;
 
+        /**
+         * When and how a frame was captured by the server. Times are in microseconds.
+         **/
+        struct Frame_Info
+        {
+            // buffer timestamp set by the camera driver, usually CLOCK_MONOTONIC of the server
+            int64_t device_timestamp = 0;
+
+            // frame counter of the driver. Gaps between consecutive frames mean dropped frames
+            int64_t sequence = 0;
+
+            // server system clock, since epoch, when the frame was received from the driver
+            int64_t receive_time = 0;
+
+            // time spent by the server serving the grab
+            int64_t grab_duration = 0;
+        };
+
+        /**
+         * Part of the frame to retrieve. The server sends only the selected pixels, which saves bandwidth.
+         * The defaults select the whole frame.
+         **/
+        struct Frame_Region
+        {
+            // an empty rectangle selects the whole frame. The server clips rectangles crossing the frame border
+            cv::Rect roi;
+            // one pixel out of decimation, up to 1024, is kept in each direction
+            int decimation = 1;
+            // averages each decimation x decimation block instead of keeping its top-left pixel. decimation is up to 16 then
+            bool binning = false;
+            // the single channel retrieved, -1 retrieves all of them
+            int channel = -1;
+        };
+
+        /**
+         * Which of the last frames kept by the server to retrieve. Times are Frame_Info::receive_time, 
+         * the system clock of the server in microseconds since epoch
+         **/
+        struct Frame_Query
+        {
+            // the frame whose Frame_Info::sequence is value
+            static const int BY_SEQUENCE = 0;
+            // the frame received the closest to value
+            static const int NEAREST_TIME = 1;
+            // the first frame received at or after value
+            static const int FIRST_AFTER_TIME = 2;
+
+            int mode = BY_SEQUENCE;
+            int64_t value = 0;
+        };
+
+        /**
+         * A frame exactly as delivered by the camera, before decoding. fourcc tells the payload format, such as MJPG.
+         **/
+        struct Compressed_Frame
+        {
+            int rows = 0;
+            int cols = 0;
+            int fourcc = 0;
+            std::vector<unsigned char> payload;
+        };
+
         /**
          * Packet is a mold to make dealing with request / response buffers easier.
          **/
@@ -84,413 +213,3521 @@ namespace rpiasgige
         };
 
         /**
-         * This class represents a remote camera. It provides convenient API-level methods to allow open, close, retrieve, etc, a remote camera.
-         * Basically, the methods serializes, send, read, and deserialize data from the camera.
-         * 
-         */
-        class Device
+         * TCP tuning applied to the connections of a Device. Buffer sizes of 0 keep the system defaults.
+         **/
+        struct Socket_Options
         {
-        public:
-            Device(const std::string &server_address, const int server_port) : Device(server_address, server_port, HEADER_SIZE + 12, HEADER_SIZE + IMAGE_META_DATA_SIZE + 1920 * 1080 * 3 ) {}
-
-            Device(const std::string &server_address, const int server_port, const int _response_buffer_size) : Device(server_address, server_port, HEADER_SIZE + 12, _response_buffer_size) {}
+            // requests are sent right away instead of waiting for the ACK of the previous one
+            bool no_delay = true;
+            int send_buffer_size = 0;
+            // a receive buffer as large as a frame lets the server send it in a single window
+            int receive_buffer_size = 0;
+            // microseconds spent polling the network device before a blocking read sleeps. Linux only, raising it needs CAP_NET_ADMIN
+            int busy_poll = 0;
+            // ACK received segments immediately. Linux only. It is set again before each response is read
+            bool quick_ack = false;
 
-            Device(const std::string &server_address, const int server_port, const int _request_buffer_size, const int _response_buffer_size) : address(server_address), port(server_port)
+            /**
+             * applies the options to socket. Failures are reported on std::cerr
+             **/
+            bool apply(tcp::socket &socket) const
             {
-
-                if (_response_buffer_size > this->response_buffer_size)
+                std::string error;
+                beast::error_code ec;
+                socket.set_option(tcp::no_delay(this->no_delay), ec);
+                if (ec)
                 {
-                    this->response_buffer_size = _response_buffer_size;
+                    error = "TCP_NODELAY: " + ec.message();
                 }
-
-                this->response_buffer = new char[this->response_buffer_size];
-
-                if (_request_buffer_size > this->request_buffer_size)
+                if (error.empty() && this->send_buffer_size > 0)
                 {
-                    this->request_buffer_size = _request_buffer_size;
+                    socket.set_option(net::socket_base::send_buffer_size(this->send_buffer_size), ec);
+                    if (ec)
+                    {
+                        error = "SO_SNDBUF: " + ec.message();
+                    }
                 }
-
-                this->request_buffer = new char[this->request_buffer_size];
-            }
-
-            virtual ~Device() {
-
-                if (this->response_buffer != nullptr) {
-                    delete [] this->response_buffer;
-                    this->response_buffer = nullptr;
+                if (error.empty() && this->receive_buffer_size > 0)
+                {
+                    socket.set_option(net::socket_base::receive_buffer_size(this->receive_buffer_size), ec);
+                    if (ec)
+                    {
+                        error = "SO_RCVBUF: " + ec.message();
+                    }
                 }
-
-                if (this->request_buffer != nullptr) {
-                    delete [] this->request_buffer;
-                    this->request_buffer = nullptr;
+                if (error.empty() && this->busy_poll > 0)
+                {
+#ifdef SO_BUSY_POLL
+                    if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &this->busy_poll, sizeof(this->busy_poll)) != 0)
+                    {
+                        error = std::string("SO_BUSY_POLL: ") + strerror(errno);
+                    }
+#else
+                    error = "SO_BUSY_POLL is not supported on this platform";
+#endif
                 }
-
-            }
-
-            bool ping(bool keep_alive = false)
-            {
-                bool result = false;
-                try
+                if (error.empty() && this->quick_ack && !set_quick_ack(socket))
                 {
-                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
-                    request.set_status("PING");
-
-                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
-                    this->send_request(request, response);
-                    result = response.check_if_status_is("PONG");
+                    error = std::string("TCP_QUICKACK: ") + strerror(errno);
                 }
-                catch (TimeoutException &tex)
+
+                if (!error.empty())
                 {
-                    this->handle_timeout("ping", tex);
+                    std::cerr << "Failed to set socket option " << error << "\n";
                 }
+                return error.empty();
+            }
 
-                return result;
+            static bool set_quick_ack(tcp::socket &socket)
+            {
+#ifdef TCP_QUICKACK
+                const int enabled = 1;
+                return setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_QUICKACK, &enabled, sizeof(enabled)) == 0;
+#else
+                errno = ENOPROTOOPT;
+                return false;
+#endif
             }
+        };
 
-            double get(int propId, bool keep_alive = false)
+        /**
+         * Reads the metadata of a GRAB response, which starts at offset in the response data. info is read only if not null, 
+         * in which case the response must have been requested with GRAB_FRAME_INFO. 
+         * On success, the pixels start at metadata_size in the response data
+         **/
+        inline bool read_frame_metadata(const Packet &response, const int offset, int &rows, int &cols, int &type, int &metadata_size, Frame_Info *info)
+        {
+            const char *data = response.data + offset;
+            const int size_int = sizeof(int);
+            metadata_size = offset + IMAGE_META_DATA_SIZE;
+            if (info != nullptr)
             {
-                double result = -1.0;
-                try
-                {
-                    const int data_size = sizeof(int);
-                    Packet request(this->request_buffer, keep_alive, data_size, this->request_buffer + HEADER_SIZE);
-                    request.set_status("GET0");
-                    memcpy(request.data, &propId, sizeof(int));
+                metadata_size += FRAME_INFO_SIZE;
+            }
+            if (response.data_size < metadata_size)
+            {
+                return false;
+            }
 
-                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
-                    this->send_request(request, response);
-                    this->read_response_data(&result, sizeof(result), response);
+            memcpy(&rows, data, size_int);
+            memcpy(&cols, data + size_int, size_int);
+            memcpy(&type, data + 2 * size_int, size_int);
+            if (info != nullptr)
+            {
+                const int size_int64 = sizeof(int64_t);
+                const char *info_data = data + IMAGE_META_DATA_SIZE;
+                memcpy(&info->device_timestamp, info_data, size_int64);
+                memcpy(&info->sequence, info_data + size_int64, size_int64);
+                memcpy(&info->receive_time, info_data + 2 * size_int64, size_int64);
+                memcpy(&info->grab_duration, info_data + 3 * size_int64, size_int64);
+            }
+            return rows > 0 && cols > 0;
+        }
 
-                }
-                catch (TimeoutException &tex)
-                {
-                    this->handle_timeout("get", tex);
-                }
-                return result;
+        /**
+         * Reads the codec metadata which ends the metadata of a GRAB response when a codec was negotiated. 
+         * It starts at metadata_size in the response data, which is moved past it. stripe_sizes has room for MAX_CODEC_STRIPES
+         **/
+        inline bool read_codec_metadata(const Packet &response, int &metadata_size, int &codec, int &stripe_count, int &stripe_rows, int *stripe_sizes)
+        {
+            const int size_int = sizeof(int);
+            if (response.data_size < metadata_size + 3 * size_int)
+            {
+                return false;
             }
+            const char *data = response.data + metadata_size;
+            memcpy(&codec, data, size_int);
+            memcpy(&stripe_count, data + size_int, size_int);
+            memcpy(&stripe_rows, data + 2 * size_int, size_int);
+            const int size = (3 + stripe_count) * size_int;
+            if (stripe_count < 0 || stripe_count > MAX_CODEC_STRIPES || response.data_size < metadata_size + size)
+            {
+                return false;
+            }
+            memcpy(stripe_sizes, data + 3 * size_int, stripe_count * size_int);
+            metadata_size += size;
+            return true;
+        }
 
-            bool set(int propId, double value, bool keep_alive = false)
+        /**
+         * Decodes the stripes of a compressed frame, one after the other, into the rows of frame, 
+         * which has the size and type of the frame sent
+         **/
+        inline bool decode_stripes(const char *data, const int data_size, const int codec, const int stripe_count, const int stripe_rows, const int *stripe_sizes, cv::Mat &frame)
+        {
+            if (stripe_rows <= 0 || static_cast<long>(stripe_count) * stripe_rows < frame.rows)
             {
-                bool result = false;
-                try
+                return false;
+            }
+            int offset = 0;
+            for (int i = 0; i < stripe_count; ++i)
+            {
+                const int first_row = i * stripe_rows;
+                const int size = stripe_sizes[i];
+                if (first_row >= frame.rows || size <= 0 || size > data_size - offset)
                 {
-                    const int data_size = sizeof(int) + sizeof(double);
-                    Packet request(this->request_buffer, keep_alive, data_size, this->request_buffer + HEADER_SIZE);
-                    request.set_status("SET0");
-                    memcpy(request.data, &propId, sizeof(int));
-                    memcpy(request.data + sizeof(int), &value, sizeof(double));
-
-                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
-                    this->send_request(request, response);
-                    result = response.check_if_status_is("0200");
+                    return false;
                 }
-                catch (TimeoutException &tex)
+                cv::Mat target = frame.rowRange(first_row, std::min(frame.rows, first_row + stripe_rows));
+                if (codec == CODEC_LZ4)
                 {
-                    this->handle_timeout("set", tex);
+#ifdef RPIASGIGE_WITH_LZ4
+                    const int target_size = static_cast<int>(target.total() * target.elemSize());
+                    if (LZ4_decompress_safe(data + offset, reinterpret_cast<char *>(target.data), size, target_size) != target_size)
+                    {
+                        return false;
+                    }
+#else
+                    std::cerr << "LZ4 frames require the client to be built with RPIASGIGE_WITH_LZ4\n";
+                    return false;
+#endif
                 }
-
-                return result;
+                else
+                {
+                    // the stripe is decoded in place, as it has the size and type of target
+                    cv::Mat stripe = target;
+                    cv::imdecode(cv::Mat(1, size, CV_8UC1, const_cast<char *>(data + offset)), cv::IMREAD_UNCHANGED, &stripe);
+                    if (stripe.rows != target.rows || stripe.cols != target.cols || stripe.type() != target.type())
+                    {
+                        return false;
+                    }
+                    if (stripe.data != target.data)
+                    {
+                        stripe.copyTo(target);
+                    }
+                }
+                offset += size;
             }
+            return true;
+        }
 
-            bool open(bool keep_alive = false)
+        /**
+         * The last frame received with GRAB_DELTA, which the next delta is applied to
+         **/
+        struct Delta_Reference
+        {
+            cv::Mat frame;
+            // acknowledged in the next GRAB_DELTA request. -1 asks for a whole frame
+            int frame_id = -1;
+        };
+
+        /**
+         * Copies the tiles of a delta over the frame it is relative to. data starts with a bitmap of the changed tiles, 
+         * a bit per tile in raster order padded to whole ints, followed by the pixels of each changed tile, row by row
+         **/
+        inline bool apply_frame_delta(const char *data, const int data_size, const int tile_size, cv::Mat &frame)
+        {
+            if (tile_size <= 0)
             {
-                bool result = false;
-                try
+                return false;
+            }
+            const int tile_cols = (frame.cols + tile_size - 1) / tile_size;
+            const int tile_rows = (frame.rows + tile_size - 1) / tile_size;
+            const int tile_count = tile_cols * tile_rows;
+            const int bitmap_size = (tile_count + 31) / 32 * static_cast<int>(sizeof(int));
+            if (data_size < bitmap_size)
+            {
+                return false;
+            }
+            const size_t pixel_size = frame.elemSize();
+            size_t offset = bitmap_size;
+            for (int index = 0; index < tile_count; ++index)
+            {
+                if ((data[index / 8] & (1 << (index % 8))) == 0)
                 {
-                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
-                    request.set_status("OPEN");
-
-                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
-                    this->send_request(request, response);
-                    result = response.check_if_status_is("0200");
+                    continue;
                 }
-                catch (TimeoutException &tex)
+                const int x = (index % tile_cols) * tile_size;
+                const int y = (index / tile_cols) * tile_size;
+                const size_t width = std::min(tile_size, frame.cols - x) * pixel_size;
+                const int last_row = std::min(y + tile_size, frame.rows);
+                if (offset + width * (last_row - y) > static_cast<size_t>(data_size))
                 {
-                    this->handle_timeout("open", tex);
+                    return false;
+                }
+                for (int row = y; row < last_row; ++row)
+                {
+                    memcpy(frame.ptr(row) + x * pixel_size, data + offset, width);
+                    offset += width;
                 }
-                return result;
             }
+            return true;
+        }
 
-            bool isOpened(bool keep_alive = false)
+        /**
+         * Writes the GRAB options selecting region after the fields already in data, updating flags and data_size
+         **/
+        inline void write_frame_region(const Frame_Region &region, int &flags, char *data, int &data_size)
+        {
+            const int size_int = sizeof(int);
+            if (region.roi.area() > 0)
             {
-                bool result = false;
-                try
-                {
-                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
-                    request.set_status("ISOP");
+                const int roi[] = {region.roi.x, region.roi.y, region.roi.width, region.roi.height};
+                memcpy(data + data_size, roi, sizeof(roi));
+                data_size += sizeof(roi);
+                flags |= GRAB_ROI;
+            }
+            if (region.decimation > 1)
+            {
+                const int mode = region.binning ? DECIMATION_BINNING : DECIMATION_SKIP;
+                memcpy(data + data_size, &region.decimation, size_int);
+                memcpy(data + data_size + size_int, &mode, size_int);
+                data_size += 2 * size_int;
+                flags |= GRAB_DECIMATION;
+            }
+            if (region.channel >= 0)
+            {
+                memcpy(data + data_size, &region.channel, size_int);
+                data_size += size_int;
+                flags |= GRAB_CHANNEL;
+            }
+        }
 
-                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
-                    this->send_request(request, response);
-                    result = response.check_if_status_is("0200");
-                }
-                catch (TimeoutException &tex)
-                {
-                    this->handle_timeout("isOpened", tex);
-                }
-                return result;
+        /**
+         * First bytes of the shared memory segment published by a server started with -shared-memory. See docs/protocol.MD
+         **/
+        struct Shared_Memory_Header
+        {
+            static const uint32_t MAGIC = 0x53414752;
+            static const uint32_t VERSION = 1;
+
+            uint32_t magic;
+            uint32_t version;
+            uint32_t slot_count;
+            uint32_t slot_size;
+            std::atomic<uint32_t> published;
+            std::atomic<uint32_t> waiters;
+            std::atomic<uint32_t> closed;
+            uint32_t reserved[9];
+        };
+
+        /**
+         * Header of each slot, followed by its pixels. version is odd while the server writes the slot
+         **/
+        struct Shared_Slot_Header
+        {
+            std::atomic<uint32_t> version;
+            int32_t rows;
+            int32_t cols;
+            int32_t type;
+            int32_t data_size;
+            int32_t reserved;
+            Frame_Info info;
+            int64_t padding;
+        };
+
+        static_assert(sizeof(Shared_Memory_Header) == 64, "The shared memory layout is part of the protocol");
+        static_assert(sizeof(Shared_Slot_Header) == 64, "The shared memory layout is part of the protocol");
+
+        /**
+         * Reads the frames a server on the same host publishes in shared memory: no socket and no framing, 
+         * a single copy from the shared memory into the destination image.
+         * 
+         * The server never waits for its readers. A frame overwritten while being copied is detected by the 
+         * sequence lock of its slot, and the newer frame is read instead
+         **/
+        class Shared_Memory_Reader
+        {
+        public:
+            Shared_Memory_Reader(const std::string &_name) : name(_name) {}
+
+            virtual ~Shared_Memory_Reader()
+            {
+                this->detach();
             }
 
-            bool retrieve(cv::Mat &dest, bool keep_alive = false)
+            bool attach()
             {
-                bool result = false;
-                try
+                if (this->memory != nullptr)
                 {
-                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
-                    request.set_status("GRAB");
-
-                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
-                    this->send_request(request, response);
-                    result = response.check_if_status_is("0200");
-                    if (result)
-                    {
-                        const char *data = response.data;
-                        int size_int = sizeof(int);
-                        const int *rows = (int *)data;
-                        const int *cols = (int *)(data + size_int);
-                        const int *type = (int *)(data + 2 * size_int);
-                        cv::Mat temp = cv::Mat::zeros(*rows, *cols, *type);
-                        temp.data = (unsigned char *)response.data + 3 * size_int;
-                        dest = temp;
-                    }
+                    return true;
                 }
-                catch (TimeoutException &tex)
+                const int fd = shm_open(this->name.c_str(), O_RDWR, 0);
+                if (fd < 0)
                 {
-                    this->handle_timeout("retrieve", tex);
+                    return false;
                 }
-                return result;
-            }
-            
-            bool release(bool keep_alive = false)
-            {
-                bool result = false;
-                try
+                struct stat status;
+                void *address = MAP_FAILED;
+                if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Shared_Memory_Header))
                 {
-                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
-                    request.set_status("CLOS");
-
-                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
-                    this->send_request(request, response);
-                    result = response.check_if_status_is("0200");
+                    address = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
                 }
-                catch (TimeoutException &tex)
+                close(fd);
+                if (address == MAP_FAILED)
                 {
-                    this->handle_timeout("release", tex);
+                    return false;
                 }
-                return result;
+
+                this->memory = static_cast<char *>(address);
+                this->size = status.st_size;
+                const Shared_Memory_Header *header = this->get_header();
+                this->slot_count = header->slot_count;
+                this->slot_size = header->slot_size;
+                this->slot_stride = sizeof(Shared_Slot_Header) + this->slot_size;
+                const bool valid = header->magic == Shared_Memory_Header::MAGIC && header->version == Shared_Memory_Header::VERSION &&
+                                   this->slot_count > 0 && sizeof(Shared_Memory_Header) + this->slot_stride * this->slot_count <= this->size;
+                if (!valid)
+                {
+                    // not initialized yet, or not a segment of a server
+                    this->detach();
+                    return false;
+                }
+                // the frames published before attaching are not new
+                this->last_read = header->published.load(std::memory_order_acquire);
+                return true;
             }
 
-            void set_read_timeout(int timeout_in_seconds)
+            void detach()
             {
-                if (this->read_timeout_in_seconds >= 0)
+                if (this->memory != nullptr)
                 {
-                    this->read_timeout_in_seconds = timeout_in_seconds;
+                    munmap(this->memory, this->size);
+                    this->memory = nullptr;
                 }
-                this->update_socket_timeout();
             }
 
-        private:
-            cv::String address;
-            int port;
-            websocket::stream<tcp::socket> *ws = nullptr;
-            net::io_context ioc;
-
+            bool is_attached() const
+            {
+                return this->memory != nullptr;
+            }
+
+            /**
+             * Copies the newest frame published since the last read into dest, reusing its storage if the size is the same. 
+             * Waits up to timeout_in_milliseconds for it, forever if 0. Returns false on timeout, or if the server closed 
+             * the segment, in which case the next read attaches again
+             **/
+            bool read(cv::Mat &dest, Frame_Info *info, const int timeout_in_milliseconds)
+            {
+                if (!this->attach())
+                {
+                    return false;
+                }
+                Shared_Memory_Header *header = this->get_header();
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_in_milliseconds);
+                while (true)
+                {
+                    const uint32_t published = header->published.load(std::memory_order_acquire);
+                    if (header->closed.load(std::memory_order_acquire) != 0)
+                    {
+                        this->detach();
+                        return false;
+                    }
+                    if (published != this->last_read)
+                    {
+                        bool consistent = false;
+                        if (!this->copy_slot((published - 1) % this->slot_count, dest, info, consistent))
+                        {
+                            return false;
+                        }
+                        if (consistent)
+                        {
+                            this->last_read = published;
+                            return true;
+                        }
+                        // overwritten meanwhile: a newer frame was published
+                        continue;
+                    }
+
+                    struct timespec timeout;
+                    struct timespec *timeout_pointer = nullptr;
+                    if (timeout_in_milliseconds > 0)
+                    {
+                        const auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+                        if (remaining <= 0)
+                        {
+                            return false;
+                        }
+                        timeout.tv_sec = static_cast<time_t>(remaining / 1000000000);
+                        timeout.tv_nsec = static_cast<long>(remaining % 1000000000);
+                        timeout_pointer = &timeout;
+                    }
+                    header->waiters.fetch_add(1, std::memory_order_seq_cst);
+                    // sleeps only if nothing was published since published was read
+                    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&header->published), FUTEX_WAIT, published, timeout_pointer, nullptr, 0);
+                    header->waiters.fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+
+            const std::string &get_name() const
+            {
+                return this->name;
+            }
+
+        private:
+            const std::string name;
+            char *memory = nullptr;
+            size_t size = 0;
+            uint32_t slot_count = 0;
+            uint32_t slot_size = 0;
+            size_t slot_stride = 0;
+            uint32_t last_read = 0;
+
+            Shared_Memory_Header *get_header()
+            {
+                return reinterpret_cast<Shared_Memory_Header *>(this->memory);
+            }
+
+            /**
+             * Copies a slot into dest. consistent is false if the server wrote the slot meanwhile. 
+             * Returns false if the slot holds no valid frame
+             **/
+            bool copy_slot(const uint32_t index, cv::Mat &dest, Frame_Info *info, bool &consistent)
+            {
+                Shared_Slot_Header *slot = reinterpret_cast<Shared_Slot_Header *>(this->memory + sizeof(Shared_Memory_Header) + this->slot_stride * index);
+                const uint32_t version = slot->version.load(std::memory_order_acquire);
+                const int rows = slot->rows;
+                const int cols = slot->cols;
+                const int type = slot->type;
+                const int data_size = slot->data_size;
+                const Frame_Info slot_info = slot->info;
+
+                const bool valid = (version & 1) == 0 && rows > 0 && cols > 0 && data_size > 0 && static_cast<uint32_t>(data_size) <= this->slot_size &&
+                                   static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type) == static_cast<size_t>(data_size);
+                if (valid)
+                {
+                    if (!dest.isContinuous())
+                    {
+                        dest.release();
+                    }
+                    dest.create(rows, cols, type);
+                    memcpy(dest.data, reinterpret_cast<char *>(slot) + sizeof(Shared_Slot_Header), data_size);
+                }
+                // orders the reads above before checking that the version did not change
+                std::atomic_thread_fence(std::memory_order_acquire);
+                consistent = (version & 1) == 0 && slot->version.load(std::memory_order_relaxed) == version;
+                if (valid && consistent && info != nullptr)
+                {
+                    *info = slot_info;
+                }
+                // metadata read while the slot was being written is not trusted
+                return valid || !consistent;
+            }
+        };
+
+        /**
+         * Header of each datagram of a multicast stream, started on the server with -multicast-group. See docs/protocol.MD
+         **/
+        struct Multicast_Fragment_Header
+        {
+            char status[4];
+            int frame_id;
+            int fragment_index;
+            int fragment_count;
+            int message_size;
+            int offset;
+        };
+
+        static_assert(sizeof(Multicast_Fragment_Header) == 24, "The datagram header is part of the protocol");
+
+        /**
+         * Counters of a Multicast_Receiver since it was opened
+         **/
+        struct Multicast_Statistics
+        {
+            long frames_received = 0;
+            // frames never completed: skipped frame ids plus frames missing some datagram
+            long frames_lost = 0;
+            long datagrams_received = 0;
+            // malformed datagrams, or fragments of a frame already completed or given up
+            long datagrams_discarded = 0;
+        };
+
+        /**
+         * Receives the frames a server streams to a UDP multicast group. Any number of receivers share the same stream.
+         * 
+         * Datagrams are reassembled by their offset in the frame, so that their order does not matter. 
+         * UDP does not retransmit: a frame missing a datagram is given up once a datagram of a newer frame arrives
+         **/
+        class Multicast_Receiver
+        {
+        public:
+            Multicast_Receiver(const std::string &_group, const int _port, const std::string &_interface_address = "0.0.0.0",
+                               const int _max_message_size = HEADER_SIZE + IMAGE_META_DATA_SIZE + 1920 * 1080 * 3) : 
+                group(_group), port(_port), interface_address(_interface_address), max_message_size(_max_message_size) {}
+
+            virtual ~Multicast_Receiver()
+            {
+                this->close();
+            }
+
+            /**
+             * Joins the group on the network interface whose address is interface_address
+             **/
+            bool open()
+            {
+                if (this->socket_fd >= 0)
+                {
+                    return true;
+                }
+                struct ip_mreq membership;
+                struct sockaddr_in address;
+                memset(&address, 0, sizeof(address));
+                address.sin_family = AF_INET;
+                address.sin_port = htons(static_cast<unsigned short>(this->port));
+                address.sin_addr.s_addr = htonl(INADDR_ANY);
+                if (inet_pton(AF_INET, this->group.c_str(), &membership.imr_multiaddr) != 1 ||
+                    inet_pton(AF_INET, this->interface_address.c_str(), &membership.imr_interface) != 1)
+                {
+                    std::cerr << "Invalid multicast group " << this->group << " or interface " << this->interface_address << "\n";
+                    return false;
+                }
+
+                this->socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+                if (this->socket_fd < 0)
+                {
+                    std::cerr << "socket: " << strerror(errno) << "\n";
+                    return false;
+                }
+                // several receivers on the same host share the port
+                const int reuse = 1;
+                // room for a few frames while the application is busy. The system may cap it to net.core.rmem_max
+                const int receive_buffer_size = 3 * this->max_message_size;
+                bool result = setsockopt(this->socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0 &&
+                              setsockopt(this->socket_fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size)) == 0 &&
+                              bind(this->socket_fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0;
+                // a unicast address receives the datagrams sent to it, such as in tests over the loopback interface
+                if (result && IN_MULTICAST(ntohl(membership.imr_multiaddr.s_addr)))
+                {
+                    result = setsockopt(this->socket_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == 0;
+                }
+                if (!result)
+                {
+                    std::cerr << "Failed to join the multicast group " << this->group << ":" << this->port << ": " << strerror(errno) << "\n";
+                    this->close();
+                    return false;
+                }
+
+                this->datagrams.resize(BATCH_SIZE * MAX_DATAGRAM_SIZE);
+                this->parts.resize(BATCH_SIZE);
+                this->messages.resize(BATCH_SIZE);
+                this->pending_index = 0;
+                this->pending_count = 0;
+                this->frame_id = -1;
+                this->last_frame_id = -1;
+                this->statistics = Multicast_Statistics();
+                return true;
+            }
+
+            void close()
+            {
+                if (this->socket_fd >= 0)
+                {
+                    ::close(this->socket_fd);
+                    this->socket_fd = -1;
+                }
+            }
+
+            bool is_open() const
+            {
+                return this->socket_fd >= 0;
+            }
+
+            /**
+             * Copies the next complete frame into dest, reusing its storage if the size is the same. 
+             * Waits up to timeout_in_milliseconds for it, forever if 0. Returns false on timeout or error
+             **/
+            bool receive(cv::Mat &dest, const int timeout_in_milliseconds)
+            {
+                if (!this->open())
+                {
+                    return false;
+                }
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_in_milliseconds);
+                while (true)
+                {
+                    while (this->pending_index < this->pending_count)
+                    {
+                        const int index = this->pending_index++;
+                        const char *datagram = &this->datagrams[index * MAX_DATAGRAM_SIZE];
+                        if (this->add_datagram(datagram, static_cast<int>(this->messages[index].msg_len)) && this->take_message(dest))
+                        {
+                            return true;
+                        }
+                    }
+
+                    int timeout = -1;
+                    if (timeout_in_milliseconds > 0)
+                    {
+                        timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+                        if (timeout <= 0)
+                        {
+                            return false;
+                        }
+                    }
+                    struct pollfd descriptor;
+                    descriptor.fd = this->socket_fd;
+                    descriptor.events = POLLIN;
+                    descriptor.revents = 0;
+                    const int ready = poll(&descriptor, 1, timeout);
+                    if (ready < 0 && errno != EINTR)
+                    {
+                        std::cerr << "poll: " << strerror(errno) << "\n";
+                        return false;
+                    }
+                    if (ready <= 0)
+                    {
+                        continue;
+                    }
+
+                    // all the datagrams already queued by the system in a single call
+                    for (int i = 0; i < BATCH_SIZE; ++i)
+                    {
+                        this->parts[i].iov_base = &this->datagrams[i * MAX_DATAGRAM_SIZE];
+                        this->parts[i].iov_len = MAX_DATAGRAM_SIZE;
+                        memset(&this->messages[i], 0, sizeof(struct mmsghdr));
+                        this->messages[i].msg_hdr.msg_iov = &this->parts[i];
+                        this->messages[i].msg_hdr.msg_iovlen = 1;
+                    }
+                    const int received = recvmmsg(this->socket_fd, this->messages.data(), BATCH_SIZE, MSG_DONTWAIT, nullptr);
+                    if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    {
+                        std::cerr << "recvmmsg: " << strerror(errno) << "\n";
+                        return false;
+                    }
+                    this->pending_index = 0;
+                    this->pending_count = std::max(0, received);
+                }
+            }
+
+            const Multicast_Statistics &get_statistics() const
+            {
+                return this->statistics;
+            }
+
+        private:
+            static const int MAX_DATAGRAM_SIZE = 65536;
+            static const int BATCH_SIZE = 16;
+
+            const std::string group;
+            const int port;
+            const std::string interface_address;
+            const int max_message_size;
+            int socket_fd = -1;
+
+            std::vector<char> datagrams;
+            std::vector<struct iovec> parts;
+            std::vector<struct mmsghdr> messages;
+            int pending_index = 0;
+            int pending_count = 0;
+
+            // the frame being reassembled, -1 if none
+            int frame_id = -1;
+            // the last frame completed or given up, -1 if none yet
+            int last_frame_id = -1;
+            std::vector<char> message;
+            int message_size = 0;
+            std::vector<bool> received_fragments;
+            int fragments_missing = 0;
+
+            Multicast_Statistics statistics;
+
+            /**
+             * Copies a datagram into the frame being reassembled. Returns true if it completed the frame
+             **/
+            bool add_datagram(const char *datagram, const int size)
+            {
+                this->statistics.datagrams_received++;
+                const int header_size = sizeof(Multicast_Fragment_Header);
+                Multicast_Fragment_Header header;
+                if (size < header_size)
+                {
+                    this->statistics.datagrams_discarded++;
+                    return false;
+                }
+                memcpy(&header, datagram, header_size);
+                const int fragment_size = size - header_size;
+                const bool valid = strncmp(header.status, "FRAG", STATUS_SIZE) == 0 && header.frame_id >= 0 && 
+                                   header.message_size > 0 && header.message_size <= this->max_message_size && 
+                                   header.fragment_count > 0 && header.fragment_index >= 0 && header.fragment_index < header.fragment_count && 
+                                   header.offset >= 0 && fragment_size <= header.message_size - header.offset;
+                // ids wrap around: older means a negative difference
+                const bool stale = this->last_frame_id >= 0 && static_cast<int>((header.frame_id - this->last_frame_id) & 0x7fffffff) > 0x3fffffff;
+                if (!valid || stale || header.frame_id == this->last_frame_id)
+                {
+                    this->statistics.datagrams_discarded++;
+                    return false;
+                }
+
+                if (header.frame_id != this->frame_id)
+                {
+                    if (this->frame_id >= 0)
+                    {
+                        // a datagram of a newer frame: the current one will not be completed
+                        this->statistics.frames_lost++;
+                        this->last_frame_id = this->frame_id;
+                    }
+                    if (this->last_frame_id >= 0)
+                    {
+                        this->statistics.frames_lost += ((header.frame_id - this->last_frame_id) & 0x7fffffff) - 1;
+                    }
+                    this->frame_id = header.frame_id;
+                    this->message_size = header.message_size;
+                    if (static_cast<int>(this->message.size()) < this->message_size)
+                    {
+                        this->message.resize(this->message_size);
+                    }
+                    this->received_fragments.assign(header.fragment_count, false);
+                    this->fragments_missing = header.fragment_count;
+                }
+                else if (header.message_size != this->message_size || header.fragment_count != static_cast<int>(this->received_fragments.size()))
+                {
+                    this->statistics.datagrams_discarded++;
+                    return false;
+                }
+
+                if (!this->received_fragments[header.fragment_index])
+                {
+                    memcpy(this->message.data() + header.offset, datagram + header_size, fragment_size);
+                    this->received_fragments[header.fragment_index] = true;
+                    this->fragments_missing--;
+                }
+                return this->fragments_missing == 0;
+            }
+
+            /**
+             * Copies the frame of the reassembled message into dest
+             **/
+            bool take_message(cv::Mat &dest)
+            {
+                this->last_frame_id = this->frame_id;
+                this->frame_id = -1;
+
+                const char *data = this->message.data();
+                if (this->message_size < HEADER_SIZE + IMAGE_META_DATA_SIZE || strncmp(data, "FRAM", STATUS_SIZE) != 0)
+                {
+                    this->statistics.frames_lost++;
+                    return false;
+                }
+                int rows, cols, type;
+                memcpy(&rows, data + HEADER_SIZE, sizeof(int));
+                memcpy(&cols, data + HEADER_SIZE + sizeof(int), sizeof(int));
+                memcpy(&type, data + HEADER_SIZE + 2 * sizeof(int), sizeof(int));
+                const size_t image_size = static_cast<size_t>(std::max(rows, 0)) * std::max(cols, 0) * CV_ELEM_SIZE(type);
+                if (rows <= 0 || cols <= 0 || image_size > static_cast<size_t>(this->message_size - HEADER_SIZE - IMAGE_META_DATA_SIZE))
+                {
+                    this->statistics.frames_lost++;
+                    return false;
+                }
+                if (!dest.isContinuous())
+                {
+                    dest.release();
+                }
+                dest.create(rows, cols, type);
+                memcpy(dest.data, data + HEADER_SIZE + IMAGE_META_DATA_SIZE, image_size);
+                this->statistics.frames_received++;
+                return true;
+            }
+        };
+
+        /**
+         * Receive buffers lent to cv::Mat as their storage.
+         * 
+         * A response is read into a buffer of the pool. A retrieved frame keeps the buffer it was read into, 
+         * through the reference counting of cv::Mat, until its last copy is released. The buffer then goes back 
+         * to the pool. In steady state, frames are neither allocated nor copied.
+         * 
+         * The pool outlives its Device if frames are still referenced: it deletes itself when the last one is released.
+         **/
+        class Frame_Buffer_Pool : public cv::MatAllocator
+        {
+
+        public:
+#if CV_VERSION_MAJOR >= 4
+            typedef cv::AccessFlag Access_Flags;
+#else
+            typedef int Access_Flags;
+#endif
+
+            explicit Frame_Buffer_Pool(const int _buffer_size) : buffer_size(_buffer_size) {}
+
+            virtual ~Frame_Buffer_Pool() {}
+
+            /**
+             * a free buffer, allocated if all of them are lent
+             **/
+            char *acquire()
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                char *result = nullptr;
+                if (this->free_buffers.empty())
+                {
+                    this->storage.emplace_back(new char[this->buffer_size]);
+                    result = this->storage.back().get();
+                }
+                else
+                {
+                    result = this->free_buffers.back();
+                    this->free_buffers.pop_back();
+                }
+                this->buffers_in_use++;
+                return result;
+            }
+
+            /**
+             * gives back a buffer which was not lent to any cv::Mat
+             **/
+            void release(char *buffer) const
+            {
+                bool orphaned = false;
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->free_buffers.push_back(buffer);
+                    this->buffers_in_use--;
+                    orphaned = this->detached && this->buffers_in_use == 0;
+                }
+                if (orphaned)
+                {
+                    delete this;
+                }
+            }
+
+            /**
+             * a cv::Mat whose pixels start at data, inside buffer. The buffer comes back to the pool when the cv::Mat is released
+             **/
+            cv::Mat wrap(char *buffer, char *data, int rows, int cols, int type) const
+            {
+                cv::Mat result(rows, cols, type, data);
+                cv::UMatData *u = new cv::UMatData(this);
+                u->origdata = reinterpret_cast<unsigned char *>(buffer);
+                u->data = reinterpret_cast<unsigned char *>(data);
+                u->size = result.total() * result.elemSize();
+                result.u = u;
+                result.addref();
+                return result;
+            }
+
+            int get_buffer_size() const
+            {
+                return this->buffer_size;
+            }
+
+            long get_allocation_count() const
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                return static_cast<long>(this->storage.size());
+            }
+
+            /**
+             * called by the owner instead of delete
+             **/
+            void detach()
+            {
+                bool orphaned = false;
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->detached = true;
+                    orphaned = this->buffers_in_use == 0;
+                }
+                if (orphaned)
+                {
+                    delete this;
+                }
+            }
+
+            // cv::Mat never allocates through this allocator: it is only assigned to the wrapped frames
+
+            virtual cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, Access_Flags flags, cv::UMatUsageFlags usage_flags) const
+            {
+                return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage_flags);
+            }
+
+            virtual bool allocate(cv::UMatData *data, Access_Flags access_flags, cv::UMatUsageFlags usage_flags) const
+            {
+                return cv::Mat::getStdAllocator()->allocate(data, access_flags, usage_flags);
+            }
+
+            virtual void deallocate(cv::UMatData *data) const
+            {
+                char *buffer = reinterpret_cast<char *>(data->origdata);
+                delete data;
+                this->release(buffer);
+            }
+
+        private:
+            const int buffer_size;
+
+            mutable std::mutex mutex;
+            std::vector<std::unique_ptr<char[]>> storage;
+            mutable std::vector<char *> free_buffers;
+            mutable int buffers_in_use = 0;
+            bool detached = false;
+        };
+
+        /**
+         * negotiated by each new connection before its first request
+         **/
+        struct Connection_Settings
+        {
+            int camera_id = 0;
+            int pixel_format = PIXEL_FORMAT_NATIVE;
+            int codec = CODEC_NONE;
+            // -1 for the default of the server
+            int codec_quality = -1;
+            // plain TCP connections to the -raw-port of the server instead of websockets. Device only
+            bool raw_tcp = false;
+
+            bool operator==(const Connection_Settings &other) const
+            {
+                return this->camera_id == other.camera_id && this->pixel_format == other.pixel_format && 
+                       this->codec == other.codec && this->codec_quality == other.codec_quality && this->raw_tcp == other.raw_tcp;
+            }
+        };
+
+        /**
+         * Moves the frame of a GRAB response, whose metadata starts at offset in the response data, into dest. 
+         * Raw pixels are not copied: dest takes response_buffer, which is replaced by a free buffer of buffers. 
+         * with_codec tells that the metadata ends with the codec metadata. Compressed frames are decoded into a free buffer.
+         * 
+         * reference is not null if the request was sent with GRAB_DELTA: a delta is applied to it and then copied into 
+         * a free buffer, and a whole frame is copied into it. Either way, it is the reference of the next delta
+         **/
+        inline bool take_frame(const Packet &response, const int offset, const bool with_codec, Frame_Info *info, Delta_Reference *reference, 
+                               Frame_Buffer_Pool &buffers, char *&response_buffer, cv::Mat &dest)
+        {
+            int rows, cols, type, metadata_size;
+            if (!read_frame_metadata(response, offset, rows, cols, type, metadata_size, info))
+            {
+                return false;
+            }
+            int delta[DELTA_META_DATA_SIZE / sizeof(int)];
+            if (reference != nullptr)
+            {
+                const int acknowledged_id = reference->frame_id;
+                // any failure from here on asks for a whole frame next time
+                reference->frame_id = -1;
+                if (response.data_size < metadata_size + DELTA_META_DATA_SIZE)
+                {
+                    return false;
+                }
+                memcpy(delta, response.data + metadata_size, DELTA_META_DATA_SIZE);
+                metadata_size += DELTA_META_DATA_SIZE;
+                const int reference_id = delta[1];
+                if (reference_id >= 0 && (reference_id != acknowledged_id || reference->frame.rows != rows || 
+                                          reference->frame.cols != cols || reference->frame.type() != type))
+                {
+                    return false;
+                }
+            }
+            int codec = CODEC_NONE;
+            int stripe_count = 0;
+            int stripe_rows = 0;
+            int stripe_sizes[MAX_CODEC_STRIPES];
+            if (with_codec && !read_codec_metadata(response, metadata_size, codec, stripe_count, stripe_rows, stripe_sizes))
+            {
+                return false;
+            }
+
+            const size_t image_size = static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type);
+            const bool is_delta = reference != nullptr && delta[1] >= 0;
+            if (codec == CODEC_NONE && !is_delta)
+            {
+                if (image_size > static_cast<size_t>(response.data_size - metadata_size))
+                {
+                    return false;
+                }
+                dest = buffers.wrap(response_buffer, response.data + metadata_size, rows, cols, type);
+                response_buffer = buffers.acquire();
+                if (reference != nullptr)
+                {
+                    dest.copyTo(reference->frame);
+                    reference->frame_id = delta[0];
+                }
+                return true;
+            }
+
+            if (image_size > static_cast<size_t>(buffers.get_buffer_size()))
+            {
+                std::cerr << "The response buffer is too small for a " << cols << "x" << rows << " frame\n";
+                return false;
+            }
+            char *buffer = buffers.acquire();
+            cv::Mat frame(rows, cols, type, buffer);
+            bool result = false;
+            if (is_delta)
+            {
+                result = apply_frame_delta(response.data + metadata_size, response.data_size - metadata_size, delta[2], reference->frame);
+                if (result)
+                {
+                    reference->frame.copyTo(frame);
+                }
+            }
+            else
+            {
+                result = decode_stripes(response.data + metadata_size, response.data_size - metadata_size, codec, stripe_count, stripe_rows, stripe_sizes, frame);
+                if (result && reference != nullptr)
+                {
+                    frame.copyTo(reference->frame);
+                }
+            }
+            if (result && reference != nullptr)
+            {
+                reference->frame_id = delta[0];
+            }
+            if (result)
+            {
+                dest = buffers.wrap(buffer, buffer, rows, cols, type);
+            }
+            else
+            {
+                buffers.release(buffer);
+            }
+            return result;
+        }
+
+        /**
+         * This class represents a remote camera. It provides convenient API-level methods to allow open, close, retrieve, etc, a remote camera.
+         * Basically, the methods serializes, send, read, and deserialize data from the camera.
+         * 
+         */
+        class Device
+        {
+        public:
+            typedef std::function<void(const cv::Mat &)> Frame_Callback;
+
+            Device(const std::string &server_address, const int server_port) : Device(server_address, server_port, HEADER_SIZE + 12, HEADER_SIZE + REQUEST_ID_SIZE + IMAGE_META_DATA_SIZE + FRAME_INFO_SIZE + 1920 * 1080 * 3 ) {}
+
+            Device(const std::string &server_address, const int server_port, const int _response_buffer_size) : Device(server_address, server_port, HEADER_SIZE + 12, _response_buffer_size) {}
+
+            /**
+             * A device on the same host as its server, started with -shared-memory: retrieve(dest) and retrieve(dest, info) 
+             * read the frames from the shared memory segment shared_memory_name, e.g., /rpiasgige_0 for camera 0 of a server 
+             * started with -shared-memory=/rpiasgige. The other requests still go through server_address and server_port
+             **/
+            Device(const std::string &server_address, const int server_port, const std::string &shared_memory_name) : Device(server_address, server_port)
+            {
+                this->shared_memory.reset(new Shared_Memory_Reader(shared_memory_name));
+            }
+
+            Device(const std::string &server_address, const int server_port, const int _request_buffer_size, const int _response_buffer_size) : address(server_address), port(server_port)
+            {
+
+                if (_response_buffer_size > this->response_buffer_size)
+                {
+                    this->response_buffer_size = _response_buffer_size;
+                }
+
+                this->response_buffers = new Frame_Buffer_Pool(this->response_buffer_size);
+                this->response_buffer = this->response_buffers->acquire();
+
+                if (_request_buffer_size > this->request_buffer_size)
+                {
+                    this->request_buffer_size = _request_buffer_size;
+                }
+
+                this->request_buffer = new char[this->request_buffer_size];
+
+                this->allocation_count++;
+            }
+
+            virtual ~Device() {
+
+                if (this->streaming) {
+                    this->stop_stream();
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(this->connections_mutex);
+                    this->connection_pool_size = 0;
+                }
+                if (this->reconnect_thread.joinable()) {
+                    this->reconnect_thread.join();
+                }
+
+                // closing the connections lets the server end their sessions right away
+                this->disconnect();
+                for (size_t i = 0; i < this->idle_connections.size(); ++i) {
+                    this->close_connection(*this->idle_connections[i]);
+                }
+                this->idle_connections.clear();
+
+                if (this->response_buffer != nullptr) {
+                    this->response_buffers->release(this->response_buffer);
+                    this->response_buffer = nullptr;
+                }
+
+                // frames still referenced by the application keep the pool alive
+                this->response_buffers->detach();
+                this->response_buffers = nullptr;
+
+                if (this->request_buffer != nullptr) {
+                    delete [] this->request_buffer;
+                    this->request_buffer = nullptr;
+                }
+
+            }
+
+            bool ping(bool keep_alive = false)
+            {
+                bool result = false;
+                try
+                {
+                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
+                    request.set_status("PING");
+
+                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    result = response.check_if_status_is("PONG");
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("ping", tex);
+                }
+
+                return result;
+            }
+
+            double get(int propId, bool keep_alive = false)
+            {
+                double result = -1.0;
+                try
+                {
+                    const int data_size = sizeof(int);
+                    Packet request(this->request_buffer, keep_alive, data_size, this->request_buffer + HEADER_SIZE);
+                    request.set_status("GET0");
+                    memcpy(request.data, &propId, sizeof(int));
+
+                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    this->read_response_data(&result, sizeof(result), response);
+
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("get", tex);
+                }
+                return result;
+            }
+
+            bool set(int propId, double value, bool keep_alive = false)
+            {
+                bool result = false;
+                try
+                {
+                    const int data_size = sizeof(int) + sizeof(double);
+                    Packet request(this->request_buffer, keep_alive, data_size, this->request_buffer + HEADER_SIZE);
+                    request.set_status("SET0");
+                    memcpy(request.data, &propId, sizeof(int));
+                    memcpy(request.data + sizeof(int), &value, sizeof(double));
+
+                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    result = response.check_if_status_is("0200");
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("set", tex);
+                }
+
+                return result;
+            }
+
+            bool open(bool keep_alive = false)
+            {
+                bool result = false;
+                try
+                {
+                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
+                    request.set_status("OPEN");
+
+                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    result = response.check_if_status_is("0200");
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("open", tex);
+                }
+                return result;
+            }
+
+            bool isOpened(bool keep_alive = false)
+            {
+                bool result = false;
+                try
+                {
+                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
+                    request.set_status("ISOP");
+
+                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    result = response.check_if_status_is("0200");
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("isOpened", tex);
+                }
+                return result;
+            }
+
+            /**
+             * Retrieves a frame. dest owns the buffer the frame was received into, without any copy: 
+             * it stays valid across calls until dest, and its copies, are released or reassigned
+             **/
+            bool retrieve(cv::Mat &dest, bool keep_alive = false)
+            {
+                if (this->shared_memory)
+                {
+                    return this->read_shared_frame(dest, nullptr);
+                }
+                return this->request_frame(dest, nullptr, nullptr, nullptr, keep_alive);
+            }
+
+            /**
+             * Retrieves a frame along with its timestamps and sequence number
+             **/
+            bool retrieve(cv::Mat &dest, Frame_Info &info, bool keep_alive = false)
+            {
+                if (this->shared_memory)
+                {
+                    return this->read_shared_frame(dest, &info);
+                }
+                return this->request_frame(dest, &info, nullptr, nullptr, keep_alive);
+            }
+
+            /**
+             * Retrieves only the region of the frame. dest has the size and channels of the region
+             **/
+            bool retrieve(cv::Mat &dest, const Frame_Region &region, bool keep_alive = false)
+            {
+                return this->request_frame(dest, nullptr, &region, nullptr, keep_alive);
+            }
+
+            bool retrieve(cv::Mat &dest, Frame_Info &info, const Frame_Region &region, bool keep_alive = false)
+            {
+                return this->request_frame(dest, &info, &region, nullptr, keep_alive);
+            }
+
+            /**
+             * Retrieves one of the last frames kept by the server, which must run with -ring-frames, e.g., the frame 
+             * matching an external trigger. A frame not captured yet is waited for up to the camera timeout of the server. 
+             * info tells which frame it was. Fails if the frame is no longer kept
+             **/
+            bool retrieve(cv::Mat &dest, Frame_Info &info, const Frame_Query &query, bool keep_alive = false)
+            {
+                return this->request_frame(dest, &info, nullptr, &query, keep_alive);
+            }
+
+            bool retrieve(cv::Mat &dest, Frame_Info &info, const Frame_Region &region, const Frame_Query &query, bool keep_alive = false)
+            {
+                return this->request_frame(dest, &info, &region, &query, keep_alive);
+            }
+
+            /**
+             * Pipelined retrieval: sends a GRAB without waiting for its response. Several requests can be in flight 
+             * on the same connection, hiding the network latency behind the capture time.
+             * 
+             * The server answers in request order. Each response is consumed by receive_retrieve(), which checks 
+             * the request id echoed by the server. No other request may be sent while responses are pending.
+             **/
+            bool send_retrieve(int &request_id, bool with_frame_info = false)
+            {
+                if (!this->is_connected())
+                {
+                    this->open_tcp_conversation();
+                }
+                if (!this->is_connected())
+                {
+                    throw RemoteException{"Not connected"};
+                }
+
+                request_id = this->next_request_id++;
+
+                const int flags = GRAB_REQUEST_ID | (with_frame_info ? GRAB_FRAME_INFO : 0);
+                memcpy(this->request_buffer + STATUS_ADDRESS, "GRAB", STATUS_SIZE);
+                this->request_buffer[KEEP_ALIVE_ADDRESS] = '1';
+                memcpy(this->request_buffer + HEADER_SIZE, &flags, sizeof(flags));
+                memcpy(this->request_buffer + HEADER_SIZE + sizeof(flags), &request_id, REQUEST_ID_SIZE);
+                const int data_size = sizeof(flags) + REQUEST_ID_SIZE;
+                this->set_request_data_size(data_size);
+
+                this->send_request_buffer(HEADER_SIZE + data_size);
+
+                Pending_Request pending;
+                pending.id = request_id;
+                pending.frame_info = with_frame_info;
+                this->pending_requests.push_back(pending);
+
+                return true;
+            }
+
+            /**
+             * waits for the response of the oldest request sent by send_retrieve(). request_id tells which one it was
+             **/
+            bool receive_retrieve(cv::Mat &dest, int &request_id)
+            {
+                return this->receive_frame(dest, nullptr, request_id);
+            }
+
+            /**
+             * as above. info is filled only if the request was sent with_frame_info
+             **/
+            bool receive_retrieve(cv::Mat &dest, Frame_Info &info, int &request_id)
+            {
+                return this->receive_frame(dest, &info, request_id);
+            }
+
+            /**
+             * number of requests sent by send_retrieve() whose responses were not received yet
+             **/
+            int get_pending_retrieves() const
+            {
+                return static_cast<int>(this->pending_requests.size());
+            }
+
+            /**
+             * Retrieves the compressed payload of a frame without decoding it. 
+             * The server must use the v4l2 backend and the camera must be set to a compressed format like MJPG.
+             **/
+            bool retrieve_compressed(Compressed_Frame &dest, bool keep_alive = false)
+            {
+                bool result = false;
+                try
+                {
+                    const char *payload;
+                    int payload_size;
+                    result = this->request_compressed(dest.rows, dest.cols, dest.fourcc, payload, payload_size, keep_alive);
+                    if (result)
+                    {
+                        if (static_cast<size_t>(payload_size) > dest.payload.capacity())
+                        {
+                            this->allocation_count++;
+                        }
+                        dest.payload.assign(payload, payload + payload_size);
+                    }
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("retrieve_compressed", tex);
+                }
+                return result;
+            }
+
+            /**
+             * Retrieves a compressed frame and decodes it on the client side, saving the server the decoding work.
+             **/
+            bool retrieve_compressed(cv::Mat &dest, bool keep_alive = false)
+            {
+                bool result = false;
+                try
+                {
+                    int rows, cols, fourcc;
+                    const char *payload;
+                    int payload_size;
+                    result = this->request_compressed(rows, cols, fourcc, payload, payload_size, keep_alive);
+                    if (result)
+                    {
+                        cv::Mat encoded(1, payload_size, CV_8UC1, (void *)payload);
+                        dest = cv::imdecode(encoded, cv::IMREAD_COLOR);
+                        result = !dest.empty();
+                    }
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("retrieve_compressed", tex);
+                }
+                return result;
+            }
+
+            bool release(bool keep_alive = false)
+            {
+                bool result = false;
+                try
+                {
+                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
+                    request.set_status("CLOS");
+
+                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    result = response.check_if_status_is("0200");
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("release", tex);
+                }
+                return result;
+            }
+
+            /**
+             * Subscribes to frames pushed by the server as soon as they are captured, saving one request per frame.
+             * 
+             * callback runs on a background thread for each frame, decoded as by retrieve if a codec is set.
+             * The frame is only valid during the call: clone it to keep it.
+             * No other method can be called until stop_stream(). Fails if the server does not run in continuous capture mode.
+             **/
+            bool start_stream(const Frame_Callback &callback)
+            {
+                bool result = false;
+                if (this->streaming) {
+                    return result;
+                }
+                try
+                {
+                    Packet request(this->request_buffer, true, 0, this->request_buffer + HEADER_SIZE);
+                    request.set_status("STRM");
+
+                    Packet response(this->response_buffer, true, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    result = response.check_if_status_is("0200");
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("start_stream", tex);
+                }
+
+                if (result) {
+                    this->stop_requested = false;
+                    this->streaming = true;
+                    this->stream_thread = std::thread(&Device::stream_loop, this, callback);
+                }
+                return result;
+            }
+
+            /**
+             * unsubscribes from the pushed frames and waits for the background thread to finish
+             **/
+            bool stop_stream()
+            {
+                bool result = false;
+                if (this->streaming) {
+                    this->stop_requested = true;
+                    if (this->stream_thread.joinable()) {
+                        this->stream_thread.join();
+                    }
+                    this->streaming = false;
+                    result = this->stream_stopped_cleanly;
+                }
+                return result;
+            }
+
+            bool is_streaming() const
+            {
+                return this->streaming;
+            }
+
+            /**
+             * number of buffers allocated by this device. Response buffers are reused once the frames 
+             * read into them are released, so it does not grow per request
+             **/
+            long get_allocation_count() const
+            {
+                return this->allocation_count + this->response_buffers->get_allocation_count();
+            }
+
+            /**
+             * asks the server how many buffers it has allocated to serve requests so far
+             **/
+            bool get_server_allocation_count(int64_t &count, bool keep_alive = false)
+            {
+                bool result = false;
+                try
+                {
+                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
+                    request.set_status("STAT");
+
+                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    result = response.check_if_status_is("0200") && response.data_size >= static_cast<int>(sizeof(count));
+                    if (result)
+                    {
+                        memcpy(&count, response.data, sizeof(count));
+                    }
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("get_server_allocation_count", tex);
+                }
+                return result;
+            }
+
+            /**
+             * selects which camera of a multi-camera server this device talks to. Camera 0 is the default
+             **/
+            bool set_camera_id(int camera_id)
+            {
+                bool result = false;
+                if (camera_id >= 0)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(this->connections_mutex);
+                        this->settings.camera_id = camera_id;
+                    }
+                    // these connections still address the previous camera
+                    this->drop_connections();
+                    result = true;
+                }
+                return result;
+            }
+
+            /**
+             * Asks the server to convert the frames before sending them, e.g., PIXEL_FORMAT_GRAY8 sends a third of the 
+             * data of a BGR frame. PIXEL_FORMAT_NV12 frames are CV_8UC1 with rows * 3 / 2 rows, to be decoded with 
+             * cv::COLOR_YUV2BGR_NV12. PIXEL_FORMAT_NATIVE, the default, sends the frames as captured.
+             * 
+             * The format is negotiated by each new connection. If the server refuses it, the requests fail
+             **/
+            bool set_pixel_format(int pixel_format)
+            {
+                bool result = false;
+                if (pixel_format >= PIXEL_FORMAT_NATIVE && pixel_format <= PIXEL_FORMAT_NV12)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(this->connections_mutex);
+                        this->settings.pixel_format = pixel_format;
+                    }
+                    // these connections still send the previous format
+                    this->drop_connections();
+                    result = true;
+                }
+                return result;
+            }
+
+            int get_pixel_format() const
+            {
+                return this->settings.pixel_format;
+            }
+
+            /**
+             * Asks the server to compress the frames before sending them: CODEC_JPEG, lossy, CODEC_PNG or CODEC_LZ4, 
+             * lossless, which is the fastest to encode and decode. The frames are decoded by retrieve, thus transparently 
+             * for the caller. quality is 1 to 100 for CODEC_JPEG and the compression level, 0 to 9, for CODEC_PNG. 
+             * -1 lets the server choose. CODEC_NONE, the default, sends the raw frames.
+             * 
+             * The server sends a frame raw when it does not compress: it should be much smaller than the response buffer.
+             * The codec is negotiated by each new connection. If the server refuses it, the requests fail
+             **/
+            bool set_codec(int codec, int quality = -1)
+            {
+                bool result = false;
+#ifndef RPIASGIGE_WITH_LZ4
+                if (codec == CODEC_LZ4)
+                {
+                    std::cerr << "CODEC_LZ4 requires the client to be built with RPIASGIGE_WITH_LZ4\n";
+                    return false;
+                }
+#endif
+                if (codec >= CODEC_NONE && codec <= CODEC_LZ4)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(this->connections_mutex);
+                        this->settings.codec = codec;
+                        this->settings.codec_quality = quality;
+                    }
+                    // these connections still send the previous codec
+                    this->drop_connections();
+                    result = true;
+                }
+                return result;
+            }
+
+            int get_codec() const
+            {
+                return this->settings.codec;
+            }
+
+            /**
+             * Talks plain TCP instead of websockets, sparing the framing and masking of each message. The server must 
+             * accept such connections with -raw-port, and the port given to the constructor must be that one. 
+             * The current connections are closed
+             **/
+            void set_raw_tcp(bool enabled)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(this->connections_mutex);
+                    this->settings.raw_tcp = enabled;
+                }
+                this->drop_connections();
+            }
+
+            bool get_raw_tcp() const
+            {
+                return this->settings.raw_tcp;
+            }
+
+            /**
+             * Asks the server to send by retrieve only the tiles changed since the previous frame, which is kept to 
+             * rebuild the next one. Worth it for mostly static scenes, at the cost of a frame copy per retrieve. 
+             * A whole frame is sent whenever the previous one is lost, or if most of the frame changed. 
+             * Pipelined retrievals are not affected
+             **/
+            void set_delta_encoding(bool enabled)
+            {
+                this->delta_encoding = enabled;
+                this->delta_reference.frame_id = -1;
+                this->delta_reference.frame.release();
+            }
+
+            bool get_delta_encoding() const
+            {
+                return this->delta_encoding;
+            }
+
+            /**
+             * Number of idle connections kept open for the next requests. A request sent without keep_alive parks its 
+             * connection here instead of closing it, so that the next request skips the TCP and websocket handshakes. 
+             * A connection dropped by a timeout is replaced in background. 0 closes the connection after every request 
+             * sent without keep_alive. The default is 1
+             **/
+            void set_connection_pool_size(int size)
+            {
+                if (size >= 0)
+                {
+                    std::vector<std::unique_ptr<Connection>> surplus;
+                    {
+                        std::lock_guard<std::mutex> lock(this->connections_mutex);
+                        this->connection_pool_size = size;
+                        while (static_cast<int>(this->idle_connections.size()) > size)
+                        {
+                            surplus.push_back(std::move(this->idle_connections.back()));
+                            this->idle_connections.pop_back();
+                        }
+                    }
+                    for (size_t i = 0; i < surplus.size(); ++i)
+                    {
+                        this->close_connection(*surplus[i]);
+                    }
+                }
+            }
+
+            int get_connection_pool_size() const
+            {
+                return this->connection_pool_size;
+            }
+
+            /**
+             * TCP options of the connections to the server. The current connections are updated as well
+             **/
+            void set_socket_options(const Socket_Options &options)
+            {
+                std::lock_guard<std::mutex> lock(this->connections_mutex);
+                this->socket_options = options;
+                if (this->is_connected())
+                {
+                    options.apply(this->connection->socket());
+                }
+                for (size_t i = 0; i < this->idle_connections.size(); ++i)
+                {
+                    options.apply(this->idle_connections[i]->socket());
+                }
+            }
+
+            /**
+             * opens the pooled connections in background, so that the first requests do not wait for them
+             **/
+            void warm_up()
+            {
+                this->reconnect_in_background();
+            }
+
+            int get_camera_id() const
+            {
+                return this->settings.camera_id;
+            }
+
+            /**
+             * Maximum time waiting for a response. A request which times out throws TimeoutException after MAX_TIMEOUT_COUNT 
+             * consecutive timeouts, and returns false before that. Its connection is dropped in both cases. 0 waits forever
+             **/
+            void set_read_timeout(int timeout_in_seconds)
+            {
+                if (timeout_in_seconds >= 0)
+                {
+                    this->read_timeout_in_milliseconds = timeout_in_seconds * 1000;
+                }
+            }
+
+            /**
+             * as above, for sending a request
+             **/
+            void set_write_timeout(int timeout_in_seconds)
+            {
+                if (timeout_in_seconds >= 0)
+                {
+                    this->write_timeout_in_milliseconds = timeout_in_seconds * 1000;
+                }
+            }
+
+            /**
+             * as above, for each of the address lookup, the TCP connection and the websocket handshake
+             **/
+            void set_connect_timeout(int timeout_in_seconds)
+            {
+                if (timeout_in_seconds >= 0)
+                {
+                    this->connect_timeout_in_milliseconds = timeout_in_seconds * 1000;
+                }
+            }
+
+        private:
+            cv::String address;
+            int port;
+            Connection_Settings settings;
+            std::atomic<long> allocation_count{0};
+
+            bool delta_encoding = false;
+            Delta_Reference delta_reference;
+
+            // set when the frames are read from the shared memory of a server on the same host
+            std::unique_ptr<Shared_Memory_Reader> shared_memory;
+
+            struct Pending_Request
+            {
+                int id;
+                bool frame_info;
+            };
+            std::deque<Pending_Request> pending_requests;
+            int next_request_id = 0;
+
+            /**
+             * A connection to the server which owns the io_context running its operations, so that the reconnect thread and 
+             * the caller thread each wait for their own connections. The context is built before the socket of the subclasses, 
+             * which frame the messages on it
+             **/
+            class Connection
+            {
+            public:
+                typedef std::function<void(beast::error_code)> Handler;
+                typedef std::function<void(beast::error_code, std::size_t)> Transfer_Handler;
+
+                virtual ~Connection() {}
+
+                net::io_context &context()
+                {
+                    return this->ioc;
+                }
+
+                virtual tcp::socket &socket() = 0;
+
+                virtual bool is_connected() const = 0;
+
+                /**
+                 * the handshake of the connected socket, if any
+                 **/
+                virtual void async_handshake(const std::string &host, const Handler &handler) = 0;
+
+                /**
+                 * writes buffer as a single message
+                 **/
+                virtual void async_write(net::const_buffer buffer, const Transfer_Handler &handler) = 0;
+
+                /**
+                 * reads the next part of the current message into destination, which holds at least a header 
+                 * when a message starts. is_message_done() tells whether the message is complete
+                 **/
+                virtual void async_read_some(net::mutable_buffer destination, const Transfer_Handler &handler) = 0;
+
+                virtual bool is_message_done() const = 0;
+
+                virtual void async_close(const Handler &handler) = 0;
+
+            protected:
+                net::io_context ioc;
+            };
+
+            class Websocket_Connection : public Connection
+            {
+            public:
+                Websocket_Connection() : ws(this->ioc) {}
+
+                virtual tcp::socket &socket()
+                {
+                    return this->ws.next_layer();
+                }
+
+                virtual bool is_connected() const
+                {
+                    return this->ws.is_open() && this->ws.next_layer().is_open();
+                }
+
+                virtual void async_handshake(const std::string &host, const Handler &handler)
+                {
+                    this->ws.set_option(websocket::stream_base::decorator(
+                        [](websocket::request_type& req)
+                        {
+                            req.set(http::field::user_agent,
+                                std::string(BOOST_BEAST_VERSION_STRING) +
+                                    " websocket-client-coro");
+                        }));
+                    this->ws.binary(true);
+                    this->ws.async_handshake(host, "/", handler);
+                }
+
+                virtual void async_write(net::const_buffer buffer, const Transfer_Handler &handler)
+                {
+                    this->ws.async_write(buffer, handler);
+                }
+
+                virtual void async_read_some(net::mutable_buffer destination, const Transfer_Handler &handler)
+                {
+                    this->ws.async_read_some(destination, handler);
+                }
+
+                virtual bool is_message_done() const
+                {
+                    return this->ws.is_message_done();
+                }
+
+                virtual void async_close(const Handler &handler)
+                {
+                    this->ws.async_close(websocket::close_code::normal, handler);
+                }
+
+            private:
+                websocket::stream<tcp::socket> ws;
+            };
+
+            /**
+             * A plain TCP connection to the -raw-port of the server. There is no handshake: the messages are written 
+             * to and read from the socket as they are, delimited by the data size of their header
+             **/
+            class Raw_Connection : public Connection
+            {
+            public:
+                Raw_Connection() : tcp_socket(this->ioc) {}
+
+                virtual tcp::socket &socket()
+                {
+                    return this->tcp_socket;
+                }
+
+                virtual bool is_connected() const
+                {
+                    return this->tcp_socket.is_open();
+                }
+
+                virtual void async_handshake(const std::string &host, const Handler &handler)
+                {
+                    boost::ignore_unused(host);
+                    net::post(this->ioc, std::bind(handler, beast::error_code()));
+                }
+
+                virtual void async_write(net::const_buffer buffer, const Transfer_Handler &handler)
+                {
+                    net::async_write(this->tcp_socket, buffer, handler);
+                }
+
+                /**
+                 * the header of a message is read first, then as much data as it announces
+                 **/
+                virtual void async_read_some(net::mutable_buffer destination, const Transfer_Handler &handler)
+                {
+                    // held by the connection rather than by the operation, which is then small enough not to allocate
+                    this->read_handler = handler;
+                    this->reading_header = this->remaining_data_size == 0;
+                    if (this->reading_header)
+                    {
+                        this->header = static_cast<const char *>(destination.data());
+                        destination = net::buffer(destination, HEADER_SIZE);
+                    }
+                    else
+                    {
+                        destination = net::buffer(destination, this->remaining_data_size);
+                    }
+                    net::async_read(this->tcp_socket, destination, [this](beast::error_code ec, std::size_t bytes_transferred) {
+                        this->on_read(ec, bytes_transferred);
+                    });
+                }
+
+                virtual bool is_message_done() const
+                {
+                    return this->remaining_data_size == 0;
+                }
+
+                /**
+                 * There is no closing handshake: the server sees the end of the stream
+                 **/
+                virtual void async_close(const Handler &handler)
+                {
+                    beast::error_code ec;
+                    this->tcp_socket.shutdown(tcp::socket::shutdown_both, ec);
+                    this->tcp_socket.close(ec);
+                    net::post(this->ioc, std::bind(handler, beast::error_code()));
+                }
+
+            private:
+                tcp::socket tcp_socket;
+
+                Transfer_Handler read_handler;
+                const char *header = nullptr;
+                bool reading_header = false;
+                int remaining_data_size = 0;
+
+                void on_read(beast::error_code ec, std::size_t bytes_transferred)
+                {
+                    if (!ec && this->reading_header)
+                    {
+                        int data_size;
+                        memcpy(&data_size, this->header + DATA_SIZE_ADDRESS, sizeof(data_size));
+                        if (data_size < 0)
+                        {
+                            ec = net::error::message_size;
+                        }
+                        else
+                        {
+                            this->remaining_data_size = data_size;
+                        }
+                    }
+                    else if (!ec)
+                    {
+                        this->remaining_data_size -= static_cast<int>(bytes_transferred);
+                    }
+                    // the handler may start the next read, which replaces read_handler
+                    Transfer_Handler handler = std::move(this->read_handler);
+                    handler(ec, bytes_transferred);
+                }
+            };
+
+            /**
+             * the outcome of an asynchronous operation run by wait_for()
+             **/
+            struct Operation_State
+            {
+                bool done = false;
+                beast::error_code ec;
+                std::size_t bytes_transferred = 0;
+                tcp::resolver::results_type results;
+            };
+
+            struct Completion
+            {
+                Operation_State *state;
+
+                void operator()(beast::error_code ec)
+                {
+                    this->state->ec = ec;
+                    this->state->done = true;
+                }
+
+                void operator()(beast::error_code ec, std::size_t bytes_transferred)
+                {
+                    this->state->bytes_transferred = bytes_transferred;
+                    (*this)(ec);
+                }
+
+                void operator()(beast::error_code ec, const tcp::endpoint &)
+                {
+                    (*this)(ec);
+                }
+
+                void operator()(beast::error_code ec, tcp::resolver::results_type results)
+                {
+                    this->state->results = results;
+                    (*this)(ec);
+                }
+            };
+
+            std::unique_ptr<Connection> connection;
+            // true if connection was taken from the pool rather than opened for the current request
+            bool reused_connection = false;
+
+            // guards the members below, shared with the reconnect thread
+            std::mutex connections_mutex;
+            std::vector<std::unique_ptr<Connection>> idle_connections;
+            int connection_pool_size = 1;
+            // resolved once: the lookup is only repeated if connecting to the cached endpoints fails
+            tcp::resolver::results_type endpoints;
+            Socket_Options socket_options;
+
+            std::thread reconnect_thread;
+            std::atomic<bool> reconnecting{false};
+
+            std::atomic<bool> streaming{false};
+            std::atomic<bool> stop_requested{false};
+            bool stream_stopped_cleanly = false;
+            std::thread stream_thread;
+            const int STREAM_POLL_INTERVAL_IN_MILLISECONDS = 50;
+            const int STREAM_STOP_TIMEOUT_IN_MILLISECONDS = 2000;
+
+            /**
+             * Reads pushed frames until stop_stream() is called. Everything runs on this thread: 
+             * the stream is polled so that the STOP request can be written between reads.
+             **/
+            void stream_loop(Frame_Callback callback)
+            {
+                net::io_context &ioc = this->connection->context();
+
+                // pushed frames are read into the response buffer, which is not used by requests while streaming. 
+                // The part of a frame larger than the buffer is dropped
+                int bytes_read = 0;
+                char discarded[1024];
+                bool done = false;
+                bool stop_sent = false;
+                bool stop_acknowledged = false;
+                std::chrono::steady_clock::time_point stop_deadline;
+
+                std::function<void()> read_next;
+                std::function<void(beast::error_code, std::size_t)> on_read = [&](beast::error_code ec, std::size_t bytes_transferred) {
+                    if (ec) {
+                        done = true;
+                        return;
+                    }
+                    if (bytes_read < this->response_buffer_size) {
+                        bytes_read += static_cast<int>(bytes_transferred);
+                    }
+                    if (!this->connection->is_message_done()) {
+                        read_next();
+                        return;
+                    }
+                    const char *message = this->response_buffer;
+                    const int size = bytes_read;
+                    bytes_read = 0;
+                    if (size >= HEADER_SIZE + IMAGE_META_DATA_SIZE && strncmp(message, "FRAM", STATUS_SIZE) == 0) {
+                        if (!stop_sent) {
+                            // pushes have the layout of a GRAB response, codec metadata included. The frame takes the 
+                            // response buffer over until the callback returns
+                            Packet response(this->response_buffer, true, size - HEADER_SIZE, this->response_buffer + HEADER_SIZE);
+                            cv::Mat frame;
+                            if (this->load_frame(response, 0, frame, nullptr)) {
+                                callback(frame);
+                            }
+                        }
+                    } else if (stop_sent && size >= HEADER_SIZE && strncmp(message, "0200", STATUS_SIZE) == 0) {
+                        stop_acknowledged = true;
+                        done = true;
+                    }
+                    if (!done) {
+                        read_next();
+                    }
+                };
+                read_next = [&]() {
+                    net::mutable_buffer destination = net::buffer(discarded, sizeof(discarded));
+                    if (bytes_read < this->response_buffer_size) {
+                        destination = net::buffer(this->response_buffer + bytes_read, this->response_buffer_size - bytes_read);
+                    }
+                    // a single reference: the handler is stored without allocating
+                    this->connection->async_read_some(destination, [&on_read](beast::error_code ec, std::size_t bytes_transferred) {
+                        on_read(ec, bytes_transferred);
+                    });
+                };
+
+                ioc.restart();
+                read_next();
+
+                while (!done) {
+                    ioc.run_for(std::chrono::milliseconds(STREAM_POLL_INTERVAL_IN_MILLISECONDS));
+                    if (ioc.stopped()) {
+                        ioc.restart();
+                    }
+                    if (this->stop_requested && !stop_sent) {
+                        stop_sent = true;
+                        stop_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(STREAM_STOP_TIMEOUT_IN_MILLISECONDS);
+                        memcpy(this->request_buffer, "STOP", STATUS_SIZE);
+                        this->request_buffer[KEEP_ALIVE_ADDRESS] = '1';
+                        this->set_request_data_size(0);
+                        auto on_written = [&](beast::error_code ec, std::size_t) {
+                            if (ec) {
+                                done = true;
+                            }
+                        };
+                        this->connection->async_write(net::buffer(this->request_buffer, HEADER_SIZE), on_written);
+                    } else if (stop_sent && !done && std::chrono::steady_clock::now() > stop_deadline) {
+                        // the server does not answer: drop the connection
+                        beast::error_code ec;
+                        this->connection->socket().close(ec);
+                    }
+                }
+
+                if (!stop_acknowledged) {
+                    beast::error_code ec;
+                    this->connection->socket().close(ec);
+                }
+
+                // let pending handlers complete before their captures go out of scope
+                ioc.restart();
+                ioc.run();
+
+                this->stream_stopped_cleanly = stop_acknowledged;
+            }
+
             int timeout_count = 0;
             const int MAX_TIMEOUT_COUNT = 2;
-            int read_timeout_in_seconds = 1;
+            // also read by the reconnect thread
+            std::atomic<int> read_timeout_in_milliseconds{5000};
+            std::atomic<int> write_timeout_in_milliseconds{5000};
+            std::atomic<int> connect_timeout_in_milliseconds{5000};
+
+            void handle_timeout(const std::string &origin, TimeoutException &tex)
+            {
+                // a late response would be taken for the answer to the next request
+                this->disconnect();
+
+                if (timeout_count < MAX_TIMEOUT_COUNT)
+                {
+                    timeout_count++;
+                }
+                else
+                {
+                    timeout_count = 0;
+                    this->reconnect_in_background();
+                    tex.origin = origin;
+                    throw tex;
+                }
+            }
+
+            void send_request(const Packet &request, Packet &response)
+            {
+                if (!this->pending_requests.empty())
+                {
+                    throw RemoteException{"Pipelined responses are pending"};
+                }
+
+                // clearing the whole buffer would touch every page of it on each request
+                memset(response_buffer, 0, HEADER_SIZE);
+
+                bool fresh_connection = false;
+                if (!this->is_connected())
+                {
+                    fresh_connection = this->open_tcp_conversation() && !this->reused_connection;
+                }
+
+                if (!this->is_connected())
+                {
+                    throw RemoteException{"Not connected"};
+                }
+
+                try
+                {
+                    this->exchange(request, response);
+                }
+                catch (boost::system::system_error &)
+                {
+                    if (fresh_connection)
+                    {
+                        throw;
+                    }
+                    // the server dropped the connection while it was idle, likely along with the other pooled ones.
+                    // This request reconnects right away, the pool is refilled for the next ones without blocking them
+                    this->discard_connections();
+                    this->reconnect_in_background();
+                    if (!this->open_tcp_conversation())
+                    {
+                        throw RemoteException{"Not connected"};
+                    }
+                    this->exchange(request, response);
+                }
+
+                if (!request.keep_alive)
+                {
+                    this->release_connection();
+                }
+            }
+
+            void exchange(const Packet &request, Packet &response)
+            {
+                if (request.keep_alive)
+                {
+                    request_buffer[KEEP_ALIVE_ADDRESS] = '1';
+                }
+                else
+                {
+                    request_buffer[KEEP_ALIVE_ADDRESS] = '0';
+                }
+
+                this->set_request_data_size(request.data_size);
+
+                if (this->send_request_buffer(request.data_size + HEADER_SIZE))
+                {
+                    this->read_response(response);
+                }
+                else
+                {
+                    std::string last_error = std::string(strerror(errno));
+                    if (!request.keep_alive)
+                    {
+                        this->disconnect();
+                    }
+                    throw TimeoutException{"Failed to send data to server: " + last_error};
+                }
+            }
+
+            /**
+             * Reads the next frame published in the shared memory into dest, reusing its storage. The frames are as captured 
+             * by the server: the pixel format, codec and delta encoding negotiated do not apply. Waits up to the read timeout
+             **/
+            bool read_shared_frame(cv::Mat &dest, Frame_Info *info)
+            {
+                const unsigned char *previous_data = dest.data;
+                const bool result = this->shared_memory->read(dest, info, this->read_timeout_in_milliseconds);
+                if (result && dest.data != previous_data)
+                {
+                    this->allocation_count++;
+                }
+                return result;
+            }
+
+            /**
+             * sends a GRAB request. The frame info is requested only if info is not null, the whole frame if region is null 
+             * and a new frame if query is null
+             **/
+            bool request_frame(cv::Mat &dest, Frame_Info *info, const Frame_Region *region, const Frame_Query *query, bool keep_alive)
+            {
+                bool result = false;
+                try
+                {
+                    int flags = info != nullptr ? GRAB_FRAME_INFO : 0;
+                    int options_size = sizeof(flags);
+                    if (region != nullptr)
+                    {
+                        write_frame_region(*region, flags, this->request_buffer + HEADER_SIZE, options_size);
+                    }
+                    Delta_Reference *reference = nullptr;
+                    if (this->delta_encoding)
+                    {
+                        // the region changes the size of the frame: the server then sends a whole frame
+                        reference = &this->delta_reference;
+                        memcpy(this->request_buffer + HEADER_SIZE + options_size, &reference->frame_id, sizeof(int));
+                        options_size += sizeof(int);
+                        flags |= GRAB_DELTA;
+                    }
+                    if (query != nullptr)
+                    {
+                        char *data = this->request_buffer + HEADER_SIZE + options_size;
+                        memcpy(data, &query->mode, sizeof(int));
+                        memcpy(data + sizeof(int), &query->value, sizeof(int64_t));
+                        options_size += sizeof(int) + sizeof(int64_t);
+                        flags |= GRAB_BUFFERED;
+                    }
+                    Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
+                    request.set_status("GRAB");
+                    if (flags != 0)
+                    {
+                        memcpy(request.data, &flags, sizeof(flags));
+                        request.data_size = options_size;
+                    }
+
+                    Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                    this->send_request(request, response);
+                    result = response.check_if_status_is("0200") && this->load_frame(response, 0, dest, info, reference);
+                }
+                catch (TimeoutException &tex)
+                {
+                    this->handle_timeout("retrieve", tex);
+                }
+                return result;
+            }
+
+            bool receive_frame(cv::Mat &dest, Frame_Info *info, int &request_id)
+            {
+                if (this->pending_requests.empty())
+                {
+                    return false;
+                }
+                const Pending_Request pending = this->pending_requests.front();
+                this->pending_requests.pop_front();
+
+                memset(this->response_buffer, 0, HEADER_SIZE);
+                Packet response(this->response_buffer, true, 0, this->response_buffer + HEADER_SIZE);
+                try
+                {
+                    this->read_response(response);
+                }
+                catch (TimeoutException &)
+                {
+                    // the other responses are lost with the connection
+                    this->disconnect();
+                    throw;
+                }
+
+                request_id = -1;
+                if (response.data_size >= REQUEST_ID_SIZE)
+                {
+                    memcpy(&request_id, response.data, REQUEST_ID_SIZE);
+                }
+
+                bool result = false;
+                if (request_id != pending.id)
+                {
+                    std::cerr << "Expected the response to request " << pending.id << " but got " << request_id << "\n";
+                }
+                else if (response.check_if_status_is("0200"))
+                {
+                    result = this->load_frame(response, REQUEST_ID_SIZE, dest, pending.frame_info ? info : nullptr);
+                }
+                return result;
+            }
+
+            /**
+             * loads the frame of a GRAB response whose metadata starts at offset in the response data.
+             * The frame takes the response buffer over: the next response goes into another one
+             **/
+            bool load_frame(const Packet &response, const int offset, cv::Mat &dest, Frame_Info *info, Delta_Reference *reference = nullptr)
+            {
+                return take_frame(response, offset, this->settings.codec != CODEC_NONE, info, reference, *this->response_buffers, this->response_buffer, dest);
+            }
+            
+            /**
+             * sends a GRBC request. On success, payload points to the compressed data inside the response buffer
+             **/
+            bool request_compressed(int &rows, int &cols, int &fourcc, const char *&payload, int &payload_size, bool keep_alive)
+            {
+                Packet request(this->request_buffer, keep_alive, 0, this->request_buffer + HEADER_SIZE);
+                request.set_status("GRBC");
+
+                Packet response(this->response_buffer, keep_alive, 0, this->response_buffer + HEADER_SIZE);
+                this->send_request(request, response);
+                bool result = response.check_if_status_is("0200") && response.data_size >= COMPRESSED_META_DATA_SIZE;
+                if (result)
+                {
+                    const int size_int = sizeof(int);
+                    memcpy(&rows, response.data, size_int);
+                    memcpy(&cols, response.data + size_int, size_int);
+                    memcpy(&fourcc, response.data + 2 * size_int, size_int);
+                    memcpy(&payload_size, response.data + 3 * size_int, size_int);
+                    payload = response.data + COMPRESSED_META_DATA_SIZE;
+                    result = payload_size > 0 && payload_size <= response.data_size - COMPRESSED_META_DATA_SIZE;
+                }
+                return result;
+            }
+
+            /**
+             * opens connection to the server, preferably by taking a pooled one
+             **/
+            bool open_tcp_conversation()
+            {
+
+                bool test = true;
+                if (this->is_connected()) {
+                    test = this->disconnect();
+                }
+
+                if (!test) {
+                    return false;
+                }
+
+                this->connection = this->take_idle_connection();
+                this->reused_connection = this->connection != nullptr;
+                if (this->connection == nullptr) {
+                    this->connection = this->connect(this->settings);
+                }
+
+                return this->is_connected();
+            }
+
+            /**
+             * Opens a new connection negotiating settings. Returns null if the server refuses them. 
+             * Also called by the reconnect thread: it must not touch connection nor the response buffer
+             **/
+            std::unique_ptr<Connection> connect(const Connection_Settings &settings)
+            {
+                std::unique_ptr<Connection> result;
+                if (settings.raw_tcp)
+                {
+                    result.reset(new Raw_Connection());
+                }
+                else
+                {
+                    result.reset(new Websocket_Connection());
+                }
+                this->allocation_count++;
+
+                Connection &connection = *result;
+                try
+                {
+                    this->connect_socket(connection, this->resolve(connection, false));
+                }
+                catch (boost::system::system_error &)
+                {
+                    // the cached address may be stale
+                    this->connect_socket(connection, this->resolve(connection, true));
+                }
+
+                Socket_Options options;
+                {
+                    std::lock_guard<std::mutex> lock(this->connections_mutex);
+                    options = this->socket_options;
+                }
+                options.apply(connection.socket());
+
+                const std::string host = this->address;
+                wait_for(connection, [&](Completion completion) {
+                    connection.async_handshake(host, completion);
+                }, abort(connection), this->connect_timeout_in_milliseconds, "handshake");
+
+                const int codec[] = {settings.codec, settings.codec_quality};
+                if (settings.camera_id != 0 && !this->send_setting(connection, "CAMS", &settings.camera_id, 1))
+                {
+                    std::cerr << "Camera " << settings.camera_id << " is not available on " << this->address << ":" << this->port << "\n";
+                    this->close_connection(connection);
+                    result.reset();
+                }
+                else if (settings.pixel_format != PIXEL_FORMAT_NATIVE && !this->send_setting(connection, "FRMT", &settings.pixel_format, 1))
+                {
+                    std::cerr << "Pixel format " << settings.pixel_format << " is not supported by " << this->address << ":" << this->port << "\n";
+                    this->close_connection(connection);
+                    result.reset();
+                }
+                else if (settings.codec != CODEC_NONE && !this->send_setting(connection, "CODC", codec, settings.codec_quality < 0 ? 1 : 2))
+                {
+                    std::cerr << "Codec " << settings.codec << " with quality " << settings.codec_quality << " is not supported by " << this->address << ":" << this->port << "\n";
+                    this->close_connection(connection);
+                    result.reset();
+                }
+
+                return result;
+            }
+
+            void connect_socket(Connection &connection, const tcp::resolver::results_type &results)
+            {
+                wait_for(connection, [&](Completion completion) {
+                    net::async_connect(connection.socket(), results, completion);
+                }, abort(connection), this->connect_timeout_in_milliseconds, "connect");
+            }
+
+            tcp::resolver::results_type resolve(Connection &connection, bool refresh)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(this->connections_mutex);
+                    if (!refresh && !this->endpoints.empty())
+                    {
+                        return this->endpoints;
+                    }
+                }
+
+                // the lookup may block for long: the lock is only held to publish its results
+                tcp::resolver resolver{connection.context()};
+                const std::string host = this->address;
+                const std::string service = std::to_string(this->port);
+                const tcp::resolver::results_type results = wait_for(connection, [&](Completion completion) {
+                    resolver.async_resolve(host, service, completion);
+                }, [&resolver]() {
+                    resolver.cancel();
+                }, this->connect_timeout_in_milliseconds, "resolve").results;
+
+                std::lock_guard<std::mutex> lock(this->connections_mutex);
+                this->endpoints = results;
+                return results;
+            }
+
+            /**
+             * Runs the asynchronous operation started by initiate on the io_context of connection and waits at most 
+             * timeout_in_milliseconds for it, 0 meaning forever. On timeout, cancel aborts the operation and TimeoutException 
+             * is thrown. Other failures throw boost::system::system_error, as the blocking calls do
+             **/
+            template <typename Initiation, typename Cancellation>
+            static Operation_State wait_for(Connection &connection, const Initiation &initiate, const Cancellation &cancel, const int timeout_in_milliseconds, const std::string &what)
+            {
+                Operation_State state;
+                net::io_context &ioc = connection.context();
+
+                ioc.restart();
+                initiate(Completion{&state});
+                if (timeout_in_milliseconds > 0)
+                {
+                    ioc.run_for(std::chrono::milliseconds(timeout_in_milliseconds));
+                }
+                else
+                {
+                    ioc.run();
+                }
+
+                if (!state.done)
+                {
+                    cancel();
+                    // the aborted handler must run before state goes out of scope
+                    ioc.restart();
+                    ioc.run();
+                    throw TimeoutException{what + " timed out"};
+                }
+                if (state.ec)
+                {
+                    throw boost::system::system_error(state.ec, what);
+                }
+                return state;
+            }
+
+            /**
+             * cancellation of the operations of connection. The connection is unusable afterwards
+             **/
+            static std::function<void()> abort(Connection &connection)
+            {
+                return [&connection]() {
+                    beast::error_code ec;
+                    connection.socket().close(ec);
+                };
+            }
+
+            /**
+             * sends a request setting up a new connection, such as CAMS, whose data is the count first values. 
+             * Returns whether the server accepted it
+             **/
+            bool send_setting(Connection &connection, const char *status, const int *values, const int count)
+            {
+                const int max_count = 2;
+                char request[HEADER_SIZE + max_count * sizeof(int)];
+                memcpy(request + STATUS_ADDRESS, status, STATUS_SIZE);
+                request[KEEP_ALIVE_ADDRESS] = '1';
+                const int data_size = std::min(count, max_count) * static_cast<int>(sizeof(int));
+                memcpy(request + DATA_SIZE_ADDRESS, &data_size, sizeof(data_size));
+                memcpy(request + HEADER_SIZE, values, data_size);
+
+                this->write_message(connection, request, HEADER_SIZE + data_size);
+
+                char response[HEADER_SIZE];
+                const int bytes_read = this->read_message(connection, response, sizeof(response));
+
+                return bytes_read >= STATUS_SIZE && strncmp(response, "0200", STATUS_SIZE) == 0;
+            }
+
+            std::unique_ptr<Connection> take_idle_connection()
+            {
+                std::unique_ptr<Connection> result;
+                std::lock_guard<std::mutex> lock(this->connections_mutex);
+                while (result == nullptr && !this->idle_connections.empty())
+                {
+                    result = std::move(this->idle_connections.back());
+                    this->idle_connections.pop_back();
+                    if (!result->is_connected())
+                    {
+                        result.reset();
+                    }
+                }
+                return result;
+            }
+
+            /**
+             * parks the connection of a request sent without keep alive, or closes it if the pool is full
+             **/
+            void release_connection()
+            {
+                if (this->is_connected() && this->pending_requests.empty())
+                {
+                    std::lock_guard<std::mutex> lock(this->connections_mutex);
+                    if (static_cast<int>(this->idle_connections.size()) < this->connection_pool_size)
+                    {
+                        this->idle_connections.push_back(std::move(this->connection));
+                        return;
+                    }
+                }
+                this->disconnect();
+            }
+
+            /**
+             * closes the connections opened with previous settings
+             **/
+            void drop_connections()
+            {
+                std::vector<std::unique_ptr<Connection>> previous_connections;
+                {
+                    std::lock_guard<std::mutex> lock(this->connections_mutex);
+                    previous_connections.swap(this->idle_connections);
+                }
+                for (size_t i = 0; i < previous_connections.size(); ++i)
+                {
+                    this->close_connection(*previous_connections[i]);
+                }
+                if (this->is_connected())
+                {
+                    this->disconnect();
+                }
+            }
+
+            /**
+             * drops connection and the pooled connections without the closing handshake: they are assumed dead
+             **/
+            void discard_connections()
+            {
+                this->pending_requests.clear();
+                this->connection.reset();
+                std::lock_guard<std::mutex> lock(this->connections_mutex);
+                this->idle_connections.clear();
+            }
+
+            /**
+             * fills the connection pool from a background thread
+             **/
+            void reconnect_in_background()
+            {
+                if (this->reconnecting.exchange(true))
+                {
+                    return;
+                }
+                if (this->reconnect_thread.joinable())
+                {
+                    this->reconnect_thread.join();
+                }
+
+                const Connection_Settings settings = this->settings;
+                this->reconnect_thread = std::thread([this, settings]() {
+                    try
+                    {
+                        bool pool_full = false;
+                        while (!pool_full)
+                        {
+                            {
+                                std::lock_guard<std::mutex> lock(this->connections_mutex);
+                                pool_full = !(settings == this->settings) || static_cast<int>(this->idle_connections.size()) >= this->connection_pool_size;
+                            }
+                            if (!pool_full)
+                            {
+                                std::unique_ptr<Connection> connection = this->connect(settings);
+                                if (connection == nullptr)
+                                {
+                                    break;
+                                }
+                                std::lock_guard<std::mutex> lock(this->connections_mutex);
+                                if (settings == this->settings && static_cast<int>(this->idle_connections.size()) < this->connection_pool_size)
+                                {
+                                    this->idle_connections.push_back(std::move(connection));
+                                }
+                            }
+                        }
+                    }
+                    catch (std::exception const &e)
+                    {
+                        std::cerr << "Failed to reconnect: " << e.what() << "\n";
+                    }
+                    this->reconnecting = false;
+                });
+            }
+
+            void close_connection(Connection &connection)
+            {
+                try {
+                    wait_for(connection, [&](Completion completion) {
+                        connection.async_close(completion);
+                    }, abort(connection), this->write_timeout_in_milliseconds, "close");
+                } catch(std::exception const&) {
+                    // already dropped by the server
+                }
+            }
+
+            int response_buffer_size = HEADER_SIZE;
+            // the buffer responses are read into. It is replaced whenever a retrieved frame keeps it
+            char *response_buffer = nullptr;
+            Frame_Buffer_Pool *response_buffers = nullptr;
+
+            int request_buffer_size = HEADER_SIZE + MAX_GRAB_OPTIONS_SIZE;
+            char *request_buffer = nullptr;
+
+            inline bool is_connected() const
+            {
+                return this->connection != nullptr && this->connection->is_connected();
+            }
+
+            bool disconnect()
+            {
+                // their responses are lost with the connection
+                this->pending_requests.clear();
+
+                bool result = true;
+                if (this->is_connected())
+                {
+                    Connection &connection = *this->connection;
+                    try {
+                        wait_for(connection, [&](Completion completion) {
+                            connection.async_close(completion);
+                        }, abort(connection), this->write_timeout_in_milliseconds, "close");
+                    } catch(std::exception const& e) {
+                        result = false;
+                        std::cerr << "Failed to close connection: " << e.what() << "\n";
+                    }
+                }
+                this->connection.reset();
+                return result;
+            }
+
+            /* *
+             * Load the response into the response parameter
+             * */
+            bool read_response(Packet &response)
+            {
+
+                int bytes_read = this->read_message();
+
+                int expected_data_size;
+                int expected_data_size_sz = sizeof(expected_data_size);
+                bool result = false;
+                response.data_size = 0;
+                if (bytes_read >= (DATA_SIZE_ADDRESS + expected_data_size_sz))
+                {
+                    response.data_size = 0;
+                    memcpy(&expected_data_size, this->response_buffer + DATA_SIZE_ADDRESS, expected_data_size_sz);
+                    if (bytes_read - HEADER_SIZE >= expected_data_size)
+                    {
+                        response.data_size = expected_data_size;
+                    }
+                }
+                
+                return result;
+            }
+
+            /**
+             * Reads the next message straight into response_buffer, without allocating nor copying it.
+             * The part of a message larger than the buffer is dropped. Returns the number of bytes stored
+             **/
+            int read_message()
+            {
+                if (this->socket_options.quick_ack)
+                {
+                    Socket_Options::set_quick_ack(this->connection->socket());
+                }
+                return this->read_message(*this->connection, this->response_buffer, this->response_buffer_size);
+            }
+
+            /**
+             * the whole message must arrive within the read timeout
+             **/
+            int read_message(Connection &connection, char *buffer, const int buffer_size)
+            {
+                const int timeout_in_milliseconds = this->read_timeout_in_milliseconds;
+                const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_in_milliseconds);
+
+                int bytes_read = 0;
+                char discarded[1024];
+                do
+                {
+                    net::mutable_buffer destination = net::buffer(discarded, sizeof(discarded));
+                    if (bytes_read < buffer_size)
+                    {
+                        destination = net::buffer(buffer + bytes_read, buffer_size - bytes_read);
+                    }
+
+                    int timeout = 0;
+                    if (timeout_in_milliseconds > 0)
+                    {
+                        // at least 1 ms: 0 would mean no timeout
+                        timeout = std::max(1, static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count()));
+                    }
+
+                    const std::size_t bytes_transferred = wait_for(connection, [&](Completion completion) {
+                        connection.async_read_some(destination, completion);
+                    }, abort(connection), timeout, "read").bytes_transferred;
+
+                    if (bytes_read < buffer_size)
+                    {
+                        bytes_read += static_cast<int>(bytes_transferred);
+                    }
+                } while (!connection.is_message_done());
+
+                return bytes_read;
+            }
+
+            void write_message(Connection &connection, const char *buffer, const int size)
+            {
+                wait_for(connection, [&](Completion completion) {
+                    connection.async_write(net::buffer(buffer, size), completion);
+                }, abort(connection), this->write_timeout_in_milliseconds, "write");
+            }
+
+            /**
+             * loads into buffer a chunk of data from the response packet
+             **/
+            void read_response_data(void *buffer, const int size, const Packet &response)
+            {
+                if (size > 0 && size <= response.data_size)
+                {
+                    memcpy(buffer, response.data, size);
+                }
+            }
+
+            /* *
+             * helper method to send request
+             * */
+            bool send_request_buffer(const int bytes_to_send)
+            {
+
+                this->write_message(*this->connection, this->request_buffer, bytes_to_send);
+
+                return true;
+            }
+
+            void set_request_data_size(int size)
+            {
+                memcpy(request_buffer + DATA_SIZE_ADDRESS, &size, sizeof(size));
+            }
+        };
+
+        /**
+         * Asynchronous counterpart of Device, driven by an io_context supplied by the application.
+         * 
+         * Every operation returns immediately. Its result is delivered either to a completion handler, called by a thread 
+         * running the io_context, or through a std::future, which must not be waited for by a thread needed to run the io_context.
+         * Operations are sent in call order, one at a time, on a single connection which is opened on demand and kept alive. 
+         * This way, a single thread can drive many cameras.
+         * 
+         * Retrieved frames own the buffer they were received into, as with Device::retrieve.
+         * An Async_Device must be owned by a std::shared_ptr.
+         **/
+        class Async_Device : public std::enable_shared_from_this<Async_Device>
+        {
+        public:
+            typedef std::function<void(bool)> Status_Handler;
+            typedef std::function<void(bool, double)> Value_Handler;
+            typedef std::function<void(bool, const cv::Mat &, const Frame_Info &)> Frame_Handler;
+
+            Async_Device(net::io_context &ioc, const std::string &server_address, const int server_port) : 
+                Async_Device(ioc, server_address, server_port, HEADER_SIZE + IMAGE_META_DATA_SIZE + FRAME_INFO_SIZE + 1920 * 1080 * 3) {}
+
+            Async_Device(net::io_context &ioc, const std::string &server_address, const int server_port, const int _response_buffer_size) : 
+                strand(net::make_strand(ioc)), resolver(strand), address(server_address), port(server_port), 
+                response_buffer_size(std::max(_response_buffer_size, static_cast<int>(HEADER_SIZE)))
+            {
+                this->response_buffers = new Frame_Buffer_Pool(this->response_buffer_size);
+                this->response_buffer = this->response_buffers->acquire();
+            }
+
+            virtual ~Async_Device()
+            {
+                this->response_buffers->release(this->response_buffer);
+                // frames still referenced by the application keep the pool alive
+                this->response_buffers->detach();
+            }
+
+            void async_ping(const Status_Handler &handler)
+            {
+                this->enqueue("PING", nullptr, 0, [handler](Async_Device &, bool success, Packet &response) {
+                    handler(success && response.check_if_status_is("PONG"));
+                });
+            }
+
+            void async_open(const Status_Handler &handler)
+            {
+                this->enqueue("OPEN", nullptr, 0, status_ok(handler));
+            }
+
+            void async_is_opened(const Status_Handler &handler)
+            {
+                this->enqueue("ISOP", nullptr, 0, status_ok(handler));
+            }
+
+            void async_release(const Status_Handler &handler)
+            {
+                this->enqueue("CLOS", nullptr, 0, status_ok(handler));
+            }
+
+            void async_set(int propId, double value, const Status_Handler &handler)
+            {
+                char data[sizeof(int) + sizeof(double)];
+                memcpy(data, &propId, sizeof(int));
+                memcpy(data + sizeof(int), &value, sizeof(double));
+                this->enqueue("SET0", data, sizeof(data), status_ok(handler));
+            }
+
+            void async_get(int propId, const Value_Handler &handler)
+            {
+                this->enqueue("GET0", &propId, sizeof(propId), [handler](Async_Device &, bool success, Packet &response) {
+                    double value = -1.0;
+                    success = success && response.check_if_status_is("0200") && response.data_size >= static_cast<int>(sizeof(value));
+                    if (success)
+                    {
+                        memcpy(&value, response.data, sizeof(value));
+                    }
+                    handler(success, value);
+                });
+            }
+
+            /**
+             * grabs a frame along with its Frame_Info
+             **/
+            void async_retrieve(const Frame_Handler &handler)
+            {
+                const int flags = GRAB_FRAME_INFO;
+                this->enqueue("GRAB", &flags, sizeof(flags), [handler](Async_Device &device, bool success, Packet &response) {
+                    cv::Mat frame;
+                    Frame_Info info;
+                    success = success && response.check_if_status_is("0200") && 
+                        take_frame(response, 0, device.connected_settings.codec != CODEC_NONE, &info, nullptr, *device.response_buffers, device.response_buffer, frame);
+                    handler(success, frame, info);
+                });
+            }
+
+            std::future<bool> async_ping()
+            {
+                std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+                this->async_ping([promise](bool result) { promise->set_value(result); });
+                return promise->get_future();
+            }
+
+            std::future<bool> async_open()
+            {
+                std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+                this->async_open([promise](bool result) { promise->set_value(result); });
+                return promise->get_future();
+            }
 
-            void handle_timeout(const std::string &origin, TimeoutException &tex)
+            std::future<bool> async_is_opened()
             {
+                std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+                this->async_is_opened([promise](bool result) { promise->set_value(result); });
+                return promise->get_future();
+            }
 
-                if (timeout_count < MAX_TIMEOUT_COUNT)
-                {
-                    timeout_count++;
-                }
-                else
-                {
-                    timeout_count = 0;
-                    this->disconnect();
-                    tex.origin = origin;
-                    throw tex;
-                }
+            std::future<bool> async_release()
+            {
+                std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+                this->async_release([promise](bool result) { promise->set_value(result); });
+                return promise->get_future();
             }
 
-            void send_request(const Packet &request, Packet &response)
+            std::future<bool> async_set(int propId, double value)
             {
-                memset(response_buffer, 0, response_buffer_size);
+                std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+                this->async_set(propId, value, [promise](bool result) { promise->set_value(result); });
+                return promise->get_future();
+            }
 
-                bool result = false;
-                if (!this->is_connected())
+            /**
+             * the value is -1 if the request fails
+             **/
+            std::future<double> async_get(int propId)
+            {
+                std::shared_ptr<std::promise<double>> promise = std::make_shared<std::promise<double>>();
+                this->async_get(propId, [promise](bool, double value) { promise->set_value(value); });
+                return promise->get_future();
+            }
+
+            /**
+             * the frame is empty if the request fails
+             **/
+            std::future<cv::Mat> async_retrieve()
+            {
+                std::shared_ptr<std::promise<cv::Mat>> promise = std::make_shared<std::promise<cv::Mat>>();
+                this->async_retrieve([promise](bool, const cv::Mat &frame, const Frame_Info &) { promise->set_value(frame); });
+                return promise->get_future();
+            }
+
+            /**
+             * selects which camera of a multi-camera server the next connection addresses
+             **/
+            void set_camera_id(int camera_id)
+            {
+                std::shared_ptr<Async_Device> self = shared_from_this();
+                net::post(this->strand, [self, camera_id]() {
+                    self->settings.camera_id = camera_id;
+                });
+            }
+
+            /**
+             * same as Device::set_pixel_format
+             **/
+            void set_pixel_format(int pixel_format)
+            {
+                std::shared_ptr<Async_Device> self = shared_from_this();
+                net::post(this->strand, [self, pixel_format]() {
+                    self->settings.pixel_format = pixel_format;
+                });
+            }
+
+            /**
+             * same as Device::set_codec
+             **/
+            void set_codec(int codec, int quality = -1)
+            {
+                std::shared_ptr<Async_Device> self = shared_from_this();
+                net::post(this->strand, [self, codec, quality]() {
+                    self->settings.codec = codec;
+                    self->settings.codec_quality = quality;
+                });
+            }
+
+            /**
+             * Maximum time for each step of an operation: connecting, sending the request and receiving the response. 
+             * An operation which times out fails and its connection is dropped. 0 waits forever. The default is 5 seconds
+             **/
+            void set_timeout(int timeout_in_seconds)
+            {
+                if (timeout_in_seconds >= 0)
                 {
-                    this->open_tcp_conversation();
+                    std::shared_ptr<Async_Device> self = shared_from_this();
+                    net::post(this->strand, [self, timeout_in_seconds]() {
+                        self->timeout_in_milliseconds = timeout_in_seconds * 1000;
+                    });
                 }
+            }
 
-                if (this->is_connected())
-                {
-                    if (request.keep_alive)
-                    {
-                        request_buffer[KEEP_ALIVE_ADDRESS] = '1';
-                    }
-                    else
+            /**
+             * closes the connection once the queued operations are done. A later operation opens it again
+             **/
+            void close()
+            {
+                std::shared_ptr<Async_Device> self = shared_from_this();
+                net::post(this->strand, [self]() {
+                    self->closing = true;
+                    if (!self->busy)
                     {
-                        request_buffer[KEEP_ALIVE_ADDRESS] = '0';
+                        self->next();
                     }
+                });
+            }
 
-                    this->set_request_data_size(request.data_size);
+        private:
+            typedef std::function<void(Async_Device &, bool, Packet &)> Response_Handler;
 
-                    if (this->send_request_buffer(request.data_size + HEADER_SIZE))
-                    {
+            struct Operation
+            {
+                char request[HEADER_SIZE + sizeof(int) + sizeof(double)];
+                int request_size = 0;
+                Response_Handler on_response;
+            };
 
-                        this->read_response(response);
+            net::strand<net::io_context::executor_type> strand;
+            tcp::resolver resolver;
+            std::unique_ptr<websocket::stream<beast::tcp_stream>> ws;
 
-                        if (!request.keep_alive)
-                        {
-                            this->disconnect();
-                        }
+            std::string address;
+            int port;
+            Connection_Settings settings;
+            Connection_Settings connected_settings;
+            int timeout_in_milliseconds = 5000;
+
+            const int response_buffer_size;
+            char *response_buffer = nullptr;
+            Frame_Buffer_Pool *response_buffers = nullptr;
+            int bytes_read = 0;
+            char discarded[1024];
+
+            std::deque<std::shared_ptr<Operation>> operations;
+            bool busy = false;
+            bool closing = false;
+
+            static Response_Handler status_ok(const Status_Handler &handler)
+            {
+                return [handler](Async_Device &, bool success, Packet &response) {
+                    handler(success && response.check_if_status_is("0200"));
+                };
+            }
+
+            void enqueue(const char *status, const void *data, const int data_size, const Response_Handler &on_response)
+            {
+                std::shared_ptr<Operation> operation = std::make_shared<Operation>();
+                memcpy(operation->request + STATUS_ADDRESS, status, STATUS_SIZE);
+                operation->request[KEEP_ALIVE_ADDRESS] = '1';
+                memcpy(operation->request + DATA_SIZE_ADDRESS, &data_size, sizeof(data_size));
+                if (data_size > 0)
+                {
+                    memcpy(operation->request + HEADER_SIZE, data, data_size);
+                }
+                operation->request_size = HEADER_SIZE + data_size;
+                operation->on_response = on_response;
+
+                std::shared_ptr<Async_Device> self = shared_from_this();
+                net::post(this->strand, [self, operation]() {
+                    self->operations.push_back(operation);
+                    if (!self->busy)
+                    {
+                        self->next();
                     }
-                    else
+                });
+            }
+
+            void next()
+            {
+                if (this->operations.empty())
+                {
+                    this->busy = false;
+                    if (this->is_connected())
                     {
-                        std::string last_error = std::string(strerror(errno));
-                        if (!request.keep_alive)
-                        {
-                            this->disconnect();
-                        }
-                        throw TimeoutException{"Failed to send data to server: " + last_error};
+                        beast::get_lowest_layer(*this->ws).expires_never();
+                    }
+                    if (this->closing && this->is_connected())
+                    {
+                        this->busy = true;
+                        this->start_deadline();
+                        this->ws->async_close(websocket::close_code::normal, beast::bind_front_handler(&Async_Device::on_close, shared_from_this()));
                     }
+                    this->closing = false;
+                    return;
+                }
+
+                this->busy = true;
+                if (this->is_connected() && this->connected_settings == this->settings)
+                {
+                    this->do_write();
                 }
                 else
                 {
-                    throw RemoteException{"Not connected"};
+                    this->do_connect();
                 }
             }
 
-            bool open_tcp_conversation()
+            inline bool is_connected() const
             {
+                return this->ws != nullptr && this->ws->is_open() && beast::get_lowest_layer(*this->ws).socket().is_open();
+            }
 
-                bool test = true;
-                if (this->is_connected()) {
-                    test = this->disconnect();
+            /**
+             * the next operations on the connection fail with beast::error::timeout unless they complete in time
+             **/
+            void start_deadline()
+            {
+                if (this->timeout_in_milliseconds > 0)
+                {
+                    beast::get_lowest_layer(*this->ws).expires_after(std::chrono::milliseconds(this->timeout_in_milliseconds));
+                }
+                else
+                {
+                    beast::get_lowest_layer(*this->ws).expires_never();
                 }
+            }
 
-                if (!test) {
-                    return false;
+            void do_connect()
+            {
+                this->ws.reset(new websocket::stream<beast::tcp_stream>(this->strand));
+                this->resolver.async_resolve(this->address, std::to_string(this->port), 
+                    beast::bind_front_handler(&Async_Device::on_resolve, shared_from_this()));
+            }
+
+            void on_resolve(beast::error_code ec, tcp::resolver::results_type results)
+            {
+                if (ec)
+                {
+                    this->fail(ec, "resolve");
+                    return;
                 }
+                this->start_deadline();
+                beast::get_lowest_layer(*this->ws).async_connect(results, beast::bind_front_handler(&Async_Device::on_connect, shared_from_this()));
+            }
 
-                tcp::resolver resolver{ioc};
-                if (this->ws == nullptr) {
-                    this->ws = new websocket::stream<tcp::socket>{ioc};
+            void on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type)
+            {
+                if (ec)
+                {
+                    this->fail(ec, "connect");
+                    return;
                 }
+                this->start_deadline();
+                this->ws->async_handshake(this->address, "/", beast::bind_front_handler(&Async_Device::on_handshake, shared_from_this()));
+            }
 
-                auto host = this->address.c_str();
-                auto s_port = std::to_string(this->port).c_str();
+            void on_handshake(beast::error_code ec)
+            {
+                if (ec)
+                {
+                    this->fail(ec, "handshake");
+                    return;
+                }
+                this->ws->binary(true);
+                const Connection_Settings &settings = this->settings;
+                this->connected_settings = settings;
 
-                auto const results = resolver.resolve(host, s_port);
+                // the first requests of the connection select the camera, then the pixel format and the codec
+                if (settings.codec != CODEC_NONE)
+                {
+                    const int codec[] = {settings.codec, settings.codec_quality};
+                    this->push_setting("CODC", codec, settings.codec_quality < 0 ? 1 : 2, "Codec " + std::to_string(settings.codec) + " is not supported by ");
+                }
+                if (settings.pixel_format != PIXEL_FORMAT_NATIVE)
+                {
+                    this->push_setting("FRMT", &settings.pixel_format, 1, "Pixel format " + std::to_string(settings.pixel_format) + " is not supported by ");
+                }
+                if (settings.camera_id != 0)
+                {
+                    this->push_setting("CAMS", &settings.camera_id, 1, "Camera " + std::to_string(settings.camera_id) + " is not available on ");
+                }
 
-                net::connect(ws->next_layer(), results.begin(), results.end());
+                this->do_write();
+            }
 
-                ws->set_option(websocket::stream_base::decorator(
-                    [](websocket::request_type& req)
+            /**
+             * queues a request setting up the connection, whose data is the count first values, before the pending operations
+             **/
+            void push_setting(const char *status, const int *values, const int count, const std::string &error)
+            {
+                std::shared_ptr<Operation> operation = std::make_shared<Operation>();
+                memcpy(operation->request + STATUS_ADDRESS, status, STATUS_SIZE);
+                operation->request[KEEP_ALIVE_ADDRESS] = '1';
+                const int data_size = count * static_cast<int>(sizeof(int));
+                memcpy(operation->request + DATA_SIZE_ADDRESS, &data_size, sizeof(data_size));
+                memcpy(operation->request + HEADER_SIZE, values, data_size);
+                operation->request_size = HEADER_SIZE + data_size;
+                operation->on_response = [error](Async_Device &device, bool success, Packet &response) {
+                    if (!success || !response.check_if_status_is("0200"))
                     {
-                        req.set(http::field::user_agent,
-                            std::string(BOOST_BEAST_VERSION_STRING) +
-                                " websocket-client-coro");
-                    }));
+                        // connection failures are reported by fail()
+                        if (success)
+                        {
+                            std::cerr << error << device.address << ":" << device.port << "\n";
+                        }
+                        device.disconnect();
+                        // the operation which opened the connection fails instead of reconnecting forever
+                        device.complete(false);
+                    }
+                };
+                this->operations.push_front(operation);
+            }
 
-                ws->handshake(host, "/");
+            void do_write()
+            {
+                const Operation &operation = *this->operations.front();
+                this->start_deadline();
+                this->ws->async_write(net::buffer(operation.request, operation.request_size), 
+                    beast::bind_front_handler(&Async_Device::on_write, shared_from_this()));
+            }
 
-                return this->is_connected();
+            void on_write(beast::error_code ec, std::size_t)
+            {
+                if (ec)
+                {
+                    this->fail(ec, "write");
+                    return;
+                }
+                this->bytes_read = 0;
+                // the whole response must arrive within the timeout
+                this->start_deadline();
+                this->do_read();
             }
 
-            void update_socket_timeout()
+            /**
+             * reads the response straight into response_buffer. The part of a message larger than the buffer is dropped
+             **/
+            void do_read()
             {
-                
+                if (this->bytes_read < this->response_buffer_size)
+                {
+                    this->ws->async_read_some(net::buffer(this->response_buffer + this->bytes_read, this->response_buffer_size - this->bytes_read), 
+                        beast::bind_front_handler(&Async_Device::on_read, shared_from_this(), true));
+                }
+                else
+                {
+                    this->ws->async_read_some(net::buffer(this->discarded, sizeof(this->discarded)), 
+                        beast::bind_front_handler(&Async_Device::on_read, shared_from_this(), false));
+                }
             }
 
-            int response_buffer_size = HEADER_SIZE;
-            char *response_buffer = nullptr;
+            void on_read(bool stored, beast::error_code ec, std::size_t bytes_transferred)
+            {
+                if (ec)
+                {
+                    this->fail(ec, "read");
+                    return;
+                }
+                if (stored)
+                {
+                    this->bytes_read += static_cast<int>(bytes_transferred);
+                }
+                if (!this->ws->is_message_done())
+                {
+                    this->do_read();
+                    return;
+                }
+                this->complete(true);
+                this->next();
+            }
 
-            int request_buffer_size = HEADER_SIZE;
-            char *request_buffer = nullptr;
+            void on_close(beast::error_code ec)
+            {
+                if (ec && ec != net::error::operation_aborted)
+                {
+                    std::cerr << "Failed to close websocket: " << ec.message() << "\n";
+                }
+                this->busy = false;
+                this->next();
+            }
 
-            inline bool is_connected() const
+            /**
+             * hands the response, or the failure, to the oldest operation
+             **/
+            void complete(bool success)
             {
-                return this->ws != nullptr && this->ws->is_open();
+                if (this->operations.empty())
+                {
+                    return;
+                }
+                std::shared_ptr<Operation> operation = this->operations.front();
+                this->operations.pop_front();
+
+                Packet response(this->response_buffer, true, 0, this->response_buffer + HEADER_SIZE);
+                int data_size = 0;
+                if (success && this->bytes_read >= HEADER_SIZE)
+                {
+                    memcpy(&data_size, this->response_buffer + DATA_SIZE_ADDRESS, sizeof(data_size));
+                    if (data_size >= 0 && this->bytes_read - HEADER_SIZE >= data_size)
+                    {
+                        response.data_size = data_size;
+                    }
+                }
+                else
+                {
+                    memset(this->response_buffer, 0, HEADER_SIZE);
+                    success = false;
+                }
+
+                operation->on_response(*this, success, response);
             }
 
-            bool disconnect()
+            void disconnect()
             {
-                bool result = true;
                 if (this->ws != nullptr)
                 {
-                    try {
-                        this->ws->close(websocket::close_code::normal);
-                    } catch(std::exception const& e) {
-                        result = false;
-                        std::cerr << "Failed to close websocket: " << e.what() << "\n";
-                    }
-                    
+                    beast::error_code ec;
+                    beast::get_lowest_layer(*this->ws).socket().close(ec);
                 }
-                return result;
             }
 
-            /* *
-             * Load the response into the response parameter
-             * */
-            bool read_response(Packet &response)
+            void fail(beast::error_code ec, const std::string &what)
             {
+                std::cerr << "Async_Device " << what << ": " << ec.message() << "\n";
+                this->disconnect();
+                this->complete(false);
+                this->next();
+            }
+        };
+
+        /**
+         * Frames grabbed at once by a Device_Group. Entry i belongs to the i-th device added to the group.
+         **/
+        struct Group_Frames
+        {
+            std::vector<cv::Mat> frames;
+            std::vector<Frame_Info> infos;
+            std::vector<char> success;
 
-                beast::flat_buffer buffer;
+            // spread, in microseconds, of the times the servers received the frames. Requires synchronized server clocks
+            int64_t skew = 0;
 
-                int bytes_read = this->ws->read(buffer);
+            // spread, in microseconds, of the times the requests were sent by this client
+            int64_t request_skew = 0;
+        };
 
-                const char* response_data = boost::asio::buffer_cast<const char*>(buffer.data());
+        /**
+         * Grabs from several devices at the same time.
+         * 
+         * Each device has its own thread, started once, which sends GRAB as soon as grab() releases it.
+         * This way the requests leave in parallel instead of one round trip after the other.
+         * 
+         * The devices are not owned by the group and must not be used elsewhere while grab() runs.
+         **/
+        class Device_Group
+        {
 
-                memcpy(this->response_buffer, response_data, std::min(bytes_read, this->response_buffer_size));
+        public:
+            Device_Group() {}
 
-                int expected_data_size;
-                int expected_data_size_sz = sizeof(expected_data_size);
-                bool result = false;
-                response.data_size = 0;
-                if (bytes_read >= (DATA_SIZE_ADDRESS + expected_data_size_sz))
+            virtual ~Device_Group()
+            {
                 {
-                    response.data_size = 0;
-                    memcpy(&expected_data_size, this->response_buffer + DATA_SIZE_ADDRESS, expected_data_size_sz);
-                    if (bytes_read - HEADER_SIZE >= expected_data_size)
-                    {
-                        response.data_size = expected_data_size;
-                    }
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->running = false;
+                }
+                this->start_condition.notify_all();
+                for (size_t i = 0; i < this->workers.size(); ++i)
+                {
+                    this->workers[i].join();
                 }
-                
-                return result;
             }
 
             /**
-             * loads into buffer a chunk of data from the response packet
+             * adds a device to the group and returns its index in Group_Frames
              **/
-            void read_response_data(void *buffer, const int size, const Packet &response)
+            int add(Device &device)
             {
-                if (size > 0 && size <= response.data_size)
-                {
-                    memcpy(buffer, response.data, size);
-                }
+                std::lock_guard<std::mutex> lock(this->mutex);
+                const int index = static_cast<int>(this->devices.size());
+                this->devices.push_back(&device);
+                this->request_times.push_back(0);
+                this->results.frames.resize(this->devices.size());
+                this->results.infos.resize(this->devices.size());
+                this->results.success.resize(this->devices.size(), false);
+                this->workers.emplace_back(&Device_Group::work, this, index, this->generation);
+                return index;
             }
 
-            /* *
-             * helper method to send request
-             * */
-            bool send_request_buffer(const int bytes_to_send)
+            int size() const
             {
+                return static_cast<int>(this->devices.size());
+            }
 
-                this->ws->binary(true);
-                this->ws->text(false);
+            /**
+             * Grabs one frame from every device. Returns true if all devices delivered a frame
+             **/
+            bool grab(Group_Frames &dest, bool keep_alive = true)
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->keep_alive = keep_alive;
+                this->pending = static_cast<int>(this->devices.size());
+                this->generation++;
+                this->start_condition.notify_all();
+                this->done_condition.wait(lock, [this]() { return this->pending == 0; });
+
+                bool result = !this->devices.empty();
+                int64_t first_receive_time = 0, last_receive_time = 0;
+                int64_t first_request_time = 0, last_request_time = 0;
+                bool first = true;
+                for (size_t i = 0; i < this->devices.size(); ++i)
+                {
+                    if (!this->results.success[i])
+                    {
+                        result = false;
+                        continue;
+                    }
+                    const int64_t receive_time = this->results.infos[i].receive_time;
+                    const int64_t request_time = this->request_times[i];
+                    if (first)
+                    {
+                        first_receive_time = last_receive_time = receive_time;
+                        first_request_time = last_request_time = request_time;
+                        first = false;
+                    }
+                    first_receive_time = std::min(first_receive_time, receive_time);
+                    last_receive_time = std::max(last_receive_time, receive_time);
+                    first_request_time = std::min(first_request_time, request_time);
+                    last_request_time = std::max(last_request_time, request_time);
+                }
+                this->results.skew = last_receive_time - first_receive_time;
+                this->results.request_skew = last_request_time - first_request_time;
 
-                this->ws->write(net::buffer(this->request_buffer, bytes_to_send));
+                dest = this->results;
 
-                return true;
+                return result;
             }
 
-            void set_request_data_size(int size)
+        private:
+            std::vector<Device *> devices;
+            std::vector<std::thread> workers;
+            std::vector<int64_t> request_times;
+            Group_Frames results;
+
+            std::mutex mutex;
+            std::condition_variable start_condition;
+            std::condition_variable done_condition;
+            bool running = true;
+            bool keep_alive = true;
+            int pending = 0;
+            long generation = 0;
+
+            void work(const int index, long last_generation)
             {
-                memcpy(request_buffer + DATA_SIZE_ADDRESS, &size, sizeof(size));
+                while (true)
+                {
+                    Device *device = nullptr;
+                    bool keep_alive = true;
+                    {
+                        std::unique_lock<std::mutex> lock(this->mutex);
+                        this->start_condition.wait(lock, [this, last_generation]() { return !this->running || this->generation != last_generation; });
+                        if (!this->running)
+                        {
+                            break;
+                        }
+                        last_generation = this->generation;
+                        device = this->devices[index];
+                        keep_alive = this->keep_alive;
+                    }
+
+                    cv::Mat frame;
+                    Frame_Info info;
+                    const int64_t request_time = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+                    bool success = false;
+                    try
+                    {
+                        success = device->retrieve(frame, info, keep_alive);
+                    }
+                    catch (std::exception &e)
+                    {
+                        std::cerr << "Device " << index << " failed to grab: " << e.what() << "\n";
+                    }
+
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->results.frames[index] = frame;
+                    this->results.infos[index] = info;
+                    this->results.success[index] = success;
+                    this->request_times[index] = request_time;
+                    this->pending--;
+                    if (this->pending == 0)
+                    {
+                        this->done_condition.notify_all();
+                    }
+                }
             }
         };
 
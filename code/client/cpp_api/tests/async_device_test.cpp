@@ -0,0 +1,121 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/client_api.hpp"
+#include "loopback_server.hpp"
+
+using rpiasgige::client::Async_Device;
+using rpiasgige::client::Frame_Info;
+using rpiasgige::client::test::Loopback_Server;
+using rpiasgige::client::test::closed_port;
+
+TEST(Async_DeviceTest, UnreachableServerTest)
+{
+
+    net::io_context ioc;
+    std::vector<std::string> completed;
+    double value = 0.0;
+    bool frame_empty = false;
+
+    {
+        std::shared_ptr<Async_Device> device = std::make_shared<Async_Device>(ioc, "127.0.0.1", closed_port());
+        device->async_ping([&completed](bool success) {
+            completed.push_back(success ? "ping succeeded" : "ping");
+        });
+        device->async_get(3, [&completed, &value](bool success, double result) {
+            completed.push_back(success ? "get succeeded" : "get");
+            value = result;
+        });
+        device->async_retrieve([&completed, &frame_empty](bool success, const cv::Mat &frame, const Frame_Info &) {
+            completed.push_back(success ? "retrieve succeeded" : "retrieve");
+            frame_empty = frame.empty();
+        });
+    }
+
+    // the pending operations keep the device alive once the application dropped it
+    ioc.run();
+
+    ASSERT_EQ(completed.size(), 3u) << "Every handler is called, even if the connection fails";
+    EXPECT_EQ(completed[0], "ping");
+    EXPECT_EQ(completed[1], "get") << "Handlers are called in call order";
+    EXPECT_EQ(completed[2], "retrieve");
+    EXPECT_EQ(value, -1.0);
+    EXPECT_TRUE(frame_empty);
+}
+
+TEST(Async_DeviceTest, FutureTest)
+{
+
+    net::io_context ioc;
+    std::shared_ptr<Async_Device> device = std::make_shared<Async_Device>(ioc, "127.0.0.1", closed_port());
+
+    std::future<bool> pong = device->async_ping();
+    std::future<cv::Mat> frame = device->async_retrieve();
+
+    // the futures are waited for by another thread than the one running the io_context
+    std::thread runner([&ioc]() {
+        ioc.run();
+    });
+    EXPECT_FALSE(pong.get());
+    EXPECT_TRUE(frame.get().empty());
+    runner.join();
+}
+
+TEST(Async_DeviceTest, LoopbackServerTest)
+{
+
+    Loopback_Server server;
+    net::io_context ioc;
+    std::vector<std::string> completed;
+    std::vector<cv::Mat> frames;
+    std::vector<int64_t> sequences;
+
+    {
+        std::shared_ptr<Async_Device> device = std::make_shared<Async_Device>(ioc, "127.0.0.1", server.get_port());
+        device->async_ping([&completed](bool success) {
+            completed.push_back(success ? "ping" : "ping failed");
+        });
+        for (int i = 0; i < 2; ++i) {
+            device->async_retrieve([&completed, &frames, &sequences](bool success, const cv::Mat &frame, const Frame_Info &info) {
+                completed.push_back(success ? "retrieve" : "retrieve failed");
+                frames.push_back(frame);
+                sequences.push_back(info.sequence);
+            });
+        }
+        device->close();
+    }
+
+    // the connection is closed once the operations are done, which lets run() return
+    ioc.run();
+
+    ASSERT_EQ(completed.size(), 3u);
+    EXPECT_EQ(completed[0], "ping");
+    EXPECT_EQ(completed[1], "retrieve");
+    EXPECT_EQ(completed[2], "retrieve");
+    ASSERT_EQ(frames.size(), 2u);
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(frames[i].size(), cv::Size(Loopback_Server::FRAME_COLS, Loopback_Server::FRAME_ROWS));
+        EXPECT_EQ(frames[i].at<uchar>(0, 0), i + 1) << "Each frame keeps its own buffer";
+        EXPECT_EQ(sequences[i], i + 1);
+    }
+    EXPECT_TRUE(server.wait_for_closed_connections(1, std::chrono::milliseconds(1000)));
+    EXPECT_EQ(server.get_grab_count(), 2);
+}
+
+TEST(Async_DeviceTest, LoopbackFutureTest)
+{
+
+    Loopback_Server server;
+    net::io_context ioc;
+    std::shared_ptr<Async_Device> device = std::make_shared<Async_Device>(ioc, "127.0.0.1", server.get_port());
+
+    std::future<bool> pong = device->async_ping();
+    std::future<cv::Mat> frame = device->async_retrieve();
+
+    std::thread runner([&ioc]() {
+        ioc.run();
+    });
+    EXPECT_TRUE(pong.get());
+    const cv::Mat mat = frame.get();
+    EXPECT_EQ(mat.size(), cv::Size(Loopback_Server::FRAME_COLS, Loopback_Server::FRAME_ROWS));
+    runner.join();
+}
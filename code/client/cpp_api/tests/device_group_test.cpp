@@ -0,0 +1,81 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/client_api.hpp"
+#include "loopback_server.hpp"
+
+using rpiasgige::client::Device;
+using rpiasgige::client::Device_Group;
+using rpiasgige::client::Group_Frames;
+using rpiasgige::client::test::Loopback_Server;
+using rpiasgige::client::test::closed_port;
+
+TEST(Device_GroupTest, EmptyGroupTest)
+{
+
+    Device_Group group;
+    Group_Frames frames;
+    EXPECT_FALSE(group.grab(frames)) << "An empty group grabs nothing";
+    EXPECT_EQ(group.size(), 0);
+    EXPECT_TRUE(frames.frames.empty());
+}
+
+TEST(Device_GroupTest, UnreachableDevicesTest)
+{
+
+    const unsigned short port = closed_port();
+    Device first("127.0.0.1", port);
+    Device second("127.0.0.1", port);
+    first.set_connection_pool_size(0);
+    second.set_connection_pool_size(0);
+
+    Device_Group group;
+    EXPECT_EQ(group.add(first), 0);
+    EXPECT_EQ(group.add(second), 1);
+    ASSERT_EQ(group.size(), 2);
+
+    // the worker of each device serves every grab
+    for (int round = 0; round < 3; ++round) {
+        Group_Frames frames;
+        EXPECT_FALSE(group.grab(frames)) << "round " << round;
+        ASSERT_EQ(frames.success.size(), 2u);
+        ASSERT_EQ(frames.frames.size(), 2u);
+        for (int i = 0; i < 2; ++i) {
+            EXPECT_FALSE(frames.success[i]);
+            EXPECT_TRUE(frames.frames[i].empty());
+        }
+        EXPECT_EQ(frames.skew, 0) << "Failed devices are not part of the skew";
+    }
+}
+
+TEST(Device_GroupTest, GrabTest)
+{
+
+    Loopback_Server first_server;
+    Loopback_Server second_server;
+    Device first("127.0.0.1", first_server.get_port());
+    Device second("127.0.0.1", second_server.get_port());
+    first.set_connection_pool_size(0);
+    second.set_connection_pool_size(0);
+
+    Device_Group group;
+    EXPECT_EQ(group.add(first), 0);
+    EXPECT_EQ(group.add(second), 1);
+
+    for (int round = 1; round <= 3; ++round) {
+        Group_Frames frames;
+        ASSERT_TRUE(group.grab(frames)) << "round " << round;
+        ASSERT_EQ(frames.frames.size(), 2u);
+        for (int i = 0; i < 2; ++i) {
+            EXPECT_TRUE(frames.success[i]);
+            ASSERT_EQ(frames.frames[i].size(), cv::Size(Loopback_Server::FRAME_COLS, Loopback_Server::FRAME_ROWS));
+            EXPECT_EQ(frames.frames[i].type(), CV_8UC1);
+            EXPECT_EQ(frames.frames[i].at<uchar>(0, 0), round) << "Each device gets the frame of its own server";
+            EXPECT_EQ(frames.infos[i].sequence, round);
+        }
+        EXPECT_GE(frames.skew, 0);
+        EXPECT_GE(frames.request_skew, 0);
+    }
+
+    EXPECT_EQ(first_server.get_grab_count(), 3);
+    EXPECT_EQ(second_server.get_grab_count(), 3);
+}
@@ -0,0 +1,53 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/client_api.hpp"
+#include "loopback_server.hpp"
+
+using rpiasgige::client::CODEC_PNG;
+using rpiasgige::client::Device;
+using rpiasgige::client::test::Loopback_Server;
+
+TEST(Device_StreamTest, CodecTest)
+{
+
+    Loopback_Server server;
+    Device device("127.0.0.1", server.get_port());
+    device.set_connection_pool_size(0);
+    ASSERT_TRUE(device.set_codec(CODEC_PNG));
+
+    std::mutex mutex;
+    std::vector<int> values;
+    bool well_formed = true;
+    ASSERT_TRUE(device.start_stream([&](const cv::Mat &frame) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (frame.size() != cv::Size(Loopback_Server::FRAME_COLS, Loopback_Server::FRAME_ROWS) || frame.type() != CV_8UC1 ||
+            cv::countNonZero(frame != frame.at<uchar>(0, 0)) != 0) {
+            well_formed = false;
+        } else {
+            values.push_back(frame.at<uchar>(0, 0));
+        }
+    }));
+
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (std::chrono::steady_clock::now() < deadline) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (values.size() >= 3 || !well_formed) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(device.stop_stream());
+
+    EXPECT_TRUE(well_formed) << "The codec metadata must not be read as pixels";
+    ASSERT_GE(values.size(), 3u);
+    for (size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(values[i], static_cast<int>(i) + 1) << "The pixels of each push are the number of the frame";
+    }
+
+    // the connection serves requests again
+    cv::Mat frame;
+    ASSERT_TRUE(device.retrieve(frame));
+    EXPECT_EQ(frame.at<uchar>(0, 0), server.get_grab_count());
+}
@@ -0,0 +1,48 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/client_api.hpp"
+#include "loopback_server.hpp"
+
+using rpiasgige::client::Device;
+using rpiasgige::client::TimeoutException;
+using rpiasgige::client::test::Loopback_Server;
+
+namespace
+{
+    long elapsed_milliseconds(const std::chrono::steady_clock::time_point &begin)
+    {
+        return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count());
+    }
+}
+
+TEST(Device_TimeoutTest, SilentServerTest)
+{
+
+    Loopback_Server server(Loopback_Server::SILENT);
+    Device device("127.0.0.1", server.get_port());
+    device.set_connection_pool_size(0);
+    device.set_raw_tcp(true);
+    device.set_read_timeout(1);
+
+    // the request is sent but its response never comes
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    EXPECT_FALSE(device.ping(true));
+    long elapsed = elapsed_milliseconds(begin);
+    EXPECT_GE(elapsed, 900);
+    EXPECT_LT(elapsed, 3000);
+    EXPECT_TRUE(server.wait_for_closed_connections(1, std::chrono::milliseconds(1000))) << "A late response would be taken for the next one";
+
+    int request_id = -1;
+    ASSERT_TRUE(device.send_retrieve(request_id));
+    EXPECT_EQ(device.get_pending_retrieves(), 1);
+
+    cv::Mat frame;
+    begin = std::chrono::steady_clock::now();
+    EXPECT_THROW(device.receive_retrieve(frame, request_id), TimeoutException);
+    elapsed = elapsed_milliseconds(begin);
+    EXPECT_GE(elapsed, 900);
+    EXPECT_LT(elapsed, 3000);
+    EXPECT_TRUE(frame.empty());
+    EXPECT_EQ(device.get_pending_retrieves(), 0) << "The pending responses are lost with the connection";
+    EXPECT_TRUE(server.wait_for_closed_connections(2, std::chrono::milliseconds(1000)));
+}
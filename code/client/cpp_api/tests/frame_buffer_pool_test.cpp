@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/client_api.hpp"
+
+using rpiasgige::client::Frame_Buffer_Pool;
+using rpiasgige::client::Packet;
+using rpiasgige::client::HEADER_SIZE;
+using rpiasgige::client::IMAGE_META_DATA_SIZE;
+
+namespace
+{
+    /**
+     * tells when the pool deletes itself
+     **/
+    class Watched_Pool : public Frame_Buffer_Pool
+    {
+    public:
+        Watched_Pool(const int buffer_size, bool &_deleted) : Frame_Buffer_Pool(buffer_size), deleted(_deleted) {}
+
+        virtual ~Watched_Pool()
+        {
+            this->deleted = true;
+        }
+
+    private:
+        bool &deleted;
+    };
+}
+
+TEST(Frame_Buffer_PoolTest, ReuseAfterReleaseTest)
+{
+
+    Frame_Buffer_Pool *pool = new Frame_Buffer_Pool(64);
+
+    char *first = pool->acquire();
+    cv::Mat frame = pool->wrap(first, first, 4, 4, CV_8UC1);
+    cv::Mat copy = frame;
+    frame.release();
+
+    char *second = pool->acquire();
+    EXPECT_NE(second, first) << "A copy of the frame still uses its buffer";
+
+    copy.release();
+    char *third = pool->acquire();
+    EXPECT_EQ(third, first) << "The buffer of a released frame is reused";
+    EXPECT_EQ(pool->get_allocation_count(), 2);
+
+    pool->release(second);
+    pool->release(third);
+    pool->detach();
+}
+
+TEST(Frame_Buffer_PoolTest, FrameOutlivesOwnerTest)
+{
+
+    bool deleted = false;
+    Frame_Buffer_Pool *pool = new Watched_Pool(64, deleted);
+
+    char *buffer = pool->acquire();
+    memset(buffer, 42, 16);
+    cv::Mat frame = pool->wrap(buffer, buffer, 4, 4, CV_8UC1);
+
+    // as ~Device does
+    pool->detach();
+    EXPECT_FALSE(deleted) << "The frame keeps the pool alive";
+    EXPECT_EQ(frame.data[15], 42);
+
+    cv::Mat copy = frame;
+    frame.release();
+    EXPECT_FALSE(deleted);
+
+    copy.release();
+    EXPECT_TRUE(deleted) << "The pool is deleted with its last frame";
+
+    bool idle_deleted = false;
+    Frame_Buffer_Pool *idle = new Watched_Pool(64, idle_deleted);
+    idle->release(idle->acquire());
+    idle->detach();
+    EXPECT_TRUE(idle_deleted) << "A pool without frames is deleted right away";
+}
+
+TEST(Frame_Buffer_PoolTest, TakeFrameTest)
+{
+
+    bool deleted = false;
+    Frame_Buffer_Pool *pool = new Watched_Pool(HEADER_SIZE + IMAGE_META_DATA_SIZE + 16, deleted);
+    char *response_buffer = pool->acquire();
+
+    cv::Mat dest;
+    for (int i = 0; i < 4; ++i) {
+        // a GRAB response of a 4x4 frame, read into the response buffer
+        const int meta_data[3] = {4, 4, CV_8UC1};
+        memcpy(response_buffer + HEADER_SIZE, meta_data, sizeof(meta_data));
+        memset(response_buffer + HEADER_SIZE + IMAGE_META_DATA_SIZE, i, 16);
+        Packet response(response_buffer, false, IMAGE_META_DATA_SIZE + 16, response_buffer + HEADER_SIZE);
+
+        char *previous_buffer = response_buffer;
+        ASSERT_TRUE(rpiasgige::client::take_frame(response, 0, false, nullptr, nullptr, *pool, response_buffer, dest));
+        EXPECT_EQ(dest.data, reinterpret_cast<unsigned char *>(previous_buffer + HEADER_SIZE + IMAGE_META_DATA_SIZE)) << "The frame is not copied";
+        EXPECT_NE(response_buffer, previous_buffer) << "The next response is read into another buffer";
+        EXPECT_EQ(dest.data[0], i);
+    }
+    EXPECT_EQ(pool->get_allocation_count(), 2) << "The buffer of the previous frame is reused once dest is reassigned";
+
+    pool->release(response_buffer);
+    pool->detach();
+    EXPECT_FALSE(deleted);
+    dest.release();
+    EXPECT_TRUE(deleted);
+}
@@ -0,0 +1,302 @@
+#ifndef RPIASGIGE_TESTS_LOOPBACK_SERVER_HPP
+#define RPIASGIGE_TESTS_LOOPBACK_SERVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "rpiasgige/client_api.hpp"
+
+namespace rpiasgige
+{
+    namespace client
+    {
+        namespace test
+        {
+
+            /**
+             * a local port nobody listens on: connections to it are refused right away
+             **/
+            inline unsigned short closed_port()
+            {
+                net::io_context ioc;
+                tcp::acceptor acceptor(ioc, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0));
+                const unsigned short result = acceptor.local_endpoint().port();
+                acceptor.close();
+                return result;
+            }
+
+            /**
+             * A stand-in for the server on a local port, serving one connection at a time from a thread of its own.
+             *
+             * By default, it accepts websocket connections, answers PING with PONG and GRAB with a FRAME_ROWS x FRAME_COLS
+             * CV_8UC1 frame whose pixels and Frame_Info::sequence are the number of the grab, starting at 1.
+             * The request id and the frame info are sent when the request asks for them. CODC is accepted for any codec: 
+             * the frames of the connection are then sent as a single PNG stripe. After STRM, frames are pushed as FRAM 
+             * messages until the next request, such as STOP. Other requests get 0404.
+             *
+             * A SILENT server accepts plain TCP connections and reads the requests without ever replying.
+             **/
+            class Loopback_Server
+            {
+            public:
+                enum Mode
+                {
+                    WEBSOCKET,
+                    SILENT
+                };
+
+                static const int FRAME_ROWS = 4;
+                static const int FRAME_COLS = 6;
+
+                explicit Loopback_Server(Mode _mode = WEBSOCKET) :
+                    mode(_mode), acceptor(ioc, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0))
+                {
+                    this->port = this->acceptor.local_endpoint().port();
+                    this->worker = std::thread(&Loopback_Server::run, this);
+                }
+
+                virtual ~Loopback_Server()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(this->mutex);
+                        this->stopping = true;
+                        // unblocks the accept or the read the thread is waiting for
+                        ::shutdown(this->acceptor.native_handle(), SHUT_RDWR);
+                        if (this->client_handle >= 0)
+                        {
+                            ::shutdown(this->client_handle, SHUT_RDWR);
+                        }
+                    }
+                    this->worker.join();
+                }
+
+                unsigned short get_port() const
+                {
+                    return this->port;
+                }
+
+                int get_grab_count() const
+                {
+                    return this->grab_count;
+                }
+
+                /**
+                 * number of connections closed by the client so far
+                 **/
+                int get_closed_connections() const
+                {
+                    return this->closed_connections;
+                }
+
+                /**
+                 * waits up to timeout for the client to have closed count connections
+                 **/
+                bool wait_for_closed_connections(const int count, const std::chrono::milliseconds &timeout) const
+                {
+                    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+                    while (this->closed_connections < count && std::chrono::steady_clock::now() < deadline)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                    return this->closed_connections >= count;
+                }
+
+            private:
+                const Mode mode;
+                net::io_context ioc;
+                tcp::acceptor acceptor;
+                unsigned short port = 0;
+                std::thread worker;
+
+                std::mutex mutex;
+                bool stopping = false;
+                int client_handle = -1;
+
+                std::atomic<int> grab_count{0};
+                std::atomic<int> closed_connections{0};
+
+                // settings of the connection being served
+                int codec = CODEC_NONE;
+                bool streaming = false;
+
+                void run()
+                {
+                    while (true)
+                    {
+                        tcp::socket socket(this->ioc);
+                        beast::error_code ec;
+                        this->acceptor.accept(socket, ec);
+                        {
+                            std::lock_guard<std::mutex> lock(this->mutex);
+                            if (ec || this->stopping)
+                            {
+                                break;
+                            }
+                            this->client_handle = socket.native_handle();
+                        }
+
+                        if (this->mode == SILENT)
+                        {
+                            this->drain(socket);
+                        }
+                        else
+                        {
+                            this->serve(socket);
+                        }
+
+                        std::lock_guard<std::mutex> lock(this->mutex);
+                        this->client_handle = -1;
+                        if (this->stopping)
+                        {
+                            break;
+                        }
+                        this->closed_connections++;
+                    }
+                }
+
+                void drain(tcp::socket &socket)
+                {
+                    char data[256];
+                    beast::error_code ec;
+                    while (!ec)
+                    {
+                        socket.read_some(net::buffer(data), ec);
+                    }
+                }
+
+                void serve(tcp::socket &socket)
+                {
+                    websocket::stream<tcp::socket &> ws(socket);
+                    beast::error_code ec;
+                    ws.accept(ec);
+                    ws.binary(true);
+
+                    this->codec = CODEC_NONE;
+                    this->streaming = false;
+
+                    beast::flat_buffer request;
+                    std::vector<char> response;
+                    while (!ec)
+                    {
+                        // the client sends nothing else than STOP while streaming
+                        while (this->streaming && !ec && socket.available(ec) == 0)
+                        {
+                            this->push(response);
+                            ws.write(net::buffer(response), ec);
+                            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                        }
+                        if (ec)
+                        {
+                            break;
+                        }
+                        request.consume(request.size());
+                        ws.read(request, ec);
+                        if (!ec)
+                        {
+                            this->respond(static_cast<const char *>(request.data().data()), static_cast<int>(request.size()), response);
+                            ws.write(net::buffer(response), ec);
+                        }
+                    }
+                }
+
+                void respond(const char *request, const int request_size, std::vector<char> &response)
+                {
+                    response.assign(HEADER_SIZE, 0);
+                    response[KEEP_ALIVE_ADDRESS] = '1';
+                    if (request_size >= HEADER_SIZE && strncmp(request + STATUS_ADDRESS, "PING", STATUS_SIZE) == 0)
+                    {
+                        memcpy(response.data() + STATUS_ADDRESS, "PONG", STATUS_SIZE);
+                    }
+                    else if (request_size >= HEADER_SIZE && strncmp(request + STATUS_ADDRESS, "GRAB", STATUS_SIZE) == 0)
+                    {
+                        memcpy(response.data() + STATUS_ADDRESS, "0200", STATUS_SIZE);
+                        this->append_frame(request + HEADER_SIZE, request_size - HEADER_SIZE, response);
+                    }
+                    else if (request_size >= HEADER_SIZE + static_cast<int>(sizeof(int)) && strncmp(request + STATUS_ADDRESS, "CODC", STATUS_SIZE) == 0)
+                    {
+                        memcpy(&this->codec, request + HEADER_SIZE, sizeof(int));
+                        memcpy(response.data() + STATUS_ADDRESS, "0200", STATUS_SIZE);
+                    }
+                    else if (request_size >= HEADER_SIZE && (strncmp(request + STATUS_ADDRESS, "STRM", STATUS_SIZE) == 0 ||
+                                                             strncmp(request + STATUS_ADDRESS, "STOP", STATUS_SIZE) == 0))
+                    {
+                        this->streaming = strncmp(request + STATUS_ADDRESS, "STRM", STATUS_SIZE) == 0;
+                        memcpy(response.data() + STATUS_ADDRESS, "0200", STATUS_SIZE);
+                    }
+                    else
+                    {
+                        memcpy(response.data() + STATUS_ADDRESS, "0404", STATUS_SIZE);
+                    }
+                    set_data_size(response);
+                }
+
+                /**
+                 * a pushed frame has the layout of a GRAB response without options
+                 **/
+                void push(std::vector<char> &response)
+                {
+                    response.assign(HEADER_SIZE, 0);
+                    response[KEEP_ALIVE_ADDRESS] = '1';
+                    memcpy(response.data() + STATUS_ADDRESS, "FRAM", STATUS_SIZE);
+                    this->append_frame(nullptr, 0, response);
+                    set_data_size(response);
+                }
+
+                void append_frame(const char *data, const int data_size, std::vector<char> &response)
+                {
+                    int flags = 0;
+                    if (data_size >= static_cast<int>(sizeof(flags)))
+                    {
+                        memcpy(&flags, data, sizeof(flags));
+                    }
+                    if ((flags & GRAB_REQUEST_ID) && data_size >= static_cast<int>(sizeof(flags)) + REQUEST_ID_SIZE)
+                    {
+                        append(response, data + sizeof(flags), REQUEST_ID_SIZE);
+                    }
+
+                    const int grab = ++this->grab_count;
+                    const int metadata[] = {FRAME_ROWS, FRAME_COLS, CV_8UC1};
+                    append(response, metadata, sizeof(metadata));
+                    if (flags & GRAB_FRAME_INFO)
+                    {
+                        const int64_t receive_time = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
+                        const int64_t info[] = {grab * 1000LL, grab, receive_time, 0};
+                        append(response, info, sizeof(info));
+                    }
+                    if (this->codec == CODEC_NONE)
+                    {
+                        response.insert(response.end(), FRAME_ROWS * FRAME_COLS, static_cast<char>(grab));
+                        return;
+                    }
+                    std::vector<uchar> stripe;
+                    cv::imencode(".png", cv::Mat(FRAME_ROWS, FRAME_COLS, CV_8UC1, cv::Scalar(grab)), stripe);
+                    const int codec_metadata[] = {CODEC_PNG, 1, FRAME_ROWS, static_cast<int>(stripe.size())};
+                    append(response, codec_metadata, sizeof(codec_metadata));
+                    append(response, stripe.data(), static_cast<int>(stripe.size()));
+                }
+
+                static void set_data_size(std::vector<char> &response)
+                {
+                    const int data_size = static_cast<int>(response.size()) - HEADER_SIZE;
+                    memcpy(response.data() + DATA_SIZE_ADDRESS, &data_size, sizeof(data_size));
+                }
+
+                static void append(std::vector<char> &response, const void *data, const int size)
+                {
+                    const char *bytes = static_cast<const char *>(data);
+                    response.insert(response.end(), bytes, bytes + size);
+                }
+            };
+
+        }
+    }
+}
+
+#endif
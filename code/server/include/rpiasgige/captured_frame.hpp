@@ -0,0 +1,74 @@
+#ifndef RPIASGIGE_CAPTURED_FRAME_HPP
+#define RPIASGIGE_CAPTURED_FRAME_HPP
+
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+
+namespace rpiasgige
+{
+
+    /**
+     * When and how a frame was captured. Times are in microseconds.
+     **/
+    struct Frame_Info
+    {
+        // buffer timestamp set by the driver. Most V4L2 drivers use CLOCK_MONOTONIC
+        int64_t device_timestamp = 0;
+
+        // frame counter of the driver. Gaps between consecutive grabs mean dropped frames
+        int64_t sequence = 0;
+
+        // system clock, since epoch, when the server received the frame. Comparable across hosts with synchronized clocks
+        int64_t receive_time = 0;
+
+        // time spent by the server serving the grab
+        int64_t grab_duration = 0;
+    };
+
+    /**
+     * A frame as read from the device.
+     * 
+     * Frames read through OpenCV are already decoded. Frames read through V4L2 hold the driver payload 
+     * as is (raw is true), along with the format needed to decode it.
+     **/
+    struct Captured_Frame
+    {
+        cv::Mat image;
+
+        bool raw = false;
+
+        // whether a raw payload must be converted to BGR before being served as an image
+        bool convert_rgb = true;
+
+        // V4L2 fourcc and layout of a raw payload
+        unsigned int pixel_format = 0;
+        int width = 0;
+        int height = 0;
+        int bytes_per_line = 0;
+
+        Frame_Info info;
+
+        bool empty() const {
+            return this->image.empty();
+        }
+
+        /**
+         * deep copy reusing the destination storage whenever possible
+         **/
+        void copy_to(Captured_Frame &dest) const
+        {
+            this->image.copyTo(dest.image);
+            dest.raw = this->raw;
+            dest.convert_rgb = this->convert_rgb;
+            dest.pixel_format = this->pixel_format;
+            dest.width = this->width;
+            dest.height = this->height;
+            dest.bytes_per_line = this->bytes_per_line;
+            dest.info = this->info;
+        }
+    };
+
+} // namespace rpiasgige
+
+#endif
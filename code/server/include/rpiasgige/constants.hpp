@@ -1,6 +1,8 @@
 #ifndef RPIASGIGE_CONSTANTS_HPP
 #define RPIASGIGE_CONSTANTS_HPP
 
+#include <cstdint>
+
 namespace rpiasgige
 {
     static const int STATUS_SIZE = 4;
@@ -11,6 +13,17 @@ namespace rpiasgige
     static const int KEEP_ALIVE_ADDRESS = 4;
     static const int HEADER_SIZE = STATUS_SIZE + KEEP_ALIVE_SIZE + DATA_SIZE;
     static const int IMAGE_META_DATA_SIZE = 3 * sizeof(int);
+    static const int COMPRESSED_META_DATA_SIZE = 4 * sizeof(int);
+    // device timestamp, sequence, receive time and grab duration, appended to the image metadata on request
+    static const int FRAME_INFO_SIZE = 4 * sizeof(int64_t);
+    // echoed before the metadata of pipelined GRAB responses
+    static const int REQUEST_ID_SIZE = sizeof(int);
+    // codec, number of stripes, rows per stripe and up to 16 stripe sizes, appended to the image metadata of compressed frames
+    static const int CODEC_META_DATA_SIZE = 19 * sizeof(int);
+    // frame id, id of the frame the delta is relative to, tile size and number of changed tiles, appended on GRAB_DELTA
+    static const int DELTA_META_DATA_SIZE = 4 * sizeof(int);
+    // header and small data only. Images are sent straight from their own storage
+    static const int RESPONSE_BUFFER_SIZE = 256;
 
 }
 
@@ -0,0 +1,162 @@
+#ifndef RPIASGIGE_FRAME_DELTA_HPP
+#define RPIASGIGE_FRAME_DELTA_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace rpiasgige
+{
+
+    /**
+     * Finds the tiles of a frame which changed since the previous frame sent on a connection.
+     *
+     * Only a hash of each tile of the previous frame is kept, not its pixels. Each frame gets an id, unique in the
+     * server, that the client sends back to acknowledge which frame it holds. A delta is sent only against the frame
+     * acknowledged, thus the client rebuilds the new frame by copying the changed tiles over it.
+     **/
+    class Frame_Delta
+    {
+    public:
+
+        static const int TILE_SIZE = 32;
+
+        /**
+         * Hashes the tiles of frame, which becomes the reference of the next call, and fills payload with a bitmap of
+         * the tiles changed since the reference followed by their pixels, row by row. The bitmap has a bit per tile,
+         * in raster order, padded to whole ints.
+         *
+         * Returns false, and payload is empty, when the whole frame must be sent instead: the client does not hold
+         * the reference (acknowledged_id), the frame changed size, type or source, or the delta is not smaller
+         **/
+        bool encode(const cv::Mat &frame, const void *source, const int acknowledged_id, std::vector<uchar> &payload)
+        {
+            const bool comparable = this->frame_id >= 0 && acknowledged_id == this->frame_id && source == this->source &&
+                                    frame.rows == this->rows && frame.cols == this->cols && frame.type() == this->type;
+
+            this->source = source;
+            this->rows = frame.rows;
+            this->cols = frame.cols;
+            this->type = frame.type();
+            this->reference_id = comparable ? this->frame_id : -1;
+            this->frame_id = next_frame_id();
+            this->changed_tiles = 0;
+
+            const int tile_cols = (frame.cols + TILE_SIZE - 1) / TILE_SIZE;
+            const int tile_rows = (frame.rows + TILE_SIZE - 1) / TILE_SIZE;
+            const int tile_count = tile_cols * tile_rows;
+            if (static_cast<int>(this->hashes.size()) != tile_count) {
+                this->hashes.assign(tile_count, 0);
+            }
+
+            const size_t frame_size = frame.total() * frame.elemSize();
+            payload.clear();
+            bool fits = comparable;
+            if (comparable) {
+                payload.assign(get_bitmap_size(tile_count), 0);
+            }
+
+            for (int tile_y = 0; tile_y < tile_rows; ++tile_y) {
+                for (int tile_x = 0; tile_x < tile_cols; ++tile_x) {
+                    const int index = tile_y * tile_cols + tile_x;
+                    const uint64_t hash = hash_tile(frame, tile_x * TILE_SIZE, tile_y * TILE_SIZE);
+                    if (fits && hash != this->hashes[index]) {
+                        payload[index / 8] |= static_cast<uchar>(1 << (index % 8));
+                        append_tile(frame, tile_x * TILE_SIZE, tile_y * TILE_SIZE, payload);
+                        this->changed_tiles++;
+                        // the frame is cheaper from here on, but the hashes must still be updated
+                        fits = payload.size() < frame_size;
+                    }
+                    this->hashes[index] = hash;
+                }
+            }
+
+            if (!fits) {
+                payload.clear();
+                this->reference_id = -1;
+                this->changed_tiles = 0;
+            }
+            return fits;
+        }
+
+        /**
+         * id of the last frame encoded
+         **/
+        int get_frame_id() const {
+            return this->frame_id;
+        }
+
+        /**
+         * id of the frame the last delta is relative to, or -1 if the whole frame must be sent
+         **/
+        int get_reference_id() const {
+            return this->reference_id;
+        }
+
+        int get_changed_tiles() const {
+            return this->changed_tiles;
+        }
+
+        static int get_bitmap_size(const int tile_count) {
+            return (tile_count + 31) / 32 * static_cast<int>(sizeof(int));
+        }
+
+    private:
+
+        static int next_frame_id() {
+            static std::atomic<int> counter{0};
+            return counter++ & 0x7fffffff;
+        }
+
+        /**
+         * FNV-1a over 64 bit words. Each step is a bijection, so a tile differing by a single word always
+         * hashes differently
+         **/
+        static uint64_t hash_tile(const cv::Mat &frame, const int x, const int y) {
+            const uint64_t prime = 1099511628211ULL;
+            uint64_t result = 14695981039346656037ULL;
+            const size_t pixel_size = frame.elemSize();
+            const int width = static_cast<int>(std::min(static_cast<int>(TILE_SIZE), frame.cols - x) * pixel_size);
+            const int last_row = std::min(y + TILE_SIZE, frame.rows);
+            for (int row = y; row < last_row; ++row) {
+                const uchar *data = frame.ptr(row) + x * pixel_size;
+                int i = 0;
+                for (; i + 8 <= width; i += 8) {
+                    uint64_t word;
+                    memcpy(&word, data + i, sizeof(word));
+                    result = (result ^ word) * prime;
+                }
+                for (; i < width; ++i) {
+                    result = (result ^ data[i]) * prime;
+                }
+            }
+            return result;
+        }
+
+        static void append_tile(const cv::Mat &frame, const int x, const int y, std::vector<uchar> &payload) {
+            const size_t pixel_size = frame.elemSize();
+            const size_t width = std::min(static_cast<int>(TILE_SIZE), frame.cols - x) * pixel_size;
+            const int last_row = std::min(y + TILE_SIZE, frame.rows);
+            for (int row = y; row < last_row; ++row) {
+                const uchar *data = frame.ptr(row) + x * pixel_size;
+                payload.insert(payload.end(), data, data + width);
+            }
+        }
+
+        const void *source = nullptr;
+        int rows = 0;
+        int cols = 0;
+        int type = -1;
+        int frame_id = -1;
+        int reference_id = -1;
+        int changed_tiles = 0;
+        std::vector<uint64_t> hashes;
+    };
+
+} // namespace rpiasgige
+
+#endif
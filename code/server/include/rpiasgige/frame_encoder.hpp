@@ -0,0 +1,238 @@
+#ifndef RPIASGIGE_FRAME_ENCODER_HPP
+#define RPIASGIGE_FRAME_ENCODER_HPP
+
+#include <cstring>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#ifdef RPIASGIGE_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#include "constants.hpp"
+#include "worker_pool.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * Compresses frames for the clients which negotiated a codec.
+     *
+     * A frame is split into horizontal stripes compressed in parallel by a Worker_Pool, each one as an
+     * independent image: a JPEG, a PNG or a LZ4 block of the raw rows. The client decodes the stripes one
+     * after the other into the rows of the frame. The buffers are kept across frames.
+     **/
+    class Frame_Encoder
+    {
+    public:
+
+        static const int NONE = 0;
+        // quality from 1 to 100. 8 bit frames with 1 or 3 channels only
+        static const int JPEG = 1;
+        // lossless. The quality is the zlib compression level, from 0 to 9. 8 and 16 bit frames with 1, 3 or 4 channels only
+        static const int PNG = 2;
+        // lossless and the fastest, for any frame. Only if the server was built with liblz4
+        static const int LZ4 = 3;
+
+        // the codec metadata of a frame has room for CODEC_META_DATA_SIZE / sizeof(int) - 3 stripes
+        static const int MAX_STRIPES = 16;
+
+        static bool is_supported(const int codec)
+        {
+#ifdef RPIASGIGE_WITH_LZ4
+            return codec >= NONE && codec <= LZ4;
+#else
+            return codec >= NONE && codec <= PNG;
+#endif
+        }
+
+        static bool is_valid_quality(const int codec, const int quality)
+        {
+            bool result = true;
+            if (codec == JPEG) {
+                result = quality >= 1 && quality <= 100;
+            } else if (codec == PNG) {
+                result = quality >= 0 && quality <= 9;
+            }
+            return result;
+        }
+
+        static int get_default_quality(const int codec)
+        {
+            int result = 0;
+            if (codec == JPEG) {
+                result = 90;
+            } else if (codec == PNG) {
+                // favors speed: higher levels are seldom worth their CPU time on frames
+                result = 1;
+            }
+            return result;
+        }
+
+        static bool can_encode(const int codec, const cv::Mat &frame)
+        {
+            bool result = false;
+            const int channels = frame.channels();
+            if (codec == JPEG) {
+                result = frame.depth() == CV_8U && (channels == 1 || channels == 3);
+            } else if (codec == PNG) {
+                result = (frame.depth() == CV_8U || frame.depth() == CV_16U) && channels != 2;
+            } else if (codec == LZ4) {
+                result = is_supported(LZ4);
+            }
+            return result;
+        }
+
+        /**
+         * Compresses frame into the payload, using the calling thread and the threads of pool.
+         * Returns false if the frame cannot be encoded with codec, or if the result is not smaller than the frame
+         **/
+        bool encode(const cv::Mat &frame, const int codec, const int quality, Worker_Pool &pool)
+        {
+            if (frame.empty() || !can_encode(codec, frame)) {
+                return false;
+            }
+
+            this->frame = frame;
+            this->codec = codec;
+            this->quality = quality;
+
+            // stripes of whole JPEG macroblocks, not too small to be worth a thread
+            const int min_stripe_rows = 64;
+            this->stripe_count = std::min(std::min(pool.get_thread_count() + 1, static_cast<int>(MAX_STRIPES)),
+                                          std::max(1, frame.rows / min_stripe_rows));
+            this->stripe_rows = (frame.rows + this->stripe_count - 1) / this->stripe_count;
+            this->stripe_rows = (this->stripe_rows + 15) / 16 * 16;
+            this->stripe_count = (frame.rows + this->stripe_rows - 1) / this->stripe_rows;
+
+            if (static_cast<int>(this->stripes.size()) < this->stripe_count) {
+                this->stripes.resize(this->stripe_count);
+                this->stripe_frames.resize(this->stripe_count);
+                this->encoded.resize(this->stripe_count);
+            }
+
+            pool.run(this->stripe_count, *this);
+
+            this->frame.release();
+
+            size_t payload_size = 0;
+            for (int i = 0; i < this->stripe_count; ++i) {
+                if (!this->encoded[i]) {
+                    return false;
+                }
+                payload_size += this->stripes[i].size();
+            }
+            if (payload_size >= frame.total() * frame.elemSize()) {
+                return false;
+            }
+
+            this->payload.resize(payload_size);
+            size_t offset = 0;
+            for (int i = 0; i < this->stripe_count; ++i) {
+                if (!this->stripes[i].empty()) {
+                    memcpy(this->payload.data() + offset, this->stripes[i].data(), this->stripes[i].size());
+                }
+                offset += this->stripes[i].size();
+            }
+            return true;
+        }
+
+        /**
+         * encodes the stripe index. Called by the pool threads
+         **/
+        void operator()(const int index)
+        {
+            const int first_row = index * this->stripe_rows;
+            const int last_row = std::min(this->frame.rows, first_row + this->stripe_rows);
+            const cv::Mat stripe = this->frame.rowRange(first_row, last_row);
+            std::vector<uchar> &buffer = this->stripes[index];
+
+            bool result = false;
+            try {
+                if (this->codec == JPEG) {
+                    const int jpeg_params[] = {cv::IMWRITE_JPEG_QUALITY, this->quality};
+                    result = cv::imencode(".jpg", stripe, buffer, std::vector<int>(jpeg_params, jpeg_params + 2));
+                } else if (this->codec == PNG) {
+                    const int png_params[] = {cv::IMWRITE_PNG_COMPRESSION, this->quality};
+                    result = cv::imencode(".png", stripe, buffer, std::vector<int>(png_params, png_params + 2));
+                } else if (this->codec == LZ4) {
+                    result = this->compress_lz4(stripe, index, buffer);
+                }
+            } catch (const cv::Exception &) {
+                result = false;
+            }
+            this->encoded[index] = result;
+        }
+
+        int get_codec() const
+        {
+            return this->codec;
+        }
+
+        int get_stripe_count() const
+        {
+            return this->stripe_count;
+        }
+
+        /**
+         * rows of each stripe but the last one, which may be shorter
+         **/
+        int get_stripe_rows() const
+        {
+            return this->stripe_rows;
+        }
+
+        int get_stripe_size(const int index) const
+        {
+            return static_cast<int>(this->stripes[index].size());
+        }
+
+        /**
+         * the stripes, one after the other
+         **/
+        const std::vector<uchar> &get_payload() const
+        {
+            return this->payload;
+        }
+
+    private:
+
+        bool compress_lz4(const cv::Mat &stripe, const int index, std::vector<uchar> &buffer)
+        {
+#ifdef RPIASGIGE_WITH_LZ4
+            const cv::Mat *source = &stripe;
+            if (!stripe.isContinuous()) {
+                stripe.copyTo(this->stripe_frames[index]);
+                source = &this->stripe_frames[index];
+            }
+            const int source_size = static_cast<int>(source->total() * source->elemSize());
+            buffer.resize(LZ4_compressBound(source_size));
+            const int size = LZ4_compress_default(reinterpret_cast<const char *>(source->data), reinterpret_cast<char *>(buffer.data()),
+                                                  source_size, static_cast<int>(buffer.size()));
+            buffer.resize(size > 0 ? size : 0);
+            return size > 0;
+#else
+            (void)stripe;
+            (void)index;
+            (void)buffer;
+            return false;
+#endif
+        }
+
+        cv::Mat frame;
+        int codec = NONE;
+        int quality = 0;
+        int stripe_count = 0;
+        int stripe_rows = 0;
+
+        std::vector<std::vector<uchar>> stripes;
+        // continuous copies of the stripes, when the frame is not
+        std::vector<cv::Mat> stripe_frames;
+        std::vector<char> encoded;
+        std::vector<uchar> payload;
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef RPIASGIGE_FRAME_REGION_HPP
+#define RPIASGIGE_FRAME_REGION_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#include <opencv2/opencv.hpp>
+
+namespace rpiasgige
+{
+
+    /**
+     * Part of a frame requested by a client: a rectangle, a decimation factor and a channel.
+     * The defaults select the whole frame.
+     **/
+    struct Frame_Region
+    {
+        // an empty rectangle selects the whole frame. Rectangles crossing the right or bottom border are clipped
+        cv::Rect roi;
+        // one pixel out of decimation is kept in each direction
+        int decimation = 1;
+        static const int MAX_DECIMATION = 1024;
+        // averages each decimation x decimation block instead of keeping its top-left pixel. 8 and 16 bit depths only
+        bool binning = false;
+        static const int MAX_BINNING = 16;
+        // the single channel kept, -1 keeps all of them
+        int channel = -1;
+
+        bool is_whole_frame() const {
+            return this->roi.area() == 0 && this->decimation == 1 && this->channel < 0;
+        }
+
+        /**
+         * Selects the region of frame. A band of whole rows is not copied: result points into frame.
+         * Otherwise the pixels are copied in a single pass into buffer, whose memory is reused across calls,
+         * and result points to buffer. Returns false if the region doesn't fit into frame.
+         *
+         * CV_8UC2 frames are YUYV, whose pairs of pixels share their chroma: the column and width of the rectangle are
+         * rounded down to even values, and decimation or channel selection, which would break the pairs, is refused
+         **/
+        bool select(const cv::Mat &frame, cv::Mat &buffer, cv::Mat &result) const
+        {
+            cv::Rect area(0, 0, frame.cols, frame.rows);
+            if (this->roi.area() > 0) {
+                area = this->roi & area;
+            }
+            if (frame.type() == CV_8UC2) {
+                if (this->decimation != 1 || this->channel >= 0) {
+                    return false;
+                }
+                area.x -= area.x % 2;
+                area.width -= area.width % 2;
+            }
+            const int channels = frame.channels();
+            if (area.area() == 0 || this->decimation < 1 || this->decimation > MAX_DECIMATION || this->channel >= channels) {
+                return false;
+            }
+
+            if (this->decimation == 1 && this->channel < 0 && area.width == frame.cols && frame.isContinuous()) {
+                result = frame.rowRange(area.y, area.y + area.height);
+                return true;
+            }
+
+            const int first_channel = this->channel < 0 ? 0 : this->channel;
+            const int selected_channels = this->channel < 0 ? channels : 1;
+            const int type = CV_MAKETYPE(frame.depth(), selected_channels);
+
+            if (this->binning && this->decimation > 1) {
+                const int rows = area.height / this->decimation;
+                const int cols = area.width / this->decimation;
+                if (rows == 0 || cols == 0 || this->decimation > MAX_BINNING) {
+                    return false;
+                }
+                if (frame.depth() == CV_8U) {
+                    buffer.create(rows, cols, type);
+                    bin<uint8_t>(frame, area, first_channel, selected_channels, buffer);
+                } else if (frame.depth() == CV_16U) {
+                    buffer.create(rows, cols, type);
+                    bin<uint16_t>(frame, area, first_channel, selected_channels, buffer);
+                } else {
+                    return false;
+                }
+            } else {
+                const int rows = (area.height + this->decimation - 1) / this->decimation;
+                const int cols = (area.width + this->decimation - 1) / this->decimation;
+                buffer.create(rows, cols, type);
+                this->skip(frame, area, first_channel, selected_channels, buffer);
+            }
+
+            result = buffer;
+            return true;
+        }
+
+    private:
+
+        void skip(const cv::Mat &frame, const cv::Rect &area, const int first_channel, const int selected_channels, cv::Mat &dest) const
+        {
+            const size_t pixel_size = frame.elemSize();
+            const size_t selected_size = selected_channels * frame.elemSize1();
+            const size_t channel_offset = first_channel * frame.elemSize1();
+            for (int r = 0; r < dest.rows; ++r) {
+                const uint8_t *src = frame.ptr(area.y + r * this->decimation) + area.x * pixel_size + channel_offset;
+                uint8_t *dst = dest.ptr(r);
+                if (this->decimation == 1 && selected_size == pixel_size) {
+                    memcpy(dst, src, dest.cols * pixel_size);
+                } else {
+                    const size_t src_step = this->decimation * pixel_size;
+                    for (int c = 0; c < dest.cols; ++c, src += src_step, dst += selected_size) {
+                        memcpy(dst, src, selected_size);
+                    }
+                }
+            }
+        }
+
+        template <typename T>
+        void bin(const cv::Mat &frame, const cv::Rect &area, const int first_channel, const int selected_channels, cv::Mat &dest) const
+        {
+            const int channels = frame.channels();
+            const int factor = this->decimation;
+            const uint32_t block_size = factor * factor;
+            for (int r = 0; r < dest.rows; ++r) {
+                T *dst = dest.ptr<T>(r);
+                for (int c = 0; c < dest.cols; ++c) {
+                    const int first_col = (area.x + c * factor) * channels + first_channel;
+                    for (int k = 0; k < selected_channels; ++k) {
+                        uint32_t sum = 0;
+                        for (int i = 0; i < factor; ++i) {
+                            const T *src = frame.ptr<T>(area.y + r * factor + i) + first_col + k;
+                            for (int j = 0; j < factor; ++j) {
+                                sum += src[j * channels];
+                            }
+                        }
+                        *dst++ = static_cast<T>((sum + block_size / 2) / block_size);
+                    }
+                }
+            }
+        }
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef RPIASGIGE_FRAME_RING_HPP
+#define RPIASGIGE_FRAME_RING_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "captured_frame.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * Which frame of a Frame_Ring a grab asks for. Times are Frame_Info::receive_time, in microseconds since epoch
+     **/
+    struct Frame_Query
+    {
+        // the frame whose Frame_Info::sequence is value
+        static const int BY_SEQUENCE = 0;
+        // the frame received the closest to value
+        static const int NEAREST_TIME = 1;
+        // the first frame received at or after value
+        static const int FIRST_AFTER_TIME = 2;
+
+        int mode = BY_SEQUENCE;
+        int64_t value = 0;
+
+        bool is_valid() const {
+            return this->mode >= BY_SEQUENCE && this->mode <= FIRST_AFTER_TIME;
+        }
+    };
+
+    /**
+     * The last frames captured, kept so that a client can pick the frame matching an external event after the fact.
+     *
+     * A single writer, the capture thread, overwrites the oldest frame. The slots keep their storage across
+     * frames: once the ring is full, no memory is allocated as long as the frame size does not change.
+     * The writer copies a frame without holding the lock, into a slot that readers no longer see. Readers copy
+     * a frame without holding the lock either: they claim its slot and share its storage, which the writer then 
+     * replaces instead of overwriting it.
+     **/
+    class Frame_Ring
+    {
+    public:
+
+        /**
+         * number of frames kept. 0 disables the ring. Must be called before the capture starts
+         **/
+        void set_capacity(const int capacity)
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->slots.clear();
+            this->slots.resize(capacity > 0 ? capacity : 0);
+            this->readers.assign(this->slots.size(), 0);
+            this->next = 0;
+            this->count = 0;
+        }
+
+        int get_capacity() const
+        {
+            return static_cast<int>(this->slots.size());
+        }
+
+        /**
+         * copies frame over the oldest one
+         **/
+        void push(const Captured_Frame &frame)
+        {
+            const int capacity = this->get_capacity();
+            if (capacity == 0) {
+                return;
+            }
+            int index;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                index = this->next;
+                if (this->count == capacity) {
+                    // readers skip the oldest slot from now on
+                    this->count--;
+                }
+                // a reader still copying the frame of this slot keeps its storage
+                if (this->readers[index] > 0) {
+                    this->slots[index].image.release();
+                }
+            }
+            frame.copy_to(this->slots[index]);
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->next = (index + 1) % capacity;
+                this->count++;
+            }
+            this->frame_pushed.notify_all();
+        }
+
+        /**
+         * Waits up to timeout for a frame recent enough to answer query: its sequence or time must not be behind the
+         * query value. Returns false on timeout, when the frame asked for may not have been captured yet
+         **/
+        bool wait(const Frame_Query &query, const std::chrono::milliseconds &timeout)
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            return this->frame_pushed.wait_for(lock, timeout, [this, &query]() {
+                return this->get_capacity() == 0 || this->has_reached(query);
+            });
+        }
+
+        /**
+         * copies the frame answering query into dest. Returns false if no frame kept matches it
+         **/
+        bool find(const Frame_Query &query, Captured_Frame &dest)
+        {
+            // shares the storage of the slot found, so that the frame is copied without holding the lock
+            Captured_Frame frame;
+            int found;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                found = this->search(query);
+                if (found < 0) {
+                    return false;
+                }
+                this->readers[found]++;
+                frame = this->slots[found];
+            }
+            frame.copy_to(dest);
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->readers[found]--;
+                // the storage goes back to the slot unless the writer replaced it
+                frame.image.release();
+            }
+            return true;
+        }
+
+    private:
+
+        /**
+         * slot of the frame answering query, -1 if none. Requires the lock
+         **/
+        int search(const Frame_Query &query) const
+        {
+            int found = -1;
+            int64_t best_distance = INT64_MAX;
+            for (int i = 0; i < this->count && (found < 0 || query.mode == Frame_Query::NEAREST_TIME); ++i) {
+                // from the oldest to the newest
+                const int index = this->get_index(i);
+                const Frame_Info &info = this->slots[index].info;
+                if (query.mode == Frame_Query::BY_SEQUENCE) {
+                    if (info.sequence == query.value) {
+                        found = index;
+                    }
+                } else if (query.mode == Frame_Query::FIRST_AFTER_TIME) {
+                    if (info.receive_time >= query.value) {
+                        found = index;
+                    }
+                } else {
+                    const int64_t distance = info.receive_time > query.value ? info.receive_time - query.value : query.value - info.receive_time;
+                    if (distance < best_distance) {
+                        best_distance = distance;
+                        found = index;
+                    }
+                }
+            }
+            return found;
+        }
+
+        /**
+         * slot of the i-th oldest frame. Requires the lock
+         **/
+        int get_index(const int i) const
+        {
+            const int capacity = this->get_capacity();
+            return (this->next - this->count + i + capacity) % capacity;
+        }
+
+        /**
+         * whether the newest frame is at or past the query value. Requires the lock
+         **/
+        bool has_reached(const Frame_Query &query) const
+        {
+            if (this->count == 0) {
+                return false;
+            }
+            const Frame_Info &newest = this->slots[this->get_index(this->count - 1)].info;
+            return query.mode == Frame_Query::BY_SEQUENCE ? newest.sequence >= query.value : newest.receive_time >= query.value;
+        }
+
+        std::vector<Captured_Frame> slots;
+        // readers copying the frame of each slot
+        std::vector<int> readers;
+
+        std::mutex mutex;
+        std::condition_variable frame_pushed;
+        // slot written by the next push
+        int next = 0;
+        // frames readable, ending right before next
+        int count = 0;
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef RPIASGIGE_FRAME_SINK_HPP
+#define RPIASGIGE_FRAME_SINK_HPP
+
+#include <opencv2/opencv.hpp>
+
+#include "captured_frame.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * Receives every frame of a camera in continuous capture, decoded, e.g., to publish it on another transport.
+     * See USB_Interface::add_frame_sink
+     **/
+    class Frame_Sink
+    {
+    public:
+        virtual ~Frame_Sink() {}
+
+        /**
+         * Called from a single thread, one frame at a time. image is only valid during the call.
+         * Returns false if the frame was not published
+         **/
+        virtual bool publish(const cv::Mat &image, const Frame_Info &info) = 0;
+    };
+
+} // namespace rpiasgige
+
+#endif
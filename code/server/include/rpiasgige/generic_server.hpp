@@ -3,6 +3,13 @@
 
 #include <string.h>
 
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "rpiasgige/dumb_logger.hpp"
 
 #include "rpiasgige/constants.hpp"
@@ -10,6 +17,47 @@
 namespace rpiasgige
 {
 
+    /**
+     * State kept for each client connection, shared by all its responses.
+     **/
+    class Connection
+    {
+    public:
+        virtual ~Connection() {}
+
+        // set while the client is subscribed to frames pushed by the server
+        bool streaming = false;
+
+        // camera addressed by the requests when the server has more than one
+        int camera_id = 0;
+
+        // pixel format negotiated by a FRMT request. Frames are converted to it before being sent
+        int pixel_format = 0;
+
+        // codec and quality negotiated by a CODC request. Frames are compressed with it before being sent
+        int codec = 0;
+        int codec_quality = 0;
+    };
+
+    /**
+     * State kept for each response in flight.
+     * 
+     * Bulk data such as image pixels is not copied into the response buffer: prepare_response points 
+     * payload to it and the connection sends it right after the response buffer. 
+     * Thus, the payload memory must stay valid until the response is written, and a connection uses
+     * one Session per queued response.
+     **/
+    class Session
+    {
+    public:
+        virtual ~Session() {}
+
+        const char *payload = nullptr;
+        int payload_size = 0;
+
+        Connection *connection = nullptr;
+    };
+
     class Websocket_Server
     {
 
@@ -25,9 +73,65 @@ namespace rpiasgige
             return this->online;
         }
 
-        void process_client(const char* request_buffer, const int request_size, char * response_buffer, int &response_size) {
-            memset(response_buffer, 0, this->max_response_buffer_size);
-            prepare_response(request_buffer, request_size, response_buffer, response_size);
+        /**
+         * Fills response_buffer (at least RESPONSE_BUFFER_SIZE bytes) with the response header and small data.
+         * The response is completed by the session payload, if any.
+         **/
+        void process_client(const char* request_buffer, const int request_size, char * response_buffer, int &response_size, Session &session) {
+            memset(response_buffer, 0, HEADER_SIZE);
+            session.payload = nullptr;
+            session.payload_size = 0;
+            prepare_response(request_buffer, request_size, response_buffer, response_size, session);
+        }
+
+        /**
+         * Fills a message pushed to a streaming client. Returns false if there is nothing to push.
+         **/
+        bool process_push(char * response_buffer, int &response_size, Session &session) {
+            memset(response_buffer, 0, HEADER_SIZE);
+            session.payload = nullptr;
+            session.payload_size = 0;
+            response_size = HEADER_SIZE;
+            return prepare_push(response_buffer, response_size, session);
+        }
+
+        virtual Session *create_session() {
+            return new Session();
+        }
+
+        virtual Connection *create_connection() {
+            return new Connection();
+        }
+
+        /**
+         * listener is called, from any thread, whenever there is new data to push to connection
+         **/
+        virtual int subscribe(const Connection &connection, const std::function<void()> &listener) {
+            // subclasses may use it, e.g. to pick the camera of the connection
+            (void)connection;
+            std::lock_guard<std::mutex> lock(this->subscribers_mutex);
+            int id = this->next_subscriber_id++;
+            this->subscribers[id] = std::make_shared<std::function<void()>>(listener);
+            return id;
+        }
+
+        virtual void unsubscribe(int id) {
+            std::lock_guard<std::mutex> lock(this->subscribers_mutex);
+            this->subscribers.erase(id);
+        }
+
+        /**
+         * called whenever a buffer is allocated to serve a request
+         **/
+        void count_allocation() {
+            this->allocation_count++;
+        }
+
+        /**
+         * number of buffers allocated to serve requests so far. It stops growing once the server reaches steady state
+         **/
+        virtual long get_allocation_count() {
+            return this->allocation_count;
         }
 
         int get_max_response_buffer_size() {
@@ -40,16 +144,63 @@ namespace rpiasgige
 
         bool stop() {
             this->online = false;
+            if (this->stop_handler) {
+                this->stop_handler();
+            }
             return true;
         }
 
+        /**
+         * called by stop(), e.g., to close the network listener
+         **/
+        void set_stop_handler(const std::function<void()> &handler) {
+            this->stop_handler = handler;
+        }
+
     protected:
 
         const int max_response_buffer_size;
 
         const Logger logger;
 
-        virtual void prepare_response(const char * request_buffer, const int request_size, char * response_buffer, int &response_size) = 0;
+        virtual void prepare_response(const char * request_buffer, const int request_size, char * response_buffer, int &response_size, Session &session) = 0;
+
+        virtual bool prepare_push(char * response_buffer, int &response_size, Session &session) {
+            (void)response_buffer;
+            (void)response_size;
+            (void)session;
+            return false;
+        }
+
+        /**
+         * must be called from a single thread, such as the capture thread
+         **/
+        void notify_subscribers() {
+            // the listeners are shared, not copied, and the list keeps its capacity: no allocation per frame
+            this->notified_listeners.clear();
+            {
+                std::lock_guard<std::mutex> lock(this->subscribers_mutex);
+                for (auto it = this->subscribers.begin(); it != this->subscribers.end(); ++it) {
+                    this->notified_listeners.push_back(it->second);
+                }
+            }
+            // called outside the lock: a listener may end up unsubscribing
+            for (size_t i = 0; i < this->notified_listeners.size(); ++i) {
+                (*this->notified_listeners[i])();
+            }
+            this->notified_listeners.clear();
+        }
+
+        /**
+         * fills a STAT response: the allocation count as a 8-byte integer
+         **/
+        void set_allocation_count(char * response_buffer, int &response_size, long count) {
+            int64_t value = count;
+            this->set_buffer_value(response_buffer, HEADER_SIZE, sizeof(value), &value);
+            this->set_response_data_size(response_buffer, sizeof(value));
+            response_size = HEADER_SIZE + sizeof(value);
+            this->set_status(response_buffer, "0200");
+        }
 
         const std::string &get_identifier() const {
             return this->identifier;
@@ -58,7 +209,7 @@ namespace rpiasgige
         bool set_buffer_value(char * buffer, int from, int size, const void *data)
         {
             bool result = false;
-            if (from >= 0 && ((from + size) <= max_response_buffer_size))
+            if (from >= 0 && ((from + size) <= RESPONSE_BUFFER_SIZE))
             {
                 memcpy(buffer + from, data, size);
                 result = true;
@@ -66,6 +217,21 @@ namespace rpiasgige
             return result;
         }
 
+        /**
+         * sets the data sent after the first response_size bytes of the response buffer
+         **/
+        bool set_response_payload(Session &session, int response_size, const void *data, int size)
+        {
+            bool result = false;
+            if (size >= 0 && ((response_size + size) <= max_response_buffer_size))
+            {
+                session.payload = static_cast<const char *>(data);
+                session.payload_size = size;
+                result = true;
+            }
+            return result;
+        }
+
         inline void set_status(char * buffer, const char *status)
         {
             memcpy(buffer + rpiasgige::STATUS_ADDRESS, status, rpiasgige::STATUS_SIZE);
@@ -80,7 +246,16 @@ namespace rpiasgige
 
         std::string identifier;
 
-        bool online = false;
+        std::atomic<bool> online{false};
+
+        std::function<void()> stop_handler;
+
+        std::mutex subscribers_mutex;
+        std::map<int, std::shared_ptr<std::function<void()>>> subscribers;
+        std::vector<std::shared_ptr<std::function<void()>>> notified_listeners;
+
+        std::atomic<long> allocation_count{0};
+        int next_subscriber_id = 0;
 
     };
 
@@ -0,0 +1,877 @@
+#ifndef RPIASGIGE_GVCP_RESPONDER_HPP
+#define RPIASGIGE_GVCP_RESPONDER_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "dumb_logger.hpp"
+#include "gvsp_streamer.hpp"
+#include "usb_interface.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * Answers the GigE Vision control protocol (GVCP) for a camera, so that GigE Vision applications discover it,
+     * read its GenICam description and stream it through a GVSP_Streamer.
+     *
+     * It implements the bootstrap registers needed by a receiver: device identity, control channel privilege,
+     * heartbeat, timestamp and stream channel 0. The GenICam features map onto registers read and written
+     * through USB_Interface::get/set. There is no message channel, and the IP configuration is left to the host.
+     **/
+    class GVCP_Responder
+    {
+    public:
+
+        static const int DEFAULT_PORT = 3956;
+
+        static const int DISCOVERY_CMD = 0x0002;
+        static const int PACKETRESEND_CMD = 0x0040;
+        static const int READREG_CMD = 0x0080;
+        static const int WRITEREG_CMD = 0x0082;
+        static const int READMEM_CMD = 0x0084;
+
+        static const int STATUS_SUCCESS = 0x0000;
+        static const int STATUS_NOT_IMPLEMENTED = 0x8001;
+        static const int STATUS_INVALID_PARAMETER = 0x8002;
+        static const int STATUS_INVALID_ADDRESS = 0x8003;
+        static const int STATUS_WRITE_PROTECT = 0x8004;
+        static const int STATUS_BAD_ALIGNMENT = 0x8005;
+        static const int STATUS_ACCESS_DENIED = 0x8006;
+
+        static const int HEADER_SIZE = 8;
+        static const int DISCOVERY_ACK_SIZE = 248;
+        // largest READMEM, so that the acknowledge fits a 576 bytes datagram
+        static const int MAX_READMEM_SIZE = 536;
+
+        // bootstrap registers
+        static const uint32_t REGISTER_VERSION = 0x0000;
+        static const uint32_t REGISTER_DEVICE_MODE = 0x0004;
+        static const uint32_t REGISTER_MAC_HIGH = 0x0008;
+        static const uint32_t REGISTER_MAC_LOW = 0x000C;
+        static const uint32_t REGISTER_SUPPORTED_IP_CONFIGURATION = 0x0010;
+        static const uint32_t REGISTER_CURRENT_IP_CONFIGURATION = 0x0014;
+        static const uint32_t REGISTER_CURRENT_IP = 0x0024;
+        static const uint32_t REGISTER_CURRENT_SUBNET_MASK = 0x0034;
+        static const uint32_t REGISTER_CURRENT_GATEWAY = 0x0044;
+        static const uint32_t REGISTER_MANUFACTURER_NAME = 0x0048;
+        static const uint32_t REGISTER_MODEL_NAME = 0x0068;
+        static const uint32_t REGISTER_DEVICE_VERSION = 0x0088;
+        static const uint32_t REGISTER_MANUFACTURER_INFO = 0x00A8;
+        static const uint32_t REGISTER_SERIAL_NUMBER = 0x00D8;
+        static const uint32_t REGISTER_USER_DEFINED_NAME = 0x00E8;
+        static const uint32_t REGISTER_FIRST_URL = 0x0200;
+        static const uint32_t REGISTER_SECOND_URL = 0x0400;
+        static const uint32_t REGISTER_NETWORK_INTERFACES = 0x0600;
+        static const uint32_t REGISTER_MESSAGE_CHANNELS = 0x0900;
+        static const uint32_t REGISTER_STREAM_CHANNELS = 0x0904;
+        static const uint32_t REGISTER_GVCP_CAPABILITY = 0x0934;
+        static const uint32_t REGISTER_HEARTBEAT_TIMEOUT = 0x0938;
+        static const uint32_t REGISTER_TICK_FREQUENCY_HIGH = 0x093C;
+        static const uint32_t REGISTER_TICK_FREQUENCY_LOW = 0x0940;
+        static const uint32_t REGISTER_TIMESTAMP_CONTROL = 0x0944;
+        static const uint32_t REGISTER_TIMESTAMP_HIGH = 0x0948;
+        static const uint32_t REGISTER_TIMESTAMP_LOW = 0x094C;
+        static const uint32_t REGISTER_CCP = 0x0A00;
+        static const uint32_t REGISTER_SCP0 = 0x0D00;
+        static const uint32_t REGISTER_SCPS0 = 0x0D04;
+        static const uint32_t REGISTER_SCPD0 = 0x0D08;
+        static const uint32_t REGISTER_SCDA0 = 0x0D18;
+
+        // registers of the features described by the GenICam file
+        static const uint32_t REGISTER_WIDTH = 0xA000;
+        static const uint32_t REGISTER_HEIGHT = 0xA004;
+        static const uint32_t REGISTER_PIXEL_FORMAT = 0xA008;
+        static const uint32_t REGISTER_PAYLOAD_SIZE = 0xA00C;
+        static const uint32_t REGISTER_ACQUISITION_START = 0xA010;
+        static const uint32_t REGISTER_ACQUISITION_STOP = 0xA014;
+        static const uint32_t REGISTER_ACQUISITION_MODE = 0xA018;
+        static const uint32_t REGISTER_TL_PARAMS_LOCKED = 0xA01C;
+        // a 4-byte float for each cv::CAP_PROP_* id
+        static const uint32_t REGISTER_CAMERA_PROPERTIES = 0xB000;
+        static const int MAX_CAMERA_PROPERTY = 64;
+        // the GenICam file, read with READMEM
+        static const uint32_t XML_ADDRESS = 0x100000;
+
+        GVCP_Responder(USB_Interface &_camera, const std::shared_ptr<GVSP_Streamer> &_streamer, const std::string &_serial_number) :
+            camera(_camera), streamer(_streamer), serial_number(_serial_number), logger("GVCP_Responder")
+        {
+            this->xml = build_xml();
+            std::stringstream url;
+            url << "Local:rpiasgige.xml;" << std::hex << XML_ADDRESS << ";" << this->xml.size();
+            this->first_url = url.str();
+        }
+
+        virtual ~GVCP_Responder()
+        {
+            this->stop();
+            if (this->socket_fd >= 0) {
+                close(this->socket_fd);
+            }
+        }
+
+        /**
+         * Binds the control channel to address:port. address also selects the interface reported on discovery,
+         * the first one up other than the loopback if it is 0.0.0.0
+         **/
+        bool open(const std::string &address, const unsigned short port)
+        {
+            struct sockaddr_in local;
+            memset(&local, 0, sizeof(local));
+            local.sin_family = AF_INET;
+            local.sin_port = htons(port);
+            if (inet_pton(AF_INET, address.c_str(), &local.sin_addr) != 1) {
+                this->logger.warn_msg("Invalid control channel address " + address);
+                return false;
+            }
+            this->socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (this->socket_fd < 0) {
+                this->logger.warn_msg(std::string("socket: ") + strerror(errno));
+                return false;
+            }
+            // discovery acknowledges may be broadcast, for applications on another subnet
+            const int enabled = 1;
+            if (setsockopt(this->socket_fd, SOL_SOCKET, SO_BROADCAST, &enabled, sizeof(enabled)) != 0 ||
+                bind(this->socket_fd, reinterpret_cast<struct sockaddr *>(&local), sizeof(local)) != 0) {
+                this->logger.warn_msg("Failed to open the control channel on port " + std::to_string(port) + ": " + strerror(errno));
+                close(this->socket_fd);
+                this->socket_fd = -1;
+                return false;
+            }
+            this->find_interface(ntohl(local.sin_addr.s_addr));
+            return true;
+        }
+
+        bool start()
+        {
+            if (this->socket_fd < 0 || this->responder.joinable()) {
+                return false;
+            }
+            this->running = true;
+            this->responder = std::thread(&GVCP_Responder::run, this);
+            return true;
+        }
+
+        void stop()
+        {
+            this->running = false;
+            if (this->responder.joinable()) {
+                this->responder.join();
+            }
+        }
+
+        /**
+         * Handles a GVCP command received from sender. Returns the size of the acknowledge written to response,
+         * 0 if there is none. response must hold MAX_READMEM_SIZE + 12 bytes
+         **/
+        int handle(const char *request, const int request_size, const struct sockaddr_in &sender, char *response)
+        {
+            if (request_size < HEADER_SIZE || static_cast<unsigned char>(request[0]) != 0x42) {
+                return 0;
+            }
+            const int flags = static_cast<unsigned char>(request[1]);
+            const int command = get_u16(request + 2);
+            const int length = get_u16(request + 4);
+            const uint16_t request_id = get_u16(request + 6);
+            const char *data = request + HEADER_SIZE;
+            if (length > request_size - HEADER_SIZE) {
+                return 0;
+            }
+
+            const bool from_controller = this->is_controller(sender);
+            if (from_controller) {
+                // any command of the controlling application keeps its privilege
+                this->last_heartbeat = std::chrono::steady_clock::now();
+            }
+
+            int status = STATUS_SUCCESS;
+            int ack_length = 0;
+            char *ack = response + HEADER_SIZE;
+            switch (command) {
+                case DISCOVERY_CMD:
+                    this->fill_discovery(ack);
+                    ack_length = DISCOVERY_ACK_SIZE;
+                    break;
+                case READREG_CMD:
+                    if (length % 4 != 0 || length == 0 || length > MAX_READMEM_SIZE) {
+                        status = STATUS_INVALID_PARAMETER;
+                        break;
+                    }
+                    for (int i = 0; i < length && status == STATUS_SUCCESS; i += 4) {
+                        uint32_t value = 0;
+                        status = this->read_register(get_u32(data + i), value);
+                        if (status == STATUS_SUCCESS) {
+                            put_u32(ack + i, value);
+                            ack_length += 4;
+                        }
+                    }
+                    break;
+                case WRITEREG_CMD: {
+                    if (length % 8 != 0 || length == 0) {
+                        status = STATUS_INVALID_PARAMETER;
+                        break;
+                    }
+                    // the number of registers written before any failure
+                    int index = 0;
+                    for (int i = 0; i < length && status == STATUS_SUCCESS; i += 8) {
+                        status = this->write_register(get_u32(data + i), get_u32(data + i + 4), sender);
+                        if (status == STATUS_SUCCESS) {
+                            index++;
+                        }
+                    }
+                    put_u16(ack, 0);
+                    put_u16(ack + 2, static_cast<uint16_t>(index));
+                    ack_length = 4;
+                    break;
+                }
+                case READMEM_CMD: {
+                    const uint32_t address = length >= 8 ? get_u32(data) : 0;
+                    const int count = length >= 8 ? get_u16(data + 6) : 0;
+                    if (count == 0 || count % 4 != 0 || count > MAX_READMEM_SIZE) {
+                        status = STATUS_INVALID_PARAMETER;
+                    } else if (address % 4 != 0) {
+                        status = STATUS_BAD_ALIGNMENT;
+                    } else {
+                        status = this->read_memory(address, count, ack + 4);
+                    }
+                    if (status == STATUS_SUCCESS) {
+                        put_u32(ack, address);
+                        ack_length = 4 + count;
+                    }
+                    break;
+                }
+                case PACKETRESEND_CMD:
+                    // never acknowledged: the packets are the answer
+                    if (length >= 12 && from_controller) {
+                        this->streamer->resend(get_u16(data + 2), get_u32(data + 4) & 0xffffff, get_u32(data + 8) & 0xffffff);
+                    }
+                    return 0;
+                default:
+                    status = STATUS_NOT_IMPLEMENTED;
+                    break;
+            }
+
+            // flag bit 0: acknowledge required
+            if ((flags & 0x01) == 0) {
+                return 0;
+            }
+            put_u16(response, static_cast<uint16_t>(status));
+            put_u16(response + 2, static_cast<uint16_t>(command + 1));
+            put_u16(response + 4, static_cast<uint16_t>(ack_length));
+            put_u16(response + 6, request_id);
+            return HEADER_SIZE + ack_length;
+        }
+
+        const std::string &get_xml() const
+        {
+            return this->xml;
+        }
+
+    private:
+
+        // timeout of the control channel privilege, in milliseconds
+        static const uint32_t DEFAULT_HEARTBEAT_TIMEOUT = 3000;
+        static const uint32_t MIN_HEARTBEAT_TIMEOUT = 500;
+        // bits numbered from the most significant one. Bit 0 and 1: user-defined name and serial number, bit 29: PACKETRESEND_CMD
+        static const uint32_t GVCP_CAPABILITY = 0xC0000004;
+        static const int POLL_TIMEOUT_IN_MILLISECONDS = 100;
+
+        /**
+         * A GenICam float feature mapped onto a camera property
+         **/
+        struct Camera_Feature
+        {
+            const char *name;
+            int property;
+        };
+
+        static const Camera_Feature *get_camera_features(int &count)
+        {
+            static const Camera_Feature features[] = {
+                {"AcquisitionFrameRate", cv::CAP_PROP_FPS},
+                {"Brightness", cv::CAP_PROP_BRIGHTNESS},
+                {"Contrast", cv::CAP_PROP_CONTRAST},
+                {"Saturation", cv::CAP_PROP_SATURATION},
+                {"Hue", cv::CAP_PROP_HUE},
+                {"Gain", cv::CAP_PROP_GAIN},
+                {"Exposure", cv::CAP_PROP_EXPOSURE},
+                {"AutoExposure", cv::CAP_PROP_AUTO_EXPOSURE},
+                {"Sharpness", cv::CAP_PROP_SHARPNESS},
+                {"Gamma", cv::CAP_PROP_GAMMA},
+                {"Focus", cv::CAP_PROP_FOCUS},
+                {"AutoFocus", cv::CAP_PROP_AUTOFOCUS}
+            };
+            count = sizeof(features) / sizeof(features[0]);
+            return features;
+        }
+
+        /**
+         * A string of the bootstrap memory
+         **/
+        struct Bootstrap_String
+        {
+            uint32_t address;
+            uint32_t size;
+            const std::string *value;
+        };
+
+        USB_Interface &camera;
+        std::shared_ptr<GVSP_Streamer> streamer;
+        const std::string serial_number;
+        const std::string manufacturer_name = "improvess";
+        const std::string model_name = "rpiasgige";
+        const std::string device_version = "1.0";
+        const std::string manufacturer_info = "Raspberry Pi as GigE camera";
+        const std::string user_defined_name;
+        const std::string second_url;
+        std::string first_url;
+        std::string xml;
+        const Logger logger;
+
+        int socket_fd = -1;
+        std::thread responder;
+        std::atomic<bool> running{false};
+
+        uint32_t interface_address = 0;
+        uint32_t interface_mask = 0;
+        unsigned char mac[6] = {};
+
+        // the application holding the control channel privilege, if ccp is not 0
+        uint32_t ccp = 0;
+        struct sockaddr_in controller;
+        std::chrono::steady_clock::time_point last_heartbeat;
+        uint32_t heartbeat_timeout = DEFAULT_HEARTBEAT_TIMEOUT;
+        uint64_t latched_timestamp = 0;
+        uint32_t tl_params_locked = 0;
+
+        void run()
+        {
+            char request[1024];
+            char response[MAX_READMEM_SIZE + 64];
+            while (this->running) {
+                struct pollfd descriptor;
+                descriptor.fd = this->socket_fd;
+                descriptor.events = POLLIN;
+                descriptor.revents = 0;
+                if (poll(&descriptor, 1, POLL_TIMEOUT_IN_MILLISECONDS) > 0) {
+                    struct sockaddr_in sender;
+                    socklen_t sender_size = sizeof(sender);
+                    const int size = static_cast<int>(recvfrom(this->socket_fd, request, sizeof(request), 0, reinterpret_cast<struct sockaddr *>(&sender), &sender_size));
+                    if (size > 0) {
+                        const int response_size = this->handle(request, size, sender, response);
+                        // flag bit 4 of a discovery: the application may be on another subnet
+                        if (response_size > 0 && get_u16(request + 2) == DISCOVERY_CMD && (request[1] & 0x10) != 0) {
+                            sender.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+                        }
+                        if (response_size > 0) {
+                            sendto(this->socket_fd, response, response_size, 0, reinterpret_cast<struct sockaddr *>(&sender), sizeof(sender));
+                        }
+                    }
+                }
+                this->check_heartbeat();
+            }
+        }
+
+        /**
+         * the controlling application which missed its heartbeat loses the privilege, and the stream stops
+         **/
+        void check_heartbeat()
+        {
+            if (this->ccp != 0) {
+                const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - this->last_heartbeat).count();
+                if (elapsed > this->heartbeat_timeout) {
+                    this->logger.warn_msg("Control channel released: no heartbeat for " + std::to_string(elapsed) + " ms");
+                    this->release_control();
+                }
+            }
+        }
+
+        void release_control()
+        {
+            this->ccp = 0;
+            this->streamer->set_acquiring(false);
+            this->streamer->set_destination(0, 0);
+        }
+
+        bool is_controller(const struct sockaddr_in &sender) const
+        {
+            return this->ccp != 0 && sender.sin_addr.s_addr == this->controller.sin_addr.s_addr && sender.sin_port == this->controller.sin_port;
+        }
+
+        void fill_discovery(char *ack)
+        {
+            memset(ack, 0, DISCOVERY_ACK_SIZE);
+            // specification version 1.2
+            put_u16(ack, 1);
+            put_u16(ack + 2, 2);
+            put_u32(ack + 4, this->read_fixed_register(REGISTER_DEVICE_MODE));
+            put_u16(ack + 10, static_cast<uint16_t>(this->read_fixed_register(REGISTER_MAC_HIGH)));
+            put_u32(ack + 12, this->read_fixed_register(REGISTER_MAC_LOW));
+            put_u32(ack + 16, this->read_fixed_register(REGISTER_SUPPORTED_IP_CONFIGURATION));
+            put_u32(ack + 20, this->read_fixed_register(REGISTER_CURRENT_IP_CONFIGURATION));
+            put_u32(ack + 36, this->interface_address);
+            put_u32(ack + 52, this->interface_mask);
+            // the discovery acknowledge holds the strings of the bootstrap memory from the manufacturer name on
+            this->read_memory(REGISTER_MANUFACTURER_NAME, DISCOVERY_ACK_SIZE - 72, ack + 72);
+        }
+
+        /**
+         * registers which do not depend on the application
+         **/
+        uint32_t read_fixed_register(const uint32_t address) const
+        {
+            uint32_t value = 0;
+            switch (address) {
+                case REGISTER_VERSION:
+                    value = 0x00010002;
+                    break;
+                case REGISTER_DEVICE_MODE:
+                    // big-endian registers, transmitter device class
+                    value = 0x80000000;
+                    break;
+                case REGISTER_MAC_HIGH:
+                    value = (static_cast<uint32_t>(this->mac[0]) << 8) | this->mac[1];
+                    break;
+                case REGISTER_MAC_LOW:
+                    value = (static_cast<uint32_t>(this->mac[2]) << 24) | (static_cast<uint32_t>(this->mac[3]) << 16) | (static_cast<uint32_t>(this->mac[4]) << 8) | this->mac[5];
+                    break;
+                case REGISTER_SUPPORTED_IP_CONFIGURATION:
+                case REGISTER_CURRENT_IP_CONFIGURATION:
+                    // DHCP and link-local address, as configured by the host
+                    value = 0x00000006;
+                    break;
+            }
+            return value;
+        }
+
+        int read_register(const uint32_t address, uint32_t &value)
+        {
+            if (address % 4 != 0) {
+                return STATUS_BAD_ALIGNMENT;
+            }
+            int status = STATUS_SUCCESS;
+            switch (address) {
+                case REGISTER_VERSION:
+                case REGISTER_DEVICE_MODE:
+                case REGISTER_MAC_HIGH:
+                case REGISTER_MAC_LOW:
+                case REGISTER_SUPPORTED_IP_CONFIGURATION:
+                case REGISTER_CURRENT_IP_CONFIGURATION:
+                    value = this->read_fixed_register(address);
+                    break;
+                case REGISTER_CURRENT_IP:
+                    value = this->interface_address;
+                    break;
+                case REGISTER_CURRENT_SUBNET_MASK:
+                    value = this->interface_mask;
+                    break;
+                case REGISTER_CURRENT_GATEWAY:
+                case REGISTER_MESSAGE_CHANNELS:
+                case REGISTER_TICK_FREQUENCY_HIGH:
+                case REGISTER_ACQUISITION_START:
+                case REGISTER_ACQUISITION_STOP:
+                    value = 0;
+                    break;
+                case REGISTER_NETWORK_INTERFACES:
+                case REGISTER_STREAM_CHANNELS:
+                    value = 1;
+                    break;
+                case REGISTER_GVCP_CAPABILITY:
+                    value = GVCP_CAPABILITY;
+                    break;
+                case REGISTER_HEARTBEAT_TIMEOUT:
+                    value = this->heartbeat_timeout;
+                    break;
+                case REGISTER_TICK_FREQUENCY_LOW:
+                    // timestamps are in microseconds, as the frame timestamps of the capture
+                    value = 1000000;
+                    break;
+                case REGISTER_TIMESTAMP_HIGH:
+                    value = static_cast<uint32_t>(this->latched_timestamp >> 32);
+                    break;
+                case REGISTER_TIMESTAMP_LOW:
+                    value = static_cast<uint32_t>(this->latched_timestamp);
+                    break;
+                case REGISTER_CCP:
+                    value = this->ccp;
+                    break;
+                case REGISTER_SCP0:
+                    value = this->streamer->get_destination_port();
+                    break;
+                case REGISTER_SCPS0:
+                    value = static_cast<uint32_t>(this->streamer->get_packet_size());
+                    break;
+                case REGISTER_SCPD0:
+                    value = this->streamer->get_packet_delay();
+                    break;
+                case REGISTER_SCDA0:
+                    value = this->streamer->get_destination_address();
+                    break;
+                case REGISTER_WIDTH:
+                    value = this->streamer->get_width() > 0 ? this->streamer->get_width() : static_cast<uint32_t>(this->camera.get(cv::CAP_PROP_FRAME_WIDTH));
+                    break;
+                case REGISTER_HEIGHT:
+                    value = this->streamer->get_height() > 0 ? this->streamer->get_height() : static_cast<uint32_t>(this->camera.get(cv::CAP_PROP_FRAME_HEIGHT));
+                    break;
+                case REGISTER_PIXEL_FORMAT:
+                    // frames are decoded to BGR unless the capture says otherwise
+                    value = this->streamer->get_pixel_format() != 0 ? this->streamer->get_pixel_format() : static_cast<uint32_t>(GVSP_Streamer::PIXEL_FORMAT_BGR8);
+                    break;
+                case REGISTER_PAYLOAD_SIZE: {
+                    uint32_t width = 0;
+                    uint32_t height = 0;
+                    this->read_register(REGISTER_WIDTH, width);
+                    this->read_register(REGISTER_HEIGHT, height);
+                    value = this->streamer->get_payload_size() > 0 ? this->streamer->get_payload_size() : width * height * 3;
+                    break;
+                }
+                case REGISTER_ACQUISITION_MODE:
+                    // continuous
+                    value = 0;
+                    break;
+                case REGISTER_TL_PARAMS_LOCKED:
+                    value = this->tl_params_locked;
+                    break;
+                default:
+                    if (address >= REGISTER_CAMERA_PROPERTIES && address < REGISTER_CAMERA_PROPERTIES + 4 * MAX_CAMERA_PROPERTY) {
+                        const float property = static_cast<float>(this->camera.get(static_cast<int>(address - REGISTER_CAMERA_PROPERTIES) / 4));
+                        memcpy(&value, &property, sizeof(value));
+                    } else {
+                        status = STATUS_INVALID_ADDRESS;
+                    }
+                    break;
+            }
+            return status;
+        }
+
+        int write_register(const uint32_t address, const uint32_t value, const struct sockaddr_in &sender)
+        {
+            if (address % 4 != 0) {
+                return STATUS_BAD_ALIGNMENT;
+            }
+            if (address == REGISTER_CCP) {
+                if (this->ccp != 0 && !this->is_controller(sender)) {
+                    return STATUS_ACCESS_DENIED;
+                }
+                if (value == 0) {
+                    this->release_control();
+                } else {
+                    this->ccp = value;
+                    this->controller = sender;
+                    this->last_heartbeat = std::chrono::steady_clock::now();
+                }
+                return STATUS_SUCCESS;
+            }
+            // everything else takes the privilege, exclusive or not
+            if (!this->is_controller(sender)) {
+                return STATUS_ACCESS_DENIED;
+            }
+
+            int status = STATUS_SUCCESS;
+            switch (address) {
+                case REGISTER_HEARTBEAT_TIMEOUT:
+                    this->heartbeat_timeout = std::max(value, static_cast<uint32_t>(MIN_HEARTBEAT_TIMEOUT));
+                    break;
+                case REGISTER_TIMESTAMP_CONTROL:
+                    // bit 30: latch. Resetting (bit 31) is not supported: the timestamps come from the system clock
+                    if (value & 0x2) {
+                        this->latched_timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+                    }
+                    break;
+                case REGISTER_SCP0:
+                    this->streamer->set_destination(this->streamer->get_destination_address(), static_cast<uint16_t>(value & 0xffff));
+                    break;
+                case REGISTER_SCPS0:
+                    if (!this->streamer->set_packet_size(static_cast<int>(value & 0xffff))) {
+                        status = STATUS_INVALID_PARAMETER;
+                    }
+                    break;
+                case REGISTER_SCPD0:
+                    this->streamer->set_packet_delay(value);
+                    break;
+                case REGISTER_SCDA0:
+                    this->streamer->set_destination(value, this->streamer->get_destination_port());
+                    break;
+                case REGISTER_WIDTH:
+                    if (!this->camera.set(cv::CAP_PROP_FRAME_WIDTH, value)) {
+                        status = STATUS_INVALID_PARAMETER;
+                    }
+                    break;
+                case REGISTER_HEIGHT:
+                    if (!this->camera.set(cv::CAP_PROP_FRAME_HEIGHT, value)) {
+                        status = STATUS_INVALID_PARAMETER;
+                    }
+                    break;
+                case REGISTER_ACQUISITION_START:
+                    this->streamer->set_acquiring(true);
+                    break;
+                case REGISTER_ACQUISITION_STOP:
+                    this->streamer->set_acquiring(false);
+                    break;
+                case REGISTER_TL_PARAMS_LOCKED:
+                    this->tl_params_locked = value;
+                    break;
+                default:
+                    if (address >= REGISTER_CAMERA_PROPERTIES && address < REGISTER_CAMERA_PROPERTIES + 4 * MAX_CAMERA_PROPERTY) {
+                        float property;
+                        memcpy(&property, &value, sizeof(property));
+                        if (!this->camera.set(static_cast<int>(address - REGISTER_CAMERA_PROPERTIES) / 4, property)) {
+                            status = STATUS_INVALID_PARAMETER;
+                        }
+                    } else {
+                        uint32_t current;
+                        status = this->read_register(address, current) == STATUS_SUCCESS ? STATUS_WRITE_PROTECT : STATUS_INVALID_ADDRESS;
+                    }
+                    break;
+            }
+            return status;
+        }
+
+        /**
+         * Reads count bytes from address: strings, the GenICam file or registers. address and count are multiples of 4
+         **/
+        int read_memory(const uint32_t address, const int count, char *dest)
+        {
+            const Bootstrap_String strings[] = {
+                {REGISTER_MANUFACTURER_NAME, 32, &this->manufacturer_name},
+                {REGISTER_MODEL_NAME, 32, &this->model_name},
+                {REGISTER_DEVICE_VERSION, 32, &this->device_version},
+                {REGISTER_MANUFACTURER_INFO, 48, &this->manufacturer_info},
+                {REGISTER_SERIAL_NUMBER, 16, &this->serial_number},
+                {REGISTER_USER_DEFINED_NAME, 16, &this->user_defined_name},
+                {REGISTER_FIRST_URL, 512, &this->first_url},
+                {REGISTER_SECOND_URL, 512, &this->second_url}
+            };
+            const int string_count = sizeof(strings) / sizeof(strings[0]);
+
+            for (int i = 0; i < count; i += 4) {
+                const uint32_t word = address + i;
+                bool found = false;
+                for (int s = 0; s < string_count && !found; ++s) {
+                    if (word >= strings[s].address && word < strings[s].address + strings[s].size) {
+                        // zero terminated, the last byte is always 0
+                        for (int b = 0; b < 4; ++b) {
+                            const size_t offset = word - strings[s].address + b;
+                            const bool in_string = offset < strings[s].value->size() && offset + 1 < strings[s].size;
+                            dest[i + b] = in_string ? (*strings[s].value)[offset] : 0;
+                        }
+                        found = true;
+                    }
+                }
+                if (!found && word >= XML_ADDRESS && word < XML_ADDRESS + this->xml.size() + 4) {
+                    for (int b = 0; b < 4; ++b) {
+                        const size_t offset = word - XML_ADDRESS + b;
+                        dest[i + b] = offset < this->xml.size() ? this->xml[offset] : 0;
+                    }
+                    found = true;
+                }
+                if (!found) {
+                    uint32_t value;
+                    const int status = this->read_register(word, value);
+                    if (status != STATUS_SUCCESS) {
+                        return status;
+                    }
+                    put_u32(dest + i, value);
+                }
+            }
+            return STATUS_SUCCESS;
+        }
+
+        /**
+         * finds the address, mask and MAC of the interface with the given address, or of the first one up
+         **/
+        void find_interface(const uint32_t address)
+        {
+            struct ifaddrs *interfaces = nullptr;
+            if (getifaddrs(&interfaces) != 0) {
+                return;
+            }
+            for (struct ifaddrs *it = interfaces; it != nullptr; it = it->ifa_next) {
+                if (it->ifa_addr == nullptr || it->ifa_addr->sa_family != AF_INET || (it->ifa_flags & IFF_UP) == 0) {
+                    continue;
+                }
+                const uint32_t candidate = ntohl(reinterpret_cast<struct sockaddr_in *>(it->ifa_addr)->sin_addr.s_addr);
+                const bool match = address != INADDR_ANY ? candidate == address : (it->ifa_flags & IFF_LOOPBACK) == 0;
+                if (!match) {
+                    continue;
+                }
+                this->interface_address = candidate;
+                if (it->ifa_netmask != nullptr) {
+                    this->interface_mask = ntohl(reinterpret_cast<struct sockaddr_in *>(it->ifa_netmask)->sin_addr.s_addr);
+                }
+                struct ifreq request;
+                memset(&request, 0, sizeof(request));
+                strncpy(request.ifr_name, it->ifa_name, IFNAMSIZ - 1);
+                if (ioctl(this->socket_fd, SIOCGIFHWADDR, &request) == 0) {
+                    memcpy(this->mac, request.ifr_hwaddr.sa_data, sizeof(this->mac));
+                }
+                break;
+            }
+            freeifaddrs(interfaces);
+        }
+
+        static std::string int_reg(const std::string &name, const uint32_t address, const std::string &access, const int length = 4)
+        {
+            std::stringstream result;
+            result << "  <IntReg Name=\"" << name << "\">\n"
+                   << "    <Address>0x" << std::hex << address << std::dec << "</Address>\n"
+                   << "    <Length>" << length << "</Length>\n"
+                   << "    <AccessMode>" << access << "</AccessMode>\n"
+                   << "    <pPort>Device</pPort>\n"
+                   << "    <Sign>Unsigned</Sign>\n"
+                   << "    <Endianess>BigEndian</Endianess>\n"
+                   << "  </IntReg>\n";
+            return result.str();
+        }
+
+        static std::string masked_int_reg(const std::string &name, const uint32_t address, const std::string &access, const int lsb, const int msb)
+        {
+            std::stringstream result;
+            result << "  <MaskedIntReg Name=\"" << name << "\">\n"
+                   << "    <Address>0x" << std::hex << address << std::dec << "</Address>\n"
+                   << "    <Length>4</Length>\n"
+                   << "    <AccessMode>" << access << "</AccessMode>\n"
+                   << "    <pPort>Device</pPort>\n"
+                   << "    <LSB>" << lsb << "</LSB>\n"
+                   << "    <MSB>" << msb << "</MSB>\n"
+                   << "    <Sign>Unsigned</Sign>\n"
+                   << "    <Endianess>BigEndian</Endianess>\n"
+                   << "  </MaskedIntReg>\n";
+            return result.str();
+        }
+
+        static std::string string_reg(const std::string &name, const uint32_t address, const int length)
+        {
+            std::stringstream result;
+            result << "  <StringReg Name=\"" << name << "\">\n"
+                   << "    <Address>0x" << std::hex << address << std::dec << "</Address>\n"
+                   << "    <Length>" << length << "</Length>\n"
+                   << "    <AccessMode>RO</AccessMode>\n"
+                   << "    <pPort>Device</pPort>\n"
+                   << "  </StringReg>\n";
+            return result.str();
+        }
+
+        static std::string command(const std::string &name, const std::string &register_name)
+        {
+            return "  <Command Name=\"" + name + "\">\n"
+                   "    <pValue>" + register_name + "</pValue>\n"
+                   "    <CommandValue>1</CommandValue>\n"
+                   "  </Command>\n";
+        }
+
+        static std::string category(const std::string &name, const std::vector<std::string> &features)
+        {
+            std::string result = "  <Category Name=\"" + name + "\">\n";
+            for (size_t i = 0; i < features.size(); ++i) {
+                result += "    <pFeature>" + features[i] + "</pFeature>\n";
+            }
+            return result + "  </Category>\n";
+        }
+
+        /**
+         * the GenICam description of the registers above
+         **/
+        static std::string build_xml()
+        {
+            int feature_count;
+            const Camera_Feature *features = get_camera_features(feature_count);
+
+            std::vector<std::string> camera_features;
+            std::string camera_registers;
+            for (int i = 0; i < feature_count; ++i) {
+                std::stringstream feature;
+                feature << "  <FloatReg Name=\"" << features[i].name << "\">\n"
+                        << "    <ToolTip>cv::VideoCapture property " << features[i].property << ", in the units of the camera driver</ToolTip>\n"
+                        << "    <Address>0x" << std::hex << REGISTER_CAMERA_PROPERTIES + 4 * features[i].property << std::dec << "</Address>\n"
+                        << "    <Length>4</Length>\n"
+                        << "    <AccessMode>RW</AccessMode>\n"
+                        << "    <pPort>Device</pPort>\n"
+                        << "    <Endianess>BigEndian</Endianess>\n"
+                        << "  </FloatReg>\n";
+                camera_registers += feature.str();
+                camera_features.push_back(features[i].name);
+            }
+
+            std::stringstream pixel_format;
+            pixel_format << "  <Enumeration Name=\"PixelFormat\">\n"
+                         << "    <EnumEntry Name=\"Mono8\"><Value>" << GVSP_Streamer::PIXEL_FORMAT_MONO8 << "</Value></EnumEntry>\n"
+                         << "    <EnumEntry Name=\"Mono16\"><Value>" << GVSP_Streamer::PIXEL_FORMAT_MONO16 << "</Value></EnumEntry>\n"
+                         << "    <EnumEntry Name=\"YUV422_8\"><Value>" << GVSP_Streamer::PIXEL_FORMAT_YUV422_8 << "</Value></EnumEntry>\n"
+                         << "    <EnumEntry Name=\"BGR8\"><Value>" << GVSP_Streamer::PIXEL_FORMAT_BGR8 << "</Value></EnumEntry>\n"
+                         << "    <pValue>PixelFormatReg</pValue>\n"
+                         << "  </Enumeration>\n";
+
+            std::string result =
+                "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                "<RegisterDescription ModelName=\"rpiasgige\" VendorName=\"improvess\" StandardNameSpace=\"None\" "
+                "SchemaMajorVersion=\"1\" SchemaMinorVersion=\"1\" SchemaSubMinorVersion=\"0\" "
+                "MajorVersion=\"1\" MinorVersion=\"0\" SubMinorVersion=\"0\" "
+                "ProductGuid=\"5c2e5b8e-6f0b-4c4a-9d38-7a1f3b2c9e01\" VersionGuid=\"5c2e5b8e-6f0b-4c4a-9d38-7a1f3b2c9e02\" "
+                "xmlns=\"http://www.genicam.org/GenApi/Version_1_1\">\n";
+            result += category("Root", {"DeviceControl", "ImageFormatControl", "AcquisitionControl", "TransportLayerControl"});
+            result += category("DeviceControl", {"DeviceVendorName", "DeviceModelName", "DeviceVersion", "DeviceID"});
+            result += category("ImageFormatControl", {"Width", "Height", "PixelFormat", "PayloadSize"});
+            std::vector<std::string> acquisition_features = {"AcquisitionMode", "AcquisitionStart", "AcquisitionStop"};
+            acquisition_features.insert(acquisition_features.end(), camera_features.begin(), camera_features.end());
+            result += category("AcquisitionControl", acquisition_features);
+            result += category("TransportLayerControl", {"GevSCPSPacketSize", "GevSCPD", "GevSCPHostPort", "GevSCDA", "GevHeartbeatTimeout", "GevTimestampTickFrequency", "TLParamsLocked"});
+
+            result += string_reg("DeviceVendorName", REGISTER_MANUFACTURER_NAME, 32);
+            result += string_reg("DeviceModelName", REGISTER_MODEL_NAME, 32);
+            result += string_reg("DeviceVersion", REGISTER_DEVICE_VERSION, 32);
+            result += string_reg("DeviceID", REGISTER_SERIAL_NUMBER, 16);
+
+            result += int_reg("Width", REGISTER_WIDTH, "RW");
+            result += int_reg("Height", REGISTER_HEIGHT, "RW");
+            result += pixel_format.str();
+            result += int_reg("PixelFormatReg", REGISTER_PIXEL_FORMAT, "RO");
+            result += int_reg("PayloadSize", REGISTER_PAYLOAD_SIZE, "RO");
+
+            result += "  <Enumeration Name=\"AcquisitionMode\">\n"
+                      "    <EnumEntry Name=\"Continuous\"><Value>0</Value></EnumEntry>\n"
+                      "    <pValue>AcquisitionModeReg</pValue>\n"
+                      "  </Enumeration>\n";
+            result += int_reg("AcquisitionModeReg", REGISTER_ACQUISITION_MODE, "RO");
+            result += command("AcquisitionStart", "AcquisitionStartReg");
+            result += int_reg("AcquisitionStartReg", REGISTER_ACQUISITION_START, "WO");
+            result += command("AcquisitionStop", "AcquisitionStopReg");
+            result += int_reg("AcquisitionStopReg", REGISTER_ACQUISITION_STOP, "WO");
+            result += camera_registers;
+
+            // bits are numbered from the most significant one in big-endian registers
+            result += masked_int_reg("GevSCPSPacketSize", REGISTER_SCPS0, "RW", 31, 16);
+            result += int_reg("GevSCPD", REGISTER_SCPD0, "RW");
+            result += masked_int_reg("GevSCPHostPort", REGISTER_SCP0, "RW", 31, 16);
+            result += int_reg("GevSCDA", REGISTER_SCDA0, "RW");
+            result += int_reg("GevHeartbeatTimeout", REGISTER_HEARTBEAT_TIMEOUT, "RW");
+            result += int_reg("GevTimestampTickFrequency", REGISTER_TICK_FREQUENCY_HIGH, "RO", 8);
+            result += int_reg("TLParamsLocked", REGISTER_TL_PARAMS_LOCKED, "RW");
+
+            result += "  <Port Name=\"Device\"/>\n"
+                      "</RegisterDescription>\n";
+            return result;
+        }
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,552 @@
+#ifndef RPIASGIGE_GVSP_STREAMER_HPP
+#define RPIASGIGE_GVSP_STREAMER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "captured_frame.hpp"
+#include "dumb_logger.hpp"
+#include "frame_sink.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * Big-endian fields of GigE Vision packets
+     **/
+    inline void put_u16(char *buffer, const uint16_t value)
+    {
+        buffer[0] = static_cast<char>(value >> 8);
+        buffer[1] = static_cast<char>(value);
+    }
+
+    inline void put_u32(char *buffer, const uint32_t value)
+    {
+        put_u16(buffer, static_cast<uint16_t>(value >> 16));
+        put_u16(buffer + 2, static_cast<uint16_t>(value));
+    }
+
+    inline uint16_t get_u16(const char *buffer)
+    {
+        return static_cast<uint16_t>((static_cast<unsigned char>(buffer[0]) << 8) | static_cast<unsigned char>(buffer[1]));
+    }
+
+    inline uint32_t get_u32(const char *buffer)
+    {
+        return (static_cast<uint32_t>(get_u16(buffer)) << 16) | get_u16(buffer + 2);
+    }
+
+    /**
+     * Streams the frames of a camera as GigE Vision stream protocol (GVSP) blocks: a leader packet, the pixels
+     * split into payload packets and a trailer packet, all sent to the stream channel destination set by
+     * the GVCP control channel.
+     *
+     * The last blocks are kept so that packets lost by the receiver can be sent again on a PACKETRESEND
+     * request. publish() only copies each frame into the oldest block: a sender thread sends the
+     * latest block, skipping the older ones when the network is slower than the camera.
+     **/
+    class GVSP_Streamer : public Frame_Sink
+    {
+    public:
+
+        // IP packet size, headers included: a standard Ethernet MTU
+        static const int DEFAULT_PACKET_SIZE = 1500;
+        static const int MIN_PACKET_SIZE = 576;
+        // jumbo frames
+        static const int MAX_PACKET_SIZE = 9000;
+        static const int DEFAULT_BLOCK_COUNT = 4;
+
+        static const int IP_UDP_HEADER_SIZE = 20 + 8;
+        static const int GVSP_HEADER_SIZE = 8;
+        static const int LEADER_SIZE = GVSP_HEADER_SIZE + 36;
+        static const int TRAILER_SIZE = GVSP_HEADER_SIZE + 8;
+
+        static const int FORMAT_LEADER = 1;
+        static const int FORMAT_TRAILER = 2;
+        static const int FORMAT_PAYLOAD = 3;
+        static const int PAYLOAD_TYPE_IMAGE = 0x0001;
+        static const int STATUS_PACKET_REMOVED_FROM_MEMORY = 0x8012;
+
+        // GenICam pixel format naming convention
+        static const uint32_t PIXEL_FORMAT_MONO8 = 0x01080001;
+        static const uint32_t PIXEL_FORMAT_MONO16 = 0x01100007;
+        static const uint32_t PIXEL_FORMAT_YUV422_8 = 0x02100032;
+        static const uint32_t PIXEL_FORMAT_BGR8 = 0x02180015;
+
+        GVSP_Streamer(const int _max_frame_size, const int block_count = DEFAULT_BLOCK_COUNT) :
+            max_frame_size(_max_frame_size), logger("GVSP_Streamer")
+        {
+            for (int i = 0; i < std::max(2, block_count); ++i) {
+                this->blocks.push_back(std::unique_ptr<Block>(new Block()));
+            }
+        }
+
+        virtual ~GVSP_Streamer()
+        {
+            this->close();
+        }
+
+        /**
+         * Opens the socket sending from source_address, any interface if empty, and starts the sender thread
+         **/
+        bool open(const std::string &source_address)
+        {
+            if (this->socket_fd >= 0) {
+                return true;
+            }
+            struct sockaddr_in source;
+            memset(&source, 0, sizeof(source));
+            source.sin_family = AF_INET;
+            source.sin_addr.s_addr = htonl(INADDR_ANY);
+            if (!source_address.empty() && inet_pton(AF_INET, source_address.c_str(), &source.sin_addr) != 1) {
+                this->logger.warn_msg("Invalid stream source address " + source_address);
+                return false;
+            }
+            this->socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (this->socket_fd < 0) {
+                this->logger.warn_msg(std::string("socket: ") + strerror(errno));
+                return false;
+            }
+            // receivers rebuild blocks from whole packets: an oversized packet fails instead of being fragmented
+            const int discovery = IP_PMTUDISC_DO;
+            const int send_buffer_size = 4 * 1024 * 1024;
+            if (bind(this->socket_fd, reinterpret_cast<struct sockaddr *>(&source), sizeof(source)) != 0 ||
+                setsockopt(this->socket_fd, IPPROTO_IP, IP_MTU_DISCOVER, &discovery, sizeof(discovery)) != 0 ||
+                setsockopt(this->socket_fd, SOL_SOCKET, SO_SNDBUF, &send_buffer_size, sizeof(send_buffer_size)) != 0) {
+                this->logger.warn_msg(std::string("Failed to open the stream channel: ") + strerror(errno));
+                ::close(this->socket_fd);
+                this->socket_fd = -1;
+                return false;
+            }
+            this->stopping = false;
+            this->sender = std::thread(&GVSP_Streamer::run, this);
+            return true;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->block_condition.notify_one();
+            if (this->sender.joinable()) {
+                this->sender.join();
+            }
+            if (this->socket_fd >= 0) {
+                ::close(this->socket_fd);
+                this->socket_fd = -1;
+            }
+        }
+
+        /**
+         * Where the blocks go: address and port in host byte order. Port 0 closes the stream channel
+         **/
+        void set_destination(const uint32_t address, const uint16_t port)
+        {
+            this->destination_address = address;
+            this->destination_port = port;
+        }
+
+        uint32_t get_destination_address() const
+        {
+            return this->destination_address;
+        }
+
+        uint16_t get_destination_port() const
+        {
+            return this->destination_port;
+        }
+
+        bool set_packet_size(const int size)
+        {
+            bool result = false;
+            if (size >= MIN_PACKET_SIZE && size <= MAX_PACKET_SIZE) {
+                this->packet_size = size;
+                result = true;
+            }
+            return result;
+        }
+
+        int get_packet_size() const
+        {
+            return this->packet_size;
+        }
+
+        /**
+         * Delay between packets in microseconds, the tick of the GVCP timestamps, for receivers unable to keep up with bursts
+         **/
+        void set_packet_delay(const uint32_t delay)
+        {
+            this->packet_delay = delay;
+        }
+
+        uint32_t get_packet_delay() const
+        {
+            return this->packet_delay;
+        }
+
+        /**
+         * Blocks are sent only while acquiring, from AcquisitionStart to AcquisitionStop
+         **/
+        void set_acquiring(const bool acquiring)
+        {
+            this->acquiring = acquiring;
+        }
+
+        bool is_acquiring() const
+        {
+            return this->acquiring;
+        }
+
+        /**
+         * geometry and format of the last frame published, 0 if none
+         **/
+        int get_width() const
+        {
+            return this->width;
+        }
+
+        int get_height() const
+        {
+            return this->height;
+        }
+
+        uint32_t get_pixel_format() const
+        {
+            return this->pixel_format;
+        }
+
+        int get_payload_size() const
+        {
+            return this->payload_size;
+        }
+
+        /**
+         * number of blocks sent so far
+         **/
+        long get_block_count() const
+        {
+            return this->block_count;
+        }
+
+        /**
+         * GenICam pixel format of an image type, 0 if there is none
+         **/
+        static uint32_t to_pixel_format(const int type)
+        {
+            uint32_t result = 0;
+            switch (type) {
+                case CV_8UC1:
+                    result = PIXEL_FORMAT_MONO8;
+                    break;
+                case CV_16UC1:
+                    result = PIXEL_FORMAT_MONO16;
+                    break;
+                case CV_8UC2:
+                    // the V4L2 backend serving YUYV frames without conversion
+                    result = PIXEL_FORMAT_YUV422_8;
+                    break;
+                case CV_8UC3:
+                    result = PIXEL_FORMAT_BGR8;
+                    break;
+            }
+            return result;
+        }
+
+        /**
+         * Copies image into the oldest block and wakes the sender. Must be called from a single thread.
+         * Returns false if the frame is not streamed: no receiver, unsupported or too large
+         **/
+        virtual bool publish(const cv::Mat &image, const Frame_Info &info)
+        {
+            const uint32_t format = to_pixel_format(image.type());
+            const size_t data_size = image.total() * image.elemSize();
+            if (data_size == 0) {
+                return false;
+            }
+            if (format == 0 || data_size > static_cast<size_t>(this->max_frame_size)) {
+                if (!this->unsupported_reported) {
+                    this->logger.warn_msg("Frames of type " + std::to_string(image.type()) + " and " + std::to_string(data_size) + " bytes are not streamed");
+                    this->unsupported_reported = true;
+                }
+                return false;
+            }
+            this->width = image.cols;
+            this->height = image.rows;
+            this->pixel_format = format;
+            this->payload_size = static_cast<int>(data_size);
+            if (this->socket_fd < 0 || !this->acquiring || this->destination_port == 0) {
+                return false;
+            }
+
+            const int index = (this->latest_index + 1) % static_cast<int>(this->blocks.size());
+            Block &block = *this->blocks[index];
+            // a block being resent is skipped rather than making the capture wait
+            std::unique_lock<std::mutex> block_lock(block.mutex, std::try_to_lock);
+            if (!block_lock.owns_lock()) {
+                return false;
+            }
+            block.data.resize(data_size);
+            if (image.isContinuous()) {
+                memcpy(block.data.data(), image.data, data_size);
+            } else {
+                const size_t row_size = image.cols * image.elemSize();
+                for (int i = 0; i < image.rows; ++i) {
+                    memcpy(block.data.data() + i * row_size, image.ptr(i), row_size);
+                }
+            }
+            // block id 0 is reserved
+            this->next_block_id = this->next_block_id == 0xffff ? 1 : this->next_block_id + 1;
+            block.block_id = static_cast<uint16_t>(this->next_block_id);
+            block.pixel_format = format;
+            block.width = image.cols;
+            block.height = image.rows;
+            block.timestamp = static_cast<uint64_t>(info.device_timestamp);
+            // resends use the packet layout the block was first sent with
+            block.chunk_size = this->packet_size - IP_UDP_HEADER_SIZE - GVSP_HEADER_SIZE;
+            block.payload_packet_count = static_cast<uint32_t>((data_size + block.chunk_size - 1) / block.chunk_size);
+            block_lock.unlock();
+
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->latest_index = index;
+                this->block_available = true;
+            }
+            this->block_condition.notify_one();
+            return true;
+        }
+
+        /**
+         * Sends again the packets first to last of the block block_id, if it is still kept. Called by the control channel
+         **/
+        bool resend(const uint16_t block_id, const uint32_t first_packet, const uint32_t last_packet)
+        {
+            if (this->socket_fd < 0 || this->destination_port == 0 || last_packet < first_packet) {
+                return false;
+            }
+            for (size_t i = 0; i < this->blocks.size(); ++i) {
+                Block &block = *this->blocks[i];
+                std::lock_guard<std::mutex> block_lock(block.mutex);
+                if (block.block_id == block_id && !block.data.empty()) {
+                    const uint32_t last = std::min(last_packet, block.payload_packet_count + 1);
+                    return first_packet <= last && this->send_packets(block, first_packet, last, this->resend_batch);
+                }
+            }
+            // gone: the receiver stops waiting for it
+            char packet[GVSP_HEADER_SIZE];
+            this->set_packet_header(packet, STATUS_PACKET_REMOVED_FROM_MEMORY, block_id, FORMAT_PAYLOAD, first_packet);
+            struct sockaddr_in destination = this->get_destination();
+            sendto(this->socket_fd, packet, sizeof(packet), 0, reinterpret_cast<struct sockaddr *>(&destination), sizeof(destination));
+            return false;
+        }
+
+    private:
+
+        // datagrams handed to the kernel by each sendmmsg
+        static const int BATCH_SIZE = 64;
+
+        struct Block
+        {
+            std::mutex mutex;
+            std::vector<char> data;
+            uint16_t block_id = 0;
+            uint32_t pixel_format = 0;
+            int width = 0;
+            int height = 0;
+            uint64_t timestamp = 0;
+            int chunk_size = 0;
+            uint32_t payload_packet_count = 0;
+        };
+
+        /**
+         * headers and vectors of the packets of a sendmmsg, one per sending thread
+         **/
+        struct Packet_Batch
+        {
+            std::vector<char> headers = std::vector<char>(BATCH_SIZE * LEADER_SIZE);
+            std::vector<struct iovec> parts = std::vector<struct iovec>(2 * BATCH_SIZE);
+            std::vector<struct mmsghdr> messages = std::vector<struct mmsghdr>(BATCH_SIZE);
+        };
+
+        const int max_frame_size;
+        const Logger logger;
+
+        int socket_fd = -1;
+        std::atomic<uint32_t> destination_address{0};
+        std::atomic<uint16_t> destination_port{0};
+        std::atomic<int> packet_size{DEFAULT_PACKET_SIZE};
+        std::atomic<uint32_t> packet_delay{0};
+        std::atomic<bool> acquiring{false};
+
+        std::atomic<int> width{0};
+        std::atomic<int> height{0};
+        std::atomic<uint32_t> pixel_format{0};
+        std::atomic<int> payload_size{0};
+        std::atomic<long> block_count{0};
+        bool unsupported_reported = false;
+        bool oversize_reported = false;
+
+        std::vector<std::unique_ptr<Block>> blocks;
+        int next_block_id = 0;
+
+        std::thread sender;
+        std::mutex mutex;
+        std::condition_variable block_condition;
+        int latest_index = -1;
+        bool block_available = false;
+        bool stopping = false;
+
+        Packet_Batch stream_batch;
+        Packet_Batch resend_batch;
+
+        void run()
+        {
+            while (true) {
+                int index;
+                {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    this->block_condition.wait(lock, [this]() {
+                        return this->block_available || this->stopping;
+                    });
+                    if (this->stopping) {
+                        break;
+                    }
+                    this->block_available = false;
+                    index = this->latest_index;
+                }
+                Block &block = *this->blocks[index];
+                std::lock_guard<std::mutex> block_lock(block.mutex);
+                if (this->send_packets(block, 0, block.payload_packet_count + 1, this->stream_batch)) {
+                    this->block_count++;
+                }
+            }
+        }
+
+        struct sockaddr_in get_destination() const
+        {
+            struct sockaddr_in destination;
+            memset(&destination, 0, sizeof(destination));
+            destination.sin_family = AF_INET;
+            destination.sin_addr.s_addr = htonl(this->destination_address);
+            destination.sin_port = htons(this->destination_port);
+            return destination;
+        }
+
+        static void set_packet_header(char *packet, const uint16_t status, const uint16_t block_id, const int format, const uint32_t packet_id)
+        {
+            put_u16(packet, status);
+            put_u16(packet + 2, block_id);
+            // the standard 24-bit packet id
+            put_u32(packet + 4, (static_cast<uint32_t>(format) << 24) | (packet_id & 0xffffff));
+        }
+
+        /**
+         * Sends the packets first to last of block: 0 is the leader, then come the payload packets and the trailer.
+         * Must be called holding the block mutex
+         **/
+        bool send_packets(const Block &block, const uint32_t first, const uint32_t last, Packet_Batch &batch)
+        {
+            struct sockaddr_in destination = this->get_destination();
+            if (destination.sin_port == 0) {
+                return false;
+            }
+            const uint32_t delay = this->packet_delay;
+            // throttled streams go one packet at a time
+            const uint32_t batch_limit = delay > 0 ? 1 : static_cast<uint32_t>(BATCH_SIZE);
+
+            uint32_t packet_id = first;
+            while (packet_id <= last) {
+                const uint32_t batch_size = std::min(batch_limit, last - packet_id + 1);
+                for (uint32_t i = 0; i < batch_size; ++i, ++packet_id) {
+                    char *header = &batch.headers[i * LEADER_SIZE];
+                    struct iovec *iov = &batch.parts[2 * i];
+                    int part_count = 1;
+                    iov[0].iov_base = header;
+                    if (packet_id == 0) {
+                        this->set_leader(header, block);
+                        iov[0].iov_len = LEADER_SIZE;
+                    } else if (packet_id > block.payload_packet_count) {
+                        set_packet_header(header, 0, block.block_id, FORMAT_TRAILER, packet_id);
+                        put_u16(header + 8, 0);
+                        put_u16(header + 10, PAYLOAD_TYPE_IMAGE);
+                        put_u32(header + 12, static_cast<uint32_t>(block.height));
+                        iov[0].iov_len = TRAILER_SIZE;
+                    } else {
+                        set_packet_header(header, 0, block.block_id, FORMAT_PAYLOAD, packet_id);
+                        iov[0].iov_len = GVSP_HEADER_SIZE;
+                        const size_t offset = static_cast<size_t>(packet_id - 1) * block.chunk_size;
+                        iov[1].iov_base = const_cast<char *>(block.data.data() + offset);
+                        iov[1].iov_len = std::min(static_cast<size_t>(block.chunk_size), block.data.size() - offset);
+                        part_count = 2;
+                    }
+                    struct mmsghdr &message = batch.messages[i];
+                    memset(&message, 0, sizeof(message));
+                    message.msg_hdr.msg_name = &destination;
+                    message.msg_hdr.msg_namelen = sizeof(destination);
+                    message.msg_hdr.msg_iov = iov;
+                    message.msg_hdr.msg_iovlen = part_count;
+                }
+
+                uint32_t sent = 0;
+                while (sent < batch_size) {
+                    const int result = sendmmsg(this->socket_fd, &batch.messages[sent], batch_size - sent, 0);
+                    if (result < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        if (errno == EMSGSIZE && !this->oversize_reported) {
+                            this->logger.warn_msg("Packets of " + std::to_string(this->packet_size) + " bytes exceed the MTU of the stream channel");
+                            this->oversize_reported = true;
+                        } else if (errno != EMSGSIZE) {
+                            this->logger.warn_msg(std::string("sendmmsg: ") + strerror(errno));
+                        }
+                        return false;
+                    }
+                    sent += result;
+                }
+                if (delay > 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(delay));
+                }
+            }
+            return true;
+        }
+
+        void set_leader(char *packet, const Block &block) const
+        {
+            set_packet_header(packet, 0, block.block_id, FORMAT_LEADER, 0);
+            put_u16(packet + 8, 0);
+            put_u16(packet + 10, PAYLOAD_TYPE_IMAGE);
+            put_u32(packet + 12, static_cast<uint32_t>(block.timestamp >> 32));
+            put_u32(packet + 16, static_cast<uint32_t>(block.timestamp));
+            put_u32(packet + 20, block.pixel_format);
+            put_u32(packet + 24, static_cast<uint32_t>(block.width));
+            put_u32(packet + 28, static_cast<uint32_t>(block.height));
+            // offset x and y, padding x and y
+            put_u32(packet + 32, 0);
+            put_u32(packet + 36, 0);
+            put_u32(packet + 40, 0);
+        }
+    };
+
+} // namespace rpiasgige
+
+#endif
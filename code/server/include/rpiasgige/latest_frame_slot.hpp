@@ -0,0 +1,93 @@
+#ifndef RPIASGIGE_LATEST_FRAME_SLOT_HPP
+#define RPIASGIGE_LATEST_FRAME_SLOT_HPP
+
+#include <atomic>
+
+namespace rpiasgige
+{
+
+    /**
+     * Lock-free triple buffer holding the most recent value produced by a single writer.
+     *
+     * The writer fills back() and calls publish(). The reader calls fetch() and then reads front().
+     * Writer and reader never touch the same buffer, so neither side ever waits for the other:
+     * the writer always overwrites the oldest unread value and the reader always sees the latest one.
+     *
+     * Exactly one writer thread and one reader thread (or readers serialized by the caller) are supported.
+     **/
+    template <typename T>
+    class Latest_Frame_Slot
+    {
+
+    public:
+        Latest_Frame_Slot() : middle(1) {}
+        virtual ~Latest_Frame_Slot() {}
+
+        /**
+         * the buffer the writer is allowed to fill
+         **/
+        T &back()
+        {
+            return this->buffers[this->back_index];
+        }
+
+        /**
+         * hands the buffer filled by the writer over to the reader
+         **/
+        void publish()
+        {
+            const int previous = this->middle.exchange(this->back_index | FRESH_FLAG, std::memory_order_acq_rel);
+            this->back_index = previous & INDEX_MASK;
+        }
+
+        /**
+         * makes the latest published buffer available as front(). Returns true if a new value was published since the last call
+         **/
+        bool fetch()
+        {
+            bool result = false;
+            if (this->middle.load(std::memory_order_acquire) & FRESH_FLAG)
+            {
+                const int previous = this->middle.exchange(this->front_index, std::memory_order_acq_rel);
+                this->front_index = previous & INDEX_MASK;
+                this->has_front = true;
+                result = true;
+            }
+            return result;
+        }
+
+        /**
+         * the buffer owned by the reader. Only meaningful if has_value() is true
+         **/
+        const T &front() const
+        {
+            return this->buffers[this->front_index];
+        }
+
+        /**
+         * true once the reader fetched at least one published value
+         **/
+        bool has_value() const
+        {
+            return this->has_front;
+        }
+
+    private:
+        static const int FRESH_FLAG = 4;
+        static const int INDEX_MASK = 3;
+
+        T buffers[3];
+
+        std::atomic<int> middle;
+
+        // writer-side only
+        int back_index = 0;
+
+        // reader-side only
+        int front_index = 2;
+        bool has_front = false;
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -3,9 +3,16 @@
 
 #include <mutex> 
 #include <chrono>
+#include <climits>
+#include <memory>
 
 #include "usb_interface.hpp"
 #include "generic_server.hpp"
+#include "frame_region.hpp"
+#include "pixel_format.hpp"
+#include "frame_encoder.hpp"
+#include "frame_delta.hpp"
+#include "worker_pool.hpp"
 
 namespace rpiasgige
 {
@@ -15,11 +22,30 @@ namespace rpiasgige
 
         public:
             Server(const std::string & identifier, USB_Interface &_usb_camera, const int max_image_size_in_bytes) : 
-            Websocket_Server(identifier, max_image_size_in_bytes), usb_camera(_usb_camera) {}
-            virtual ~Server() {}
+            Websocket_Server(identifier, max_image_size_in_bytes), usb_camera(_usb_camera), compression_pool(std::make_shared<Worker_Pool>(0)) {
+                this->usb_camera.set_frame_listener([this]() {
+                    this->notify_subscribers();
+                });
+            }
+            virtual ~Server() {
+                this->usb_camera.set_frame_listener(nullptr);
+            }
 
             static const int IMAGE_META_DATA_SIZE = 3 * sizeof(int);
 
+            // GRAB request flags
+            static const int GRAB_FRAME_INFO = 1;
+            static const int GRAB_REQUEST_ID = 2;
+            static const int GRAB_ROI = 4;
+            static const int GRAB_DECIMATION = 8;
+            static const int GRAB_CHANNEL = 16;
+            static const int GRAB_DELTA = 32;
+            static const int GRAB_BUFFERED = 64;
+
+            // GRAB_DECIMATION modes
+            static const int DECIMATION_SKIP = 0;
+            static const int DECIMATION_BINNING = 1;
+
             bool set_camera_timeout_in_milliseconds(const int val) {
                 bool result = false;
                 if (val > 0) {
@@ -29,10 +55,186 @@ namespace rpiasgige
                 return result;
             }
 
+            /**
+             * threads compressing the frames, possibly shared with other servers. By default, frames are compressed 
+             * by the thread serving the request only
+             **/
+            void set_compression_pool(const std::shared_ptr<Worker_Pool> &pool) {
+                if (pool) {
+                    this->compression_pool = pool;
+                }
+            }
+
+            virtual Session *create_session() {
+                return new Camera_Session();
+            }
+
+            virtual Connection *create_connection() {
+                return new Camera_Connection();
+            }
+
+            virtual long get_allocation_count() {
+                return Websocket_Server::get_allocation_count() + this->usb_camera.get_allocation_count();
+            }
+
         protected:
 
-            virtual void prepare_response(const char * request_buffer, const int request_size, char * response_buffer, int &response_size)
+            /**
+             * The hashes of the last frame sent by GRAB_DELTA. The connection may switch to another camera of a 
+             * Multi_Camera_Server, whose Server created it: the delta then restarts from a whole frame
+             **/
+            class Camera_Connection : public Connection
             {
+            public:
+                Frame_Delta delta;
+            };
+
+            /**
+             * Frames sent to a client are owned by the session of the response until it is written.
+             **/
+            class Camera_Session : public Session
+            {
+            public:
+                cv::Mat frame;
+                // copy of the part of the frame selected by a GRAB request
+                cv::Mat region;
+                // the frame converted to the pixel format negotiated by the connection
+                cv::Mat converted;
+                // the frame compressed with the codec negotiated by the connection
+                Frame_Encoder encoder;
+                // the tiles changed since the frame acknowledged by the client
+                std::vector<uchar> delta_payload;
+                Captured_Frame compressed_frame;
+            };
+
+            /**
+             * Optional data of a GRAB request: the flags followed by the fields they enable, in the order of the flag bits.
+             * Requests without data get the defaults
+             **/
+            struct Grab_Options
+            {
+                int flags = 0;
+                int request_id = 0;
+                Frame_Region region;
+                // id of the frame held by the client, -1 if none
+                int acknowledged_frame_id = -1;
+                // the frame kept by the camera which GRAB_BUFFERED asks for
+                Frame_Query query;
+
+                /**
+                 * Returns false if a field is missing or out of range. The request id is read even so, 
+                 * to be echoed in the error response
+                 **/
+                bool read(const char * request_buffer, const int request_size)
+                {
+                    const int data_size = request_size - HEADER_SIZE;
+                    const char *data = request_buffer + HEADER_SIZE;
+                    int offset = 0;
+                    if (data_size == 0) {
+                        return true;
+                    }
+                    if (!read_int(data, data_size, offset, this->flags)) {
+                        return false;
+                    }
+                    if ((this->flags & GRAB_REQUEST_ID) && !read_int(data, data_size, offset, this->request_id)) {
+                        return false;
+                    }
+                    if (this->flags & GRAB_ROI) {
+                        cv::Rect &roi = this->region.roi;
+                        if (!read_int(data, data_size, offset, roi.x) || !read_int(data, data_size, offset, roi.y) ||
+                            !read_int(data, data_size, offset, roi.width) || !read_int(data, data_size, offset, roi.height)) {
+                            return false;
+                        }
+                        // the far corner of the rectangle must not overflow
+                        if (roi.x < 0 || roi.y < 0 || roi.width <= 0 || roi.height <= 0 || roi.width > INT_MAX - roi.x || roi.height > INT_MAX - roi.y) {
+                            return false;
+                        }
+                    }
+                    if (this->flags & GRAB_DECIMATION) {
+                        int mode = DECIMATION_SKIP;
+                        if (!read_int(data, data_size, offset, this->region.decimation) || !read_int(data, data_size, offset, mode)) {
+                            return false;
+                        }
+                        if (mode != DECIMATION_SKIP && mode != DECIMATION_BINNING) {
+                            return false;
+                        }
+                        this->region.binning = mode == DECIMATION_BINNING;
+                        const int max_decimation = this->region.binning ? Frame_Region::MAX_BINNING : Frame_Region::MAX_DECIMATION;
+                        if (this->region.decimation < 1 || this->region.decimation > max_decimation) {
+                            return false;
+                        }
+                    }
+                    if (this->flags & GRAB_CHANNEL) {
+                        if (!read_int(data, data_size, offset, this->region.channel) || this->region.channel < 0) {
+                            return false;
+                        }
+                    }
+                    if ((this->flags & GRAB_DELTA) && !read_int(data, data_size, offset, this->acknowledged_frame_id)) {
+                        return false;
+                    }
+                    if (this->flags & GRAB_BUFFERED) {
+                        if (!read_int(data, data_size, offset, this->query.mode) || !read_int64(data, data_size, offset, this->query.value)) {
+                            return false;
+                        }
+                        if (!this->query.is_valid()) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+
+                /**
+                 * bytes written before the image metadata in the response data
+                 **/
+                int get_response_prefix_size() const {
+                    return (this->flags & GRAB_REQUEST_ID) ? REQUEST_ID_SIZE : 0;
+                }
+
+            private:
+
+                static bool read_int(const char * data, const int data_size, int &offset, int &value) 
+                {
+                    const int size_int = sizeof(int);
+                    bool result = false;
+                    if (data_size >= offset + size_int) {
+                        memcpy(&value, data + offset, size_int);
+                        offset += size_int;
+                        result = true;
+                    }
+                    return result;
+                }
+
+                static bool read_int64(const char * data, const int data_size, int &offset, int64_t &value) 
+                {
+                    const int size_int64 = sizeof(int64_t);
+                    bool result = false;
+                    if (data_size >= offset + size_int64) {
+                        memcpy(&value, data + offset, size_int64);
+                        offset += size_int64;
+                        result = true;
+                    }
+                    return result;
+                }
+            };
+
+            /**
+             * frames are pushed to streaming clients with the same layout of a GRAB response but with status FRAM
+             **/
+            virtual bool prepare_push(char * response_buffer, int &response_size, Session &session)
+            {
+                bool camera_timeout = false;
+                response_buffer[KEEP_ALIVE_ADDRESS] = '1';
+                bool result = this->load_frame(response_buffer, response_size, static_cast<Camera_Session &>(session), Grab_Options(), camera_timeout);
+                if (result) {
+                    this->set_status(response_buffer, "FRAM");
+                }
+                return result;
+            }
+
+            virtual void prepare_response(const char * request_buffer, const int request_size, char * response_buffer, int &response_size, Session &session)
+            {
+
+                Camera_Session &camera_session = static_cast<Camera_Session &>(session);
 
                 response_size = HEADER_SIZE;
 
@@ -41,34 +243,58 @@ namespace rpiasgige
                 bool camera_timeout = false;
                 if (strncmp("GRAB", request_buffer, STATUS_SIZE) == 0) {
 
+                    Grab_Options options;
+                    if (options.read(request_buffer, request_size)) {
+                        this->load_frame(response_buffer, response_size, camera_session, options, camera_timeout);
+                    } else {
+                        this->set_status(response_buffer, "0400");
+                    }
+
+                    // pipelining clients match every response, successful or not, by its request id
+                    if (options.flags & GRAB_REQUEST_ID) {
+                        this->set_buffer_value(response_buffer, HEADER_SIZE, REQUEST_ID_SIZE, &options.request_id);
+                        if (response_size == HEADER_SIZE) {
+                            response_size += REQUEST_ID_SIZE;
+                            this->set_response_data_size(response_buffer, REQUEST_ID_SIZE);
+                        }
+                    }
+        
+                }
+                else if (strncmp("GRBC", request_buffer, STATUS_SIZE) == 0) {
+
                     if(usb_camera_mutex.try_lock_for(this->usb_camera_mutex_timeout)) {
-                        this->usb_camera.grab();
-                        const cv::Mat &mat = this->usb_camera.get_captured_image();
-                        int image_size = 0;
+                        bool grabbed = this->usb_camera.grab_compressed();
+                        if (grabbed) {
+                            this->usb_camera.take_compressed_payload(camera_session.compressed_frame);
+                        }
+                        usb_camera_mutex.unlock();
 
-                        if (!mat.empty()) {
-                            image_size = mat.total() * mat.elemSize();
-                            const char *mat_data = (const char *)mat.data;
+                        if (grabbed) {
+                            const Captured_Frame &payload = camera_session.compressed_frame;
+                            int payload_size = payload.image.total() * payload.image.elemSize();
                             int size_int = sizeof(int);
-                            const int metada_data_size = 3*size_int;
-                            this->set_buffer_value(response_buffer, HEADER_SIZE, size_int, &mat.rows);
-                            this->set_buffer_value(response_buffer, HEADER_SIZE + size_int, size_int, &mat.cols);
-                            int type = mat.type();
-                            this->set_buffer_value(response_buffer, HEADER_SIZE + 2*size_int, size_int, &type);
-                            this->set_buffer_value(response_buffer, HEADER_SIZE + metada_data_size, image_size, mat_data);
-                            this->set_status(response_buffer, "0200");
+                            int fourcc = payload.pixel_format;
+                            this->set_buffer_value(response_buffer, HEADER_SIZE, size_int, &payload.height);
+                            this->set_buffer_value(response_buffer, HEADER_SIZE + size_int, size_int, &payload.width);
+                            this->set_buffer_value(response_buffer, HEADER_SIZE + 2*size_int, size_int, &fourcc);
+                            this->set_buffer_value(response_buffer, HEADER_SIZE + 3*size_int, size_int, &payload_size);
 
-                            response_size = HEADER_SIZE + image_size + metada_data_size;
+                            response_size = HEADER_SIZE + COMPRESSED_META_DATA_SIZE;
 
-                            set_response_data_size(response_buffer, image_size + metada_data_size);
+                            if (this->set_response_payload(session, response_size, payload.image.data, payload_size)) {
+                                this->set_status(response_buffer, "0200");
+                                set_response_data_size(response_buffer, COMPRESSED_META_DATA_SIZE + payload_size);
+                            } else {
+                                response_size = HEADER_SIZE;
+                                this->set_status(response_buffer, "NOPE");
+                            }
                         } else {
                             this->set_status(response_buffer, "NOPE");
                         }
-                        usb_camera_mutex.unlock();
                     } else {
                         camera_timeout = true;
                     }
-        
+
                 }
                 else if (strncmp("SET0", request_buffer, STATUS_SIZE) == 0) {
                     int data_size = request_size - HEADER_SIZE;
@@ -173,6 +399,63 @@ namespace rpiasgige
                         }
                     }
 
+                } else if (strncmp("FRMT", request_buffer, STATUS_SIZE) == 0) {
+                    int data_size = request_size - HEADER_SIZE;
+                    if (data_size >= static_cast<int>(sizeof(int))) {
+                        int format;
+                        memcpy(&format, request_buffer + HEADER_SIZE, sizeof(int));
+                        // the pixels of compressed payloads cannot be converted
+                        const bool convertible = format == Pixel_Format_Converter::NATIVE || !this->usb_camera.delivers_compressed_images();
+                        if (Pixel_Format_Converter::is_valid(format) && convertible) {
+                            session.connection->pixel_format = format;
+                            this->set_status(response_buffer, "0200");
+                        } else {
+                            this->set_status(response_buffer, "NOPE");
+                        }
+                    } else {
+                        this->set_status(response_buffer, "0400");
+                    }
+
+                } else if (strncmp("CODC", request_buffer, STATUS_SIZE) == 0) {
+                    int data_size = request_size - HEADER_SIZE;
+                    const int size_int = sizeof(int);
+                    if (data_size >= size_int) {
+                        int codec;
+                        memcpy(&codec, request_buffer + HEADER_SIZE, size_int);
+                        int quality = Frame_Encoder::get_default_quality(codec);
+                        if (data_size >= 2 * size_int) {
+                            memcpy(&quality, request_buffer + HEADER_SIZE + size_int, size_int);
+                        }
+                        if (!Frame_Encoder::is_supported(codec)) {
+                            this->set_status(response_buffer, "NOPE");
+                        } else if (!Frame_Encoder::is_valid_quality(codec, quality)) {
+                            this->set_status(response_buffer, "0400");
+                        } else {
+                            session.connection->codec = codec;
+                            session.connection->codec_quality = quality;
+                            this->set_status(response_buffer, "0200");
+                        }
+                    } else {
+                        this->set_status(response_buffer, "0400");
+                    }
+
+                } else if (strncmp("STRM", request_buffer, STATUS_SIZE) == 0) {
+                    // pushing frames requires the capture thread to tell when a new frame is available. It is started 
+                    // with the server, never by a request: it changes how every client is served
+                    if (this->usb_camera.is_continuous_capture()) {
+                        session.connection->streaming = true;
+                        this->set_status(response_buffer, "0200");
+                    } else {
+                        this->set_status(response_buffer, "NOPE");
+                    }
+
+                } else if (strncmp("STOP", request_buffer, STATUS_SIZE) == 0) {
+                    session.connection->streaming = false;
+                    this->set_status(response_buffer, "0200");
+
+                } else if (strncmp("STAT", request_buffer, STATUS_SIZE) == 0) {
+                    this->set_allocation_count(response_buffer, response_size, this->get_allocation_count());
+
                 } else if (strncmp("PING", request_buffer, STATUS_SIZE) == 0) {
                     this->set_status(response_buffer, "PONG");
                 } else {
@@ -184,7 +467,151 @@ namespace rpiasgige
             }
 
         private:
+
+            /**
+             * grabs a frame and sets it as the response payload, with the GRAB response layout:
+             * rows, cols and type, the Frame_Info if GRAB_FRAME_INFO is set, then the pixels.
+             * The metadata is preceded by room for the request id if GRAB_REQUEST_ID is set.
+             * Only the region selected by the options is sent, converted to the pixel format of the connection, 
+             * and the metadata describes it. GRAB_BUFFERED picks the frame among the last ones captured instead of 
+             * grabbing a new one. GRAB_DELTA adds the frame id and, if the client holds the frame it 
+             * acknowledged, sends only the tiles changed since it. If the connection negotiated a codec, the metadata 
+             * ends with the codec actually used and the size of each compressed stripe
+             **/
+            bool load_frame(char * response_buffer, int &response_size, Camera_Session &camera_session, const Grab_Options &options, bool &camera_timeout)
+            {
+                bool result = false;
+                const bool buffered = (options.flags & GRAB_BUFFERED) != 0;
+                if (buffered) {
+                    // a frame about to be captured is waited for without holding the camera. On timeout, it is not found
+                    this->usb_camera.wait_for_buffered_frame(options.query, this->usb_camera_mutex_timeout);
+                }
+                if(usb_camera_mutex.try_lock_for(this->usb_camera_mutex_timeout)) {
+                    const bool grabbed = buffered ? this->usb_camera.grab_buffered(options.query) : this->usb_camera.grab();
+                    if (grabbed) {
+                        this->usb_camera.take_captured_image(camera_session.frame);
+                    } else {
+                        // the captured image may be an older frame, possibly the one of another session
+                        camera_session.frame.release();
+                    }
+                    const Frame_Info info = this->usb_camera.get_captured_frame_info();
+                    const bool compressed = this->usb_camera.is_captured_image_compressed();
+                    usb_camera_mutex.unlock();
+
+                    cv::Mat mat = camera_session.frame;
+                    int image_size = 0;
+
+                    bool selected = true;
+                    if (!mat.empty() && !options.region.is_whole_frame()) {
+                        // a compressed payload is not an image: it cannot be cropped or decimated
+                        selected = !compressed && options.region.select(camera_session.frame, camera_session.region, mat);
+                    }
+
+                    const Connection *connection = camera_session.connection;
+                    const int pixel_format = connection != nullptr ? connection->pixel_format : Pixel_Format_Converter::NATIVE;
+                    if (!mat.empty() && selected && pixel_format != Pixel_Format_Converter::NATIVE) {
+                        // converting after the selection converts only the pixels sent. A compressed payload, 
+                        // e.g. after the camera settings changed, is not an image: it cannot be converted
+                        const cv::Mat source = mat;
+                        selected = !compressed && Pixel_Format_Converter::convert(source, pixel_format, camera_session.converted, mat);
+                    }
+
+                    if (!mat.empty() && selected) {
+                        image_size = mat.total() * mat.elemSize();
+                        int size_int = sizeof(int);
+                        const int prefix_size = options.get_response_prefix_size();
+                        const int metadata_address = HEADER_SIZE + prefix_size;
+                        int metada_data_size = prefix_size + 3*size_int;
+                        this->set_buffer_value(response_buffer, metadata_address, size_int, &mat.rows);
+                        this->set_buffer_value(response_buffer, metadata_address + size_int, size_int, &mat.cols);
+                        int type = mat.type();
+                        this->set_buffer_value(response_buffer, metadata_address + 2*size_int, size_int, &type);
+
+                        if (options.flags & GRAB_FRAME_INFO) {
+                            const int size_int64 = sizeof(int64_t);
+                            const int address = HEADER_SIZE + metada_data_size;
+                            this->set_buffer_value(response_buffer, address, size_int64, &info.device_timestamp);
+                            this->set_buffer_value(response_buffer, address + size_int64, size_int64, &info.sequence);
+                            this->set_buffer_value(response_buffer, address + 2*size_int64, size_int64, &info.receive_time);
+                            this->set_buffer_value(response_buffer, address + 3*size_int64, size_int64, &info.grab_duration);
+                            metada_data_size += FRAME_INFO_SIZE;
+                        }
+
+                        const void *payload = mat.data;
+                        int payload_size = image_size;
+                        bool is_delta = false;
+                        if (options.flags & GRAB_DELTA) {
+                            // the tiles changed since the frame the client acknowledged, or the whole frame
+                            int frame_id = -1;
+                            int reference_id = -1;
+                            int changed_tiles = 0;
+                            if (connection != nullptr) {
+                                Frame_Delta &delta = static_cast<Camera_Connection *>(camera_session.connection)->delta;
+                                is_delta = delta.encode(mat, this, options.acknowledged_frame_id, camera_session.delta_payload);
+                                frame_id = delta.get_frame_id();
+                                reference_id = delta.get_reference_id();
+                                changed_tiles = delta.get_changed_tiles();
+                            }
+                            if (is_delta) {
+                                payload = camera_session.delta_payload.data();
+                                payload_size = static_cast<int>(camera_session.delta_payload.size());
+                            }
+                            const int tile_size = Frame_Delta::TILE_SIZE;
+                            const int address = HEADER_SIZE + metada_data_size;
+                            this->set_buffer_value(response_buffer, address, size_int, &frame_id);
+                            this->set_buffer_value(response_buffer, address + size_int, size_int, &reference_id);
+                            this->set_buffer_value(response_buffer, address + 2*size_int, size_int, &tile_size);
+                            this->set_buffer_value(response_buffer, address + 3*size_int, size_int, &changed_tiles);
+                            metada_data_size += DELTA_META_DATA_SIZE;
+                        }
+
+                        const int codec = connection != nullptr ? connection->codec : Frame_Encoder::NONE;
+                        if (codec != Frame_Encoder::NONE) {
+                            // frames which cannot be compressed, or which would grow, are sent as they are
+                            Frame_Encoder &encoder = camera_session.encoder;
+                            int used_codec = Frame_Encoder::NONE;
+                            int stripe_count = 0;
+                            int stripe_rows = 0;
+                            // deltas, and payloads already compressed by the camera, are sent as they are
+                            if (!is_delta && !compressed && encoder.encode(mat, codec, connection->codec_quality, *this->compression_pool)) {
+                                used_codec = codec;
+                                stripe_count = encoder.get_stripe_count();
+                                stripe_rows = encoder.get_stripe_rows();
+                                payload = encoder.get_payload().data();
+                                payload_size = static_cast<int>(encoder.get_payload().size());
+                            }
+                            const int address = HEADER_SIZE + metada_data_size;
+                            this->set_buffer_value(response_buffer, address, size_int, &used_codec);
+                            this->set_buffer_value(response_buffer, address + size_int, size_int, &stripe_count);
+                            this->set_buffer_value(response_buffer, address + 2*size_int, size_int, &stripe_rows);
+                            for (int i = 0; i < stripe_count; ++i) {
+                                const int stripe_size = encoder.get_stripe_size(i);
+                                this->set_buffer_value(response_buffer, address + (3 + i) * size_int, size_int, &stripe_size);
+                            }
+                            metada_data_size += (3 + stripe_count) * size_int;
+                        }
+
+                        response_size = HEADER_SIZE + metada_data_size;
+
+                        if (this->set_response_payload(camera_session, response_size, payload, payload_size)) {
+                            this->set_status(response_buffer, "0200");
+                            set_response_data_size(response_buffer, payload_size + metada_data_size);
+                            result = true;
+                        } else {
+                            response_size = HEADER_SIZE;
+                            this->set_status(response_buffer, "NOPE");
+                        }
+                    } else {
+                        this->set_status(response_buffer, "NOPE");
+                    }
+                } else {
+                    camera_timeout = true;
+                }
+                return result;
+            }
+
             USB_Interface &usb_camera;
+            std::shared_ptr<Worker_Pool> compression_pool;
             std::timed_mutex usb_camera_mutex;
             std::chrono::milliseconds usb_camera_mutex_timeout = std::chrono::milliseconds(200);
             static const int SIZE_OF_DOUBLE = sizeof(double);
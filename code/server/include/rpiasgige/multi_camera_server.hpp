@@ -0,0 +1,151 @@
+#ifndef RPIASGIGE_MULTI_CAMERA_SERVER_HPP
+#define RPIASGIGE_MULTI_CAMERA_SERVER_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "machine_vision_server.hpp"
+#include "usb_interface.hpp"
+#include "generic_server.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * Serves several USB cameras from a single process and port.
+     * 
+     * Each camera keeps its own Server, thus its own lock and capture thread. Cameras are identified by 
+     * the order they were added, starting at 0. A connection addresses camera 0 until it sends a CAMS request
+     * with the id of another camera. Every other request is forwarded to the Server of the addressed camera.
+     **/
+    class Multi_Camera_Server : public Websocket_Server
+    {
+
+    public:
+        Multi_Camera_Server(const std::string &identifier, const int max_response_buffer_size) :
+            Websocket_Server(identifier, max_response_buffer_size) {}
+
+        virtual ~Multi_Camera_Server() {}
+
+        /**
+         * takes ownership of usb_camera and returns its camera id
+         **/
+        int add_camera(const std::string &identifier, std::unique_ptr<USB_Interface> usb_camera)
+        {
+            std::unique_ptr<Server> server(new Server(identifier, *usb_camera, this->get_max_response_buffer_size()));
+            server->init();
+            server->set_compression_pool(this->compression_pool);
+            this->usb_cameras.push_back(std::move(usb_camera));
+            this->servers.push_back(std::move(server));
+            return static_cast<int>(this->servers.size()) - 1;
+        }
+
+        /**
+         * threads compressing the frames of all the cameras
+         **/
+        void set_compression_pool(const std::shared_ptr<Worker_Pool> &pool) {
+            this->compression_pool = pool;
+            for (size_t i = 0; i < this->servers.size(); ++i) {
+                this->servers[i]->set_compression_pool(pool);
+            }
+        }
+
+        int get_camera_count() const {
+            return static_cast<int>(this->servers.size());
+        }
+
+        USB_Interface &get_camera(int camera_id) {
+            return *this->usb_cameras.at(camera_id);
+        }
+
+        Server &get_server(int camera_id) {
+            return *this->servers.at(camera_id);
+        }
+
+        virtual Session *create_session() {
+            return this->servers.at(0)->create_session();
+        }
+
+        virtual Connection *create_connection() {
+            return this->servers.at(0)->create_connection();
+        }
+
+        virtual long get_allocation_count() {
+            long result = Websocket_Server::get_allocation_count();
+            for (size_t i = 0; i < this->servers.size(); ++i) {
+                result += this->servers[i]->get_allocation_count();
+            }
+            return result;
+        }
+
+        virtual int subscribe(const Connection &connection, const std::function<void()> &listener) {
+            std::lock_guard<std::mutex> lock(this->subscriptions_mutex);
+            const int camera_id = connection.camera_id;
+            const int camera_subscription_id = this->servers.at(camera_id)->subscribe(connection, listener);
+            const int id = this->next_subscription_id++;
+            this->subscriptions[id] = std::make_pair(camera_id, camera_subscription_id);
+            return id;
+        }
+
+        virtual void unsubscribe(int id) {
+            std::lock_guard<std::mutex> lock(this->subscriptions_mutex);
+            auto it = this->subscriptions.find(id);
+            if (it != this->subscriptions.end()) {
+                this->servers.at(it->second.first)->unsubscribe(it->second.second);
+                this->subscriptions.erase(it);
+            }
+        }
+
+    protected:
+
+        virtual void prepare_response(const char * request_buffer, const int request_size, char * response_buffer, int &response_size, Session &session)
+        {
+            if (strncmp("STAT", request_buffer, STATUS_SIZE) == 0) {
+
+                response_buffer[KEEP_ALIVE_ADDRESS] = request_buffer[KEEP_ALIVE_ADDRESS];
+                this->set_allocation_count(response_buffer, response_size, this->get_allocation_count());
+
+            } else if (strncmp("CAMS", request_buffer, STATUS_SIZE) == 0) {
+
+                response_size = HEADER_SIZE;
+                response_buffer[KEEP_ALIVE_ADDRESS] = request_buffer[KEEP_ALIVE_ADDRESS];
+
+                int camera_id = -1;
+                if (request_size - HEADER_SIZE >= static_cast<int>(sizeof(int))) {
+                    memcpy(&camera_id, request_buffer + HEADER_SIZE, sizeof(int));
+                }
+
+                if (camera_id >= 0 && camera_id < this->get_camera_count()) {
+                    // a subscription is bound to a camera
+                    session.connection->streaming = false;
+                    session.connection->camera_id = camera_id;
+                    this->set_status(response_buffer, "0200");
+                } else {
+                    this->set_status(response_buffer, "NOPE");
+                }
+
+            } else {
+                this->servers.at(session.connection->camera_id)->process_client(request_buffer, request_size, response_buffer, response_size, session);
+            }
+        }
+
+        virtual bool prepare_push(char * response_buffer, int &response_size, Session &session)
+        {
+            return this->servers.at(session.connection->camera_id)->process_push(response_buffer, response_size, session);
+        }
+
+    private:
+        std::shared_ptr<Worker_Pool> compression_pool;
+        std::vector<std::unique_ptr<USB_Interface>> usb_cameras;
+        std::vector<std::unique_ptr<Server>> servers;
+
+        std::mutex subscriptions_mutex;
+        std::map<int, std::pair<int, int>> subscriptions;
+        int next_subscription_id = 0;
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,332 @@
+#ifndef RPIASGIGE_MULTICAST_SENDER_HPP
+#define RPIASGIGE_MULTICAST_SENDER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "dumb_logger.hpp"
+#include "generic_server.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * Header of each datagram. A message is split into fragments sent in order, each one carrying its offset
+     * in the message. See docs/protocol.MD
+     **/
+    struct Multicast_Fragment_Header
+    {
+        char status[4] = {'F', 'R', 'A', 'G'};
+        // consecutive for each message sent: a gap means lost messages
+        int frame_id = 0;
+        int fragment_index = 0;
+        int fragment_count = 0;
+        int message_size = 0;
+        int offset = 0;
+    };
+
+    static_assert(sizeof(Multicast_Fragment_Header) == 24, "The datagram header is part of the protocol");
+
+    /**
+     * Streams the frames of a camera to a UDP multicast group, so that any number of viewers share a single
+     * capture and a single uplink stream.
+     *
+     * The sender subscribes to the frames like a streaming client: each message is the one pushed to a STRM
+     * client, split into datagrams. Frames arriving while the previous one is being sent are skipped,
+     * the latest one is sent next.
+     **/
+    class Multicast_Sender
+    {
+    public:
+
+        // an Ethernet frame: 1500 bytes of MTU minus the IP and UDP headers
+        static const int DEFAULT_DATAGRAM_SIZE = 1472;
+        static const int MAX_DATAGRAM_SIZE = 65507;
+
+        Multicast_Sender(Websocket_Server &_server, const int camera_id = 0) : server(_server), logger("Multicast_Sender")
+        {
+            this->connection.reset(this->server.create_connection());
+            this->connection->camera_id = camera_id;
+            this->connection->streaming = true;
+            this->session.reset(this->server.create_session());
+            this->session->connection = this->connection.get();
+        }
+
+        virtual ~Multicast_Sender()
+        {
+            this->stop();
+            if (this->socket_fd >= 0) {
+                close(this->socket_fd);
+            }
+        }
+
+        /**
+         * Opens the socket sending to group:port. interface_address selects the network interface by its address,
+         * the system default if empty. ttl is the number of routers the datagrams may cross, 1 stays in the local network
+         **/
+        bool open(const std::string &group, const unsigned short port, const std::string &interface_address, const int ttl)
+        {
+            struct sockaddr_in destination;
+            memset(&destination, 0, sizeof(destination));
+            destination.sin_family = AF_INET;
+            destination.sin_port = htons(port);
+            if (inet_pton(AF_INET, group.c_str(), &destination.sin_addr) != 1) {
+                this->logger.warn_msg("Invalid multicast group " + group);
+                return false;
+            }
+
+            this->socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (this->socket_fd < 0) {
+                this->logger.warn_msg(std::string("socket: ") + strerror(errno));
+                return false;
+            }
+
+            std::string error;
+            const unsigned char multicast_ttl = static_cast<unsigned char>(std::max(0, std::min(ttl, 255)));
+            // viewers on this host receive the frames as well
+            const unsigned char loop = 1;
+            const int send_buffer_size = SEND_BUFFER_SIZE;
+            if (setsockopt(this->socket_fd, IPPROTO_IP, IP_MULTICAST_TTL, &multicast_ttl, sizeof(multicast_ttl)) != 0) {
+                error = std::string("IP_MULTICAST_TTL: ") + strerror(errno);
+            } else if (setsockopt(this->socket_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0) {
+                error = std::string("IP_MULTICAST_LOOP: ") + strerror(errno);
+            } else if (setsockopt(this->socket_fd, SOL_SOCKET, SO_SNDBUF, &send_buffer_size, sizeof(send_buffer_size)) != 0) {
+                error = std::string("SO_SNDBUF: ") + strerror(errno);
+            }
+            if (error.empty() && !interface_address.empty()) {
+                struct in_addr interface;
+                if (inet_pton(AF_INET, interface_address.c_str(), &interface) != 1) {
+                    error = "invalid interface address " + interface_address;
+                } else if (setsockopt(this->socket_fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) != 0) {
+                    error = std::string("IP_MULTICAST_IF: ") + strerror(errno);
+                }
+            }
+            // datagrams are then sent without a destination address
+            if (error.empty() && connect(this->socket_fd, reinterpret_cast<struct sockaddr *>(&destination), sizeof(destination)) != 0) {
+                error = std::string("connect: ") + strerror(errno);
+            }
+
+            if (!error.empty()) {
+                this->logger.warn_msg(error);
+                close(this->socket_fd);
+                this->socket_fd = -1;
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * bytes of each datagram, header included. Larger datagrams are fragmented by IP: losing any piece loses them all
+         **/
+        bool set_datagram_size(const int size)
+        {
+            bool result = false;
+            if (size > static_cast<int>(sizeof(Multicast_Fragment_Header)) && size <= MAX_DATAGRAM_SIZE) {
+                this->datagram_size = size;
+                result = true;
+            }
+            return result;
+        }
+
+        int get_datagram_size() const
+        {
+            return this->datagram_size;
+        }
+
+        /**
+         * starts sending the frames of the camera, which must be in continuous capture
+         **/
+        bool start()
+        {
+            if (this->socket_fd < 0 || this->sender.joinable()) {
+                return false;
+            }
+            this->signal->stopping = false;
+            this->sender = std::thread(&Multicast_Sender::run, this);
+            // a notification may still be running once unsubscribed: the listener keeps the signal alive
+            std::shared_ptr<Frame_Signal> frame_signal = this->signal;
+            this->subscription_id = this->server.subscribe(*this->connection, [frame_signal]() {
+                // called by the capture thread: it must not wait for the frame to be sent
+                {
+                    std::lock_guard<std::mutex> lock(frame_signal->mutex);
+                    frame_signal->frame_available = true;
+                }
+                frame_signal->condition.notify_one();
+            });
+            return true;
+        }
+
+        void stop()
+        {
+            if (this->subscription_id >= 0) {
+                this->server.unsubscribe(this->subscription_id);
+                this->subscription_id = -1;
+            }
+            {
+                std::lock_guard<std::mutex> lock(this->signal->mutex);
+                this->signal->stopping = true;
+            }
+            this->signal->condition.notify_one();
+            if (this->sender.joinable()) {
+                this->sender.join();
+            }
+        }
+
+        /**
+         * number of frames sent so far
+         **/
+        long get_frame_count() const
+        {
+            return this->frame_count;
+        }
+
+    private:
+
+        // a whole frame fits in the socket buffer, at least on the host side
+        static const int SEND_BUFFER_SIZE = 4 * 1024 * 1024;
+        // datagrams handed to the kernel by each sendmmsg
+        static const int BATCH_SIZE = 64;
+
+        Websocket_Server &server;
+        const Logger logger;
+
+        std::unique_ptr<Connection> connection;
+        std::unique_ptr<Session> session;
+        char response_buffer[RESPONSE_BUFFER_SIZE];
+
+        int socket_fd = -1;
+        int datagram_size = DEFAULT_DATAGRAM_SIZE;
+        int subscription_id = -1;
+        int next_frame_id = 0;
+        std::atomic<long> frame_count{0};
+
+        struct Frame_Signal
+        {
+            std::mutex mutex;
+            std::condition_variable condition;
+            bool frame_available = false;
+            bool stopping = false;
+        };
+
+        std::shared_ptr<Frame_Signal> signal = std::make_shared<Frame_Signal>();
+        std::thread sender;
+
+        // reused for every batch of datagrams
+        std::vector<Multicast_Fragment_Header> headers;
+        std::vector<struct iovec> parts;
+        std::vector<struct mmsghdr> messages;
+
+        void run()
+        {
+            while (true) {
+                {
+                    Frame_Signal &frame_signal = *this->signal;
+                    std::unique_lock<std::mutex> lock(frame_signal.mutex);
+                    frame_signal.condition.wait(lock, [&frame_signal]() {
+                        return frame_signal.frame_available || frame_signal.stopping;
+                    });
+                    if (frame_signal.stopping) {
+                        break;
+                    }
+                    frame_signal.frame_available = false;
+                }
+
+                int response_size = 0;
+                try {
+                    if (this->server.process_push(this->response_buffer, response_size, *this->session)) {
+                        this->send(this->response_buffer, response_size, this->session->payload, this->session->payload_size);
+                    }
+                } catch (const std::exception &e) {
+                    // e.g. cv::Exception or std::bad_alloc: the frame is skipped, the sender goes on with the next one
+                    this->logger.error_msg(std::string("push: ") + e.what());
+                }
+            }
+        }
+
+        /**
+         * sends the message made of head and payload as datagrams of at most datagram_size bytes
+         **/
+        bool send(const char *head, const int head_size, const char *payload, const int payload_size)
+        {
+            const int message_size = head_size + payload_size;
+            const int chunk_size = this->datagram_size - static_cast<int>(sizeof(Multicast_Fragment_Header));
+            const int fragment_count = (message_size + chunk_size - 1) / chunk_size;
+            const int frame_id = this->next_frame_id;
+            this->next_frame_id = (this->next_frame_id + 1) & 0x7fffffff;
+
+            this->headers.resize(BATCH_SIZE);
+            // a fragment spans at most the end of head and the start of payload
+            this->parts.resize(3 * BATCH_SIZE);
+            this->messages.resize(BATCH_SIZE);
+
+            int fragment_index = 0;
+            while (fragment_index < fragment_count) {
+                const int batch_size = std::min(static_cast<int>(BATCH_SIZE), fragment_count - fragment_index);
+                for (int i = 0; i < batch_size; ++i) {
+                    Multicast_Fragment_Header &header = this->headers[i];
+                    header.frame_id = frame_id;
+                    header.fragment_index = fragment_index + i;
+                    header.fragment_count = fragment_count;
+                    header.message_size = message_size;
+                    header.offset = header.fragment_index * chunk_size;
+                    const int end = std::min(message_size, header.offset + chunk_size);
+
+                    struct iovec *iov = &this->parts[3 * i];
+                    int part_count = 0;
+                    iov[part_count].iov_base = &header;
+                    iov[part_count++].iov_len = sizeof(header);
+                    if (header.offset < head_size) {
+                        iov[part_count].iov_base = const_cast<char *>(head + header.offset);
+                        iov[part_count++].iov_len = std::min(end, head_size) - header.offset;
+                    }
+                    if (end > head_size) {
+                        const int from = std::max(header.offset, head_size) - head_size;
+                        iov[part_count].iov_base = const_cast<char *>(payload + from);
+                        iov[part_count++].iov_len = end - head_size - from;
+                    }
+
+                    struct mmsghdr &message = this->messages[i];
+                    memset(&message, 0, sizeof(message));
+                    message.msg_hdr.msg_iov = iov;
+                    message.msg_hdr.msg_iovlen = part_count;
+                }
+
+                int sent = 0;
+                while (sent < batch_size) {
+                    const int result = sendmmsg(this->socket_fd, &this->messages[sent], batch_size - sent, 0);
+                    if (result < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        // e.g., ECONNREFUSED reported for a previous datagram sent to a unicast address: the frame is dropped
+                        this->logger.warn_msg(std::string("sendmmsg: ") + strerror(errno));
+                        return false;
+                    }
+                    sent += result;
+                }
+                fragment_index += batch_size;
+            }
+
+            this->frame_count++;
+            return true;
+        }
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef RPIASGIGE_PIXEL_FORMAT_HPP
+#define RPIASGIGE_PIXEL_FORMAT_HPP
+
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(RPIASGIGE_NO_NEON)
+#include <arm_neon.h>
+#define RPIASGIGE_NEON
+#endif
+
+namespace rpiasgige
+{
+
+    /**
+     * Converts frames to the pixel format negotiated by a client, so that clients receive only the data they need.
+     *
+     * The source format is told by the frame type: CV_8UC3 is BGR, CV_8UC2 is YUYV, as delivered by V4L2 when
+     * CAP_PROP_CONVERT_RGB is off, and CV_8UC1 is gray. The YUV formats use BT.601 limited range coefficients,
+     * the ones expected by cv::cvtColor on the client. Gray is full range, as cv::COLOR_BGR2GRAY.
+     *
+     * The row kernels process 16 pixels per iteration with NEON on ARM. Elsewhere, or with RPIASGIGE_NO_NEON,
+     * the same fixed point arithmetic is done one pixel at a time.
+     **/
+    class Pixel_Format_Converter
+    {
+    public:
+
+        // the frame is sent as captured
+        static const int NATIVE = 0;
+        // CV_8UC3
+        static const int BGR = 1;
+        // CV_8UC1
+        static const int GRAY8 = 2;
+        // CV_8UC2, Y0 U Y1 V. The frame width must be even
+        static const int YUYV = 3;
+        // CV_8UC1 with rows * 3 / 2 rows: the Y plane followed by the interleaved UV plane. Width and height must be even
+        static const int NV12 = 4;
+
+        static bool is_valid(const int format)
+        {
+            return format >= NATIVE && format <= NV12;
+        }
+
+        /**
+         * Converts frame to format. If no conversion is needed, result points to frame. Otherwise, the pixels are
+         * converted into buffer, whose memory is reused across calls, and result points to buffer.
+         * Returns false if frame cannot be converted to format
+         **/
+        static bool convert(const cv::Mat &frame, const int format, cv::Mat &buffer, cv::Mat &result)
+        {
+            const int source = get_format(frame.type());
+            if (format == NATIVE || format == source) {
+                result = frame;
+                return true;
+            }
+
+            const bool even_cols = frame.cols % 2 == 0;
+            const bool even_rows = frame.rows % 2 == 0;
+            bool converted = false;
+            if (source == BGR) {
+                if (format == GRAY8) {
+                    buffer.create(frame.rows, frame.cols, CV_8UC1);
+                    for (int r = 0; r < frame.rows; ++r) {
+                        bgr_to_gray(frame.ptr(r), buffer.ptr(r), frame.cols);
+                    }
+                    converted = true;
+                } else if (format == YUYV && even_cols) {
+                    buffer.create(frame.rows, frame.cols, CV_8UC2);
+                    for (int r = 0; r < frame.rows; ++r) {
+                        bgr_to_yuyv(frame.ptr(r), buffer.ptr(r), frame.cols);
+                    }
+                    converted = true;
+                } else if (format == NV12 && even_cols && even_rows) {
+                    buffer.create(frame.rows * 3 / 2, frame.cols, CV_8UC1);
+                    for (int r = 0; r < frame.rows; r += 2) {
+                        bgr_to_nv12(frame.ptr(r), frame.ptr(r + 1), buffer.ptr(r), buffer.ptr(r + 1), buffer.ptr(frame.rows + r / 2), frame.cols);
+                    }
+                    converted = true;
+                }
+            } else if (source == YUYV && even_cols) {
+                // each pair of pixels shares its chroma: an odd width is not a YUYV frame
+                if (format == BGR) {
+                    cv::cvtColor(frame, buffer, cv::COLOR_YUV2BGR_YUYV);
+                    converted = true;
+                } else if (format == GRAY8) {
+                    buffer.create(frame.rows, frame.cols, CV_8UC1);
+                    for (int r = 0; r < frame.rows; ++r) {
+                        yuyv_to_gray(frame.ptr(r), buffer.ptr(r), frame.cols);
+                    }
+                    converted = true;
+                } else if (format == NV12 && even_rows) {
+                    buffer.create(frame.rows * 3 / 2, frame.cols, CV_8UC1);
+                    for (int r = 0; r < frame.rows; r += 2) {
+                        yuyv_to_nv12(frame.ptr(r), frame.ptr(r + 1), buffer.ptr(r), buffer.ptr(r + 1), buffer.ptr(frame.rows + r / 2), frame.cols);
+                    }
+                    converted = true;
+                }
+            } else if (source == GRAY8 && format == BGR) {
+                cv::cvtColor(frame, buffer, cv::COLOR_GRAY2BGR);
+                converted = true;
+            }
+
+            if (converted) {
+                result = buffer;
+            }
+            return converted;
+        }
+
+        /**
+         * format of frames of type, NATIVE if the type is none of the negotiable formats
+         **/
+        static int get_format(const int type)
+        {
+            int result = NATIVE;
+            if (type == CV_8UC3) {
+                result = BGR;
+            } else if (type == CV_8UC2) {
+                result = YUYV;
+            } else if (type == CV_8UC1) {
+                result = GRAY8;
+            }
+            return result;
+        }
+
+        static void bgr_to_gray(const uint8_t *bgr, uint8_t *gray, const int width)
+        {
+            int x = 0;
+#ifdef RPIASGIGE_NEON
+            for (; x + 16 <= width; x += 16) {
+                const uint8x16x3_t px = vld3q_u8(bgr + 3 * x);
+                uint16x8_t low = vmull_u8(vget_low_u8(px.val[0]), vdup_n_u8(GRAY_B));
+                low = vmlal_u8(low, vget_low_u8(px.val[1]), vdup_n_u8(GRAY_G));
+                low = vmlal_u8(low, vget_low_u8(px.val[2]), vdup_n_u8(GRAY_R));
+                uint16x8_t high = vmull_u8(vget_high_u8(px.val[0]), vdup_n_u8(GRAY_B));
+                high = vmlal_u8(high, vget_high_u8(px.val[1]), vdup_n_u8(GRAY_G));
+                high = vmlal_u8(high, vget_high_u8(px.val[2]), vdup_n_u8(GRAY_R));
+                vst1q_u8(gray + x, vcombine_u8(vrshrn_n_u16(low, 8), vrshrn_n_u16(high, 8)));
+            }
+#endif
+            for (; x < width; ++x) {
+                const uint8_t *px = bgr + 3 * x;
+                gray[x] = static_cast<uint8_t>((GRAY_B * px[0] + GRAY_G * px[1] + GRAY_R * px[2] + 128) >> 8);
+            }
+        }
+
+        /**
+         * width must be even
+         **/
+        static void bgr_to_yuyv(const uint8_t *bgr, uint8_t *yuyv, const int width)
+        {
+            int x = 0;
+#ifdef RPIASGIGE_NEON
+            for (; x + 16 <= width; x += 16) {
+                const uint8x16x3_t px = vld3q_u8(bgr + 3 * x);
+                const uint8x16_t y = luma(px);
+                // chroma of each pair of pixels
+                const uint8x8_t b = vrshrn_n_u16(vpaddlq_u8(px.val[0]), 1);
+                const uint8x8_t g = vrshrn_n_u16(vpaddlq_u8(px.val[1]), 1);
+                const uint8x8_t r = vrshrn_n_u16(vpaddlq_u8(px.val[2]), 1);
+                const uint8x8x2_t even_odd = vuzp_u8(vget_low_u8(y), vget_high_u8(y));
+                uint8x8x4_t out;
+                out.val[0] = even_odd.val[0];
+                out.val[1] = chroma_u(b, g, r);
+                out.val[2] = even_odd.val[1];
+                out.val[3] = chroma_v(b, g, r);
+                vst4_u8(yuyv + 2 * x, out);
+            }
+#endif
+            for (; x < width; x += 2) {
+                const uint8_t *px = bgr + 3 * x;
+                uint8_t *out = yuyv + 2 * x;
+                const int b = (px[0] + px[3] + 1) >> 1;
+                const int g = (px[1] + px[4] + 1) >> 1;
+                const int r = (px[2] + px[5] + 1) >> 1;
+                out[0] = luma(px[0], px[1], px[2]);
+                out[1] = chroma_u(b, g, r);
+                out[2] = luma(px[3], px[4], px[5]);
+                out[3] = chroma_v(b, g, r);
+            }
+        }
+
+        /**
+         * converts two rows. width must be even
+         **/
+        static void bgr_to_nv12(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1, uint8_t *uv, const int width)
+        {
+            int x = 0;
+#ifdef RPIASGIGE_NEON
+            for (; x + 16 <= width; x += 16) {
+                const uint8x16x3_t px0 = vld3q_u8(bgr0 + 3 * x);
+                const uint8x16x3_t px1 = vld3q_u8(bgr1 + 3 * x);
+                vst1q_u8(y0 + x, luma(px0));
+                vst1q_u8(y1 + x, luma(px1));
+                // chroma of each 2x2 block
+                const uint8x8_t b = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(px0.val[0]), vpaddlq_u8(px1.val[0])), 2);
+                const uint8x8_t g = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(px0.val[1]), vpaddlq_u8(px1.val[1])), 2);
+                const uint8x8_t r = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(px0.val[2]), vpaddlq_u8(px1.val[2])), 2);
+                uint8x8x2_t out;
+                out.val[0] = chroma_u(b, g, r);
+                out.val[1] = chroma_v(b, g, r);
+                vst2_u8(uv + x, out);
+            }
+#endif
+            for (; x < width; x += 2) {
+                const uint8_t *p0 = bgr0 + 3 * x;
+                const uint8_t *p1 = bgr1 + 3 * x;
+                y0[x] = luma(p0[0], p0[1], p0[2]);
+                y0[x + 1] = luma(p0[3], p0[4], p0[5]);
+                y1[x] = luma(p1[0], p1[1], p1[2]);
+                y1[x + 1] = luma(p1[3], p1[4], p1[5]);
+                const int b = (p0[0] + p0[3] + p1[0] + p1[3] + 2) >> 2;
+                const int g = (p0[1] + p0[4] + p1[1] + p1[4] + 2) >> 2;
+                const int r = (p0[2] + p0[5] + p1[2] + p1[5] + 2) >> 2;
+                uv[x] = chroma_u(b, g, r);
+                uv[x + 1] = chroma_v(b, g, r);
+            }
+        }
+
+        static void yuyv_to_gray(const uint8_t *yuyv, uint8_t *gray, const int width)
+        {
+            int x = 0;
+#ifdef RPIASGIGE_NEON
+            for (; x + 16 <= width; x += 16) {
+                vst1q_u8(gray + x, vld2q_u8(yuyv + 2 * x).val[0]);
+            }
+#endif
+            for (; x < width; ++x) {
+                gray[x] = yuyv[2 * x];
+            }
+        }
+
+        /**
+         * converts two rows. The chroma of both rows is averaged
+         **/
+        static void yuyv_to_nv12(const uint8_t *yuyv0, const uint8_t *yuyv1, uint8_t *y0, uint8_t *y1, uint8_t *uv, const int width)
+        {
+            int x = 0;
+#ifdef RPIASGIGE_NEON
+            for (; x + 16 <= width; x += 16) {
+                const uint8x16x2_t px0 = vld2q_u8(yuyv0 + 2 * x);
+                const uint8x16x2_t px1 = vld2q_u8(yuyv1 + 2 * x);
+                vst1q_u8(y0 + x, px0.val[0]);
+                vst1q_u8(y1 + x, px1.val[0]);
+                vst1q_u8(uv + x, vrhaddq_u8(px0.val[1], px1.val[1]));
+            }
+#endif
+            for (; x < width; ++x) {
+                y0[x] = yuyv0[2 * x];
+                y1[x] = yuyv1[2 * x];
+                uv[x] = static_cast<uint8_t>((yuyv0[2 * x + 1] + yuyv1[2 * x + 1] + 1) >> 1);
+            }
+        }
+
+    private:
+
+        // full range gray, scaled by 256
+        static const uint8_t GRAY_B = 29;
+        static const uint8_t GRAY_G = 150;
+        static const uint8_t GRAY_R = 77;
+
+        static uint8_t luma(const int b, const int g, const int r)
+        {
+            return static_cast<uint8_t>(((25 * b + 129 * g + 66 * r + 128) >> 8) + 16);
+        }
+
+        static uint8_t chroma_u(const int b, const int g, const int r)
+        {
+            return static_cast<uint8_t>(((112 * b - 74 * g - 38 * r + 128) >> 8) + 128);
+        }
+
+        static uint8_t chroma_v(const int b, const int g, const int r)
+        {
+            return static_cast<uint8_t>(((-18 * b - 94 * g + 112 * r + 128) >> 8) + 128);
+        }
+
+#ifdef RPIASGIGE_NEON
+        static uint8x16_t luma(const uint8x16x3_t &px)
+        {
+            uint16x8_t low = vmull_u8(vget_low_u8(px.val[0]), vdup_n_u8(25));
+            low = vmlal_u8(low, vget_low_u8(px.val[1]), vdup_n_u8(129));
+            low = vmlal_u8(low, vget_low_u8(px.val[2]), vdup_n_u8(66));
+            uint16x8_t high = vmull_u8(vget_high_u8(px.val[0]), vdup_n_u8(25));
+            high = vmlal_u8(high, vget_high_u8(px.val[1]), vdup_n_u8(129));
+            high = vmlal_u8(high, vget_high_u8(px.val[2]), vdup_n_u8(66));
+            return vaddq_u8(vcombine_u8(vrshrn_n_u16(low, 8), vrshrn_n_u16(high, 8)), vdupq_n_u8(16));
+        }
+
+        static uint8x8_t chroma_u(const uint8x8_t b, const uint8x8_t g, const uint8x8_t r)
+        {
+            int16x8_t sum = vmulq_n_s16(vreinterpretq_s16_u16(vmovl_u8(b)), 112);
+            sum = vmlsq_n_s16(sum, vreinterpretq_s16_u16(vmovl_u8(g)), 74);
+            sum = vmlsq_n_s16(sum, vreinterpretq_s16_u16(vmovl_u8(r)), 38);
+            return offset_chroma(sum);
+        }
+
+        static uint8x8_t chroma_v(const uint8x8_t b, const uint8x8_t g, const uint8x8_t r)
+        {
+            int16x8_t sum = vmulq_n_s16(vreinterpretq_s16_u16(vmovl_u8(r)), 112);
+            sum = vmlsq_n_s16(sum, vreinterpretq_s16_u16(vmovl_u8(g)), 94);
+            sum = vmlsq_n_s16(sum, vreinterpretq_s16_u16(vmovl_u8(b)), 18);
+            return offset_chroma(sum);
+        }
+
+        static uint8x8_t offset_chroma(const int16x8_t sum)
+        {
+            const int16x8_t scaled = vshrq_n_s16(vaddq_s16(sum, vdupq_n_s16(128)), 8);
+            return vqmovun_s16(vaddq_s16(scaled, vdupq_n_s16(128)));
+        }
+#endif
+    };
+
+} // namespace rpiasgige
+
+#endif
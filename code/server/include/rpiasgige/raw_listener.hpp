@@ -0,0 +1,214 @@
+#ifndef RPIASGIGE_RAW_LISTENER_HPP
+#define RPIASGIGE_RAW_LISTENER_HPP
+
+#include <array>
+#include <chrono>
+#include <cstring>
+
+#include <boost/beast/core.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+
+#include "rpiasgige/stream_session.hpp"
+
+namespace beast = boost::beast;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+namespace rpiasgige
+{
+
+    /**
+     * Transport of the raw TCP sessions: the protocol without the websocket handshake and framing. 
+     * Messages are delimited by the data size of their header, and responses are written to the socket 
+     * with a single gathering write.
+     *
+     * As the websocket sessions, the first request, which stands for the handshake, and every request once 
+     * its first byte is read must arrive within SESSION_TIMEOUT_IN_SECONDS. Idle connections are kept. 
+     * The deadline runs on a timer of its own: the responses written while a request is read leave it alone.
+     **/
+    class Raw_Stream
+    {
+
+    public:
+        // requests are a few bytes long. A session is closed on a larger request, likely not sent by a client
+        static const int MAX_REQUEST_DATA_SIZE = 64 * 1024;
+
+        static const char *name()
+        {
+            return "Raw";
+        }
+
+        explicit Raw_Stream(tcp::socket &&socket) : stream(std::move(socket)), read_timer(stream.get_executor()) {}
+
+        beast::tcp_stream::executor_type get_executor()
+        {
+            return this->stream.get_executor();
+        }
+
+        tcp::socket &socket()
+        {
+            return this->stream.socket();
+        }
+
+        bool is_open() const
+        {
+            return this->stream.socket().is_open();
+        }
+
+        /**
+         * no handshake: completes right away
+         **/
+        template <typename Handler>
+        void async_accept(Handler &&handler)
+        {
+            net::post(this->stream.get_executor(), beast::bind_handler(std::forward<Handler>(handler), beast::error_code()));
+        }
+
+        /**
+         * reads the header, then the data it announces
+         **/
+        template <typename Handler>
+        void async_read(beast::flat_buffer &buffer, Handler &&handler)
+        {
+            Read_Operation<typename std::decay<Handler>::type> operation(*this, buffer, std::forward<Handler>(handler));
+            if (this->first_request) {
+                this->first_request = false;
+                operation.start();
+            }
+            this->stream.async_read_some(buffer.prepare(HEADER_SIZE), std::move(operation));
+        }
+
+        template <typename Handler>
+        void async_write(char *response_buffer, const int response_size, const char *payload, const int payload_size, Handler &&handler)
+        {
+            // the header frames the message: its data size must match what is sent
+            const int data_size = response_size - HEADER_SIZE + payload_size;
+            memcpy(response_buffer + DATA_SIZE_ADDRESS, &data_size, sizeof(data_size));
+
+            // responses have no deadline
+            // a single sendmsg for both buffers whenever the socket takes them at once
+            std::array<net::const_buffer, 2> buffers = {{
+                net::buffer(response_buffer, response_size),
+                net::buffer(payload, payload_size)
+            }};
+            net::async_write(this->stream, buffers, std::forward<Handler>(handler));
+        }
+
+        template <typename Handler>
+        void async_close(Handler &&handler)
+        {
+            beast::error_code ec;
+            this->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+            this->stream.close();
+            net::post(this->stream.get_executor(), beast::bind_handler(std::forward<Handler>(handler), ec));
+        }
+
+    private:
+        beast::tcp_stream stream;
+        bool first_request = true;
+
+        // deadline of the request being read, if any
+        net::steady_timer read_timer;
+        bool read_timed_out = false;
+
+        /**
+         * closes the socket, thus failing the read, unless the request is read before SESSION_TIMEOUT_IN_SECONDS
+         **/
+        void arm_read_timer()
+        {
+            this->read_timer.expires_after(std::chrono::seconds(SESSION_TIMEOUT_IN_SECONDS));
+            this->read_timer.async_wait([this](beast::error_code ec) {
+                // the timer may have expired right before the request was read: it was disarmed meanwhile
+                if (ec || this->read_timer.expiry() > std::chrono::steady_clock::now()) {
+                    return;
+                }
+                this->read_timed_out = true;
+                this->stream.close();
+            });
+        }
+
+        void disarm_read_timer()
+        {
+            this->read_timer.expires_at(net::steady_timer::time_point::max());
+        }
+
+        template <typename Handler>
+        struct Read_Operation
+        {
+            Raw_Stream &owner;
+            beast::flat_buffer &buffer;
+            Handler handler;
+            bool started;
+            bool header_read;
+
+            template <typename H>
+            Read_Operation(Raw_Stream &_owner, beast::flat_buffer &_buffer, H &&_handler) :
+                owner(_owner), buffer(_buffer), handler(std::forward<H>(_handler)), started(false), header_read(false) {}
+
+            /**
+             * the rest of the request must be read before the deadline
+             **/
+            void start()
+            {
+                this->started = true;
+                this->owner.arm_read_timer();
+            }
+
+            void operator()(beast::error_code ec, std::size_t bytes_transferred)
+            {
+                if (!ec) {
+                    this->buffer.commit(bytes_transferred);
+                }
+                if (ec || this->header_read) {
+                    this->complete(ec);
+                    return;
+                }
+
+                if (!this->started) {
+                    this->start();
+                }
+
+                const std::size_t size = this->buffer.size();
+                if (size < static_cast<std::size_t>(HEADER_SIZE)) {
+                    net::async_read(this->owner.stream, this->buffer.prepare(HEADER_SIZE - size), std::move(*this));
+                    return;
+                }
+
+                int data_size;
+                memcpy(&data_size, static_cast<const char *>(this->buffer.data().data()) + DATA_SIZE_ADDRESS, sizeof(data_size));
+                if (data_size < 0 || data_size > MAX_REQUEST_DATA_SIZE) {
+                    this->complete(net::error::message_size);
+                    return;
+                }
+
+                this->header_read = true;
+                net::async_read(this->owner.stream, this->buffer.prepare(data_size), std::move(*this));
+            }
+
+            void complete(beast::error_code ec)
+            {
+                if (this->started) {
+                    this->owner.disarm_read_timer();
+                }
+                if (this->owner.read_timed_out) {
+                    this->owner.read_timed_out = false;
+                    ec = beast::error::timeout;
+                }
+                this->handler(ec, this->buffer.size());
+            }
+        };
+    };
+
+    typedef Stream_Session<Raw_Stream> Raw_Session;
+
+    /**
+     * Accepts raw TCP connections and starts a session for each of them.
+     **/
+    typedef Stream_Listener<Raw_Stream> Raw_Listener;
+
+} // namespace rpiasgige
+
+#endif
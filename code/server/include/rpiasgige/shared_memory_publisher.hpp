@@ -0,0 +1,249 @@
+#ifndef RPIASGIGE_SHARED_MEMORY_PUBLISHER_HPP
+#define RPIASGIGE_SHARED_MEMORY_PUBLISHER_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "captured_frame.hpp"
+#include "dumb_logger.hpp"
+#include "frame_sink.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * First bytes of the shared memory segment. The layout is part of the protocol: see docs/protocol.MD
+     **/
+    struct Shared_Memory_Header
+    {
+        static const uint32_t MAGIC = 0x53414752; // "RGAS"
+        static const uint32_t VERSION = 1;
+
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint32_t slot_count = 0;
+        // bytes of pixels a slot holds
+        uint32_t slot_size = 0;
+        // frames published so far. Readers wait on it with FUTEX_WAIT
+        std::atomic<uint32_t> published{0};
+        // readers sleeping on published. The publisher skips FUTEX_WAKE while there is none
+        std::atomic<uint32_t> waiters{0};
+        // set when the publisher goes away. Readers must attach again
+        std::atomic<uint32_t> closed{0};
+        uint32_t reserved[9] = {};
+    };
+
+    /**
+     * Header of each slot, followed by its pixels. version is a sequence lock: odd while the slot is being written
+     **/
+    struct Shared_Slot_Header
+    {
+        std::atomic<uint32_t> version{0};
+        int32_t rows = 0;
+        int32_t cols = 0;
+        int32_t type = 0;
+        int32_t data_size = 0;
+        int32_t reserved = 0;
+        Frame_Info info;
+        int64_t padding = 0;
+    };
+
+    static_assert(sizeof(Shared_Memory_Header) == 64, "The shared memory layout is part of the protocol");
+    static_assert(sizeof(Shared_Slot_Header) == 64, "The shared memory layout is part of the protocol");
+
+    /**
+     * Publishes the frames of a camera in a POSIX shared memory segment, for clients running on the same host.
+     *
+     * Frames go round a few slots, each guarded by a sequence lock: a single writer never waits for the readers,
+     * which copy the latest frame and retry if it was overwritten meanwhile. Readers waiting for a new frame sleep
+     * on a futex woken by each publication.
+     **/
+    class Shared_Memory_Publisher : public Frame_Sink
+    {
+    public:
+
+        static const int DEFAULT_SLOT_COUNT = 4;
+
+        Shared_Memory_Publisher(const std::string &_name, const int _max_frame_size, const int _slot_count = DEFAULT_SLOT_COUNT) :
+            name(_name), max_frame_size(_max_frame_size), slot_count(_slot_count), logger("Shared_Memory_Publisher") {}
+
+        virtual ~Shared_Memory_Publisher() {
+            this->close();
+        }
+
+        /**
+         * Creates the segment, replacing any segment left behind with the same name, e.g., by a crashed server
+         **/
+        bool open()
+        {
+            if (this->memory != nullptr) {
+                return true;
+            }
+            if (this->name.size() < 2 || this->name[0] != '/' || this->name.find('/', 1) != std::string::npos) {
+                this->logger.warn_msg("Invalid shared memory name " + this->name + ". It must look like /name");
+                return false;
+            }
+            if (this->max_frame_size <= 0 || this->slot_count <= 0) {
+                return false;
+            }
+
+            this->slot_stride = sizeof(Shared_Slot_Header) + align(this->max_frame_size);
+            this->segment_size = sizeof(Shared_Memory_Header) + this->slot_stride * this->slot_count;
+
+            shm_unlink(this->name.c_str());
+            const int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+            if (fd < 0) {
+                this->logger.warn_msg("Failed to create shared memory " + this->name + ": " + strerror(errno));
+                return false;
+            }
+            void *address = MAP_FAILED;
+            if (ftruncate(fd, static_cast<off_t>(this->segment_size)) == 0) {
+                address = mmap(nullptr, this->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            if (address == MAP_FAILED) {
+                this->logger.warn_msg("Failed to map shared memory " + this->name + ": " + strerror(errno));
+                ::close(fd);
+                shm_unlink(this->name.c_str());
+                return false;
+            }
+            // the mapping stays valid once the descriptor is closed
+            ::close(fd);
+
+            this->memory = static_cast<char *>(address);
+            // the memory is zeroed: the header is set last so that readers attaching meanwhile see no slot yet
+            for (int i = 0; i < this->slot_count; ++i) {
+                new (this->get_slot(i)) Shared_Slot_Header();
+            }
+            Shared_Memory_Header *header = new (this->memory) Shared_Memory_Header();
+            header->slot_count = static_cast<uint32_t>(this->slot_count);
+            header->slot_size = static_cast<uint32_t>(align(this->max_frame_size));
+            this->published = 0;
+
+            this->logger.debug_msg("publishing frames on shared memory " + this->name);
+            return true;
+        }
+
+        /**
+         * Marks the segment closed, so that readers attach again, and removes its name
+         **/
+        void close()
+        {
+            if (this->memory != nullptr) {
+                Shared_Memory_Header *header = this->get_header();
+                header->closed.store(1, std::memory_order_release);
+                // readers waiting on published wake up and see the segment closed
+                header->published.fetch_add(1, std::memory_order_release);
+                wake(header);
+                munmap(this->memory, this->segment_size);
+                shm_unlink(this->name.c_str());
+                this->memory = nullptr;
+            }
+        }
+
+        /**
+         * Copies image into the oldest slot and wakes the waiting readers. Must be called from a single thread.
+         * Returns false if the image is larger than the slots
+         **/
+        virtual bool publish(const cv::Mat &image, const Frame_Info &info)
+        {
+            if (this->memory == nullptr) {
+                return false;
+            }
+            const size_t data_size = image.total() * image.elemSize();
+            if (data_size > static_cast<size_t>(this->max_frame_size)) {
+                if (!this->oversize_reported) {
+                    this->logger.warn_msg("Frames larger than " + std::to_string(this->max_frame_size) + " bytes are not published on shared memory");
+                    this->oversize_reported = true;
+                }
+                return false;
+            }
+
+            Shared_Memory_Header *header = this->get_header();
+            Shared_Slot_Header *slot = this->get_slot(static_cast<int>(this->published % this->slot_count));
+            const uint32_t version = slot->version.load(std::memory_order_relaxed);
+            slot->version.store(version + 1, std::memory_order_relaxed);
+            // orders the odd version before the writes below, as seen by the readers
+            std::atomic_thread_fence(std::memory_order_release);
+
+            slot->rows = image.rows;
+            slot->cols = image.cols;
+            slot->type = image.type();
+            slot->data_size = static_cast<int32_t>(data_size);
+            slot->info = info;
+            char *data = reinterpret_cast<char *>(slot) + sizeof(Shared_Slot_Header);
+            if (image.isContinuous()) {
+                memcpy(data, image.data, data_size);
+            } else {
+                const size_t row_size = image.cols * image.elemSize();
+                for (int i = 0; i < image.rows; ++i) {
+                    memcpy(data + i * row_size, image.ptr(i), row_size);
+                }
+            }
+
+            slot->version.store(version + 2, std::memory_order_release);
+            this->published++;
+            header->published.store(this->published, std::memory_order_release);
+            // the waiter count is read after published: a reader counted later checks published before sleeping
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (header->waiters.load(std::memory_order_relaxed) > 0) {
+                wake(header);
+            }
+            return true;
+        }
+
+        const std::string &get_name() const {
+            return this->name;
+        }
+
+        bool is_open() const {
+            return this->memory != nullptr;
+        }
+
+    private:
+
+        static size_t align(const size_t size) {
+            return (size + 63) / 64 * 64;
+        }
+
+        static void wake(Shared_Memory_Header *header) {
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&header->published), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+
+        Shared_Memory_Header *get_header() {
+            return reinterpret_cast<Shared_Memory_Header *>(this->memory);
+        }
+
+        Shared_Slot_Header *get_slot(const int index) {
+            return reinterpret_cast<Shared_Slot_Header *>(this->memory + sizeof(Shared_Memory_Header) + this->slot_stride * index);
+        }
+
+        const std::string name;
+        const int max_frame_size;
+        const int slot_count;
+
+        char *memory = nullptr;
+        size_t slot_stride = 0;
+        size_t segment_size = 0;
+        uint32_t published = 0;
+        bool oversize_reported = false;
+
+        const Logger logger;
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef RPIASGIGE_SOCKET_OPTIONS_HPP
+#define RPIASGIGE_SOCKET_OPTIONS_HPP
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <boost/asio/ip/tcp.hpp>
+
+namespace rpiasgige
+{
+
+    /**
+     * TCP tuning applied to every accepted connection. Buffer sizes of 0 keep the system defaults.
+     **/
+    struct Socket_Options
+    {
+        // small replies such as PONG or GET0 are sent right away instead of waiting for the previous ACK
+        bool no_delay = true;
+        int send_buffer_size = 0;
+        int receive_buffer_size = 0;
+        // microseconds spent polling the network device before a blocking read sleeps. Linux only, raising it needs CAP_NET_ADMIN
+        int busy_poll = 0;
+        // ACK received segments immediately. Linux only. The kernel clears it from time to time, so it is set again after each read
+        bool quick_ack = false;
+
+        /**
+         * applies the options to socket. On failure, error tells which option was refused
+         **/
+        bool apply(boost::asio::ip::tcp::socket &socket, std::string &error) const
+        {
+            boost::system::error_code ec;
+
+            socket.set_option(boost::asio::ip::tcp::no_delay(this->no_delay), ec);
+            if (ec) {
+                error = "TCP_NODELAY: " + ec.message();
+                return false;
+            }
+
+            if (this->send_buffer_size > 0) {
+                socket.set_option(boost::asio::socket_base::send_buffer_size(this->send_buffer_size), ec);
+                if (ec) {
+                    error = "SO_SNDBUF: " + ec.message();
+                    return false;
+                }
+            }
+
+            if (this->receive_buffer_size > 0) {
+                socket.set_option(boost::asio::socket_base::receive_buffer_size(this->receive_buffer_size), ec);
+                if (ec) {
+                    error = "SO_RCVBUF: " + ec.message();
+                    return false;
+                }
+            }
+
+            if (this->busy_poll > 0) {
+#ifdef SO_BUSY_POLL
+                if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &this->busy_poll, sizeof(this->busy_poll)) != 0) {
+                    error = std::string("SO_BUSY_POLL: ") + strerror(errno);
+                    return false;
+                }
+#else
+                error = "SO_BUSY_POLL is not supported on this platform";
+                return false;
+#endif
+            }
+
+            if (this->quick_ack && !set_quick_ack(socket)) {
+                error = std::string("TCP_QUICKACK: ") + strerror(errno);
+                return false;
+            }
+
+            return true;
+        }
+
+        static bool set_quick_ack(boost::asio::ip::tcp::socket &socket)
+        {
+#ifdef TCP_QUICKACK
+            const int enabled = 1;
+            return setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_QUICKACK, &enabled, sizeof(enabled)) == 0;
+#else
+            errno = ENOPROTOOPT;
+            return false;
+#endif
+        }
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,532 @@
+#ifndef RPIASGIGE_STREAM_SESSION_HPP
+#define RPIASGIGE_STREAM_SESSION_HPP
+
+#include <string.h>
+
+#include <array>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+#include "rpiasgige/dumb_logger.hpp"
+#include "rpiasgige/generic_server.hpp"
+#include "rpiasgige/socket_options.hpp"
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+namespace rpiasgige
+{
+
+    // time given to a client to complete its handshake, or a request it started. Idle connections are kept
+    static const int SESSION_TIMEOUT_IN_SECONDS = 30;
+
+    /**
+     * One client connection. Requests are read and answered asynchronously on the session strand.
+     * Serving a request may wait for a camera, so the server processes it on the request pool and
+     * the strand resumes once it is done: a slow grab never holds a thread serving the connections.
+     *
+     * Responses are queued so that the next request can be read and processed while the previous
+     * response is still being written. Each queued response owns its Session, thus its payload memory.
+     *
+     * While the client is streaming, pushed messages join the same queue. At most one of them is queued
+     * at a time: a client slower than the camera receives the latest frame instead of a growing backlog.
+     * Pushed frames are loaded on the request pool as well, never while a request is processed: both use the connection.
+     *
+     * Transport frames the messages on the socket, see Websocket_Stream and Raw_Stream. It provides:
+     *  - name(), naming the sessions in the log
+     *  - Transport(tcp::socket &&socket), get_executor() and socket()
+     *  - async_accept(handler(ec)): the handshake, if any
+     *  - async_read(flat_buffer &buffer, handler(ec, bytes_transferred)): reads a whole message into buffer
+     *  - async_write(response_buffer, response_size, payload, payload_size, handler(ec, bytes_transferred)):
+     *    writes the message made of the response buffer followed by its payload
+     *  - is_open() and async_close(handler(ec))
+     **/
+    template <class Transport>
+    class Stream_Session : public std::enable_shared_from_this<Stream_Session<Transport>>
+    {
+
+    public:
+        Stream_Session(tcp::socket &&socket, Websocket_Server &_server, net::thread_pool &_request_pool, bool _quick_ack = false) :
+            stream(std::move(socket)), server(_server), request_pool(_request_pool), logger(std::string(Transport::name()) + "_Session"), quick_ack(_quick_ack) {}
+
+        virtual ~Stream_Session() {
+            this->unsubscribe();
+        }
+
+        void run()
+        {
+            net::dispatch(this->stream.get_executor(), beast::bind_front_handler(&Stream_Session::on_run, this->shared_from_this()));
+        }
+
+        /**
+         * closes the connection once the queued responses are written
+         **/
+        void close()
+        {
+            net::post(this->stream.get_executor(), beast::bind_front_handler(&Stream_Session::do_close, this->shared_from_this()));
+        }
+
+        static const size_t MAX_QUEUED_RESPONSES = 4;
+
+    private:
+
+        struct Response
+        {
+            char buffer[RESPONSE_BUFFER_SIZE];
+            int size = 0;
+            bool pushed = false;
+            std::unique_ptr<Session> session;
+        };
+
+        Transport stream;
+        Websocket_Server &server;
+        net::thread_pool &request_pool;
+        const Logger logger;
+        const bool quick_ack;
+
+        // reused by every request: it only grows when a request is larger than all the previous ones
+        beast::flat_buffer read_buffer;
+        size_t read_buffer_capacity = 0;
+
+        std::unique_ptr<Connection> connection;
+        int subscription_id = -1;
+        bool push_queued = false;
+        bool push_available = false;
+
+        std::deque<std::unique_ptr<Response>> write_queue;
+        std::vector<std::unique_ptr<Response>> spare_responses;
+
+        // response to the request being processed on the request pool, if any
+        std::unique_ptr<Response> processed_response;
+
+        // pushed frame being loaded on the request pool, if any
+        std::unique_ptr<Response> prepared_push;
+
+        // set from the read of a request until it is processed: the next request is read afterwards
+        bool reading = false;
+        bool closing = false;
+        bool failed = false;
+
+        void on_run()
+        {
+            this->connection.reset(this->server.create_connection());
+            this->stream.async_accept(beast::bind_front_handler(&Stream_Session::on_accept, this->shared_from_this()));
+        }
+
+        void on_accept(beast::error_code ec)
+        {
+            if (ec) {
+                this->fail(ec, "accept");
+                return;
+            }
+            this->do_read();
+        }
+
+        void do_read()
+        {
+            this->reading = true;
+            this->read_buffer_capacity = this->read_buffer.capacity();
+            this->stream.async_read(this->read_buffer, beast::bind_front_handler(&Stream_Session::on_read, this->shared_from_this()));
+        }
+
+        void on_read(beast::error_code ec, std::size_t bytes_transferred)
+        {
+            boost::ignore_unused(bytes_transferred);
+
+            if (ec) {
+                this->reading = false;
+                if (ec != websocket::error::closed && ec != net::error::eof && ec != net::error::operation_aborted) {
+                    this->fail(ec, "read");
+                }
+                this->failed = true;
+                this->unsubscribe();
+                return;
+            }
+
+            if (this->quick_ack) {
+                Socket_Options::set_quick_ack(this->stream.socket());
+            }
+
+            this->processed_response = this->acquire_response();
+
+            if (this->read_buffer.capacity() != this->read_buffer_capacity) {
+                this->server.count_allocation();
+            }
+
+            // otherwise the request is processed once the push being loaded is done, see on_push_prepared
+            if (!this->prepared_push) {
+                net::post(this->request_pool, beast::bind_front_handler(&Stream_Session::process_request, this->shared_from_this()));
+            }
+        }
+
+        /**
+         * runs on the request pool. The strand leaves the read buffer, the processed response and the connection
+         * alone until on_processed
+         **/
+        void process_request()
+        {
+            Response &response = *this->processed_response;
+
+            const int request_size = this->read_buffer.size();
+            const char *request_buffer = static_cast<const char *>(this->read_buffer.data().data());
+
+            try {
+                this->server.process_client(request_buffer, request_size, response.buffer, response.size, *response.session);
+            } catch (const std::exception &e) {
+                // e.g. cv::Exception or std::bad_alloc: the request fails, not the server
+                this->logger.error_msg(std::string("request: ") + e.what());
+                this->refuse(request_buffer, request_size, response);
+            }
+
+            net::post(this->stream.get_executor(), beast::bind_front_handler(&Stream_Session::on_processed, this->shared_from_this()));
+        }
+
+        /**
+         * answers NOPE to a request whose processing threw
+         **/
+        static void refuse(const char *request_buffer, const int request_size, Response &response)
+        {
+            memset(response.buffer, 0, HEADER_SIZE);
+            memcpy(response.buffer + STATUS_ADDRESS, "NOPE", STATUS_SIZE);
+            if (request_size > KEEP_ALIVE_ADDRESS) {
+                response.buffer[KEEP_ALIVE_ADDRESS] = request_buffer[KEEP_ALIVE_ADDRESS];
+            }
+            response.size = HEADER_SIZE;
+            response.session->payload = nullptr;
+            response.session->payload_size = 0;
+        }
+
+        void on_processed()
+        {
+            this->reading = false;
+            this->read_buffer.consume(this->read_buffer.size());
+
+            std::unique_ptr<Response> response = std::move(this->processed_response);
+
+            // the connection was closed meanwhile
+            if (this->failed || (this->closing && this->write_queue.empty())) {
+                this->spare_responses.push_back(std::move(response));
+                return;
+            }
+
+            this->enqueue(std::move(response));
+
+            this->update_subscription();
+
+            // a frame arrived while the request was processed
+            if (!this->push_queued && this->push_available) {
+                this->push_available = false;
+                this->on_push_available();
+            }
+
+            if (this->write_queue.size() < MAX_QUEUED_RESPONSES && !this->closing) {
+                this->do_read();
+            }
+        }
+
+        void enqueue(std::unique_ptr<Response> response)
+        {
+            this->write_queue.push_back(std::move(response));
+            if (this->write_queue.size() == 1) {
+                this->do_write();
+            }
+        }
+
+        void update_subscription()
+        {
+            if (this->connection->streaming && this->subscription_id < 0) {
+                std::weak_ptr<Stream_Session> weak_self = this->shared_from_this();
+                this->subscription_id = this->server.subscribe(*this->connection, [weak_self]() {
+                    std::shared_ptr<Stream_Session> self = weak_self.lock();
+                    if (self) {
+                        net::post(self->stream.get_executor(), beast::bind_front_handler(&Stream_Session::on_push_available, self));
+                    }
+                });
+            } else if (!this->connection->streaming) {
+                this->unsubscribe();
+            }
+        }
+
+        void unsubscribe()
+        {
+            if (this->subscription_id >= 0) {
+                this->server.unsubscribe(this->subscription_id);
+                this->subscription_id = -1;
+            }
+        }
+
+        void on_push_available()
+        {
+            // a request being processed may change the connection: the push waits for it
+            if (this->processed_response || this->prepared_push) {
+                this->push_available = true;
+                return;
+            }
+            if (!this->connection->streaming || this->closing || this->failed) {
+                return;
+            }
+            if (this->push_queued) {
+                this->push_available = true;
+                return;
+            }
+
+            // loading the frame may wait for the camera, compress it, etc.: it must not hold the strand
+            this->prepared_push = this->acquire_response();
+            net::post(this->request_pool, beast::bind_front_handler(&Stream_Session::prepare_push, this->shared_from_this()));
+        }
+
+        /**
+         * runs on the request pool, as process_request. The strand leaves the prepared push and the connection 
+         * alone until on_push_prepared
+         **/
+        void prepare_push()
+        {
+            Response &response = *this->prepared_push;
+
+            bool ready = false;
+            try {
+                ready = this->server.process_push(response.buffer, response.size, *response.session);
+            } catch (const std::exception &e) {
+                // the frame is skipped, as if there was nothing to push
+                this->logger.error_msg(std::string("push: ") + e.what());
+            }
+
+            net::post(this->stream.get_executor(), beast::bind_front_handler(&Stream_Session::on_push_prepared, this->shared_from_this(), ready));
+        }
+
+        void on_push_prepared(bool ready)
+        {
+            std::unique_ptr<Response> response = std::move(this->prepared_push);
+
+            if (ready && this->connection->streaming && !this->closing && !this->failed) {
+                response->pushed = true;
+                this->push_queued = true;
+                this->enqueue(std::move(response));
+            } else {
+                this->spare_responses.push_back(std::move(response));
+            }
+
+            // a request was read while the frame was loaded
+            if (this->processed_response) {
+                net::post(this->request_pool, beast::bind_front_handler(&Stream_Session::process_request, this->shared_from_this()));
+            } else if (!this->push_queued && this->push_available) {
+                this->push_available = false;
+                this->on_push_available();
+            }
+        }
+
+        void do_write()
+        {
+            Response &response = *this->write_queue.front();
+            this->stream.async_write(response.buffer, response.size, response.session->payload, response.session->payload_size,
+                beast::bind_front_handler(&Stream_Session::on_write, this->shared_from_this()));
+        }
+
+        void on_write(beast::error_code ec, std::size_t bytes_transferred)
+        {
+            boost::ignore_unused(bytes_transferred);
+
+            if (ec) {
+                if (ec != net::error::operation_aborted) {
+                    this->fail(ec, "write");
+                }
+                this->failed = true;
+                return;
+            }
+
+            std::unique_ptr<Response> written = std::move(this->write_queue.front());
+            this->write_queue.pop_front();
+            if (written->pushed) {
+                written->pushed = false;
+                this->push_queued = false;
+            }
+            this->spare_responses.push_back(std::move(written));
+
+            if (!this->write_queue.empty()) {
+                this->do_write();
+            }
+
+            // a frame arrived while the previous push was queued
+            if (!this->push_queued && this->push_available) {
+                this->push_available = false;
+                this->on_push_available();
+            }
+
+            if (this->write_queue.empty() && this->closing) {
+                this->do_close();
+                return;
+            }
+
+            if (!this->reading && !this->closing && !this->failed && this->write_queue.size() < MAX_QUEUED_RESPONSES) {
+                this->do_read();
+            }
+        }
+
+        void do_close()
+        {
+            this->closing = true;
+            this->unsubscribe();
+            if (this->failed || !this->stream.is_open()) {
+                return;
+            }
+            if (this->write_queue.empty()) {
+                this->stream.async_close(beast::bind_front_handler(&Stream_Session::on_close, this->shared_from_this()));
+            }
+        }
+
+        void on_close(beast::error_code ec)
+        {
+            if (ec && ec != net::error::operation_aborted) {
+                this->fail(ec, "close");
+            }
+        }
+
+        std::unique_ptr<Response> acquire_response()
+        {
+            std::unique_ptr<Response> result;
+            if (this->spare_responses.empty()) {
+                result.reset(new Response());
+                result->session.reset(this->server.create_session());
+                this->server.count_allocation();
+            } else {
+                result = std::move(this->spare_responses.back());
+                this->spare_responses.pop_back();
+            }
+            result->session->connection = this->connection.get();
+            return result;
+        }
+
+        void fail(beast::error_code ec, const std::string &what)
+        {
+            this->logger.warn_msg(what + ": " + ec.message());
+        }
+    };
+
+    /**
+     * Accepts TCP connections and starts a Stream_Session<Transport> for each of them.
+     **/
+    template <class Transport>
+    class Stream_Listener : public std::enable_shared_from_this<Stream_Listener<Transport>>
+    {
+
+    public:
+        typedef Stream_Session<Transport> Session_Type;
+
+        Stream_Listener(net::io_context &_ioc, Websocket_Server &_server, net::thread_pool &_request_pool) :
+            ioc(_ioc), acceptor(net::make_strand(_ioc)), server(_server), request_pool(_request_pool), logger(std::string(Transport::name()) + "_Listener") {}
+
+        virtual ~Stream_Listener() {}
+
+        bool open(const tcp::endpoint &endpoint)
+        {
+            beast::error_code ec;
+
+            this->acceptor.open(endpoint.protocol(), ec);
+            if (!ec) this->acceptor.set_option(net::socket_base::reuse_address(true), ec);
+            if (!ec) this->acceptor.bind(endpoint, ec);
+            if (!ec) this->acceptor.listen(net::socket_base::max_listen_connections, ec);
+
+            if (ec) {
+                this->logger.error_msg("cannot listen on " + endpoint.address().to_string() + ":" + std::to_string(endpoint.port()) + ": " + ec.message());
+            }
+            return !ec;
+        }
+
+        void run()
+        {
+            net::dispatch(this->acceptor.get_executor(), beast::bind_front_handler(&Stream_Listener::do_accept, this->shared_from_this()));
+        }
+
+        /**
+         * TCP options applied to the accepted connections. Call it before run()
+         **/
+        void set_socket_options(const Socket_Options &options)
+        {
+            this->socket_options = options;
+        }
+
+        /**
+         * stops accepting connections and closes the current ones
+         **/
+        void stop()
+        {
+            net::post(this->acceptor.get_executor(), beast::bind_front_handler(&Stream_Listener::do_stop, this->shared_from_this()));
+        }
+
+    private:
+        net::io_context &ioc;
+        tcp::acceptor acceptor;
+        Websocket_Server &server;
+        net::thread_pool &request_pool;
+        const Logger logger;
+        Socket_Options socket_options;
+
+        std::vector<std::weak_ptr<Session_Type>> sessions;
+
+        void do_accept()
+        {
+            this->acceptor.async_accept(net::make_strand(this->ioc), beast::bind_front_handler(&Stream_Listener::on_accept, this->shared_from_this()));
+        }
+
+        void on_accept(beast::error_code ec, tcp::socket socket)
+        {
+            if (!this->acceptor.is_open() || !this->server.is_online()) {
+                return;
+            }
+
+            if (ec) {
+                this->logger.warn_msg("accept: " + ec.message());
+            } else {
+                std::string error;
+                if (!this->socket_options.apply(socket, error)) {
+                    this->logger.warn_msg("socket options: " + error);
+                }
+                std::shared_ptr<Session_Type> session = std::make_shared<Session_Type>(std::move(socket), this->server, this->request_pool, this->socket_options.quick_ack);
+                this->forget_closed_sessions();
+                this->sessions.push_back(session);
+                session->run();
+            }
+
+            this->do_accept();
+        }
+
+        void do_stop()
+        {
+            beast::error_code ec;
+            this->acceptor.close(ec);
+
+            for (size_t i = 0; i < this->sessions.size(); ++i) {
+                std::shared_ptr<Session_Type> session = this->sessions[i].lock();
+                if (session) {
+                    session->close();
+                }
+            }
+            this->sessions.clear();
+        }
+
+        void forget_closed_sessions()
+        {
+            std::vector<std::weak_ptr<Session_Type>> alive;
+            for (size_t i = 0; i < this->sessions.size(); ++i) {
+                if (!this->sessions[i].expired()) {
+                    alive.push_back(this->sessions[i]);
+                }
+            }
+            this->sessions.swap(alive);
+        }
+    };
+
+} // namespace rpiasgige
+
+#endif
@@ -2,6 +2,14 @@
 #define RPIASGIGE_CAMERA_USB_INTERFACE_HPP
 
 #include <map>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <vector>
 
 #include <linux/types.h>
 #include <linux/v4l2-common.h>
@@ -20,17 +28,30 @@
 #include <opencv2/opencv.hpp>
 
 #include "dumb_logger.hpp"
+#include "latest_frame_slot.hpp"
+#include "captured_frame.hpp"
+#include "frame_ring.hpp"
+#include "frame_sink.hpp"
+#include "v4l2_capture.hpp"
 
 namespace rpiasgige
 {
 
+    enum class Capture_Backend
+    {
+        OPENCV,
+        V4L2
+    };
+
     class USB_Interface
     {
 
     public:
 
         USB_Interface() : logger("USB_Interface") {}
-        virtual ~USB_Interface() {}
+        virtual ~USB_Interface() {
+            this->stop_continuous_capture();
+        }
 
         void set_camera_path(const std::string &camera_path) {
             this->camera_path = camera_path;
@@ -40,11 +61,32 @@ namespace rpiasgige
             this->usb_bus_id = usb_bus_id;
         }
 
+        /**
+         * Selects how the device is read. Takes effect on the next open_camera()
+         **/
+        void set_capture_backend(Capture_Backend backend) {
+            this->backend = backend;
+        }
+
+        Capture_Backend get_capture_backend() const {
+            return this->backend;
+        }
+
+        /**
+         * number of memory mapped buffers used by the V4L2 backend
+         **/
+        bool set_v4l2_buffer_count(int count) {
+            std::lock_guard<std::mutex> lock(this->capture_mutex);
+            this->release_driver_images();
+            return this->v4l2_capture.set_buffer_count(count);
+        }
+
         bool open_camera()
         {
             bool result = false;
 
-            if (!this->capture.isOpened()) {
+            std::lock_guard<std::mutex> lock(this->capture_mutex);
+            if (!this->device_is_opened()) {
                 result = this->connect_to_device();
             } else {
                 result = true;
@@ -53,45 +95,236 @@ namespace rpiasgige
         }
 
         bool isOpened() {
-            return this->capture.isOpened();
+            std::lock_guard<std::mutex> lock(this->capture_mutex);
+            return this->device_is_opened();
         }
 
+        /**
+         * Loads a frame into the captured image.
+         * 
+         * In continuous capture mode the camera is not touched at all: the latest frame published by 
+         * the capture thread is copied instead.
+         **/
         bool grab()
         {
+            auto begin_time_ref = std::chrono::steady_clock::now();
 
             bool success = false;
-            if (this->capture.isOpened())
-            {
-                auto begin_time_ref = std::chrono::high_resolution_clock::now();
-                success = this->capture.grab() && this->capture.retrieve(this->captured_image);
-                auto end_time_ref = std::chrono::high_resolution_clock::now();
-                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time_ref - begin_time_ref);
-                auto time_spent = ms.count();
-                if (time_spent > 500) {
-                    std::cerr << "grab took " << time_spent << " milliseconds\n";
+            if (this->continuous_capture) {
+                if (this->fetch_latest_frame()) {
+                    success = this->load_captured_frame(this->latest_frame.front());
+                }
+            } else {
+                std::lock_guard<std::mutex> lock(this->capture_mutex);
+                const unsigned char *previous_frame_data = this->device_frame.image.data;
+                success = this->read_from_device(this->device_frame);
+                this->count_reallocation(this->device_frame.image, previous_frame_data);
+                if (success) {
+                    this->captured_image_compressed = V4L2_Capture::is_left_compressed(this->device_frame);
+                    if (this->device_frame.raw) {
+                        const unsigned char *previous_data = this->captured_image.data;
+                        success = V4L2_Capture::to_image(this->device_frame, this->captured_image);
+                        this->count_reallocation(this->captured_image, previous_data);
+                    } else {
+                        cv::swap(this->device_frame.image, this->captured_image);
+                    }
+                    this->captured_info = this->device_frame.info;
                 }
             }
 
-            if (!success)
-            {
+            this->captured_info.grab_duration = elapsed_microseconds(begin_time_ref);
 
-                if (consecutive_misses >= MAX_CONSECUTIVE_MISSES)
-                {
-                    this->disconnect_device();
+            return success;
+        }
+
+        /**
+         * Number of frames kept by the capture thread for grab_buffered(). 0, the default, keeps none. 
+         * Must be called before starting the continuous capture
+         **/
+        void set_frame_ring_size(int size) {
+            this->frame_ring.set_capacity(size);
+        }
+
+        int get_frame_ring_size() const {
+            return this->frame_ring.get_capacity();
+        }
+
+        /**
+         * Waits up to timeout for the capture thread to reach the frame asked by query. Returns false on timeout. 
+         * Called before grab_buffered() in order to wait for a frame about to be captured without holding any lock
+         **/
+        bool wait_for_buffered_frame(const Frame_Query &query, const std::chrono::milliseconds &timeout) {
+            return this->frame_ring.wait(query, timeout);
+        }
+
+        /**
+         * As grab(), but loads the frame asked by query from the frames kept by the capture thread. 
+         * Returns false if it is no longer kept, or not captured yet
+         **/
+        bool grab_buffered(const Frame_Query &query)
+        {
+            auto begin_time_ref = std::chrono::steady_clock::now();
+
+            bool success = this->frame_ring.find(query, this->buffered_frame) && this->load_captured_frame(this->buffered_frame);
+
+            this->captured_info.grab_duration = elapsed_microseconds(begin_time_ref);
+
+            return success;
+        }
+
+        /**
+         * The continuous capture publishes every frame, decoded, to sink. The frames are decoded once for all 
+         * the sinks by a thread of their own, which skips to the latest frame when the sinks are slower than the camera.
+         * Must be called before starting the continuous capture
+         **/
+        void add_frame_sink(const std::shared_ptr<Frame_Sink> &sink) {
+            this->frame_sinks.push_back(sink);
+        }
+
+        /**
+         * Loads the compressed payload of a frame, exactly as delivered by the camera, without decoding it.
+         * 
+         * It only works with the V4L2 backend and a compressed pixel format such as MJPG.
+         **/
+        bool grab_compressed()
+        {
+            auto begin_time_ref = std::chrono::steady_clock::now();
+
+            bool success = false;
+            if (this->backend != Capture_Backend::V4L2) {
+                return success;
+            }
+
+            if (this->continuous_capture) {
+                if (this->fetch_latest_frame()) {
+                    const Captured_Frame &frame = this->latest_frame.front();
+                    if (frame.raw && V4L2_Capture::is_compressed(frame.pixel_format)) {
+                        const unsigned char *previous_data = this->captured_payload.image.data;
+                        frame.copy_to(this->captured_payload);
+                        this->count_reallocation(this->captured_payload.image, previous_data);
+                        success = true;
+                    }
                 }
-                else
-                {
-                    consecutive_misses++;
+            } else {
+                std::lock_guard<std::mutex> lock(this->capture_mutex);
+                success = this->read_from_device(this->device_frame) && 
+                    this->device_frame.raw && V4L2_Capture::is_compressed(this->device_frame.pixel_format);
+                if (success) {
+                    // device_frame points into a driver buffer, requeued by the next capture or unmapped by set()
+                    const unsigned char *previous_data = this->captured_payload.image.data;
+                    this->device_frame.copy_to(this->captured_payload);
+                    this->count_reallocation(this->captured_payload.image, previous_data);
                 }
             }
-            else
-            {
-                consecutive_misses = 0;
-            }
+
+            this->captured_payload.info.grab_duration = elapsed_microseconds(begin_time_ref);
 
             return success;
         }
 
+        /**
+         * true if the image loaded by the last grab() is the compressed payload of the frame, e.g., MJPG 
+         * with CAP_PROP_CONVERT_RGB off. Its pixels cannot be converted
+         **/
+        bool is_captured_image_compressed() const {
+            return this->captured_image_compressed;
+        }
+
+        /**
+         * true if grab() loads compressed payloads with the current settings
+         **/
+        bool delivers_compressed_images() {
+            std::lock_guard<std::mutex> lock(this->capture_mutex);
+            return this->backend == Capture_Backend::V4L2 && this->device_is_opened() &&
+                V4L2_Capture::is_compressed(static_cast<unsigned int>(this->device_get(cv::CAP_PROP_FOURCC))) &&
+                this->device_get(cv::CAP_PROP_CONVERT_RGB) == 0.0;
+        }
+
+        /**
+         * timestamps of the frame loaded by the last grab()
+         **/
+        const Frame_Info &get_captured_frame_info() const {
+            return this->captured_info;
+        }
+
+        const Captured_Frame &get_compressed_payload() const {
+            return this->captured_payload;
+        }
+
+        /**
+         * Moves the captured image into dest, giving the previous storage of dest back for reuse. 
+         * The image is copied only if its memory is shared, e.g., when it points into a driver buffer.
+         **/
+        void take_captured_image(cv::Mat &dest)
+        {
+            this->take(this->captured_image, dest);
+        }
+
+        void take_compressed_payload(Captured_Frame &dest)
+        {
+            cv::Mat image = dest.image;
+            dest = this->captured_payload;
+            dest.image = image;
+            this->take(this->captured_payload.image, dest.image);
+        }
+
+        /**
+         * number of times frame storage had to be allocated. It stops growing once the frame size is stable
+         **/
+        long get_allocation_count() const {
+            return this->allocation_count;
+        }
+
+        /**
+         * Starts a thread which grabs frames at the sensor rate and publishes the latest one for grab().
+         * The thread waits for the camera to be opened and survives open/release cycles.
+         **/
+        bool start_continuous_capture()
+        {
+            bool result = false;
+            if (!this->continuous_capture) {
+                this->continuous_capture = true;
+                this->capture_thread = std::thread(&USB_Interface::capture_loop, this);
+                if (!this->frame_sinks.empty()) {
+                    this->sink_thread = std::thread(&USB_Interface::sink_loop, this);
+                }
+                this->logger.debug_msg("continuous capture started.");
+                result = true;
+            }
+            return result;
+        }
+
+        void stop_continuous_capture()
+        {
+            if (this->continuous_capture) {
+                this->continuous_capture = false;
+                if (this->capture_thread.joinable()) {
+                    this->capture_thread.join();
+                }
+                {
+                    std::lock_guard<std::mutex> lock(this->sink_mutex);
+                    this->sink_condition.notify_one();
+                }
+                if (this->sink_thread.joinable()) {
+                    this->sink_thread.join();
+                }
+                this->logger.debug_msg("continuous capture stopped.");
+            }
+        }
+
+        bool is_continuous_capture() const {
+            return this->continuous_capture;
+        }
+
+        /**
+         * listener is called by the capture thread each time a new frame is published. Once this returns, the previous
+         * listener is no longer running: its owner may go away. listener must not call set_frame_listener
+         **/
+        void set_frame_listener(const std::function<void()> &listener) {
+            std::lock_guard<std::mutex> lock(this->frame_listener_mutex);
+            this->frame_listener = listener;
+        }
+
         bool retrieve(cv::Mat &dest)
         {
             bool result = false;
@@ -106,7 +339,7 @@ namespace rpiasgige
 
         bool release()
         {
-
+            std::lock_guard<std::mutex> lock(this->capture_mutex);
             return this->disconnect_device();
         }
 
@@ -118,8 +351,9 @@ namespace rpiasgige
         {
             double result;
 
+            std::lock_guard<std::mutex> lock(this->capture_mutex);
             if (this->props.find(propId) == this->props.end()) {
-                result = this->capture.get(propId);
+                result = this->device_get(propId);
             } else {
                 result = this->props[propId];
             }
@@ -130,7 +364,10 @@ namespace rpiasgige
         bool set(int propId, double value)
         {
             bool result = false;
-            if (this->capture.set(propId, value)) {
+            std::lock_guard<std::mutex> lock(this->capture_mutex);
+            // changing the format, the frame rate or the buffer count unmaps the V4L2 buffers
+            this->release_driver_images();
+            if (this->device_set(propId, value)) {
 
                 this->props[propId] = value;
                 result = true;
@@ -149,31 +386,259 @@ namespace rpiasgige
         std::string camera_path;
         std::string usb_bus_id;
 
+        Capture_Backend backend = Capture_Backend::OPENCV;
         cv::VideoCapture capture;
+        V4L2_Capture v4l2_capture;
         cv::Mat captured_image;
+        bool captured_image_compressed = false;
+        Frame_Info captured_info;
+        Captured_Frame captured_payload;
+
+        // V4L2 frames alias driver buffers, so they are read here before being copied anywhere else
+        Captured_Frame device_frame;
+
+        // decoding target swapped with captured_image to avoid allocations
+        cv::Mat image_view;
+
+        // guards capture against concurrent use by the capture thread and the server commands
+        std::mutex capture_mutex;
+
+        std::atomic<bool> continuous_capture{false};
+        std::atomic<bool> device_alive{false};
+        std::thread capture_thread;
+        Latest_Frame_Slot<Captured_Frame> latest_frame;
+
+        // the last frames captured by the capture thread, and the one copied from them by grab_buffered()
+        Frame_Ring frame_ring;
+        Captured_Frame buffered_frame;
+
+        // frames copied by the capture thread for the sink thread, which decodes them into sink_image
+        std::vector<std::shared_ptr<Frame_Sink>> frame_sinks;
+        Latest_Frame_Slot<Captured_Frame> sink_frames;
+        std::thread sink_thread;
+        std::mutex sink_mutex;
+        std::condition_variable sink_condition;
+        bool sink_frame_available = false;
+        cv::Mat sink_image;
+
+        std::mutex frame_listener_mutex;
+        std::function<void()> frame_listener;
+
+        static const int IDLE_CAPTURE_SLEEP_IN_MILLISECONDS = 10;
+
+        /**
+         * grabs a frame from the device into dest. The V4L2 backend leaves the payload undecoded.
+         * Must be called holding capture_mutex
+         **/
+        bool read_from_device(Captured_Frame &dest)
+        {
+            bool success = false;
+            if (this->device_is_opened())
+            {
+                auto begin_time_ref = std::chrono::high_resolution_clock::now();
+                if (this->backend == Capture_Backend::V4L2) {
+                    success = this->v4l2_capture.read_raw(dest);
+                } else {
+                    success = this->capture.grab() && this->capture.retrieve(dest.image);
+                    dest.raw = false;
+                    // OpenCV does not expose the driver sequence: frames dropped by the driver go unnoticed
+                    dest.info.device_timestamp = static_cast<int64_t>(this->capture.get(cv::CAP_PROP_POS_MSEC) * 1000);
+                    dest.info.sequence = this->frames_read;
+                }
+                if (success) {
+                    this->frames_read++;
+                    dest.info.receive_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                }
+                auto end_time_ref = std::chrono::high_resolution_clock::now();
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time_ref - begin_time_ref);
+                auto time_spent = ms.count();
+                if (time_spent > 500) {
+                    std::cerr << "grab took " << time_spent << " milliseconds\n";
+                }
+            }
+
+            if (!success)
+            {
+
+                if (consecutive_misses >= MAX_CONSECUTIVE_MISSES)
+                {
+                    this->disconnect_device();
+                }
+                else
+                {
+                    consecutive_misses++;
+                }
+            }
+            else
+            {
+                consecutive_misses = 0;
+            }
+
+            return success;
+        }
+
+        void capture_loop()
+        {
+            while (this->continuous_capture) {
+                bool opened = false;
+                bool success = false;
+                {
+                    std::lock_guard<std::mutex> lock(this->capture_mutex);
+                    opened = this->device_is_opened();
+                    if (opened) {
+                        Captured_Frame &back = this->latest_frame.back();
+                        const unsigned char *previous_data = back.image.data;
+                        if (this->backend == Capture_Backend::V4L2) {
+                            success = this->read_from_device(this->device_frame);
+                            if (success) {
+                                this->device_frame.copy_to(back);
+                            }
+                        } else {
+                            success = this->read_from_device(back);
+                        }
+                        this->count_reallocation(back.image, previous_data);
+                        if (success) {
+                            // the undecoded payload: V4L2 frames are smaller before being converted to BGR
+                            this->frame_ring.push(back);
+                        }
+                    }
+                    this->device_alive = this->device_is_opened();
+                }
+                if (success) {
+                    // back() is still owned by this thread until published
+                    this->hand_to_sinks(this->latest_frame.back());
+                    this->latest_frame.publish();
+                    this->notify_frame_listener();
+                } else if (!opened) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(IDLE_CAPTURE_SLEEP_IN_MILLISECONDS)));
+                }
+            }
+        }
+
+        void notify_frame_listener()
+        {
+            // called holding the lock, so that set_frame_listener waits for a running call
+            std::lock_guard<std::mutex> lock(this->frame_listener_mutex);
+            if (this->frame_listener) {
+                this->frame_listener();
+            }
+        }
+
+        /**
+         * copies frame, undecoded, for the sink thread. Called by the capture thread only
+         **/
+        void hand_to_sinks(const Captured_Frame &frame)
+        {
+            if (this->frame_sinks.empty()) {
+                return;
+            }
+            Captured_Frame &back = this->sink_frames.back();
+            const unsigned char *previous_data = back.image.data;
+            frame.copy_to(back);
+            this->count_reallocation(back.image, previous_data);
+            this->sink_frames.publish();
+            {
+                std::lock_guard<std::mutex> lock(this->sink_mutex);
+                this->sink_frame_available = true;
+            }
+            this->sink_condition.notify_one();
+        }
+
+        void sink_loop()
+        {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(this->sink_mutex);
+                    this->sink_condition.wait(lock, [this]() {
+                        return this->sink_frame_available || !this->continuous_capture;
+                    });
+                    if (!this->continuous_capture) {
+                        break;
+                    }
+                    this->sink_frame_available = false;
+                }
+                if (this->sink_frames.fetch()) {
+                    this->publish_decoded_frame(this->sink_frames.front());
+                }
+            }
+        }
+
+        /**
+         * decodes frame, if raw, once for all the sinks. Called by the sink thread only
+         **/
+        void publish_decoded_frame(const Captured_Frame &frame)
+        {
+            const cv::Mat *image = &frame.image;
+            if (frame.raw) {
+                const unsigned char *previous_data = this->sink_image.data;
+                if (!V4L2_Capture::to_image(frame, this->sink_image)) {
+                    return;
+                }
+                this->count_reallocation(this->sink_image, previous_data);
+                image = &this->sink_image;
+            }
+            for (size_t i = 0; i < this->frame_sinks.size(); ++i) {
+                this->frame_sinks[i]->publish(*image, frame.info);
+            }
+        }
+
+        /**
+         * decodes frame, if raw, into the captured image
+         **/
+        bool load_captured_frame(const Captured_Frame &frame)
+        {
+            bool success = false;
+            this->captured_image_compressed = V4L2_Capture::is_left_compressed(frame);
+            if (frame.raw) {
+                const unsigned char *previous_data = this->image_view.data;
+                success = V4L2_Capture::to_image(frame, this->image_view);
+                this->count_reallocation(this->image_view, previous_data);
+                if (success) {
+                    if (this->image_view.data == frame.image.data) {
+                        this->copy(this->image_view, this->captured_image);
+                    } else {
+                        cv::swap(this->image_view, this->captured_image);
+                    }
+                }
+            } else {
+                this->copy(frame.image, this->captured_image);
+                success = true;
+            }
+            this->captured_info = frame.info;
+            return success;
+        }
+
+        /**
+         * makes the latest frame published by the capture thread available as latest_frame.front()
+         **/
+        bool fetch_latest_frame()
+        {
+            this->latest_frame.fetch();
+            return this->device_alive && this->latest_frame.has_value() && !this->latest_frame.front().empty();
+        }
 
         bool connect_to_device()
         {
 
             if (!this->camera_path.empty()) {
-                this->capture.open(this->camera_path);
+                this->device_open(this->camera_path);
             } else if (!this->usb_bus_id.empty()) {
                 auto path = this->resolve_usb_interface(this->usb_bus_id);
                 if (!path.empty()) {
-                    this->capture.open(path);
+                    this->device_open(path);
                 }
             } else {
                 return false;
             }
 
-            bool result = this->capture.isOpened();
+            bool result = this->device_is_opened();
 
             if (result)
             {
                 std::map<int, double>::iterator it;
                 for (it = this->props.begin(); it != this->props.end(); it++)
                 {
-                    this->capture.set(it->first, it->second);
+                    this->device_set(it->first, it->second);
                 }
             }
 
@@ -183,13 +648,99 @@ namespace rpiasgige
         bool disconnect_device()
         {
             this->capture.release();
+            this->v4l2_capture.release();
             this->captured_image.release();
+            this->captured_payload.image.release();
+            this->device_frame.image.release();
             this->logger.debug_msg("device disconnected.");
 
             return true;
         }
 
+        /**
+         * drops the images which point into driver buffers, e.g., GREY or unconverted YUYV frames, before they can be unmapped.
+         * Must be called holding capture_mutex
+         **/
+        void release_driver_images()
+        {
+            release_if_borrowed(this->captured_image);
+            release_if_borrowed(this->device_frame.image);
+        }
+
+        static void release_if_borrowed(cv::Mat &image)
+        {
+            if (image.data != nullptr && image.u == nullptr) {
+                image.release();
+            }
+        }
+
+        bool device_open(const std::string &path)
+        {
+            if (this->backend == Capture_Backend::V4L2) {
+                return this->v4l2_capture.open(path);
+            }
+            return this->capture.open(path);
+        }
+
+        bool device_is_opened() const
+        {
+            if (this->backend == Capture_Backend::V4L2) {
+                return this->v4l2_capture.isOpened();
+            }
+            return this->capture.isOpened();
+        }
+
+        double device_get(int propId)
+        {
+            if (this->backend == Capture_Backend::V4L2) {
+                return this->v4l2_capture.get(propId);
+            }
+            return this->capture.get(propId);
+        }
+
+        bool device_set(int propId, double value)
+        {
+            if (this->backend == Capture_Backend::V4L2) {
+                return this->v4l2_capture.set(propId, value);
+            }
+            return this->capture.set(propId, value);
+        }
+
+        void take(cv::Mat &src, cv::Mat &dest)
+        {
+            if (src.u != nullptr && src.u->refcount == 1) {
+                cv::swap(src, dest);
+            } else {
+                this->copy(src, dest);
+            }
+        }
+
+        void copy(const cv::Mat &src, cv::Mat &dest)
+        {
+            const unsigned char *previous_data = dest.data;
+            src.copyTo(dest);
+            this->count_reallocation(dest, previous_data);
+        }
+
+        /**
+         * counts an allocation if dest no longer uses the storage it had before an operation which may reallocate it
+         **/
+        void count_reallocation(const cv::Mat &dest, const unsigned char *previous_data)
+        {
+            if (dest.data != previous_data && dest.u != nullptr) {
+                this->allocation_count++;
+            }
+        }
+
+        std::atomic<long> allocation_count{0};
+
+        static int64_t elapsed_microseconds(const std::chrono::steady_clock::time_point &begin)
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+        }
+
         static const int MAX_CONSECUTIVE_MISSES = 3;
+        int64_t frames_read = 0;
         int consecutive_misses = 0;
 
         std::map<int, double> props;
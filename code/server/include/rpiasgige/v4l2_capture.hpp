@@ -0,0 +1,503 @@
+#ifndef RPIASGIGE_V4L2_CAPTURE_HPP
+#define RPIASGIGE_V4L2_CAPTURE_HPP
+
+#include <map>
+#include <vector>
+
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "dumb_logger.hpp"
+#include "captured_frame.hpp"
+
+namespace rpiasgige
+{
+
+    /**
+     * Minimal V4L2 streaming capture using memory mapped buffers.
+     *
+     * It mirrors the parts of cv::VideoCapture used by USB_Interface (open, get, set, release) but
+     * gives control over the number of driver buffers and exposes the dequeued buffer directly instead
+     * of copying it into a new cv::Mat.
+     *
+     * A dequeued buffer stays owned by the application until the next call to read(), when it is
+     * handed back to the driver.
+     **/
+    class V4L2_Capture
+    {
+
+    public:
+
+        V4L2_Capture() : logger("V4L2_Capture") {}
+        virtual ~V4L2_Capture() {
+            this->release();
+        }
+
+        bool open(const std::string &path)
+        {
+            this->release();
+
+            this->fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+            if (this->fd < 0) {
+                this->logger.warn_msg("cannot open " + path + ": " + strerror(errno));
+                return false;
+            }
+
+            v4l2_capability capability;
+            memset(&capability, 0, sizeof(capability));
+            if (xioctl(VIDIOC_QUERYCAP, &capability) < 0 ||
+                !(capability.capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
+                !(capability.capabilities & V4L2_CAP_STREAMING)) {
+                this->logger.warn_msg(path + " is not a V4L2 streaming capture device");
+                this->release();
+                return false;
+            }
+
+            return true;
+        }
+
+        bool isOpened() const {
+            return this->fd >= 0;
+        }
+
+        void release()
+        {
+            if (this->fd >= 0) {
+                this->stop_streaming();
+                ::close(this->fd);
+                this->fd = -1;
+            }
+        }
+
+        /**
+         * Dequeues the next frame. If the format is raw, dest is a header over the memory mapped buffer (no copy).
+         * Otherwise dest receives the decoded BGR image unless CAP_PROP_CONVERT_RGB is off.
+         * In both cases dest is only valid until the next call to read().
+         **/
+        bool read(cv::Mat &dest)
+        {
+            return this->read_raw(this->current_frame) && to_image(this->current_frame, dest);
+        }
+
+        /**
+         * Dequeues the next frame without decoding it. frame.image is a 1 x bytesused header over the 
+         * memory mapped buffer, valid until the next call to read() or read_raw().
+         **/
+        bool read_raw(Captured_Frame &frame)
+        {
+            bool result = false;
+            if (this->isOpened() && this->start_streaming() && this->requeue_current() && this->dequeue()) {
+                const v4l2_pix_format &pix = this->format.fmt.pix;
+                frame.image = cv::Mat(1, this->current_buffer.bytesused, CV_8UC1, this->buffers[this->current_index].start);
+                frame.raw = true;
+                frame.convert_rgb = this->convert_rgb;
+                frame.pixel_format = pix.pixelformat;
+                frame.width = pix.width;
+                frame.height = pix.height;
+                frame.bytes_per_line = pix.bytesperline;
+                frame.info.device_timestamp = static_cast<int64_t>(this->current_buffer.timestamp.tv_sec) * 1000000 + this->current_buffer.timestamp.tv_usec;
+                frame.info.sequence = this->current_buffer.sequence;
+                result = true;
+            }
+            return result;
+        }
+
+        /**
+         * Turns a raw payload into an image. Uncompressed formats which need no conversion are not copied:
+         * dest points into frame.image.
+         **/
+        static bool to_image(const Captured_Frame &frame, cv::Mat &dest)
+        {
+            if (!frame.raw) {
+                dest = frame.image;
+                return !dest.empty();
+            }
+
+            // never decode into memory owned by someone else, such as a driver buffer
+            if (dest.data != nullptr && dest.u == nullptr) {
+                dest.release();
+            }
+
+            void *data = frame.image.data;
+            bool result = true;
+            switch (frame.pixel_format) {
+                case V4L2_PIX_FMT_GREY:
+                    dest = cv::Mat(frame.height, frame.width, CV_8UC1, data, frame.bytes_per_line);
+                    break;
+                case V4L2_PIX_FMT_YUYV:
+                    if (frame.convert_rgb) {
+                        cv::cvtColor(cv::Mat(frame.height, frame.width, CV_8UC2, data, frame.bytes_per_line), dest, cv::COLOR_YUV2BGR_YUYV);
+                    } else {
+                        dest = cv::Mat(frame.height, frame.width, CV_8UC2, data, frame.bytes_per_line);
+                    }
+                    break;
+                case V4L2_PIX_FMT_MJPEG:
+                case V4L2_PIX_FMT_JPEG:
+                    if (frame.convert_rgb) {
+                        cv::imdecode(frame.image, cv::IMREAD_COLOR, &dest);
+                        result = !dest.empty();
+                    } else {
+                        dest = frame.image;
+                    }
+                    break;
+                default:
+                    dest = frame.image;
+            }
+            return result;
+        }
+
+        static bool is_compressed(unsigned int pixel_format)
+        {
+            return pixel_format == V4L2_PIX_FMT_MJPEG || pixel_format == V4L2_PIX_FMT_JPEG;
+        }
+
+        /**
+         * true if to_image() gives the compressed payload of frame as it is: a 1 x N CV_8UC1 which is not an image
+         **/
+        static bool is_left_compressed(const Captured_Frame &frame)
+        {
+            return frame.raw && !frame.convert_rgb && is_compressed(frame.pixel_format);
+        }
+
+        double get(int propId)
+        {
+            double result = -1.0;
+            if (!this->isOpened()) {
+                return result;
+            }
+
+            switch (propId) {
+                case cv::CAP_PROP_FRAME_WIDTH:
+                    if (this->load_format()) result = this->format.fmt.pix.width;
+                    break;
+                case cv::CAP_PROP_FRAME_HEIGHT:
+                    if (this->load_format()) result = this->format.fmt.pix.height;
+                    break;
+                case cv::CAP_PROP_FOURCC:
+                    if (this->load_format()) result = this->format.fmt.pix.pixelformat;
+                    break;
+                case cv::CAP_PROP_FPS: {
+                    v4l2_streamparm parm;
+                    memset(&parm, 0, sizeof(parm));
+                    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                    if (xioctl(VIDIOC_G_PARM, &parm) >= 0 && parm.parm.capture.timeperframe.numerator > 0) {
+                        result = static_cast<double>(parm.parm.capture.timeperframe.denominator) / parm.parm.capture.timeperframe.numerator;
+                    }
+                    break;
+                }
+                case cv::CAP_PROP_BUFFERSIZE:
+                    result = this->buffer_count;
+                    break;
+                case cv::CAP_PROP_CONVERT_RGB:
+                    result = this->convert_rgb ? 1.0 : 0.0;
+                    break;
+                default: {
+                    auto it = control_ids().find(propId);
+                    if (it != control_ids().end()) {
+                        v4l2_control control;
+                        memset(&control, 0, sizeof(control));
+                        control.id = it->second;
+                        if (xioctl(VIDIOC_G_CTRL, &control) >= 0) {
+                            result = control.value;
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        bool set(int propId, double value)
+        {
+            bool result = false;
+            if (!this->isOpened()) {
+                return result;
+            }
+
+            switch (propId) {
+                case cv::CAP_PROP_FRAME_WIDTH:
+                case cv::CAP_PROP_FRAME_HEIGHT:
+                case cv::CAP_PROP_FOURCC:
+                    result = this->set_format(propId, static_cast<unsigned int>(value));
+                    break;
+                case cv::CAP_PROP_FPS: {
+                    this->stop_streaming();
+                    v4l2_streamparm parm;
+                    memset(&parm, 0, sizeof(parm));
+                    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                    parm.parm.capture.timeperframe.numerator = 1000;
+                    parm.parm.capture.timeperframe.denominator = static_cast<unsigned int>(value * 1000);
+                    result = value > 0 && xioctl(VIDIOC_S_PARM, &parm) >= 0;
+                    break;
+                }
+                case cv::CAP_PROP_BUFFERSIZE:
+                    result = this->set_buffer_count(static_cast<int>(value));
+                    break;
+                case cv::CAP_PROP_CONVERT_RGB:
+                    this->convert_rgb = value != 0;
+                    result = true;
+                    break;
+                default: {
+                    auto it = control_ids().find(propId);
+                    if (it != control_ids().end()) {
+                        v4l2_control control;
+                        memset(&control, 0, sizeof(control));
+                        control.id = it->second;
+                        control.value = static_cast<int>(value);
+                        result = xioctl(VIDIOC_S_CTRL, &control) >= 0;
+                    }
+                }
+            }
+            return result;
+        }
+
+        /**
+         * number of buffers requested to the driver. Takes effect when streaming (re)starts
+         **/
+        bool set_buffer_count(int count)
+        {
+            bool result = false;
+            if (count >= MIN_BUFFER_COUNT && count <= MAX_BUFFER_COUNT) {
+                this->stop_streaming();
+                this->buffer_count = count;
+                result = true;
+            }
+            return result;
+        }
+
+        int get_buffer_count() const {
+            return this->buffer_count;
+        }
+
+        static const int MIN_BUFFER_COUNT = 2;
+        static const int MAX_BUFFER_COUNT = 32;
+
+    private:
+
+        struct Mapped_Buffer
+        {
+            void *start;
+            size_t length;
+        };
+
+        int fd = -1;
+        int buffer_count = 4;
+        bool convert_rgb = true;
+        bool streaming = false;
+
+        std::vector<Mapped_Buffer> buffers;
+
+        v4l2_format format;
+        v4l2_buffer current_buffer;
+        int current_index = -1;
+
+        Captured_Frame current_frame;
+
+        const Logger logger;
+
+        static const int DEQUEUE_TIMEOUT_IN_MILLISECONDS = 2000;
+
+        int xioctl(unsigned long request, void *arg)
+        {
+            int r;
+            do {
+                r = ioctl(this->fd, request, arg);
+            } while (r == -1 && errno == EINTR);
+            return r;
+        }
+
+        static const std::map<int, unsigned int> &control_ids()
+        {
+            static const std::map<int, unsigned int> ids = {
+                {cv::CAP_PROP_BRIGHTNESS, V4L2_CID_BRIGHTNESS},
+                {cv::CAP_PROP_CONTRAST, V4L2_CID_CONTRAST},
+                {cv::CAP_PROP_SATURATION, V4L2_CID_SATURATION},
+                {cv::CAP_PROP_HUE, V4L2_CID_HUE},
+                {cv::CAP_PROP_GAIN, V4L2_CID_GAIN},
+                {cv::CAP_PROP_SHARPNESS, V4L2_CID_SHARPNESS},
+                {cv::CAP_PROP_GAMMA, V4L2_CID_GAMMA},
+                {cv::CAP_PROP_BACKLIGHT, V4L2_CID_BACKLIGHT_COMPENSATION},
+                {cv::CAP_PROP_AUTO_WB, V4L2_CID_AUTO_WHITE_BALANCE},
+                {cv::CAP_PROP_WB_TEMPERATURE, V4L2_CID_WHITE_BALANCE_TEMPERATURE},
+                {cv::CAP_PROP_EXPOSURE, V4L2_CID_EXPOSURE_ABSOLUTE},
+                {cv::CAP_PROP_AUTO_EXPOSURE, V4L2_CID_EXPOSURE_AUTO},
+                {cv::CAP_PROP_FOCUS, V4L2_CID_FOCUS_ABSOLUTE},
+                {cv::CAP_PROP_AUTOFOCUS, V4L2_CID_FOCUS_AUTO},
+                {cv::CAP_PROP_ZOOM, V4L2_CID_ZOOM_ABSOLUTE}
+            };
+            return ids;
+        }
+
+        bool load_format()
+        {
+            memset(&this->format, 0, sizeof(this->format));
+            this->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            return xioctl(VIDIOC_G_FMT, &this->format) >= 0;
+        }
+
+        bool set_format(int propId, unsigned int value)
+        {
+            if (!this->load_format()) {
+                return false;
+            }
+            this->stop_streaming();
+
+            v4l2_format requested = this->format;
+            if (propId == cv::CAP_PROP_FRAME_WIDTH) {
+                requested.fmt.pix.width = value;
+            } else if (propId == cv::CAP_PROP_FRAME_HEIGHT) {
+                requested.fmt.pix.height = value;
+            } else {
+                requested.fmt.pix.pixelformat = value;
+            }
+            requested.fmt.pix.field = V4L2_FIELD_ANY;
+
+            bool result = xioctl(VIDIOC_S_FMT, &requested) >= 0;
+            if (result) {
+                this->format = requested;
+                // the driver adjusts the request to the closest supported format
+                if (propId == cv::CAP_PROP_FRAME_WIDTH) {
+                    result = requested.fmt.pix.width == value;
+                } else if (propId == cv::CAP_PROP_FRAME_HEIGHT) {
+                    result = requested.fmt.pix.height == value;
+                } else {
+                    result = requested.fmt.pix.pixelformat == value;
+                }
+            }
+            return result;
+        }
+
+        bool start_streaming()
+        {
+            if (this->streaming) {
+                return true;
+            }
+
+            if (!this->load_format()) {
+                return false;
+            }
+
+            v4l2_requestbuffers request;
+            memset(&request, 0, sizeof(request));
+            request.count = this->buffer_count;
+            request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            request.memory = V4L2_MEMORY_MMAP;
+            if (xioctl(VIDIOC_REQBUFS, &request) < 0 || request.count < 1) {
+                this->logger.warn_msg(std::string("VIDIOC_REQBUFS failed: ") + strerror(errno));
+                return false;
+            }
+
+            for (unsigned int i = 0; i < request.count; ++i) {
+                v4l2_buffer buffer;
+                memset(&buffer, 0, sizeof(buffer));
+                buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                buffer.memory = V4L2_MEMORY_MMAP;
+                buffer.index = i;
+                if (xioctl(VIDIOC_QUERYBUF, &buffer) < 0) {
+                    this->unmap_buffers();
+                    return false;
+                }
+                Mapped_Buffer mapped;
+                mapped.length = buffer.length;
+                mapped.start = mmap(NULL, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, buffer.m.offset);
+                if (mapped.start == MAP_FAILED) {
+                    this->logger.warn_msg(std::string("mmap failed: ") + strerror(errno));
+                    this->unmap_buffers();
+                    return false;
+                }
+                this->buffers.push_back(mapped);
+
+                if (xioctl(VIDIOC_QBUF, &buffer) < 0) {
+                    this->unmap_buffers();
+                    return false;
+                }
+            }
+
+            v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            if (xioctl(VIDIOC_STREAMON, &type) < 0) {
+                this->logger.warn_msg(std::string("VIDIOC_STREAMON failed: ") + strerror(errno));
+                this->unmap_buffers();
+                return false;
+            }
+
+            this->streaming = true;
+            return true;
+        }
+
+        void stop_streaming()
+        {
+            if (this->streaming) {
+                v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                xioctl(VIDIOC_STREAMOFF, &type);
+                this->streaming = false;
+            }
+            this->current_index = -1;
+            // the last frame read points into the buffers about to be unmapped
+            this->current_frame.image.release();
+            this->unmap_buffers();
+        }
+
+        void unmap_buffers()
+        {
+            for (size_t i = 0; i < this->buffers.size(); ++i) {
+                munmap(this->buffers[i].start, this->buffers[i].length);
+            }
+            this->buffers.clear();
+
+            if (this->fd >= 0) {
+                v4l2_requestbuffers request;
+                memset(&request, 0, sizeof(request));
+                request.count = 0;
+                request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                request.memory = V4L2_MEMORY_MMAP;
+                xioctl(VIDIOC_REQBUFS, &request);
+            }
+        }
+
+        bool requeue_current()
+        {
+            bool result = true;
+            if (this->current_index >= 0) {
+                result = xioctl(VIDIOC_QBUF, &this->current_buffer) >= 0;
+                this->current_index = -1;
+            }
+            return result;
+        }
+
+        bool dequeue()
+        {
+            pollfd pfd;
+            pfd.fd = this->fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            int ready;
+            do {
+                ready = poll(&pfd, 1, DEQUEUE_TIMEOUT_IN_MILLISECONDS);
+            } while (ready == -1 && errno == EINTR);
+
+            if (ready <= 0) {
+                return false;
+            }
+
+            memset(&this->current_buffer, 0, sizeof(this->current_buffer));
+            this->current_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            this->current_buffer.memory = V4L2_MEMORY_MMAP;
+            if (xioctl(VIDIOC_DQBUF, &this->current_buffer) < 0) {
+                return false;
+            }
+            this->current_index = this->current_buffer.index;
+            return true;
+        }
+    };
+
+} // namespace rpiasgige
+
+#endif
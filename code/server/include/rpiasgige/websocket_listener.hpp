@@ -0,0 +1,98 @@
+#ifndef RPIASGIGE_WEBSOCKET_LISTENER_HPP
+#define RPIASGIGE_WEBSOCKET_LISTENER_HPP
+
+#include <array>
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "rpiasgige/stream_session.hpp"
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+namespace rpiasgige
+{
+
+    /**
+     * Transport of the websocket sessions: one binary websocket message per request or response
+     **/
+    class Websocket_Stream
+    {
+
+    public:
+        static const char *name()
+        {
+            return "Websocket";
+        }
+
+        explicit Websocket_Stream(tcp::socket &&socket) : ws(std::move(socket)) {}
+
+        websocket::stream<beast::tcp_stream>::executor_type get_executor()
+        {
+            return this->ws.get_executor();
+        }
+
+        tcp::socket &socket()
+        {
+            return beast::get_lowest_layer(this->ws).socket();
+        }
+
+        bool is_open() const
+        {
+            return this->ws.is_open();
+        }
+
+        template <typename Handler>
+        void async_accept(Handler &&handler)
+        {
+            websocket::stream_base::timeout timeout_settings;
+            timeout_settings.handshake_timeout = std::chrono::seconds(SESSION_TIMEOUT_IN_SECONDS);
+            timeout_settings.idle_timeout = websocket::stream_base::none();
+            timeout_settings.keep_alive_pings = false;
+            this->ws.set_option(timeout_settings);
+            this->ws.binary(true);
+
+            this->ws.async_accept(std::forward<Handler>(handler));
+        }
+
+        template <typename Handler>
+        void async_read(beast::flat_buffer &buffer, Handler &&handler)
+        {
+            this->ws.async_read(buffer, std::forward<Handler>(handler));
+        }
+
+        template <typename Handler>
+        void async_write(char *response_buffer, const int response_size, const char *payload, const int payload_size, Handler &&handler)
+        {
+            // header and metadata from the response buffer, bulk data straight from its own storage
+            std::array<net::const_buffer, 2> buffers = {{
+                net::buffer(response_buffer, response_size),
+                net::buffer(payload, payload_size)
+            }};
+            this->ws.async_write(buffers, std::forward<Handler>(handler));
+        }
+
+        template <typename Handler>
+        void async_close(Handler &&handler)
+        {
+            this->ws.async_close(websocket::close_code::going_away, std::forward<Handler>(handler));
+        }
+
+    private:
+        websocket::stream<beast::tcp_stream> ws;
+    };
+
+    typedef Stream_Session<Websocket_Stream> Websocket_Session;
+
+    /**
+     * Accepts websocket connections and starts a session for each of them.
+     **/
+    typedef Stream_Listener<Websocket_Stream> Websocket_Listener;
+
+} // namespace rpiasgige
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef RPIASGIGE_WORKER_POOL_HPP
+#define RPIASGIGE_WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rpiasgige
+{
+
+    /**
+     * Fixed set of threads splitting a job, such as compressing the stripes of a frame, across the cores.
+     *
+     * The calling thread works on the job too, so a pool of 0 threads runs it sequentially. Jobs of concurrent
+     * callers, e.g. the clients of several cameras, run at the same time: the pool threads take their calls in
+     * arrival order while each caller works on its own job. No memory is allocated per job.
+     **/
+    class Worker_Pool
+    {
+    public:
+        explicit Worker_Pool(const int thread_count)
+        {
+            for (int i = 0; i < thread_count; ++i) {
+                this->threads.emplace_back([this]() {
+                    this->wait_for_jobs();
+                });
+            }
+        }
+
+        virtual ~Worker_Pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->job_available.notify_all();
+            for (size_t i = 0; i < this->threads.size(); ++i) {
+                this->threads[i].join();
+            }
+        }
+
+        int get_thread_count() const
+        {
+            return static_cast<int>(this->threads.size());
+        }
+
+        /**
+         * calls job(i) for every i in [0, count), from the pool threads and the calling thread, and returns once all calls returned
+         **/
+        template <typename Job>
+        void run(const int count, Job &job)
+        {
+            if (count <= 0) {
+                return;
+            }
+
+            Job_State state;
+            state.job = &job;
+            state.call = &call_job<Job>;
+            state.count = count;
+            state.pending = count;
+
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->enqueue(state);
+            this->job_available.notify_all();
+
+            this->work(state, lock);
+            this->job_done.wait(lock, [&state]() {
+                return state.pending == 0;
+            });
+        }
+
+    private:
+
+        /**
+         * a job of run(), queued until all its calls are taken
+         **/
+        struct Job_State
+        {
+            void *job = nullptr;
+            void (*call)(void *, int) = nullptr;
+            int count = 0;
+            int next = 0;
+            int pending = 0;
+            Job_State *following = nullptr;
+        };
+
+        template <typename Job>
+        static void call_job(void *job, const int index)
+        {
+            (*static_cast<Job *>(job))(index);
+        }
+
+        void wait_for_jobs()
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            while (!this->stopping) {
+                if (this->first_job != nullptr) {
+                    this->work(*this->first_job, lock);
+                } else {
+                    this->job_available.wait(lock, [this]() {
+                        return this->stopping || this->first_job != nullptr;
+                    });
+                }
+            }
+        }
+
+        /**
+         * runs the calls of state not taken yet. lock is held on entry and on return
+         **/
+        void work(Job_State &state, std::unique_lock<std::mutex> &lock)
+        {
+            while (state.next < state.count) {
+                const int index = state.next++;
+                if (state.next == state.count) {
+                    // state may go out of scope once its calls return: nobody else must find it
+                    this->dequeue(state);
+                }
+                lock.unlock();
+                state.call(state.job, index);
+                lock.lock();
+                if (--state.pending == 0) {
+                    this->job_done.notify_all();
+                }
+            }
+        }
+
+        void enqueue(Job_State &state)
+        {
+            if (this->last_job != nullptr) {
+                this->last_job->following = &state;
+            } else {
+                this->first_job = &state;
+            }
+            this->last_job = &state;
+        }
+
+        /**
+         * the queue holds a job per concurrent caller at most: it is short
+         **/
+        void dequeue(Job_State &state)
+        {
+            Job_State *previous = nullptr;
+            Job_State *current = this->first_job;
+            while (current != &state) {
+                previous = current;
+                current = current->following;
+            }
+            if (previous != nullptr) {
+                previous->following = state.following;
+            } else {
+                this->first_job = state.following;
+            }
+            if (this->last_job == &state) {
+                this->last_job = previous;
+            }
+            state.following = nullptr;
+        }
+
+        std::vector<std::thread> threads;
+
+        std::mutex mutex;
+        std::condition_variable job_available;
+        std::condition_variable job_done;
+        bool stopping = false;
+
+        // jobs with calls not taken yet, in arrival order
+        Job_State *first_job = nullptr;
+        Job_State *last_job = nullptr;
+    };
+
+} // namespace rpiasgige
+
+#endif
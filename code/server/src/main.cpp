@@ -1,67 +1,39 @@
 #include <chrono>
+#include <memory>
+#include <sstream>
 #include <thread>
+#include <vector>
 
-#include <boost/beast/core.hpp>
-#include <boost/beast/websocket.hpp>
-#include <boost/asio/ip/tcp.hpp>
-
-namespace beast = boost::beast;         
-namespace http = beast::http;           
-namespace websocket = beast::websocket; 
-namespace net = boost::asio;           
-using tcp = boost::asio::ip::tcp;
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/thread_pool.hpp>
 
 #include <opencv2/opencv.hpp>
 
+#include "rpiasgige/gvcp_responder.hpp"
+#include "rpiasgige/gvsp_streamer.hpp"
 #include "rpiasgige/machine_vision_server.hpp"
+#include "rpiasgige/multi_camera_server.hpp"
+#include "rpiasgige/multicast_sender.hpp"
+#include "rpiasgige/shared_memory_publisher.hpp"
+#include "rpiasgige/socket_options.hpp"
+#include "rpiasgige/worker_pool.hpp"
 #include "rpiasgige/usb_interface.hpp"
+#include "rpiasgige/raw_listener.hpp"
+#include "rpiasgige/websocket_listener.hpp"
 
 #include "rpiasgige/constants.hpp"
 
-void do_session(tcp::socket& socket, rpiasgige::Server &server)
+static std::vector<std::string> split_list(const std::string &list)
 {
-    char * response_buffer = nullptr;
-    
-    try
-    {
-        websocket::stream<tcp::socket> ws{std::move(socket)};
-
-        ws.accept();
-
-        response_buffer = new char[server.get_max_response_buffer_size()];
-
-        while(true) {
-            beast::flat_buffer buffer;
-
-            ws.read(buffer);
-
-            int request_size = buffer.size();
-            const char* request_buffer = boost::asio::buffer_cast<const char*>(buffer.data());
-
-            int response_size;
-
-            server.process_client(request_buffer, request_size, response_buffer, response_size);
-
-            ws.text(false);
-            ws.binary(true);
-            ws.write(net::buffer(response_buffer, response_size));
+    std::vector<std::string> result;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(item);
         }
-
-    } catch(beast::system_error const& se) {
-
-        if(se.code() != websocket::error::closed)
-            std::cerr << "Error: " << se.code().message() << "\n";
-
-    } catch(std::exception const& e) {
-
-        std::cerr << "Error: " << e.what() << "\n";
-
-    }
-
-    if (response_buffer != nullptr) {
-        delete [] response_buffer;
     }
-
+    return result;
 }
 
 int main(int argc, char **argv)
@@ -71,10 +43,33 @@ int main(int argc, char **argv)
         "{device           | /dev/video0    | camera path such as /dev/video0         }"
         "{address           | 0.0.0.0    | server address name or ip       }"
         "{usb_bus_id           |     | usb bus id like:  usb-0000:00:14.0-1        }"
+        "{devices           |     | comma separated camera paths served on the same port, e.g. /dev/video0,/dev/video2        }"
+        "{usb_bus_ids           |     | comma separated usb bus ids served on the same port        }"
         "{port           | 4001    | TCP port to accept connections         }"
+        "{raw-port           | 0    | TCP port to accept connections speaking the protocol without websocket framing. 0 disables it         }"
         "{max-width-resolution           | 1920    | Max acceptable width image resolution         }"
         "{max-heigth-resolution           | 1080    | Max acceptable heigth image resolution         }"
         "{max-number-of-channels           | 3    | Max acceptable number of image channels         }"
+        "{threads           | 2    | number of threads serving the connections         }"
+        "{request-threads           | 4    | number of threads processing the requests, which may wait for the cameras         }"
+        "{continuous-capture           | false    | grab frames in a background thread at the sensor rate         }"
+        "{backend           | opencv    | capture backend: opencv or v4l2         }"
+        "{v4l2-buffers           | 4    | number of memory mapped buffers used by the v4l2 backend         }"
+        "{tcp-nodelay           | true    | send small replies right away, disabling Nagle's algorithm         }"
+        "{so-sndbuf           | 0    | socket send buffer size in bytes. 0 keeps the system default         }"
+        "{so-rcvbuf           | 0    | socket receive buffer size in bytes. 0 keeps the system default         }"
+        "{busy-poll           | 0    | microseconds to busy poll the network device on reads (Linux only). 0 disables it         }"
+        "{quick-ack           | false    | acknowledge received data immediately (Linux only)         }"
+        "{compression-threads           | 3    | threads helping to compress the frames of clients which negotiated a codec         }"
+        "{ring-frames           | 0    | last frames kept for grabs by sequence or timestamp. Starts the continuous capture         }"
+        "{shared-memory           |     | POSIX shared memory name such as /rpiasgige. Camera N publishes its frames on <name>_N for clients on the same host. Starts the continuous capture         }"
+        "{multicast-group           |     | UDP multicast group such as 239.255.0.1 to stream the frames to. Starts the continuous capture         }"
+        "{multicast-port           | 5000    | UDP port of the multicast stream of camera 0. Camera N streams to port multicast-port + N         }"
+        "{multicast-interface           |     | address of the network interface sending the multicast stream. Empty uses the system default         }"
+        "{multicast-datagram-size           | 1472    | bytes of each multicast datagram. Keep it within the MTU to avoid IP fragmentation         }"
+        "{multicast-ttl           | 1    | routers the multicast datagrams may cross. 1 keeps them in the local network         }"
+        "{gvcp-port           | 0    | UDP port of the GigE Vision control channel, 3956 for standard applications. Camera N answers on gvcp-port + N. 0 disables it. Starts the continuous capture         }"
+        "{gvsp-blocks           | 4    | frames kept by each GigE Vision stream to resend the packets lost by the receivers         }"
         ;
 
     cv::CommandLineParser parser(argc, argv, keys);
@@ -91,45 +86,196 @@ int main(int argc, char **argv)
 
     int max_channels = parser.get<int>("max-number-of-channels");
 
-    rpiasgige::USB_Interface usb_camera;
+    const int threads = std::max(1, parser.get<int>("threads"));
+    const int request_threads = std::max(1, parser.get<int>("request-threads"));
+
+    // camera ids follow the order of the usb bus ids, then the order of the device paths
+    std::vector<std::string> usb_bus_ids = split_list(parser.get<cv::String>("usb_bus_ids"));
+    std::vector<std::string> devices = split_list(parser.get<cv::String>("devices"));
+    if (usb_bus_ids.empty() && devices.empty()) {
+        if (!usb_bus_id.empty()) {
+            usb_bus_ids.push_back(usb_bus_id);
+        } else {
+            devices.push_back(device);
+        }
+    }
 
-    std::string identifier = device;
+    int max_image_size = max_channels * max_width * max_heigth;
+    int max_response_buffer_size = max_image_size + rpiasgige::HEADER_SIZE + rpiasgige::IMAGE_META_DATA_SIZE + rpiasgige::FRAME_INFO_SIZE + rpiasgige::REQUEST_ID_SIZE + rpiasgige::DELTA_META_DATA_SIZE + rpiasgige::CODEC_META_DATA_SIZE;
 
-    if (!usb_bus_id.empty()) {
-        usb_camera.set_usb_bus_id(usb_bus_id);
-        identifier = usb_bus_id;
-    } else {
-        usb_camera.set_camera_path(device);
+    const std::string backend = parser.get<cv::String>("backend");
+    if (backend.compare("v4l2") != 0 && backend.compare("opencv") != 0) {
+        std::cerr << "Unknown capture backend: " << backend << "\n";
+        return EXIT_FAILURE;
     }
 
-    int max_image_size = max_channels * max_width * max_heigth;
-    int max_response_buffer_size = max_image_size + rpiasgige::HEADER_SIZE + rpiasgige::IMAGE_META_DATA_SIZE;
+    const std::string shared_memory = parser.get<cv::String>("shared-memory");
+    const std::string multicast_group = parser.get<cv::String>("multicast-group");
+    const int gvcp_port = parser.get<int>("gvcp-port");
+    // the stream source, any interface for 0.0.0.0
+    const std::string gvsp_address = server_address.compare("0.0.0.0") == 0 ? std::string() : server_address;
+    std::vector<std::shared_ptr<rpiasgige::GVSP_Streamer>> gvsp_streamers;
+    std::vector<std::string> identifiers;
+
+    rpiasgige::Multi_Camera_Server server("rpiasgige", max_response_buffer_size);
+    server.set_compression_pool(std::make_shared<rpiasgige::Worker_Pool>(std::max(0, parser.get<int>("compression-threads"))));
+
+    const size_t camera_count = usb_bus_ids.size() + devices.size();
+    for (size_t i = 0; i < camera_count; ++i) {
+
+        std::unique_ptr<rpiasgige::USB_Interface> usb_camera(new rpiasgige::USB_Interface());
+
+        std::string identifier;
+        if (i < usb_bus_ids.size()) {
+            identifier = usb_bus_ids[i];
+            usb_camera->set_usb_bus_id(identifier);
+        } else {
+            identifier = devices[i - usb_bus_ids.size()];
+            usb_camera->set_camera_path(identifier);
+        }
+
+        if (backend.compare("v4l2") == 0) {
+            usb_camera->set_capture_backend(rpiasgige::Capture_Backend::V4L2);
+            if (!usb_camera->set_v4l2_buffer_count(parser.get<int>("v4l2-buffers"))) {
+                std::cerr << "Invalid number of v4l2 buffers.\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        const int ring_frames = std::max(0, parser.get<int>("ring-frames"));
+        usb_camera->set_frame_ring_size(ring_frames);
+
+        // camera ids are given in order by add_camera
+        if (!shared_memory.empty()) {
+            auto publisher = std::make_shared<rpiasgige::Shared_Memory_Publisher>(shared_memory + "_" + std::to_string(i), max_image_size);
+            if (!publisher->open()) {
+                std::cerr << "Failed to create the shared memory " << publisher->get_name() << "\n";
+                return EXIT_FAILURE;
+            }
+            usb_camera->add_frame_sink(publisher);
+        }
 
-    rpiasgige::Server server(identifier, usb_camera, max_response_buffer_size);
+        if (gvcp_port > 0) {
+            auto streamer = std::make_shared<rpiasgige::GVSP_Streamer>(max_image_size, parser.get<int>("gvsp-blocks"));
+            if (!streamer->open(gvsp_address)) {
+                std::cerr << "Failed to open the GigE Vision stream of " << identifier << "\n";
+                return EXIT_FAILURE;
+            }
+            usb_camera->add_frame_sink(streamer);
+            gvsp_streamers.push_back(streamer);
+        }
+
+        if (parser.get<bool>("continuous-capture") || ring_frames > 0 || !shared_memory.empty() || !multicast_group.empty() || gvcp_port > 0) {
+            usb_camera->start_continuous_capture();
+        }
+
+        const int camera_id = server.add_camera(identifier, std::move(usb_camera));
+        identifiers.push_back(identifier);
+
+        std::cout << "Camera " << camera_id << ": " << identifier << "\n";
+    }
 
     if (!server.init()) {
         std::cerr << "Failed to initialize server.";
         return EXIT_FAILURE;
     }
+
+    // declared after the server: the senders stop before the cameras
+    std::vector<std::unique_ptr<rpiasgige::Multicast_Sender>> multicast_senders;
+    if (!multicast_group.empty()) {
+        const int multicast_port = parser.get<int>("multicast-port");
+        for (size_t i = 0; i < camera_count; ++i) {
+            std::unique_ptr<rpiasgige::Multicast_Sender> sender(new rpiasgige::Multicast_Sender(server, static_cast<int>(i)));
+            const unsigned short port = static_cast<unsigned short>(multicast_port + i);
+            if (!sender->set_datagram_size(parser.get<int>("multicast-datagram-size"))) {
+                std::cerr << "Invalid multicast datagram size.\n";
+                return EXIT_FAILURE;
+            }
+            if (!sender->open(multicast_group, port, parser.get<cv::String>("multicast-interface"), parser.get<int>("multicast-ttl")) || !sender->start()) {
+                std::cerr << "Failed to stream to the multicast group " << multicast_group << ":" << port << "\n";
+                return EXIT_FAILURE;
+            }
+            std::cout << "Camera " << i << " streaming to " << multicast_group << ":" << port << "\n";
+            multicast_senders.push_back(std::move(sender));
+        }
+    }
+
+    // declared after the server: the responders stop before the cameras
+    std::vector<std::unique_ptr<rpiasgige::GVCP_Responder>> gvcp_responders;
+    for (size_t i = 0; i < gvsp_streamers.size(); ++i) {
+        std::unique_ptr<rpiasgige::GVCP_Responder> responder(new rpiasgige::GVCP_Responder(server.get_camera(static_cast<int>(i)), gvsp_streamers[i], identifiers[i]));
+        const unsigned short port = static_cast<unsigned short>(gvcp_port + i);
+        if (!responder->open(server_address, port) || !responder->start()) {
+            std::cerr << "Failed to open the GigE Vision control channel on port " << port << "\n";
+            return EXIT_FAILURE;
+        }
+        std::cout << "Camera " << i << " answering GigE Vision applications on port " << port << "\n";
+        gvcp_responders.push_back(std::move(responder));
+    }
         
     try
     {
-        net::io_context ioc{1};
+        net::io_context ioc{threads};
+        // declared after ioc: its threads post the processed requests back to the connections, so they are joined first
+        net::thread_pool request_pool(request_threads);
         auto const address = net::ip::make_address(server_address);
-        tcp::acceptor acceptor{ioc, {address, server_port}};
 
-        std::cout << "Server initialized on address " << server_address << ":" << server_port <<"\n";
+        rpiasgige::Socket_Options socket_options;
+        socket_options.no_delay = parser.get<bool>("tcp-nodelay");
+        socket_options.send_buffer_size = std::max(0, parser.get<int>("so-sndbuf"));
+        socket_options.receive_buffer_size = std::max(0, parser.get<int>("so-rcvbuf"));
+        socket_options.busy_poll = std::max(0, parser.get<int>("busy-poll"));
+        socket_options.quick_ack = parser.get<bool>("quick-ack");
+
+        auto listener = std::make_shared<rpiasgige::Websocket_Listener>(ioc, server, request_pool);
+        listener->set_socket_options(socket_options);
+        if (!listener->open(tcp::endpoint{address, server_port})) {
+            return EXIT_FAILURE;
+        }
+        listener->run();
+
+        std::shared_ptr<rpiasgige::Raw_Listener> raw_listener;
+        const int raw_port = parser.get<int>("raw-port");
+        if (raw_port > 0) {
+            raw_listener = std::make_shared<rpiasgige::Raw_Listener>(ioc, server, request_pool);
+            raw_listener->set_socket_options(socket_options);
+            if (!raw_listener->open(tcp::endpoint{address, static_cast<unsigned short>(raw_port)})) {
+                return EXIT_FAILURE;
+            }
+            raw_listener->run();
+            std::cout << "Raw TCP connections accepted on port " << raw_port << "\n";
+        }
 
-        while(server.is_online())
-        {
-            tcp::socket socket{ioc};
-            std::cout << "Server waiting for connection\n";
-            acceptor.accept(socket);
+        server.set_stop_handler([listener, raw_listener]() {
+            listener->stop();
+            if (raw_listener) {
+                raw_listener->stop();
+            }
+        });
+
+        // control+c stops the server gracefully: no new connections and the current ones are closed
+        net::signal_set signals(ioc, SIGINT, SIGTERM);
+        signals.async_wait([&server](const beast::error_code &, int) {
+            server.stop();
+        });
+
+        std::cout << "Server initialized on address " << server_address << ":" << server_port << " using " << threads << " threads\n";
+
+        std::vector<std::thread> workers;
+        for (int i = 1; i < threads; ++i) {
+            workers.emplace_back([&ioc]() {
+                ioc.run();
+            });
+        }
+        ioc.run();
 
-            std::thread{std::bind(
-                &do_session,
-                std::move(socket), std::ref(server))}.detach();
+        for (size_t i = 0; i < workers.size(); ++i) {
+            workers[i].join();
         }
+
+        server.set_stop_handler(nullptr);
+
+        std::cout << "Server stopped\n";
     }
     catch (const std::exception& e)
     {
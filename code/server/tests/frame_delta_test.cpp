@@ -0,0 +1,70 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/frame_delta.hpp"
+
+using rpiasgige::Frame_Delta;
+
+class Frame_DeltaTest : public ::testing::Test
+{
+protected:
+    cv::Mat frame;
+    Frame_Delta delta;
+    std::vector<uchar> payload;
+
+    void SetUp() override
+    {
+        // 3 x 2 tiles, the last column and row of tiles partial
+        this->frame.create(50, 70, CV_8UC3);
+        for (int i = 0; i < this->frame.rows; ++i) {
+            memset(this->frame.ptr(i), i, this->frame.cols * 3);
+        }
+    }
+};
+
+TEST_F(Frame_DeltaTest, StaticFrameTest)
+{
+
+    ASSERT_FALSE(this->delta.encode(this->frame, this, -1, this->payload)) << "The first frame is sent whole";
+    EXPECT_EQ(this->delta.get_reference_id(), -1);
+    EXPECT_TRUE(this->payload.empty());
+
+    const int first_id = this->delta.get_frame_id();
+    ASSERT_TRUE(this->delta.encode(this->frame, this, first_id, this->payload));
+    EXPECT_EQ(this->delta.get_reference_id(), first_id);
+    EXPECT_NE(this->delta.get_frame_id(), first_id);
+    EXPECT_EQ(this->delta.get_changed_tiles(), 0);
+    EXPECT_EQ(this->payload.size(), 4u) << "The bitmap only";
+}
+
+TEST_F(Frame_DeltaTest, ChangedTileTest)
+{
+
+    this->delta.encode(this->frame, this, -1, this->payload);
+
+    // bottom right tile, 6 x 18 pixels
+    this->frame.ptr(49)[69 * 3] = 255;
+    ASSERT_TRUE(this->delta.encode(this->frame, this, this->delta.get_frame_id(), this->payload));
+    EXPECT_EQ(this->delta.get_changed_tiles(), 1);
+    ASSERT_EQ(this->payload.size(), 4u + 18 * 6 * 3);
+    EXPECT_EQ(this->payload[0], 1 << 5);
+    EXPECT_EQ(this->payload.back(), 49);
+    EXPECT_EQ(this->payload[this->payload.size() - 3], 255);
+}
+
+TEST_F(Frame_DeltaTest, WholeFrameTest)
+{
+
+    this->delta.encode(this->frame, this, -1, this->payload);
+    const int acknowledged_id = this->delta.get_frame_id();
+
+    this->delta.encode(this->frame, this, acknowledged_id, this->payload);
+    EXPECT_FALSE(this->delta.encode(this->frame, this, acknowledged_id, this->payload)) << "The client does not hold the last frame sent";
+
+    EXPECT_FALSE(this->delta.encode(this->frame, &this->payload, this->delta.get_frame_id(), this->payload)) << "Another camera";
+
+    for (int i = 0; i < this->frame.rows; ++i) {
+        memset(this->frame.ptr(i), i + 1, this->frame.cols * 3);
+    }
+    EXPECT_FALSE(this->delta.encode(this->frame, &this->payload, this->delta.get_frame_id(), this->payload)) << "Every tile changed";
+    EXPECT_TRUE(this->payload.empty());
+}
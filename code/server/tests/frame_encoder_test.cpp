@@ -0,0 +1,116 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+
+#include "rpiasgige/frame_encoder.hpp"
+#include "rpiasgige/worker_pool.hpp"
+
+using rpiasgige::Frame_Encoder;
+using rpiasgige::Worker_Pool;
+
+namespace
+{
+    struct Counting_Job
+    {
+        std::atomic<int> calls[100];
+
+        Counting_Job()
+        {
+            for (int i = 0; i < 100; ++i) {
+                this->calls[i] = 0;
+            }
+        }
+
+        void operator()(const int index)
+        {
+            this->calls[index]++;
+        }
+    };
+}
+
+TEST(Worker_PoolTest, RunsEveryIndexOnceTest)
+{
+
+    Worker_Pool pool(3);
+    ASSERT_EQ(pool.get_thread_count(), 3);
+
+    for (int round = 0; round < 10; ++round) {
+        Counting_Job job;
+        pool.run(100, job);
+        for (int i = 0; i < 100; ++i) {
+            ASSERT_EQ(job.calls[i], 1) << "index " << i << " at round " << round;
+        }
+    }
+
+    Worker_Pool sequential(0);
+    Counting_Job job;
+    sequential.run(5, job);
+    EXPECT_EQ(job.calls[4], 1) << "The calling thread runs the job when the pool has no threads";
+}
+
+TEST(Worker_PoolTest, ConcurrentJobsTest)
+{
+
+    Worker_Pool pool(2);
+
+    std::atomic<int> failures(0);
+    std::vector<std::thread> callers;
+    for (int caller = 0; caller < 4; ++caller) {
+        callers.emplace_back([&pool, &failures]() {
+            for (int round = 0; round < 50; ++round) {
+                Counting_Job job;
+                pool.run(100, job);
+                for (int i = 0; i < 100; ++i) {
+                    if (job.calls[i] != 1) {
+                        failures++;
+                    }
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < callers.size(); ++i) {
+        callers[i].join();
+    }
+    EXPECT_EQ(failures, 0) << "Every job of concurrent callers runs each index once";
+}
+
+TEST(Frame_EncoderTest, StripesTest)
+{
+
+    cv::Mat frame(480, 640, CV_8UC1);
+    for (int i = 0; i < frame.rows; ++i) {
+        memset(frame.ptr(i), i / 4, frame.cols);
+    }
+
+    Worker_Pool pool(3);
+    Frame_Encoder encoder;
+    ASSERT_TRUE(encoder.encode(frame, Frame_Encoder::PNG, 1, pool));
+
+    ASSERT_EQ(encoder.get_stripe_count(), 4);
+    ASSERT_EQ(encoder.get_stripe_rows(), 128) << "Stripes are made of whole 16 rows blocks";
+
+    size_t offset = 0;
+    for (int i = 0; i < encoder.get_stripe_count(); ++i) {
+        const int size = encoder.get_stripe_size(i);
+        const std::vector<uchar> stripe(encoder.get_payload().begin() + offset, encoder.get_payload().begin() + offset + size);
+        const cv::Mat decoded = cv::imdecode(stripe, cv::IMREAD_UNCHANGED);
+        const int first_row = i * encoder.get_stripe_rows();
+        ASSERT_EQ(decoded.rows, std::min(encoder.get_stripe_rows(), frame.rows - first_row));
+        EXPECT_EQ(decoded.ptr(decoded.rows - 1)[639], frame.ptr(first_row + decoded.rows - 1)[639]);
+        offset += size;
+    }
+    EXPECT_EQ(offset, encoder.get_payload().size());
+}
+
+TEST(Frame_EncoderTest, CannotEncodeTest)
+{
+
+    Worker_Pool pool(0);
+    Frame_Encoder encoder;
+
+    cv::Mat frame(64, 64, CV_16UC1);
+    EXPECT_FALSE(encoder.encode(frame, Frame_Encoder::JPEG, 90, pool)) << "JPEG frames have 8 bits";
+    EXPECT_FALSE(encoder.encode(cv::Mat(), Frame_Encoder::PNG, 1, pool));
+    EXPECT_FALSE(Frame_Encoder::is_valid_quality(Frame_Encoder::PNG, 10));
+}
@@ -0,0 +1,133 @@
+#include "gtest/gtest.h"
+
+#include <climits>
+
+#include "rpiasgige/frame_region.hpp"
+
+class Frame_RegionTest : public ::testing::Test
+{
+protected:
+    cv::Mat frame;
+
+    void SetUp() override
+    {
+        this->frame.create(6, 8, CV_8UC3);
+        for (int r = 0; r < this->frame.rows; ++r) {
+            for (int c = 0; c < this->frame.cols; ++c) {
+                for (int k = 0; k < 3; ++k) {
+                    this->frame.ptr(r)[c * 3 + k] = r * 40 + c * 4 + k;
+                }
+            }
+        }
+    }
+};
+
+TEST_F(Frame_RegionTest, WholeRowsAreNotCopiedTest)
+{
+
+    rpiasgige::Frame_Region region;
+    region.roi = cv::Rect(0, 2, 8, 3);
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(region.select(this->frame, buffer, result));
+
+    EXPECT_EQ(result.rows, 3);
+    EXPECT_EQ(result.cols, 8);
+    EXPECT_EQ(result.data, this->frame.ptr(2)) << "A band of whole rows must point into the frame";
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST_F(Frame_RegionTest, RoiIsClippedTest)
+{
+
+    rpiasgige::Frame_Region region;
+    region.roi = cv::Rect(2, 1, 100, 2);
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(region.select(this->frame, buffer, result));
+
+    EXPECT_EQ(result.rows, 2);
+    EXPECT_EQ(result.cols, 6);
+    EXPECT_EQ(result.type(), CV_8UC3);
+    EXPECT_EQ(result.ptr(1)[0], 2 * 40 + 2 * 4);
+
+    region.roi = cv::Rect(10, 10, 2, 2);
+    EXPECT_FALSE(region.select(this->frame, buffer, result)) << "The ROI is outside the frame";
+}
+
+TEST_F(Frame_RegionTest, DecimationAndChannelTest)
+{
+
+    rpiasgige::Frame_Region region;
+    region.decimation = 3;
+    region.channel = 2;
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(region.select(this->frame, buffer, result));
+
+    EXPECT_EQ(result.rows, 2);
+    EXPECT_EQ(result.cols, 3);
+    EXPECT_EQ(result.type(), CV_8UC1);
+    EXPECT_EQ(result.ptr(1)[2], 3 * 40 + 6 * 4 + 2);
+
+    region.channel = 3;
+    EXPECT_FALSE(region.select(this->frame, buffer, result)) << "The frame has 3 channels only";
+
+    region.channel = -1;
+    region.decimation = 100;
+    ASSERT_TRUE(region.select(this->frame, buffer, result));
+    EXPECT_EQ(result.size(), cv::Size(1, 1)) << "Only the top-left pixel is kept";
+
+    region.decimation = INT_MAX;
+    EXPECT_FALSE(region.select(this->frame, buffer, result)) << "The factor is out of range";
+}
+
+TEST_F(Frame_RegionTest, BinningTest)
+{
+
+    rpiasgige::Frame_Region region;
+    region.roi = cv::Rect(1, 1, 5, 5);
+    region.decimation = 2;
+    region.binning = true;
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(region.select(this->frame, buffer, result));
+
+    EXPECT_EQ(result.rows, 2) << "Incomplete blocks must be dropped";
+    EXPECT_EQ(result.cols, 2);
+    EXPECT_EQ(result.type(), CV_8UC3);
+    EXPECT_EQ(result.ptr(0)[0], (44 + 48 + 84 + 88) / 4);
+    EXPECT_EQ(result.ptr(1)[5], (134 + 138 + 174 + 178) / 4);
+}
+
+TEST_F(Frame_RegionTest, YuyvPairsTest)
+{
+
+    cv::Mat yuyv(4, 8, CV_8UC2);
+    for (int r = 0; r < yuyv.rows; ++r) {
+        for (int c = 0; c < yuyv.cols * 2; ++c) {
+            yuyv.ptr(r)[c] = r * 16 + c;
+        }
+    }
+
+    rpiasgige::Frame_Region region;
+    region.roi = cv::Rect(1, 1, 5, 2);
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(region.select(yuyv, buffer, result));
+    EXPECT_EQ(result.cols, 4) << "The column and width must be rounded down to even values";
+    EXPECT_EQ(result.rows, 2);
+    EXPECT_EQ(result.ptr(0)[0], 16) << "The region must start with the Y0 of a pair";
+    EXPECT_EQ(result.ptr(0)[1], 17);
+
+    region.roi = cv::Rect(1, 0, 1, 2);
+    EXPECT_FALSE(region.select(yuyv, buffer, result)) << "No whole pair is left";
+
+    region.roi = cv::Rect();
+    region.decimation = 2;
+    EXPECT_FALSE(region.select(yuyv, buffer, result)) << "Decimation would break the pairs";
+
+    region.decimation = 1;
+    region.channel = 0;
+    EXPECT_FALSE(region.select(yuyv, buffer, result)) << "Channel selection would break the pairs";
+}
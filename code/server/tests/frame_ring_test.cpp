@@ -0,0 +1,113 @@
+#include "gtest/gtest.h"
+
+#include <thread>
+
+#include "rpiasgige/frame_ring.hpp"
+
+using rpiasgige::Captured_Frame;
+using rpiasgige::Frame_Query;
+using rpiasgige::Frame_Ring;
+
+class Frame_RingTest : public ::testing::Test
+{
+protected:
+    Frame_Ring ring;
+    Captured_Frame frame;
+
+    // frame sequence is received at sequence * 1000 microseconds, and its pixels are sequence
+    void push(const int sequence)
+    {
+        this->frame.image.create(2, 4, CV_8UC1);
+        for (int i = 0; i < this->frame.image.rows; ++i) {
+            memset(this->frame.image.ptr(i), sequence, this->frame.image.cols);
+        }
+        this->frame.info.sequence = sequence;
+        this->frame.info.receive_time = sequence * 1000;
+        this->ring.push(this->frame);
+    }
+
+    static Frame_Query query(const int mode, const int64_t value)
+    {
+        Frame_Query result;
+        result.mode = mode;
+        result.value = value;
+        return result;
+    }
+};
+
+TEST_F(Frame_RingTest, FindTest)
+{
+
+    this->ring.set_capacity(4);
+    for (int i = 1; i <= 6; ++i) {
+        this->push(i);
+    }
+
+    Captured_Frame found;
+    EXPECT_FALSE(this->ring.find(query(Frame_Query::BY_SEQUENCE, 2), found)) << "The oldest frames are overwritten";
+    ASSERT_TRUE(this->ring.find(query(Frame_Query::BY_SEQUENCE, 3), found));
+    EXPECT_EQ(found.image.ptr(1)[3], 3);
+
+    ASSERT_TRUE(this->ring.find(query(Frame_Query::NEAREST_TIME, 4400), found));
+    EXPECT_EQ(found.info.sequence, 4);
+    ASSERT_TRUE(this->ring.find(query(Frame_Query::NEAREST_TIME, 100), found));
+    EXPECT_EQ(found.info.sequence, 3);
+
+    ASSERT_TRUE(this->ring.find(query(Frame_Query::FIRST_AFTER_TIME, 4400), found));
+    EXPECT_EQ(found.info.sequence, 5);
+    ASSERT_TRUE(this->ring.find(query(Frame_Query::FIRST_AFTER_TIME, 5000), found));
+    EXPECT_EQ(found.info.sequence, 5);
+    EXPECT_FALSE(this->ring.find(query(Frame_Query::FIRST_AFTER_TIME, 6001), found));
+}
+
+TEST_F(Frame_RingTest, WaitTest)
+{
+
+    this->ring.set_capacity(2);
+    this->push(1);
+
+    EXPECT_TRUE(this->ring.wait(query(Frame_Query::FIRST_AFTER_TIME, 1000), std::chrono::milliseconds(0)));
+    EXPECT_FALSE(this->ring.wait(query(Frame_Query::FIRST_AFTER_TIME, 1001), std::chrono::milliseconds(10)));
+
+    std::thread capture([this]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        this->push(2);
+    });
+    EXPECT_TRUE(this->ring.wait(query(Frame_Query::BY_SEQUENCE, 2), std::chrono::milliseconds(5000)));
+    capture.join();
+
+    Captured_Frame found;
+    ASSERT_TRUE(this->ring.find(query(Frame_Query::FIRST_AFTER_TIME, 1001), found));
+    EXPECT_EQ(found.info.sequence, 2);
+}
+
+TEST_F(Frame_RingTest, ConcurrentFindTest)
+{
+
+    // readers copy the oldest frame, the one overwritten next, without holding the ring lock
+    this->ring.set_capacity(2);
+    this->push(1);
+
+    std::thread capture([this]() {
+        for (int i = 2; i <= 2000; ++i) {
+            this->push(i & 0xff);
+        }
+    });
+
+    Captured_Frame found;
+    int torn_frames = 0;
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_TRUE(this->ring.find(query(Frame_Query::FIRST_AFTER_TIME, 0), found));
+        const unsigned char expected = static_cast<unsigned char>(found.info.sequence);
+        for (int row = 0; row < found.image.rows; ++row) {
+            for (int col = 0; col < found.image.cols; ++col) {
+                if (found.image.ptr(row)[col] != expected) {
+                    torn_frames++;
+                }
+            }
+        }
+    }
+    capture.join();
+
+    EXPECT_EQ(torn_frames, 0) << "Frames overwritten while being copied";
+}
@@ -0,0 +1,137 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/gvcp_responder.hpp"
+
+using rpiasgige::GVCP_Responder;
+using rpiasgige::GVSP_Streamer;
+using rpiasgige::USB_Interface;
+using rpiasgige::get_u16;
+using rpiasgige::get_u32;
+using rpiasgige::put_u16;
+using rpiasgige::put_u32;
+
+class GVCP_ResponderTest : public ::testing::Test
+{
+protected:
+    USB_Interface camera;
+    std::shared_ptr<GVSP_Streamer> streamer = std::make_shared<GVSP_Streamer>(640 * 480 * 3);
+    GVCP_Responder responder{camera, streamer, "/dev/video0"};
+
+    char response[1024];
+
+    struct sockaddr_in application(const unsigned short port)
+    {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        return address;
+    }
+
+    /**
+     * sends a command with data, requiring an acknowledge, and returns the acknowledge size
+     **/
+    int command(const int command, const std::vector<uint32_t> &data, const struct sockaddr_in &sender, const uint16_t request_id = 1)
+    {
+        char request[512];
+        request[0] = 0x42;
+        request[1] = 0x01;
+        put_u16(request + 2, static_cast<uint16_t>(command));
+        put_u16(request + 4, static_cast<uint16_t>(4 * data.size()));
+        put_u16(request + 6, request_id);
+        for (size_t i = 0; i < data.size(); ++i) {
+            put_u32(request + 8 + 4 * i, data[i]);
+        }
+        return this->responder.handle(request, static_cast<int>(8 + 4 * data.size()), sender, this->response);
+    }
+
+    int status() const
+    {
+        return get_u16(this->response);
+    }
+};
+
+TEST_F(GVCP_ResponderTest, DiscoveryTest)
+{
+    const int size = this->command(GVCP_Responder::DISCOVERY_CMD, {}, this->application(5000), 7);
+    ASSERT_EQ(size, 8 + static_cast<int>(GVCP_Responder::DISCOVERY_ACK_SIZE));
+    EXPECT_EQ(this->status(), 0);
+    EXPECT_EQ(get_u16(this->response + 2), static_cast<uint16_t>(GVCP_Responder::DISCOVERY_CMD + 1));
+    EXPECT_EQ(get_u16(this->response + 6), 7);
+    const char *ack = this->response + 8;
+    EXPECT_EQ(get_u16(ack), 1);
+    EXPECT_EQ(get_u16(ack + 2), 2);
+    EXPECT_STREQ(ack + 72, "improvess");
+    EXPECT_STREQ(ack + 104, "rpiasgige");
+    EXPECT_STREQ(ack + 216, "/dev/video0");
+}
+
+TEST_F(GVCP_ResponderTest, RegisterTest)
+{
+    const struct sockaddr_in controller = this->application(5000);
+    const struct sockaddr_in other = this->application(5001);
+
+    ASSERT_EQ(this->command(GVCP_Responder::READREG_CMD, {GVCP_Responder::REGISTER_VERSION, GVCP_Responder::REGISTER_CCP}, other), 16);
+    EXPECT_EQ(get_u32(this->response + 8), 0x00010002u);
+    EXPECT_EQ(get_u32(this->response + 12), 0u);
+
+    // user-defined name, serial number and PACKETRESEND, no event
+    ASSERT_EQ(this->command(GVCP_Responder::READREG_CMD, {GVCP_Responder::REGISTER_GVCP_CAPABILITY}, other), 12);
+    EXPECT_EQ(get_u32(this->response + 8), 0xC0000004u);
+
+    // no privilege yet
+    ASSERT_EQ(this->command(GVCP_Responder::WRITEREG_CMD, {GVCP_Responder::REGISTER_SCDA0, INADDR_LOOPBACK}, controller), 12);
+    EXPECT_EQ(this->status(), static_cast<int>(GVCP_Responder::STATUS_ACCESS_DENIED));
+    EXPECT_EQ(get_u16(this->response + 10), 0) << "No register written";
+
+    ASSERT_EQ(this->command(GVCP_Responder::WRITEREG_CMD, {GVCP_Responder::REGISTER_CCP, 2}, controller), 12);
+    EXPECT_EQ(this->status(), 0);
+    this->command(GVCP_Responder::WRITEREG_CMD, {GVCP_Responder::REGISTER_CCP, 2}, other);
+    EXPECT_EQ(this->status(), static_cast<int>(GVCP_Responder::STATUS_ACCESS_DENIED)) << "Held by another application";
+
+    ASSERT_EQ(this->command(GVCP_Responder::WRITEREG_CMD, {GVCP_Responder::REGISTER_SCDA0, INADDR_LOOPBACK, GVCP_Responder::REGISTER_SCP0, 6000,
+                                                           GVCP_Responder::REGISTER_SCPS0, 8000, GVCP_Responder::REGISTER_ACQUISITION_START, 1}, controller), 12);
+    EXPECT_EQ(this->status(), 0);
+    EXPECT_EQ(get_u16(this->response + 10), 4);
+    EXPECT_EQ(this->streamer->get_destination_address(), static_cast<uint32_t>(INADDR_LOOPBACK));
+    EXPECT_EQ(this->streamer->get_destination_port(), 6000);
+    EXPECT_EQ(this->streamer->get_packet_size(), 8000) << "Jumbo frames";
+    EXPECT_TRUE(this->streamer->is_acquiring());
+
+    this->command(GVCP_Responder::WRITEREG_CMD, {GVCP_Responder::REGISTER_VERSION, 0}, controller);
+    EXPECT_EQ(this->status(), static_cast<int>(GVCP_Responder::STATUS_WRITE_PROTECT));
+    this->command(GVCP_Responder::READREG_CMD, {0x7000}, controller);
+    EXPECT_EQ(this->status(), static_cast<int>(GVCP_Responder::STATUS_INVALID_ADDRESS));
+
+    // releasing the privilege closes the stream channel
+    this->command(GVCP_Responder::WRITEREG_CMD, {GVCP_Responder::REGISTER_CCP, 0}, controller);
+    EXPECT_EQ(this->status(), 0);
+    EXPECT_FALSE(this->streamer->is_acquiring());
+    EXPECT_EQ(this->streamer->get_destination_port(), 0);
+}
+
+TEST_F(GVCP_ResponderTest, MemoryTest)
+{
+    const struct sockaddr_in sender = this->application(5000);
+
+    // address, then reserved and count
+    ASSERT_EQ(this->command(GVCP_Responder::READMEM_CMD, {GVCP_Responder::REGISTER_FIRST_URL, 64}, sender), 8 + 4 + 64);
+    EXPECT_EQ(this->status(), 0);
+    const std::string url(this->response + 12);
+    const std::string prefix = "Local:rpiasgige.xml;100000;";
+    ASSERT_EQ(url.compare(0, prefix.size(), prefix), 0) << url;
+    EXPECT_EQ(std::stoul(url.substr(prefix.size()), nullptr, 16), this->responder.get_xml().size());
+
+    ASSERT_EQ(this->command(GVCP_Responder::READMEM_CMD, {GVCP_Responder::XML_ADDRESS, 16}, sender), 8 + 4 + 16);
+    EXPECT_EQ(std::string(this->response + 12, 16), this->responder.get_xml().substr(0, 16));
+    EXPECT_NE(this->responder.get_xml().find("<IntReg Name=\"Width\">"), std::string::npos);
+
+    this->command(GVCP_Responder::READMEM_CMD, {GVCP_Responder::REGISTER_FIRST_URL + 2, 4}, sender);
+    EXPECT_EQ(this->status(), static_cast<int>(GVCP_Responder::STATUS_BAD_ALIGNMENT));
+    this->command(GVCP_Responder::READMEM_CMD, {GVCP_Responder::REGISTER_FIRST_URL, 1000}, sender);
+    EXPECT_EQ(this->status(), static_cast<int>(GVCP_Responder::STATUS_INVALID_PARAMETER));
+
+    ASSERT_EQ(this->command(0x0086, {0, 0}, sender), 8);
+    EXPECT_EQ(this->status(), static_cast<int>(GVCP_Responder::STATUS_NOT_IMPLEMENTED));
+}
@@ -0,0 +1,113 @@
+#include "gtest/gtest.h"
+
+#include <poll.h>
+
+#include "rpiasgige/gvsp_streamer.hpp"
+
+using rpiasgige::Frame_Info;
+using rpiasgige::GVSP_Streamer;
+using rpiasgige::get_u16;
+using rpiasgige::get_u32;
+
+class GVSP_StreamerTest : public ::testing::Test
+{
+protected:
+    int receiver = -1;
+    unsigned short port = 0;
+
+    virtual void SetUp()
+    {
+        this->receiver = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t address_size = sizeof(address);
+        ASSERT_EQ(bind(this->receiver, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)), 0);
+        ASSERT_EQ(getsockname(this->receiver, reinterpret_cast<struct sockaddr *>(&address), &address_size), 0);
+        this->port = ntohs(address.sin_port);
+    }
+
+    virtual void TearDown()
+    {
+        close(this->receiver);
+    }
+
+    int receive(char *packet, const int size)
+    {
+        struct pollfd descriptor = {this->receiver, POLLIN, 0};
+        if (poll(&descriptor, 1, 1000) <= 0) {
+            return -1;
+        }
+        return static_cast<int>(recv(this->receiver, packet, size, 0));
+    }
+};
+
+TEST_F(GVSP_StreamerTest, BlockTest)
+{
+    GVSP_Streamer streamer(100 * 50);
+    ASSERT_TRUE(streamer.open("127.0.0.1"));
+    EXPECT_FALSE(streamer.set_packet_size(GVSP_Streamer::MAX_PACKET_SIZE + 1));
+    ASSERT_TRUE(streamer.set_packet_size(576));
+
+    cv::Mat frame(50, 100, CV_8UC1);
+    for (int i = 0; i < 50 * 100; ++i) {
+        frame.data[i] = static_cast<unsigned char>(i % 251);
+    }
+    Frame_Info info;
+    info.device_timestamp = 0x123456789LL;
+
+    EXPECT_FALSE(streamer.publish(frame, info)) << "No destination";
+    streamer.set_destination(INADDR_LOOPBACK, this->port);
+    EXPECT_FALSE(streamer.publish(frame, info)) << "Not acquiring";
+    streamer.set_acquiring(true);
+    ASSERT_TRUE(streamer.publish(frame, info));
+
+    // 540 bytes of pixels per packet of 576 bytes
+    const int chunk_size = 576 - GVSP_Streamer::IP_UDP_HEADER_SIZE - GVSP_Streamer::GVSP_HEADER_SIZE;
+    const int payload_packets = (50 * 100 + chunk_size - 1) / chunk_size;
+
+    char packet[1024];
+    ASSERT_EQ(this->receive(packet, sizeof(packet)), static_cast<int>(GVSP_Streamer::LEADER_SIZE));
+    EXPECT_EQ(get_u16(packet), 0);
+    const uint16_t block_id = get_u16(packet + 2);
+    EXPECT_EQ(block_id, 1);
+    EXPECT_EQ(get_u32(packet + 4), (static_cast<uint32_t>(GVSP_Streamer::FORMAT_LEADER) << 24));
+    EXPECT_EQ(get_u16(packet + 10), static_cast<int>(GVSP_Streamer::PAYLOAD_TYPE_IMAGE));
+    EXPECT_EQ(get_u32(packet + 12), 0x1u);
+    EXPECT_EQ(get_u32(packet + 16), 0x23456789u);
+    EXPECT_EQ(get_u32(packet + 20), static_cast<uint32_t>(GVSP_Streamer::PIXEL_FORMAT_MONO8));
+    EXPECT_EQ(get_u32(packet + 24), 100u);
+    EXPECT_EQ(get_u32(packet + 28), 50u);
+
+    std::vector<unsigned char> pixels(50 * 100, 0);
+    for (int i = 1; i <= payload_packets; ++i) {
+        const int size = this->receive(packet, sizeof(packet));
+        ASSERT_GT(size, static_cast<int>(GVSP_Streamer::GVSP_HEADER_SIZE));
+        EXPECT_EQ(get_u16(packet + 2), block_id);
+        EXPECT_EQ(get_u32(packet + 4), (static_cast<uint32_t>(GVSP_Streamer::FORMAT_PAYLOAD) << 24) | i);
+        memcpy(pixels.data() + (i - 1) * chunk_size, packet + GVSP_Streamer::GVSP_HEADER_SIZE, size - GVSP_Streamer::GVSP_HEADER_SIZE);
+    }
+    EXPECT_EQ(memcmp(pixels.data(), frame.data, pixels.size()), 0);
+
+    ASSERT_EQ(this->receive(packet, sizeof(packet)), static_cast<int>(GVSP_Streamer::TRAILER_SIZE));
+    EXPECT_EQ(get_u32(packet + 4), (static_cast<uint32_t>(GVSP_Streamer::FORMAT_TRAILER) << 24) | (payload_packets + 1));
+    EXPECT_EQ(get_u32(packet + 12), 50u);
+
+    // packets lost by the receiver
+    ASSERT_TRUE(streamer.resend(block_id, 3, 4));
+    for (int i = 3; i <= 4; ++i) {
+        ASSERT_GT(this->receive(packet, sizeof(packet)), static_cast<int>(GVSP_Streamer::GVSP_HEADER_SIZE));
+        EXPECT_EQ(get_u32(packet + 4) & 0xffffff, static_cast<uint32_t>(i));
+        EXPECT_EQ(static_cast<unsigned char>(packet[GVSP_Streamer::GVSP_HEADER_SIZE]), (i - 1) * chunk_size % 251);
+    }
+
+    EXPECT_FALSE(streamer.resend(block_id + 1, 1, 1)) << "Never sent";
+    ASSERT_EQ(this->receive(packet, sizeof(packet)), static_cast<int>(GVSP_Streamer::GVSP_HEADER_SIZE));
+    EXPECT_EQ(get_u16(packet), static_cast<int>(GVSP_Streamer::STATUS_PACKET_REMOVED_FROM_MEMORY));
+
+    // the sender thread counts the block once the trailer is sent
+    streamer.close();
+    EXPECT_EQ(streamer.get_block_count(), 1);
+    EXPECT_EQ(streamer.get_payload_size(), 50 * 100);
+}
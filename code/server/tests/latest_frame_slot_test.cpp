@@ -0,0 +1,72 @@
+#include "gtest/gtest.h"
+
+#include <thread>
+
+#include "rpiasgige/latest_frame_slot.hpp"
+
+class Latest_Frame_SlotTest : public ::testing::Test
+{
+};
+
+TEST_F(Latest_Frame_SlotTest, EmptySlotTest)
+{
+
+    rpiasgige::Latest_Frame_Slot<int> slot;
+
+    EXPECT_FALSE(slot.fetch());
+
+    EXPECT_FALSE(slot.has_value());
+}
+
+TEST_F(Latest_Frame_SlotTest, ReaderSeesLatestValueTest)
+{
+
+    rpiasgige::Latest_Frame_Slot<int> slot;
+
+    for (int i = 1; i <= 5; ++i) {
+        slot.back() = i;
+        slot.publish();
+    }
+
+    ASSERT_TRUE(slot.fetch());
+
+    EXPECT_EQ(slot.front(), 5) << "Reader must see the last published value";
+
+    EXPECT_FALSE(slot.fetch()) << "No value was published since the last fetch";
+
+    EXPECT_EQ(slot.front(), 5) << "front() must be stable between fetches";
+
+    slot.back() = 6;
+    slot.publish();
+
+    ASSERT_TRUE(slot.fetch());
+
+    EXPECT_EQ(slot.front(), 6);
+}
+
+TEST_F(Latest_Frame_SlotTest, ConcurrentWriterTest)
+{
+
+    rpiasgige::Latest_Frame_Slot<int> slot;
+
+    const int LAST_VALUE = 100000;
+
+    std::thread writer([&slot, LAST_VALUE]() {
+        for (int i = 1; i <= LAST_VALUE; ++i) {
+            slot.back() = i;
+            slot.publish();
+        }
+    });
+
+    int last_seen = 0;
+    while (last_seen < LAST_VALUE) {
+        if (slot.fetch()) {
+            ASSERT_GT(slot.front(), last_seen) << "Values must never go backwards";
+            last_seen = slot.front();
+        }
+    }
+
+    writer.join();
+
+    EXPECT_EQ(last_seen, LAST_VALUE);
+}
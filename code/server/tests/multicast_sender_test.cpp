@@ -0,0 +1,141 @@
+#include "gtest/gtest.h"
+
+#include <poll.h>
+
+#include "rpiasgige/multicast_sender.hpp"
+
+using rpiasgige::DATA_SIZE_ADDRESS;
+using rpiasgige::HEADER_SIZE;
+using rpiasgige::Multicast_Fragment_Header;
+using rpiasgige::Multicast_Sender;
+
+static const int TEST_PAYLOAD_SIZE = 10000;
+
+/**
+ * Pushes a fixed message: a header and TEST_PAYLOAD_SIZE bytes of payload numbered by their position
+ **/
+class Multicast_Test_Server : public rpiasgige::Websocket_Server
+{
+
+public:
+    Multicast_Test_Server() : rpiasgige::Websocket_Server("Multicast_Test_Server", HEADER_SIZE + TEST_PAYLOAD_SIZE)
+    {
+        for (int i = 0; i < TEST_PAYLOAD_SIZE; ++i) {
+            this->payload[i] = static_cast<char>(i % 251);
+        }
+    }
+
+    void notify_subscribers_wrapper()
+    {
+        this->notify_subscribers();
+    }
+
+protected:
+    virtual void prepare_response(const char *request_buffer, const int request_size, char *response_buffer, int &response_size, rpiasgige::Session &session)
+    {
+        (void)request_buffer;
+        (void)request_size;
+        (void)response_buffer;
+        (void)session;
+        response_size = HEADER_SIZE;
+    }
+
+    virtual bool prepare_push(char *response_buffer, int &response_size, rpiasgige::Session &session)
+    {
+        this->set_status(response_buffer, "FRAM");
+        this->set_response_data_size(response_buffer, TEST_PAYLOAD_SIZE);
+        return session.connection->streaming && this->set_response_payload(session, response_size, this->payload, TEST_PAYLOAD_SIZE);
+    }
+
+private:
+    char payload[TEST_PAYLOAD_SIZE];
+};
+
+class Multicast_SenderTest : public ::testing::Test
+{
+protected:
+    int receiver = -1;
+    unsigned short port = 0;
+
+    // the loopback interface delivers unicast datagrams regardless of the multicast routes of the host
+    virtual void SetUp()
+    {
+        this->receiver = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t address_size = sizeof(address);
+        ASSERT_EQ(bind(this->receiver, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)), 0);
+        ASSERT_EQ(getsockname(this->receiver, reinterpret_cast<struct sockaddr *>(&address), &address_size), 0);
+        this->port = ntohs(address.sin_port);
+    }
+
+    virtual void TearDown()
+    {
+        close(this->receiver);
+    }
+
+    int receive(char *datagram, const int size)
+    {
+        struct pollfd descriptor = {this->receiver, POLLIN, 0};
+        if (poll(&descriptor, 1, 1000) <= 0) {
+            return -1;
+        }
+        return static_cast<int>(recv(this->receiver, datagram, size, 0));
+    }
+};
+
+TEST_F(Multicast_SenderTest, FragmentTest)
+{
+    Multicast_Test_Server server;
+    ASSERT_TRUE(server.init());
+
+    Multicast_Sender sender(server);
+    EXPECT_FALSE(sender.set_datagram_size(sizeof(Multicast_Fragment_Header))) << "No room for data";
+    ASSERT_TRUE(sender.set_datagram_size(1024));
+    EXPECT_FALSE(sender.start()) << "Not open";
+    ASSERT_TRUE(sender.open("127.0.0.1", this->port, "", 1));
+    ASSERT_TRUE(sender.start());
+
+    const int message_size = HEADER_SIZE + TEST_PAYLOAD_SIZE;
+    const int chunk_size = 1024 - static_cast<int>(sizeof(Multicast_Fragment_Header));
+    const int fragment_count = (message_size + chunk_size - 1) / chunk_size;
+
+    for (int frame = 0; frame < 2; ++frame) {
+        server.notify_subscribers_wrapper();
+
+        std::vector<char> message(message_size, 0);
+        char datagram[2048];
+        for (int i = 0; i < fragment_count; ++i) {
+            const int size = this->receive(datagram, sizeof(datagram));
+            ASSERT_GT(size, static_cast<int>(sizeof(Multicast_Fragment_Header)));
+            Multicast_Fragment_Header header;
+            memcpy(&header, datagram, sizeof(header));
+            EXPECT_EQ(strncmp(header.status, "FRAG", 4), 0);
+            EXPECT_EQ(header.frame_id, frame);
+            EXPECT_EQ(header.fragment_index, i);
+            EXPECT_EQ(header.fragment_count, fragment_count);
+            EXPECT_EQ(header.message_size, message_size);
+            EXPECT_EQ(header.offset, i * chunk_size);
+            const int data_size = size - static_cast<int>(sizeof(header));
+            EXPECT_EQ(data_size, std::min(chunk_size, message_size - header.offset));
+            memcpy(message.data() + header.offset, datagram + sizeof(header), data_size);
+        }
+
+        // the message is the one pushed to a streaming client
+        EXPECT_EQ(strncmp(message.data(), "FRAM", 4), 0);
+        int data_size;
+        memcpy(&data_size, message.data() + DATA_SIZE_ADDRESS, sizeof(data_size));
+        EXPECT_EQ(data_size, TEST_PAYLOAD_SIZE);
+        for (int i = 0; i < TEST_PAYLOAD_SIZE; ++i) {
+            ASSERT_EQ(message[HEADER_SIZE + i], static_cast<char>(i % 251)) << "at " << i;
+        }
+    }
+    EXPECT_EQ(sender.get_frame_count(), 2);
+
+    sender.stop();
+    server.notify_subscribers_wrapper();
+    char datagram[2048];
+    EXPECT_LT(this->receive(datagram, sizeof(datagram)), 0) << "Unsubscribed";
+}
@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/pixel_format.hpp"
+
+using rpiasgige::Pixel_Format_Converter;
+
+class Pixel_Format_ConverterTest : public ::testing::Test
+{
+protected:
+    cv::Mat frame;
+
+    // wide enough to run both the vectorized and the scalar tail of the row kernels
+    void fill(const int rows, const int cols, const uint8_t b, const uint8_t g, const uint8_t r)
+    {
+        this->frame.create(rows, cols, CV_8UC3);
+        for (int i = 0; i < rows; ++i) {
+            uint8_t *px = this->frame.ptr(i);
+            for (int j = 0; j < cols; ++j) {
+                px[3 * j] = b;
+                px[3 * j + 1] = g;
+                px[3 * j + 2] = r;
+            }
+        }
+    }
+};
+
+TEST_F(Pixel_Format_ConverterTest, NativeIsNotCopiedTest)
+{
+
+    this->fill(4, 20, 1, 2, 3);
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(Pixel_Format_Converter::convert(this->frame, Pixel_Format_Converter::NATIVE, buffer, result));
+    EXPECT_EQ(result.data, this->frame.data);
+
+    ASSERT_TRUE(Pixel_Format_Converter::convert(this->frame, Pixel_Format_Converter::BGR, buffer, result));
+    EXPECT_EQ(result.data, this->frame.data) << "The frame is BGR already";
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST_F(Pixel_Format_ConverterTest, Gray8Test)
+{
+
+    this->fill(2, 21, 0, 0, 255);
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(Pixel_Format_Converter::convert(this->frame, Pixel_Format_Converter::GRAY8, buffer, result));
+
+    ASSERT_EQ(result.type(), CV_8UC1);
+    ASSERT_EQ(result.cols, 21);
+    for (int j = 0; j < result.cols; ++j) {
+        EXPECT_EQ(result.ptr(1)[j], 77) << "Full range gray of pure red, as cv::COLOR_BGR2GRAY";
+    }
+}
+
+TEST_F(Pixel_Format_ConverterTest, YuyvTest)
+{
+
+    this->fill(2, 34, 0, 0, 255);
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(Pixel_Format_Converter::convert(this->frame, Pixel_Format_Converter::YUYV, buffer, result));
+
+    ASSERT_EQ(result.type(), CV_8UC2);
+    ASSERT_EQ(result.cols, 34);
+    const uint8_t *yuyv = result.ptr(1);
+    for (int j = 0; j < result.cols; j += 2) {
+        // BT.601 limited range red
+        EXPECT_EQ(yuyv[2 * j], 82);
+        EXPECT_EQ(yuyv[2 * j + 1], 90);
+        EXPECT_EQ(yuyv[2 * j + 2], 82);
+        EXPECT_EQ(yuyv[2 * j + 3], 240);
+    }
+
+    cv::Mat gray_buffer, gray;
+    ASSERT_TRUE(Pixel_Format_Converter::convert(result, Pixel_Format_Converter::GRAY8, gray_buffer, gray));
+    EXPECT_EQ(gray.ptr(0)[33], 82) << "The gray of a YUYV frame is its Y";
+
+    this->fill(2, 33, 0, 0, 255);
+    EXPECT_FALSE(Pixel_Format_Converter::convert(this->frame, Pixel_Format_Converter::YUYV, buffer, result)) << "The width must be even";
+}
+
+TEST_F(Pixel_Format_ConverterTest, Nv12Test)
+{
+
+    this->fill(4, 18, 255, 255, 255);
+
+    cv::Mat buffer, result;
+    ASSERT_TRUE(Pixel_Format_Converter::convert(this->frame, Pixel_Format_Converter::NV12, buffer, result));
+
+    ASSERT_EQ(result.type(), CV_8UC1);
+    ASSERT_EQ(result.rows, 6) << "The Y plane is followed by half as many UV rows";
+    ASSERT_EQ(result.cols, 18);
+    EXPECT_EQ(result.ptr(3)[17], 235);
+    EXPECT_EQ(result.ptr(4)[0], 128);
+    EXPECT_EQ(result.ptr(5)[17], 128);
+
+    this->fill(3, 18, 255, 255, 255);
+    EXPECT_FALSE(Pixel_Format_Converter::convert(this->frame, Pixel_Format_Converter::NV12, buffer, result)) << "The height must be even";
+}
+
+TEST_F(Pixel_Format_ConverterTest, OddWidthYuyvTest)
+{
+
+    // e.g. a YUYV frame cropped by a region of interest of odd width
+    cv::Mat yuyv(2, 33, CV_8UC2, cv::Scalar(82, 128));
+
+    cv::Mat buffer, result;
+    EXPECT_FALSE(Pixel_Format_Converter::convert(yuyv, Pixel_Format_Converter::BGR, buffer, result)) << "The width must be even";
+    EXPECT_FALSE(Pixel_Format_Converter::convert(yuyv, Pixel_Format_Converter::GRAY8, buffer, result)) << "The width must be even";
+    EXPECT_FALSE(Pixel_Format_Converter::convert(yuyv, Pixel_Format_Converter::NV12, buffer, result)) << "The width must be even";
+}
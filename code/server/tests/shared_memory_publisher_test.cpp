@@ -0,0 +1,73 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/shared_memory_publisher.hpp"
+
+using rpiasgige::Frame_Info;
+using rpiasgige::Shared_Memory_Header;
+using rpiasgige::Shared_Memory_Publisher;
+using rpiasgige::Shared_Slot_Header;
+
+class Shared_Memory_PublisherTest : public ::testing::Test
+{
+protected:
+    const std::string name = "/rpiasgige_test_" + std::to_string(getpid());
+
+    // maps the segment as a client does
+    const char *attach(size_t &size)
+    {
+        const int fd = shm_open(this->name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat status;
+        fstat(fd, &status);
+        size = status.st_size;
+        void *address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        return address == MAP_FAILED ? nullptr : static_cast<const char *>(address);
+    }
+};
+
+TEST_F(Shared_Memory_PublisherTest, PublishTest)
+{
+
+    Shared_Memory_Publisher publisher(this->name, 64 * 48 * 3, 2);
+    ASSERT_TRUE(publisher.open());
+
+    size_t size;
+    const char *memory = this->attach(size);
+    ASSERT_NE(memory, nullptr);
+    const Shared_Memory_Header *header = reinterpret_cast<const Shared_Memory_Header *>(memory);
+    EXPECT_EQ(header->magic, static_cast<uint32_t>(Shared_Memory_Header::MAGIC));
+    EXPECT_EQ(header->slot_count, 2u);
+    EXPECT_EQ(header->slot_size, 64u * 48 * 3);
+    EXPECT_EQ(size, sizeof(Shared_Memory_Header) + 2 * (sizeof(Shared_Slot_Header) + header->slot_size));
+
+    cv::Mat frame(48, 64, CV_8UC3);
+    Frame_Info info;
+    for (int i = 1; i <= 3; ++i) {
+        memset(frame.data, i, frame.total() * frame.elemSize());
+        info.sequence = i;
+        ASSERT_TRUE(publisher.publish(frame, info));
+    }
+    EXPECT_EQ(header->published.load(), 3u);
+
+    // the third frame went to the first slot again
+    const Shared_Slot_Header *slot = reinterpret_cast<const Shared_Slot_Header *>(memory + sizeof(Shared_Memory_Header));
+    EXPECT_EQ(slot->version.load(), 4u) << "Written twice";
+    EXPECT_EQ(slot->rows, 48);
+    EXPECT_EQ(slot->cols, 64);
+    EXPECT_EQ(slot->type, CV_8UC3);
+    EXPECT_EQ(slot->info.sequence, 3);
+    const char *data = reinterpret_cast<const char *>(slot) + sizeof(Shared_Slot_Header);
+    EXPECT_EQ(data[0], 3);
+    EXPECT_EQ(data[slot->data_size - 1], 3);
+
+    cv::Mat large(49, 64, CV_8UC3);
+    EXPECT_FALSE(publisher.publish(large, info)) << "Larger than the slots";
+
+    publisher.close();
+    EXPECT_EQ(header->closed.load(), 1u);
+    EXPECT_LT(shm_open(this->name.c_str(), O_RDONLY, 0), 0) << "The name is removed";
+    munmap(const_cast<char *>(memory), size);
+}
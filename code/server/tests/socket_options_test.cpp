@@ -0,0 +1,61 @@
+#include "gtest/gtest.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "rpiasgige/socket_options.hpp"
+
+using tcp = boost::asio::ip::tcp;
+
+class Socket_OptionsTest : public ::testing::Test
+{
+protected:
+    boost::asio::io_context ioc;
+    tcp::acceptor acceptor{ioc, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0)};
+    tcp::socket client{ioc};
+    tcp::socket server{ioc};
+
+    void SetUp() override
+    {
+        this->client.connect(this->acceptor.local_endpoint());
+        this->acceptor.accept(this->server);
+    }
+};
+
+TEST_F(Socket_OptionsTest, NoDelayByDefaultTest)
+{
+
+    rpiasgige::Socket_Options options;
+
+    std::string error;
+    ASSERT_TRUE(options.apply(this->server, error)) << error;
+
+    tcp::no_delay no_delay;
+    this->server.get_option(no_delay);
+    EXPECT_TRUE(no_delay.value()) << "Small replies must not wait for Nagle's algorithm";
+}
+
+TEST_F(Socket_OptionsTest, BufferSizesTest)
+{
+
+    rpiasgige::Socket_Options options;
+    options.no_delay = false;
+    options.send_buffer_size = 256 * 1024;
+    options.receive_buffer_size = 256 * 1024;
+
+    std::string error;
+    ASSERT_TRUE(options.apply(this->server, error)) << error;
+
+    tcp::no_delay no_delay;
+    this->server.get_option(no_delay);
+    EXPECT_FALSE(no_delay.value());
+
+    // Linux doubles the requested sizes, within the system limits
+    boost::asio::socket_base::send_buffer_size send_buffer_size;
+    this->server.get_option(send_buffer_size);
+    EXPECT_GT(send_buffer_size.value(), 64 * 1024);
+
+    boost::asio::socket_base::receive_buffer_size receive_buffer_size;
+    this->server.get_option(receive_buffer_size);
+    EXPECT_GT(receive_buffer_size.value(), 64 * 1024);
+}
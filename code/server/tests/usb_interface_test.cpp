@@ -69,4 +69,94 @@ TEST_F(USB_InterfaceTest, GetSetTest)
     EXPECT_TRUE(device.set(cv::CAP_PROP_POS_FRAMES, 2));
 
     ASSERT_TRUE(device.release());
-}
\ No newline at end of file
+}
+
+/**
+ * Counts the frames published by the continuous capture
+ **/
+class Counting_Frame_Sink : public rpiasgige::Frame_Sink
+{
+public:
+    std::atomic<int> frame_count{0};
+    std::atomic<int> width{0};
+
+    virtual bool publish(const cv::Mat &image, const rpiasgige::Frame_Info &)
+    {
+        this->width = image.cols;
+        this->frame_count++;
+        return true;
+    }
+};
+
+TEST_F(USB_InterfaceTest, FrameSinkTest)
+{
+
+    rpiasgige::USB_Interface device;
+
+    device.set_camera_path(USB_InterfaceTest::device_path);
+
+    auto sink = std::make_shared<Counting_Frame_Sink>();
+    device.add_frame_sink(sink);
+
+    ASSERT_TRUE(device.open_camera());
+
+    ASSERT_TRUE(device.start_continuous_capture());
+
+    for (int i = 0; i < 100 && sink->frame_count == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    device.stop_continuous_capture();
+
+    EXPECT_GT(sink->frame_count, 0) << "No frame published";
+
+    EXPECT_EQ(sink->width, 1280) << "Wrong size width";
+
+    const int frame_count = sink->frame_count;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(sink->frame_count, frame_count) << "Published after the capture stopped";
+
+    ASSERT_TRUE(device.release());
+}
+
+TEST_F(USB_InterfaceTest, FrameListenerTest)
+{
+
+    rpiasgige::USB_Interface device;
+
+    device.set_camera_path(USB_InterfaceTest::device_path);
+
+    std::atomic<int> call_count{0};
+    std::atomic<bool> running{false};
+    device.set_frame_listener([&call_count, &running]() {
+        running = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        call_count++;
+        running = false;
+    });
+
+    ASSERT_TRUE(device.open_camera());
+
+    ASSERT_TRUE(device.start_continuous_capture());
+
+    for (int i = 0; i < 100 && call_count == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    // the owner of a listener, such as a Server, may be destroyed once it is replaced
+    device.set_frame_listener(nullptr);
+
+    EXPECT_FALSE(running) << "Still running once replaced";
+
+    const int call_count_when_replaced = call_count;
+
+    EXPECT_GT(call_count_when_replaced, 0) << "Never called";
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(call_count, call_count_when_replaced) << "Called once replaced";
+
+    device.stop_continuous_capture();
+
+    ASSERT_TRUE(device.release());
+}
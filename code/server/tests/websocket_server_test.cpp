@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+
+#include "rpiasgige/generic_server.hpp"
+
+class Websocket_ServerTest : public ::testing::Test
+{
+};
+
+/**
+ * This class aims to expose the protected methods in order we can test them.
+ **/
+class Websocket_Server_Wrapper : public rpiasgige::Websocket_Server
+{
+
+public:
+    Websocket_Server_Wrapper() : 
+        rpiasgige::Websocket_Server("Websocket_Server_Wrapper", rpiasgige::RESPONSE_BUFFER_SIZE) {}
+    virtual ~Websocket_Server_Wrapper() {};
+
+    bool set_buffer_value_wrapper(char *buffer, int from, int size, const void *data)
+    {
+        return this->set_buffer_value(buffer, from, size, data);
+    }
+
+    void set_status_wrapper(char *buffer, const char *status)
+    {
+        this->set_status(buffer, status);
+    }
+
+    void set_response_data_size_wrapper(char *buffer, int size)
+    {
+        this->set_response_data_size(buffer, size);
+    }
+
+protected:
+    void prepare_response(const char *request_buffer, const int request_size, char *response_buffer, int &response_size, rpiasgige::Session &session)
+    {
+        (void)request_buffer;
+        (void)request_size;
+        (void)response_buffer;
+        (void)response_size;
+        (void)session;
+    }
+};
+
+TEST_F(Websocket_ServerTest, set_buffer_value_Test)
+{
+
+    const int data_size = rpiasgige::RESPONSE_BUFFER_SIZE - rpiasgige::HEADER_SIZE;
+    char data[rpiasgige::RESPONSE_BUFFER_SIZE];
+    for(int i = 0; i < data_size; ++i) {
+        data[i] = (i % 100) + 1;
+    }
+
+    Websocket_Server_Wrapper server;
+    char response_buffer[rpiasgige::RESPONSE_BUFFER_SIZE] = {0};
+
+    ASSERT_TRUE(server.set_buffer_value_wrapper(response_buffer, rpiasgige::HEADER_SIZE, data_size, data));
+
+    const char *data_ro = response_buffer + rpiasgige::HEADER_SIZE;
+    for(int i = 0; i < data_size; ++i) {
+        char expected = (i % 100) + 1;
+        EXPECT_EQ(data_ro[i], expected) << "at index " << i;
+    }
+
+    EXPECT_FALSE(server.set_buffer_value_wrapper(response_buffer, rpiasgige::HEADER_SIZE, data_size + 1, data)) << "The response buffer would overflow";
+    EXPECT_FALSE(server.set_buffer_value_wrapper(response_buffer, -1, 1, data));
+}
+
+TEST_F(Websocket_ServerTest, set_status_Test)
+{
+
+    Websocket_Server_Wrapper server;
+    char response_buffer[rpiasgige::RESPONSE_BUFFER_SIZE] = {0};
+
+    server.set_status_wrapper(response_buffer, "NOPE");
+
+    EXPECT_EQ(strncmp(response_buffer + rpiasgige::STATUS_ADDRESS, "NOPE", rpiasgige::STATUS_SIZE), 0);
+    EXPECT_EQ(response_buffer[rpiasgige::STATUS_ADDRESS + rpiasgige::STATUS_SIZE], 0) << "Only the status is written";
+}
+
+TEST_F(Websocket_ServerTest, set_response_data_size_Test)
+{
+
+    const int data_size = 3 * 1280 * 1024;
+
+    Websocket_Server_Wrapper server;
+    char response_buffer[rpiasgige::RESPONSE_BUFFER_SIZE] = {0};
+
+    server.set_response_data_size_wrapper(response_buffer, data_size);
+
+    int data_size_copy;
+    memcpy(&data_size_copy, response_buffer + rpiasgige::DATA_SIZE_ADDRESS, sizeof(int));
+
+    EXPECT_EQ(data_size, data_size_copy);
+}